@@ -0,0 +1,362 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BlobLabeling.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Image/Manipulation.h>
+#include <asp/Core/BlobLabeling.h>
+
+#include <algorithm>
+#include <set>
+
+using namespace vw;
+
+namespace asp {
+
+int label_tile_components(ImageView<uint8> const& mask, ImageView<int32> & labels) {
+
+  labels.set_size(mask.cols(), mask.rows());
+  fill(labels, -1);
+
+  static const int dx[] = {1, -1, 0, 0}, dy[] = {0, 0, 1, -1};
+
+  int num_labels = 0;
+  std::vector<Vector2i> stack;
+  for (int row = 0; row < mask.rows(); row++) {
+    for (int col = 0; col < mask.cols(); col++) {
+
+      if (labels(col, row) >= 0)
+        continue;
+
+      // Flood fill the component this pixel belongs to
+      bool is_set = (mask(col, row) != 0);
+      labels(col, row) = num_labels;
+      stack.push_back(Vector2i(col, row));
+      while (!stack.empty()) {
+        Vector2i p = stack.back();
+        stack.pop_back();
+        for (int k = 0; k < 4; k++) {
+          int x = p.x() + dx[k], y = p.y() + dy[k];
+          if (x < 0 || y < 0 || x >= mask.cols() || y >= mask.rows())
+            continue;
+          if (labels(x, y) >= 0 || (mask(x, y) != 0) != is_set)
+            continue;
+          labels(x, y) = num_labels;
+          stack.push_back(Vector2i(x, y));
+        }
+      }
+
+      num_labels++;
+    }
+  }
+
+  return num_labels;
+}
+
+int32 TiledBlobIndex::find(std::vector<int32> & parent, int32 id) const {
+  int32 root = id;
+  while (parent[root] != root)
+    root = parent[root];
+  // Path compression
+  while (parent[id] != root) {
+    int32 next = parent[id];
+    parent[id] = root;
+    id = next;
+  }
+  return root;
+}
+
+// The smaller id becomes the root, so the result does not depend on
+// the order in which tiles were added or merged.
+void TiledBlobIndex::join(std::vector<int32> & parent, int32 a, int32 b) const {
+  a = find(parent, a);
+  b = find(parent, b);
+  if (a < b)
+    parent[b] = a;
+  else if (b < a)
+    parent[a] = b;
+}
+
+void TiledBlobIndex::add_tile(BBox2i const& bbox, ImageView<uint8> const& mask) {
+
+  VW_ASSERT(mask.cols() == bbox.width() && mask.rows() == bbox.height(),
+            ArgumentErr() << "TiledBlobIndex: tile and mask sizes differ.\n");
+
+  // Do the expensive work outside of the lock
+  ImageView<int32> labels;
+  int num_labels = label_tile_components(mask, labels);
+
+  std::vector<int64>    area(num_labels, 0);
+  std::vector<BBox2i>   box (num_labels);
+  std::vector<Vector2i> seed(num_labels);
+  std::vector<uint8>    is_set(num_labels, 0);
+  std::set<std::pair<int32, int32> > adjacent;
+  for (int row = 0; row < labels.rows(); row++) {
+    for (int col = 0; col < labels.cols(); col++) {
+      int32 l = labels(col, row);
+      Vector2i pix = bbox.min() + Vector2i(col, row);
+      if (area[l] == 0) {
+        seed[l]   = pix;
+        is_set[l] = (mask(col, row) != 0);
+      }
+      area[l]++;
+      box[l].grow(pix);
+
+      // Record the neighbors of opposite kind, valid one first
+      if (col + 1 < labels.cols() && labels(col + 1, row) != l) {
+        int32 n = labels(col + 1, row);
+        adjacent.insert(is_set[l] ? std::make_pair(l, n) : std::make_pair(n, l));
+      }
+      if (row + 1 < labels.rows() && labels(col, row + 1) != l) {
+        int32 n = labels(col, row + 1);
+        adjacent.insert(mask(col, row) != 0 ? std::make_pair(l, n) : std::make_pair(n, l));
+      }
+    }
+  }
+
+  Mutex::Lock lock(m_mutex);
+
+  VW_ASSERT(!m_finalized, LogicErr() << "TiledBlobIndex: cannot add tiles after finalize().\n");
+
+  std::pair<int, int> corner(bbox.min().x(), bbox.min().y());
+  if (m_tile_lookup.find(corner) != m_tile_lookup.end())
+    return; // This tile was seen already
+
+  int32 first_id = m_parent.size();
+  for (int l = 0; l < num_labels; l++) {
+    m_parent.push_back(first_id + l);
+    m_area.push_back(area[l]);
+    m_bbox.push_back(box[l]);
+    m_seed.push_back(seed[l]);
+    m_is_set.push_back(is_set[l]);
+  }
+  for (std::set<std::pair<int32, int32> >::const_iterator it = adjacent.begin();
+       it != adjacent.end(); it++)
+    m_adjacent.push_back(std::make_pair(first_id + it->first, first_id + it->second));
+
+  TileLabels tile;
+  tile.bbox     = bbox;
+  tile.first_id = first_id;
+  int last_col = labels.cols() - 1, last_row = labels.rows() - 1;
+  for (int col = 0; col < labels.cols(); col++) {
+    tile.top.push_back   (first_id + labels(col, 0));
+    tile.bottom.push_back(first_id + labels(col, last_row));
+  }
+  for (int row = 0; row < labels.rows(); row++) {
+    tile.left.push_back (first_id + labels(0, row));
+    tile.right.push_back(first_id + labels(last_col, row));
+  }
+
+  m_tile_lookup[corner] = m_tiles.size();
+  m_tiles.push_back(tile);
+}
+
+void TiledBlobIndex::finalize(int64 max_hole_area, int64 max_blob_area) {
+
+  Mutex::Lock lock(m_mutex);
+  VW_ASSERT(!m_finalized, LogicErr() << "TiledBlobIndex: finalize() called twice.\n");
+
+  // Index the tiles by their left and top edges to find the neighbors
+  std::map<int, std::vector<int> > by_left, by_top;
+  for (size_t t = 0; t < m_tiles.size(); t++) {
+    by_left[m_tiles[t].bbox.min().x()].push_back(t);
+    by_top [m_tiles[t].bbox.min().y()].push_back(t);
+  }
+
+  // The grid the tiles are on, so classify() can find them by position
+  m_col_starts.clear();
+  m_row_starts.clear();
+  for (std::map<int, std::vector<int> >::const_iterator it = by_left.begin();
+       it != by_left.end(); it++)
+    m_col_starts.push_back(it->first);
+  for (std::map<int, std::vector<int> >::const_iterator it = by_top.begin();
+       it != by_top.end(); it++)
+    m_row_starts.push_back(it->first);
+
+  // Merge across the seams. Pixels of the same kind are joined, and
+  // those of opposite kind are recorded as adjacent.
+  for (size_t t = 0; t < m_tiles.size(); t++) {
+    TileLabels const& tile = m_tiles[t];
+
+    std::vector<int> const& right_nbrs = by_left[tile.bbox.max().x()];
+    for (size_t k = 0; k < right_nbrs.size(); k++) {
+      TileLabels const& nbr = m_tiles[right_nbrs[k]];
+      int beg = std::max(tile.bbox.min().y(), nbr.bbox.min().y());
+      int end = std::min(tile.bbox.max().y(), nbr.bbox.max().y());
+      for (int row = beg; row < end; row++) {
+        int32 a = tile.right[row - tile.bbox.min().y()];
+        int32 b = nbr.left  [row - nbr.bbox.min().y()];
+        if (m_is_set[a] == m_is_set[b])
+          join(m_parent, a, b);
+        else
+          m_adjacent.push_back(m_is_set[a] ? std::make_pair(a, b) : std::make_pair(b, a));
+      }
+    }
+
+    std::vector<int> const& bottom_nbrs = by_top[tile.bbox.max().y()];
+    for (size_t k = 0; k < bottom_nbrs.size(); k++) {
+      TileLabels const& nbr = m_tiles[bottom_nbrs[k]];
+      int beg = std::max(tile.bbox.min().x(), nbr.bbox.min().x());
+      int end = std::min(tile.bbox.max().x(), nbr.bbox.max().x());
+      for (int col = beg; col < end; col++) {
+        int32 a = tile.bottom[col - tile.bbox.min().x()];
+        int32 b = nbr.top    [col - nbr.bbox.min().x()];
+        if (m_is_set[a] == m_is_set[b])
+          join(m_parent, a, b);
+        else
+          m_adjacent.push_back(m_is_set[a] ? std::make_pair(a, b) : std::make_pair(b, a));
+      }
+    }
+  }
+
+  // Accumulate the statistics in the roots. The seed of the root is
+  // kept, any pixel of the component will do for it.
+  int32 num_ids = m_parent.size();
+  for (int32 id = 0; id < num_ids; id++) {
+    int32 root = find(m_parent, id);
+    if (root == id)
+      continue;
+    m_area[root] += m_area[id];
+    m_bbox[root].grow(m_bbox[id]);
+  }
+
+  // Small holes are merged with the blobs around them, so that a blob
+  // is judged by its size after filling.
+  std::vector<uint8> small_hole(num_ids, 0);
+  int num_holes = 0;
+  for (int32 id = 0; id < num_ids; id++) {
+    if (m_parent[id] == id && !m_is_set[id] && max_hole_area > 0 && m_area[id] <= max_hole_area) {
+      small_hole[id] = 1;
+      num_holes++;
+    }
+  }
+  std::vector<int32> group(num_ids);
+  for (int32 id = 0; id < num_ids; id++)
+    group[id] = id;
+  for (size_t it = 0; it < m_adjacent.size(); it++) {
+    int32 blob = find(m_parent, m_adjacent[it].first);
+    int32 hole = find(m_parent, m_adjacent[it].second);
+    if (small_hole[hole])
+      join(group, blob, hole);
+  }
+  std::vector<int64> group_area(num_ids, 0);
+  std::vector<uint8> group_has_blob(num_ids, 0);
+  for (int32 id = 0; id < num_ids; id++) {
+    if (m_parent[id] != id || (!m_is_set[id] && !small_hole[id]))
+      continue;
+    int32 g = find(group, id);
+    group_area[g] += m_area[id];
+    if (m_is_set[id])
+      group_has_blob[g] = 1;
+  }
+
+  m_status.assign(num_ids, NODATA);
+  m_num_holes_filled = 0;
+  m_num_blobs_removed = 0;
+  for (int32 id = 0; id < num_ids; id++) {
+    if (m_parent[id] != id)
+      continue;
+    int32 g = find(group, id);
+    bool removed = (max_blob_area > 0 && group_has_blob[g] && group_area[g] <= max_blob_area);
+    if (m_is_set[id]) {
+      m_status[id] = removed ? REMOVE : KEEP;
+      if (removed)
+        m_num_blobs_removed++;
+    } else if (small_hole[id] && !removed) {
+      m_status[id] = FILL;
+      m_num_holes_filled++;
+    }
+  }
+
+  // The adjacency is no longer needed
+  std::vector<std::pair<int32, int32> >().swap(m_adjacent);
+
+  m_finalized = true;
+}
+
+void TiledBlobIndex::classify(ImageViewRef<uint8> const& mask, BBox2i const& bbox,
+                              ImageView<uint8> & status,
+                              std::vector<HoleInfo> & holes) const {
+
+  VW_ASSERT(m_finalized, LogicErr() << "TiledBlobIndex: must call finalize() first.\n");
+
+  status.set_size(bbox.width(), bbox.height());
+  fill(status, NODATA);
+  holes.clear();
+
+  // Find the tiles intersecting the box from the grid. The one
+  // containing the box corner may start before it.
+  std::vector<int>::const_iterator col_beg
+    = std::upper_bound(m_col_starts.begin(), m_col_starts.end(), bbox.min().x());
+  if (col_beg != m_col_starts.begin())
+    col_beg--;
+  std::vector<int>::const_iterator row_beg
+    = std::upper_bound(m_row_starts.begin(), m_row_starts.end(), bbox.min().y());
+  if (row_beg != m_row_starts.begin())
+    row_beg--;
+  std::vector<int> tile_ids;
+  for (std::vector<int>::const_iterator row = row_beg;
+       row != m_row_starts.end() && *row < bbox.max().y(); row++) {
+    for (std::vector<int>::const_iterator col = col_beg;
+         col != m_col_starts.end() && *col < bbox.max().x(); col++) {
+      std::map<std::pair<int, int>, int>::const_iterator it
+        = m_tile_lookup.find(std::make_pair(*col, *row));
+      if (it != m_tile_lookup.end())
+        tile_ids.push_back(it->second);
+    }
+  }
+
+  std::set<int32> seen_holes;
+  for (size_t t = 0; t < tile_ids.size(); t++) {
+    TileLabels const& tile = m_tiles[tile_ids[t]];
+    BBox2i shared = tile.bbox;
+    shared.crop(bbox);
+    if (shared.empty())
+      continue;
+
+    // Label the whole tile again, which gives the same local labels
+    // as when it was added.
+    ImageView<uint8> tile_mask = crop(mask, tile.bbox);
+    ImageView<int32> labels;
+    label_tile_components(tile_mask, labels);
+
+    for (int col = shared.min().x(); col < shared.max().x(); col++) {
+      for (int row = shared.min().y(); row < shared.max().y(); row++) {
+        int32 id = tile.first_id + labels(col - tile.bbox.min().x(),
+                                          row - tile.bbox.min().y());
+        // find() without path compression, as this is called from many threads
+        while (m_parent[id] != id)
+          id = m_parent[id];
+        uint8 s = m_status[id];
+        status(col - bbox.min().x(), row - bbox.min().y()) = s;
+        if (s == FILL && seen_holes.find(id) == seen_holes.end()) {
+          seen_holes.insert(id);
+          HoleInfo hole;
+          hole.seed = m_seed[id];
+          hole.bbox = m_bbox[id];
+          holes.push_back(hole);
+        }
+      }
+    }
+  }
+}
+
+} // end namespace asp
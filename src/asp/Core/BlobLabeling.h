@@ -0,0 +1,328 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BlobLabeling.h
+///
+/// Tile-parallel connected component labeling. Each tile is labeled
+/// independently as it is rasterized, and labels are merged across
+/// tile seams with a union-find once all tiles were seen. This allows
+/// exact hole filling and small blob removal which do not depend on
+/// where the tile boundaries are.
+
+#ifndef __ASP_CORE_BLOBLABELING_H__
+#define __ASP_CORE_BLOBLABELING_H__
+
+#include <vw/Core/Thread.h>
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/Algorithms.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Image/PerPixelViews.h>
+
+#include <map>
+#include <vector>
+
+namespace asp {
+
+  /// Returns 1 for valid pixels and 0 for invalid ones.
+  struct ValidMaskFunctor: public vw::ReturnFixedType<vw::uint8> {
+    template <class PixelT>
+    vw::uint8 operator()(PixelT const& pix) const {
+      return is_valid(pix) ? 1 : 0;
+    }
+  };
+
+  /// Label the 4-connected components of a binary tile, with both the
+  /// set and unset pixels being labeled. Labels start at 0 and are
+  /// assigned in row-major order of the first pixel of each component,
+  /// so labeling the same tile twice gives the same result.
+  /// Returns the number of components.
+  int label_tile_components(vw::ImageView<vw::uint8> const& mask,
+                            vw::ImageView<vw::int32>      & labels);
+
+  /// A blob index built incrementally from tiles. Call add_tile() for
+  /// a grid of non-overlapping tiles covering the image, such as those
+  /// block_write_gdal_image rasterizes, from any number of threads,
+  /// then finalize() once. After that classify()
+  /// tells for every pixel whether it is kept, removed, left as nodata,
+  /// or is part of a hole which should be filled.
+  class TiledBlobIndex {
+  public:
+
+    enum PixelStatus { NODATA = 0, KEEP = 1, REMOVE = 2, FILL = 3 };
+
+    /// A hole to be filled, with a pixel in it and its bounding box.
+    struct HoleInfo {
+      vw::Vector2i seed;
+      vw::BBox2i   bbox;
+    };
+
+    TiledBlobIndex(): m_finalized(false), m_num_holes_filled(0), m_num_blobs_removed(0) {}
+
+    /// Label a tile of the mask (nonzero is a valid pixel). Thread-safe.
+    /// If a tile with the same extent was already added it is ignored.
+    void add_tile(vw::BBox2i const& bbox, vw::ImageView<vw::uint8> const& mask);
+
+    /// Merge labels across tile seams. Holes (invalid components) of
+    /// area at most max_hole_area are marked to be filled, and then
+    /// blobs (valid components, together with any holes filled in
+    /// them) of area at most max_blob_area are marked to be removed.
+    /// A non-positive value disables the corresponding step.
+    void finalize(vw::int64 max_hole_area, vw::int64 max_blob_area);
+
+    /// Find the status of each pixel in the given box. The mask must be
+    /// the same as the one the tiles were built from. Also return the
+    /// holes intersecting this box which are to be filled.
+    void classify(vw::ImageViewRef<vw::uint8> const& mask, vw::BBox2i const& bbox,
+                  vw::ImageView<vw::uint8> & status,
+                  std::vector<HoleInfo> & holes) const;
+
+    int num_tiles        () const { return m_tiles.size(); }
+    int num_holes_filled () const { return m_num_holes_filled;  }
+    int num_blobs_removed() const { return m_num_blobs_removed; }
+
+  private:
+
+    struct TileLabels {
+      vw::BBox2i bbox;
+      vw::int32  first_id; // the global id of the local label 0
+      std::vector<vw::int32> top, bottom, left, right; // global ids on the tile border
+    };
+
+    vw::int32 find(std::vector<vw::int32> & parent, vw::int32 id) const;
+    void      join(std::vector<vw::int32> & parent, vw::int32 a, vw::int32 b) const;
+
+    // The components, indexed by global id. After finalize(), the
+    // statistics are accumulated in the root of each component.
+    std::vector<vw::int32>    m_parent;
+    std::vector<vw::int64>    m_area;
+    std::vector<vw::BBox2i>   m_bbox;
+    std::vector<vw::Vector2i> m_seed;
+    std::vector<vw::uint8>    m_is_set;
+
+    // Pairs of adjacent valid and invalid components
+    std::vector<std::pair<vw::int32, vw::int32> > m_adjacent;
+
+    std::vector<TileLabels>  m_tiles;
+    std::map<std::pair<int, int>, int> m_tile_lookup; // tile corner to tile index
+    std::vector<int> m_col_starts, m_row_starts;      // the tile grid, sorted
+
+    // The status of each root component after finalize()
+    std::vector<vw::uint8> m_status;
+
+    bool m_finalized;
+    int  m_num_holes_filled, m_num_blobs_removed;
+    vw::Mutex m_mutex;
+  };
+
+  /// Pass the image through unchanged, while recording the blobs of
+  /// each rasterized tile in the given index.
+  template <class ImageT>
+  class BlobLabelingView: public vw::ImageViewBase<BlobLabelingView<ImageT> > {
+    ImageT           m_img;
+    TiledBlobIndex & m_index;
+  public:
+    BlobLabelingView(vw::ImageViewBase<ImageT> const& img, TiledBlobIndex & index):
+      m_img(img.impl()), m_index(index){}
+
+    typedef typename ImageT::pixel_type pixel_type;
+    typedef pixel_type                  result_type;
+    typedef vw::ProceduralPixelAccessor<BlobLabelingView> pixel_accessor;
+
+    inline vw::int32 cols  () const { return m_img.cols(); }
+    inline vw::int32 rows  () const { return m_img.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+    inline pixel_type operator()( double /*i*/, double /*j*/, vw::int32 /*p*/ = 0 ) const {
+      vw_throw(vw::NoImplErr() << "BlobLabelingView::operator()(...) is not implemented");
+      return pixel_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<pixel_type> tile = crop(m_img, bbox);
+      m_index.add_tile(bbox, per_pixel_filter(tile, ValidMaskFunctor()));
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  template <class ImageT>
+  BlobLabelingView<ImageT>
+  label_blobs(vw::ImageViewBase<ImageT> const& img, TiledBlobIndex & index) {
+    return BlobLabelingView<ImageT>(img.impl(), index);
+  }
+
+  /// Fill the holes and remove the blobs found by a finalized
+  /// TiledBlobIndex. A hole is filled from its boundary inwards, each
+  /// pixel getting the average of its already known 8 neighbors.
+  /// Since each hole is filled as a whole, the result does not depend
+  /// on the tiling.
+  template <class ImageT>
+  class TiledBlobFilterView: public vw::ImageViewBase<TiledBlobFilterView<ImageT> > {
+    ImageT                      m_img;
+    vw::ImageViewRef<vw::uint8> m_mask;
+    TiledBlobIndex const&       m_index;
+  public:
+    TiledBlobFilterView(vw::ImageViewBase<ImageT> const& img, TiledBlobIndex const& index):
+      m_img(img.impl()), m_mask(per_pixel_filter(img.impl(), ValidMaskFunctor())),
+      m_index(index){}
+
+    typedef typename ImageT::pixel_type pixel_type;
+    typedef typename vw::UnmaskedPixelType<pixel_type>::type value_type;
+    typedef pixel_type result_type;
+    typedef vw::ProceduralPixelAccessor<TiledBlobFilterView> pixel_accessor;
+
+    inline vw::int32 cols  () const { return m_img.cols(); }
+    inline vw::int32 rows  () const { return m_img.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+    inline pixel_type operator()( double /*i*/, double /*j*/, vw::int32 /*p*/ = 0 ) const {
+      vw_throw(vw::NoImplErr() << "TiledBlobFilterView::operator()(...) is not implemented");
+      return pixel_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+
+      vw::ImageView<pixel_type> tile = crop(m_img, bbox);
+      vw::ImageView<vw::uint8>  status;
+      std::vector<TiledBlobIndex::HoleInfo> holes;
+      m_index.classify(m_mask, bbox, status, holes);
+
+      for (int col = 0; col < tile.cols(); col++) {
+        for (int row = 0; row < tile.rows(); row++) {
+          if (status(col, row) == TiledBlobIndex::REMOVE)
+            tile(col, row).invalidate();
+        }
+      }
+
+      for (size_t h = 0; h < holes.size(); h++)
+        fill_hole(holes[h], bbox, tile);
+
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+
+  private:
+
+    // Fill the given hole in full, and copy the part of it within
+    // bbox into the tile.
+    void fill_hole(TiledBlobIndex::HoleInfo const& hole, vw::BBox2i const& bbox,
+                   vw::ImageView<pixel_type> & tile) const {
+
+      vw::BBox2i region = hole.bbox;
+      region.expand(1);
+      region.crop(vw::bounding_box(m_img));
+      vw::ImageView<pixel_type> vals = crop(m_img, region);
+
+      // Find the pixels of the hole. It is fully contained in its box,
+      // so a flood fill from the seed finds all of it.
+      vw::ImageView<vw::uint8> in_hole(vals.cols(), vals.rows());
+      vw::fill(in_hole, 0);
+      std::vector<vw::Vector2i> stack(1, hole.seed - region.min());
+      std::vector<vw::Vector2i> pixels;
+      in_hole(stack[0].x(), stack[0].y()) = 1;
+      while (!stack.empty()) {
+        vw::Vector2i p = stack.back();
+        stack.pop_back();
+        pixels.push_back(p);
+        static const int dx[] = {1, -1, 0, 0}, dy[] = {0, 0, 1, -1};
+        for (int k = 0; k < 4; k++) {
+          vw::Vector2i q(p.x() + dx[k], p.y() + dy[k]);
+          if (q.x() < 0 || q.y() < 0 || q.x() >= vals.cols() || q.y() >= vals.rows())
+            continue;
+          if (in_hole(q.x(), q.y()) || is_valid(vals(q.x(), q.y())))
+            continue;
+          in_hole(q.x(), q.y()) = 1;
+          stack.push_back(q);
+        }
+      }
+
+      // Peel the hole from the outside in. Pixels of other holes which
+      // touch this one only diagonally are not used, as they are not
+      // marked as being in this hole and are not valid.
+      while (!pixels.empty()) {
+        std::vector<vw::Vector2i> remaining;
+        std::vector<std::pair<vw::Vector2i, value_type> > layer;
+        for (size_t it = 0; it < pixels.size(); it++) {
+          vw::Vector2i p = pixels[it];
+          value_type sum = value_type();
+          int count = 0;
+          for (int dx = -1; dx <= 1; dx++) {
+            for (int dy = -1; dy <= 1; dy++) {
+              int x = p.x() + dx, y = p.y() + dy;
+              if ((dx == 0 && dy == 0) || x < 0 || y < 0 ||
+                  x >= vals.cols() || y >= vals.rows())
+                continue;
+              if (!is_valid(vals(x, y)))
+                continue;
+              sum += vals(x, y).child();
+              count++;
+            }
+          }
+          if (count > 0)
+            layer.push_back(std::make_pair(p, value_type(sum/double(count))));
+          else
+            remaining.push_back(p);
+        }
+        if (layer.empty())
+          break; // No valid neighbors at all, nothing to fill from
+        for (size_t it = 0; it < layer.size(); it++)
+          vals(layer[it].first.x(), layer[it].first.y()) = pixel_type(layer[it].second);
+        pixels.swap(remaining);
+      }
+
+      // Copy the part of the hole which is within the current tile
+      vw::BBox2i shared = region;
+      shared.crop(bbox);
+      for (int col = shared.min().x(); col < shared.max().x(); col++) {
+        for (int row = shared.min().y(); row < shared.max().y(); row++) {
+          int x = col - region.min().x(), y = row - region.min().y();
+          if (in_hole(x, y))
+            tile(col - bbox.min().x(), row - bbox.min().y()) = vals(x, y);
+        }
+      }
+    }
+  };
+
+  template <class ImageT>
+  TiledBlobFilterView<ImageT>
+  fill_holes_and_remove_blobs(vw::ImageViewBase<ImageT> const& img,
+                              TiledBlobIndex const& index) {
+    return TiledBlobFilterView<ImageT>(img.impl(), index);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_BLOBLABELING_H__
@@ -0,0 +1,219 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <asp/Core/BlockJournal.h>
+
+#include <boost/filesystem.hpp>
+
+#include <vector>
+
+namespace fs = boost::filesystem;
+using namespace vw;
+
+namespace {
+
+  const std::string JOURNAL_TAG = "ASP_BLOCK_JOURNAL_V1";
+
+  // A record is the block box, the number of bytes, and the checksum,
+  // followed by the pixels.
+  const boost::uint64_t RECORD_HEADER_SIZE = 4*sizeof(boost::int32_t) + 2*sizeof(boost::uint64_t);
+
+  // 64-bit FNV-1a hash of the box and the pixels of a block
+  boost::uint64_t block_checksum(const boost::int32_t * box, const char * data,
+                                 boost::uint64_t num_bytes) {
+    boost::uint64_t hash = 14695981039346656037ULL;
+    const char * box_bytes = (const char*)box;
+    for (size_t it = 0; it < 4*sizeof(boost::int32_t); it++)
+      hash = (hash ^ (unsigned char)box_bytes[it]) * 1099511628211ULL;
+    for (boost::uint64_t it = 0; it < num_bytes; it++)
+      hash = (hash ^ (unsigned char)data[it]) * 1099511628211ULL;
+    return hash;
+  }
+
+  // What the journals of this run are made from
+  std::vector<std::string> g_journal_args, g_journal_inputs;
+  vw::Mutex g_journal_mutex;
+
+  void bbox_to_array(BBox2i const& bbox, boost::int32_t * box) {
+    box[0] = bbox.min().x(); box[1] = bbox.min().y();
+    box[2] = bbox.max().x(); box[3] = bbox.max().y();
+  }
+
+} // end anonymous namespace
+
+namespace asp {
+
+  void set_journal_command_line(int argc, char *argv[]) {
+    vw::Mutex::Lock lock(g_journal_mutex);
+    g_journal_args.assign(argv, argv + argc);
+  }
+
+  void add_journal_input(std::string const& file) {
+    vw::Mutex::Lock lock(g_journal_mutex);
+    g_journal_inputs.push_back(file);
+  }
+
+  std::string journal_fingerprint(std::string const& output_file) {
+    std::ostringstream os;
+    std::vector<std::string> files;
+    {
+      vw::Mutex::Lock lock(g_journal_mutex);
+      for (size_t it = 0; it < g_journal_args.size(); it++)
+        os << g_journal_args[it] << "\n";
+      files = g_journal_args;
+      files.insert(files.end(), g_journal_inputs.begin(), g_journal_inputs.end());
+    }
+
+    // The arguments which are files, other than the output, which
+    // changes as it is written.
+    for (size_t it = 0; it < files.size(); it++) {
+      boost::system::error_code ec;
+      if (!fs::is_regular_file(files[it], ec))
+        continue;
+      if (fs::exists(output_file, ec) && fs::equivalent(files[it], output_file, ec))
+        continue;
+      os << files[it] << " " << fs::file_size(files[it], ec) << " "
+         << fs::last_write_time(files[it], ec) << "\n";
+    }
+
+    std::string text = os.str();
+    boost::int32_t no_box[4] = {0, 0, 0, 0};
+    std::ostringstream hash;
+    hash << std::hex << block_checksum(no_box, text.data(), text.size());
+    return hash.str();
+  }
+
+  std::string BlockJournal::journal_file(std::string const& output_file) {
+    return output_file + ".journal";
+  }
+
+  BlockJournal::BlockKey BlockJournal::block_key(BBox2i const& bbox) {
+    return BlockKey(std::make_pair(bbox.min().x(), bbox.min().y()),
+                    std::make_pair(bbox.max().x(), bbox.max().y()));
+  }
+
+  BlockJournal::BlockJournal(std::string const& output_file, std::string const& description):
+    m_file(journal_file(output_file)), m_num_resumed(0) {
+
+    std::string header = JOURNAL_TAG + " " + description + " "
+      + journal_fingerprint(output_file) + "\n";
+
+    // Keep the records up to the first incomplete or damaged one, as
+    // the process may have died while appending it.
+    boost::uint64_t good_end = 0;
+    if (fs::exists(m_file)) {
+      boost::uint64_t file_size = fs::file_size(m_file);
+      std::ifstream in(m_file.c_str(), std::ios::binary);
+      std::string line;
+      if (std::getline(in, line) && line + "\n" == header) {
+        good_end = header.size();
+        std::vector<char> buf;
+        while (good_end + RECORD_HEADER_SIZE <= file_size) {
+          boost::int32_t  box[4];
+          boost::uint64_t num_bytes = 0, checksum = 0;
+          in.read((char*)box, sizeof(box));
+          in.read((char*)&num_bytes, sizeof(num_bytes));
+          in.read((char*)&checksum, sizeof(checksum));
+          if (!in || good_end + RECORD_HEADER_SIZE + num_bytes > file_size)
+            break;
+          buf.resize(num_bytes);
+          if (num_bytes > 0 && !in.read(&buf[0], num_bytes))
+            break;
+          if (checksum != block_checksum(box, num_bytes > 0 ? &buf[0] : NULL, num_bytes))
+            break;
+
+          BlockRecord rec;
+          rec.offset    = good_end + RECORD_HEADER_SIZE;
+          rec.num_bytes = num_bytes;
+          m_blocks[block_key(BBox2i(Vector2i(box[0], box[1]), Vector2i(box[2], box[3])))] = rec;
+          good_end = rec.offset + num_bytes;
+        }
+      } else {
+        vw_out(WarningMessage) << "Discarding the journal " << m_file
+                               << ", as it is for a different image, options, or inputs.\n";
+      }
+    }
+
+    if (good_end == 0) {
+      std::ofstream out(m_file.c_str(), std::ios::binary | std::ios::trunc);
+      out << header;
+      if (!out)
+        vw_throw(IOErr() << "Cannot write the journal: " << m_file << "\n");
+    } else if (good_end < fs::file_size(m_file)) {
+      vw_out(WarningMessage) << "Discarding the incomplete last part of the journal: "
+                             << m_file << "\n";
+      fs::resize_file(m_file, good_end);
+    }
+
+    m_fh.open(m_file.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    if (!m_fh)
+      vw_throw(IOErr() << "Cannot open the journal: " << m_file << "\n");
+
+    m_num_resumed = m_blocks.size();
+    if (m_num_resumed > 0)
+      vw_out() << "Resuming with " << m_num_resumed << " blocks already written, from: "
+               << m_file << "\n";
+  }
+
+  bool BlockJournal::read_block(BBox2i const& bbox, void * data, size_t num_bytes) {
+    vw::Mutex::Lock lock(m_mutex);
+
+    std::map<BlockKey, BlockRecord>::const_iterator it = m_blocks.find(block_key(bbox));
+    if (it == m_blocks.end() || it->second.num_bytes != num_bytes)
+      return false;
+
+    m_fh.seekg(it->second.offset);
+    m_fh.read((char*)data, num_bytes);
+    if (!m_fh) {
+      m_fh.clear();
+      return false;
+    }
+    return true;
+  }
+
+  void BlockJournal::add_block(BBox2i const& bbox, const void * data, size_t num_bytes) {
+    vw::Mutex::Lock lock(m_mutex);
+
+    boost::int32_t  box[4];
+    bbox_to_array(bbox, box);
+    boost::uint64_t size     = num_bytes;
+    boost::uint64_t checksum = block_checksum(box, (const char*)data, size);
+
+    m_fh.seekp(0, std::ios::end);
+    BlockRecord rec;
+    rec.offset    = boost::uint64_t(m_fh.tellp()) + RECORD_HEADER_SIZE;
+    rec.num_bytes = size;
+    m_fh.write((const char*)box, sizeof(box));
+    m_fh.write((const char*)&size, sizeof(size));
+    m_fh.write((const char*)&checksum, sizeof(checksum));
+    m_fh.write((const char*)data, num_bytes);
+    m_fh.flush();
+    if (!m_fh)
+      vw_throw(IOErr() << "Failed to write to the journal: " << m_file << "\n");
+
+    m_blocks[block_key(bbox)] = rec;
+  }
+
+  void BlockJournal::remove() {
+    vw::Mutex::Lock lock(m_mutex);
+    m_fh.close();
+    m_blocks.clear();
+    fs::remove(m_file);
+  }
+
+} // end namespace asp
@@ -0,0 +1,209 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file BlockJournal.h
+///
+/// Resumable block writing of images. As an image is block-written,
+/// each finished block is also appended, with a checksum, to a journal
+/// file next to the output. If the run is killed and then started
+/// again with the same output and block size, the blocks found intact
+/// in the journal are read back rather than computed. The journal is
+/// removed once the output is fully written. A journal is also
+/// discarded if the command line, or the size or modification time of
+/// an input file, changed since it was made.
+///
+/// A GeoTIFF which was being written when the process died cannot be
+/// trusted, hence the blocks are kept in the journal rather than read
+/// from the output. This takes as much disk space as the uncompressed
+/// output, until the write finishes.
+
+#ifndef __ASP_CORE_BLOCK_JOURNAL_H__
+#define __ASP_CORE_BLOCK_JOURNAL_H__
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/Thread.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/Core/CompoundTypes.h>
+#include <vw/Math/BBox.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelTypeInfo.h>
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/cstdint.hpp>
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace asp {
+
+  /// Record the command line of this run. The journals made after this
+  /// are for this command line, and for the files named on it.
+  void set_journal_command_line(int argc, char *argv[]);
+
+  /// Add an input file not named on the command line, such as an
+  /// intermediate file of an earlier stage, to the journals made after this.
+  void add_journal_input(std::string const& file);
+
+  /// A fingerprint of the command line and of the size and
+  /// modification time of the input files, other than the given output.
+  std::string journal_fingerprint(std::string const& output_file);
+
+  /// The journal of the blocks written so far to an output image.
+  /// Blocks may be read and added from multiple threads.
+  class BlockJournal: private boost::noncopyable {
+  public:
+
+    /// Open the journal of the given output file. The blocks already
+    /// in it are kept if it was made for an image of the same
+    /// description, with the same journal_fingerprint(), and if their
+    /// checksums agree. A journal for a different image, options, or
+    /// inputs, or the damaged end of one, is discarded.
+    BlockJournal(std::string const& output_file, std::string const& description);
+
+    /// The journal file for a given output file
+    static std::string journal_file(std::string const& output_file);
+
+    /// Number of blocks found in the journal when it was opened
+    size_t num_resumed_blocks() const { return m_num_resumed; }
+
+    /// Read a block with exactly this box and size, if present.
+    bool read_block(vw::BBox2i const& bbox, void * data, size_t num_bytes);
+
+    /// Append a block and flush it to disk.
+    void add_block(vw::BBox2i const& bbox, const void * data, size_t num_bytes);
+
+    /// Delete the journal. Call this once the output is complete.
+    void remove();
+
+  private:
+    typedef std::pair< std::pair<int, int>, std::pair<int, int> > BlockKey;
+    struct BlockRecord {
+      boost::uint64_t offset, num_bytes;
+    };
+
+    static BlockKey block_key(vw::BBox2i const& bbox);
+
+    std::string  m_file;
+    std::fstream m_fh;
+    std::map<BlockKey, BlockRecord> m_blocks;
+    size_t       m_num_resumed;
+    vw::Mutex    m_mutex;
+  };
+
+  /// Describe an image to be written, so that a journal is not resumed
+  /// for a different one. The blocks must be the same, as they are
+  /// looked up by their boxes.
+  template <class PixelT>
+  std::string journal_description(int cols, int rows, vw::Vector2i const& block_size) {
+    std::ostringstream os;
+    os << cols << " " << rows << " " << block_size[0] << " " << block_size[1] << " "
+       << sizeof(PixelT) << " " << vw::CompoundNumChannels<PixelT>::value << " "
+       << vw::ChannelTypeID<typename vw::CompoundChannelType<PixelT>::type>::value;
+    return os.str();
+  }
+
+  /// Pass the tiles of an image through, taking them from the journal
+  /// if there, and otherwise computing them and adding them to it. The
+  /// pixels must be plain data, which all VW pixel types are.
+  template <class ImageT>
+  class JournaledView: public vw::ImageViewBase<JournaledView<ImageT> > {
+    ImageT         m_img;
+    BlockJournal & m_journal;
+  public:
+    typedef typename ImageT::pixel_type pixel_type;
+    typedef pixel_type result_type;
+    typedef vw::ProceduralPixelAccessor<JournaledView> pixel_accessor;
+
+    JournaledView(vw::ImageViewBase<ImageT> const& img, BlockJournal & journal):
+      m_img(img.impl()), m_journal(journal){}
+
+    inline vw::int32 cols  () const { return m_img.cols(); }
+    inline vw::int32 rows  () const { return m_img.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+    inline pixel_type operator()( double /*i*/, double /*j*/, vw::int32 /*p*/ = 0 ) const {
+      vw_throw(vw::NoImplErr() << "JournaledView::operator()(...) is not implemented");
+      return pixel_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<pixel_type> tile(bbox.width(), bbox.height());
+      size_t num_bytes = sizeof(pixel_type)*tile.cols()*tile.rows();
+      if (!m_journal.read_block(bbox, tile.data(), num_bytes)) {
+        tile = crop(m_img, bbox);
+        m_journal.add_block(bbox, tile.data(), num_bytes);
+      }
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  template <class ImageT>
+  JournaledView<ImageT>
+  journal_blocks(vw::ImageViewBase<ImageT> const& img, BlockJournal & journal) {
+    return JournaledView<ImageT>(img.impl(), journal);
+  }
+
+  /// Block-write an image. If resumable is true, keep a journal of the
+  /// written blocks, so that if this is interrupted, running it again
+  /// computes only the blocks not written yet.
+  template <class ImageT>
+  void block_write_gdal_image_resumable(std::string const& filename,
+                                        vw::ImageViewBase<ImageT> const& image,
+                                        bool has_georef,
+                                        vw::cartography::GeoReference const& georef,
+                                        bool has_nodata, double nodata,
+                                        vw::cartography::GdalWriteOptions const& opt,
+                                        bool resumable,
+                                        vw::ProgressCallback const& progress_callback
+                                        = vw::ProgressCallback::dummy_instance(),
+                                        std::map<std::string, std::string> const& keywords
+                                        = std::map<std::string, std::string>()) {
+
+    if (!resumable) {
+      vw::cartography::block_write_gdal_image(filename, image.impl(), has_georef, georef,
+                                              has_nodata, nodata, opt,
+                                              progress_callback, keywords);
+      return;
+    }
+
+    BlockJournal journal(filename, journal_description<typename ImageT::pixel_type>
+                         (image.impl().cols(), image.impl().rows(), opt.raster_tile_size));
+    vw::cartography::block_write_gdal_image(filename, journal_blocks(image.impl(), journal),
+                                            has_georef, georef, has_nodata, nodata, opt,
+                                            progress_callback, keywords);
+    journal.remove();
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_BLOCK_JOURNAL_H__
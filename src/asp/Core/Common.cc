@@ -308,6 +308,22 @@ void asp::parse_append_metadata(std::string const& metadata,
   }
 }
 
+// If a point is inside a polygon, by the even-odd rule
+bool asp::point_in_polygon(vw::Vector2 const& pt, std::vector<vw::Vector2> const& poly){
+
+  // Count the edges crossed by a ray going from the point in the
+  // positive x direction.
+  bool inside = false;
+  size_t num = poly.size();
+  for (size_t i = 0, j = num - 1; i < num; j = i++) {
+    if ( (poly[i].y() > pt.y()) != (poly[j].y() > pt.y()) &&
+         pt.x() < poly[j].x() + (poly[i].x() - poly[j].x())*(pt.y() - poly[j].y())
+                                /(poly[i].y() - poly[j].y()) )
+      inside = !inside;
+  }
+  return inside;
+}
+
 // Print time function
 std::string asp::current_posix_time_string() {
   return boost::posix_time::to_simple_string(boost::posix_time::second_clock::local_time());
@@ -514,6 +530,15 @@ asp::check_command_line( int argc, char *argv[], vw::cartography::GdalWriteOptio
              << "\" is not a valid options for TIF_COMPRESS." );
   opt.gdal_options["COMPRESS"] = opt.tif_compress;
 
+  // Compress the tiles of output GeoTIFF files in parallel. GDAL does
+  // that in its own thread pool, and the thread which writes the image
+  // waits for the oldest pending tile and writes the compressed tiles
+  // in order, so the number of tiles held in memory stays bounded.
+#if GDAL_VERSION_NUM >= 2010000
+  if (opt.tif_compress != "NONE")
+    opt.gdal_options["NUM_THREADS"] = boost::lexical_cast<std::string>(opt.num_threads);
+#endif
+
   return vm;
 }
 
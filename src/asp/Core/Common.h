@@ -38,6 +38,8 @@
 #include <vw/Image/ImageViewRef.h>
 #include <vw/Cartography/GeoReference.h>
 #include <vw/Cartography/GeoReferenceUtils.h>
+#include <asp/Core/Overviews.h>
+#include <asp/Core/BlockJournal.h>
 #include <map>
 #include <string>
 
@@ -94,6 +96,9 @@ namespace asp {
   void parse_append_metadata(std::string const& metadata,
                              std::map<std::string, std::string> & keywords);
   
+  /// Return true if the point is inside the polygon with the given vertices.
+  bool point_in_polygon(vw::Vector2 const& pt, std::vector<vw::Vector2> const& poly);
+
   /// Print time function
   std::string current_posix_time_string();
 
@@ -194,6 +199,8 @@ namespace asp {
 
   /// Block write image while subtracting a given value from all pixels
   /// and casting the result to float, while rounding to nearest mm.
+  /// If resumable is true, an interrupted write can be resumed, see
+  /// BlockJournal.h.
   template <class ImageT>
   void block_write_approx_gdal_image(const std::string &filename,
                                      vw::Vector3 const& shift,
@@ -206,7 +213,8 @@ namespace asp {
                                      vw::ProgressCallback const& progress_callback
                                      = vw::ProgressCallback::dummy_instance(),
                                      std::map<std::string, std::string> const& keywords =
-                                     std::map<std::string, std::string>() );
+                                     std::map<std::string, std::string>(),
+                                     bool resumable = false);
 
 
   /// Single-threaded write image while subtracting a given value from
@@ -228,6 +236,10 @@ namespace asp {
 
   /// Often times, we'd like to save an image to disk by using big
   /// blocks, for performance reasons, then re-write it with desired blocks.
+  /// If num_overview_levels is positive, internal overviews are built
+  /// during the last of these writes. If resumable is true, the
+  /// blocks computed in the first write are journaled, so that an
+  /// interrupted run can be resumed.
   template <class ImageT>
   void save_with_temp_big_blocks(int big_block_size,
                                  const std::string &filename,
@@ -235,7 +247,10 @@ namespace asp {
                                  vw::cartography::GeoReference const& georef,
                                  double nodata,
                                  vw::cartography::GdalWriteOptions & opt,
-                                 vw::ProgressCallback const& tpc);
+                                 vw::ProgressCallback const& tpc,
+                                 int num_overview_levels = 0,
+                                 std::string const& overview_resampling = "average",
+                                 bool resumable = false);
 
 
   // TODO: Replace with something else!
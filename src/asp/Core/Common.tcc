@@ -38,7 +38,8 @@ namespace asp {
                                      bool has_nodata, double nodata,
                                      vw::cartography::GdalWriteOptions const& opt,
                                      vw::ProgressCallback const& progress_callback,
-                                     std::map<std::string, std::string> const& keywords) {
+                                     std::map<std::string, std::string> const& keywords,
+                                     bool resumable) {
 
 
     if (norm_2(shift) > 0){
@@ -47,17 +48,17 @@ namespace asp {
       std::map<std::string, std::string> local_keywords = keywords;
       local_keywords[ASP_POINT_OFFSET_TAG_STR] = vw::vec_to_str(shift);
 
-      block_write_gdal_image(filename,
-                             vw::channel_cast<float>
-                             (round_image_pixels(subtract_shift(image.impl(), shift),
-                                                 get_rounding_error(shift, rounding_error))),
-                             has_georef, georef, has_nodata, nodata,
-                             opt, progress_callback, local_keywords);
+      block_write_gdal_image_resumable(filename,
+                                       vw::channel_cast<float>
+                                       (round_image_pixels(subtract_shift(image.impl(), shift),
+                                                           get_rounding_error(shift, rounding_error))),
+                                       has_georef, georef, has_nodata, nodata,
+                                       opt, resumable, progress_callback, local_keywords);
 
     }else{
-      block_write_gdal_image(filename, image, has_georef, georef,
-                             has_nodata, nodata, opt,
-                             progress_callback, keywords);
+      block_write_gdal_image_resumable(filename, image, has_georef, georef,
+                                       has_nodata, nodata, opt, resumable,
+                                       progress_callback, keywords);
     }
 
   }
@@ -106,15 +107,36 @@ namespace asp {
                                  vw::cartography::GeoReference const& georef,
                                  double nodata,
                                  vw::cartography::GdalWriteOptions & opt,
-                                 vw::ProgressCallback const& tpc){
+                                 vw::ProgressCallback const& tpc,
+                                 int num_overview_levels,
+                                 std::string const& overview_resampling,
+                                 bool resumable){
 
     vw::Vector2 orig_block_size = opt.raster_tile_size;
     opt.raster_tile_size = vw::Vector2(big_block_size, big_block_size);
     bool has_georef = true;
     bool has_nodata = true;
-    block_write_gdal_image(filename, img, has_georef, georef, has_nodata, nodata, opt, tpc);
+    bool rewrite = (opt.raster_tile_size != orig_block_size);
+
+    // The journal is kept until the re-write is done, as that is
+    // from a file which would not be complete if interrupted.
+    boost::shared_ptr<BlockJournal> journal;
+    if (resumable) {
+      journal.reset(new BlockJournal(filename, journal_description<typename ImageT::pixel_type>
+                                     (img.impl().cols(), img.impl().rows(),
+                                      opt.raster_tile_size)));
+      block_write_gdal_image_with_overviews(filename, journal_blocks(img.impl(), *journal),
+                                            has_georef, georef, has_nodata, nodata, opt,
+                                            rewrite ? 0 : num_overview_levels,
+                                            overview_resampling, tpc);
+    } else {
+      block_write_gdal_image_with_overviews(filename, img, has_georef, georef,
+                                            has_nodata, nodata, opt,
+                                            rewrite ? 0 : num_overview_levels,
+                                            overview_resampling, tpc);
+    }
 
-    if (opt.raster_tile_size != orig_block_size){
+    if (rewrite){
       std::string tmp_file
         = boost::filesystem::path(filename).replace_extension(".tmp.tif").string();
       boost::filesystem::rename(filename, tmp_file);
@@ -122,10 +144,13 @@ namespace asp {
       opt.raster_tile_size = orig_block_size;
       vw::vw_out() << "Re-writing with blocks of size: "
                    << opt.raster_tile_size[0] << " x " << opt.raster_tile_size[1] << ".\n";
-      vw::cartography::block_write_gdal_image(filename, tmp_img, has_georef, georef,
-                                  has_nodata, nodata, opt, tpc);
+      block_write_gdal_image_with_overviews(filename, tmp_img, has_georef, georef,
+                                            has_nodata, nodata, opt,
+                                            num_overview_levels, overview_resampling, tpc);
       boost::filesystem::remove(tmp_file);
     }
+    if (journal)
+      journal->remove();
     return;
   }
 
@@ -0,0 +1,134 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Exception.h>
+#include <vw/Image/Manipulation.h>
+#include <asp/Core/ConsistencyCheck.h>
+
+#include <cmath>
+#include <limits>
+#include <vector>
+
+using namespace vw;
+
+namespace {
+
+  // The right pixel on which a left pixel lands
+  Vector2i landing_pixel(Vector2i const& lpix, Vector2f const& d) {
+    return lpix + Vector2i((int)std::floor(d[0] + 0.5), (int)std::floor(d[1] + 0.5));
+  }
+
+} // end anonymous namespace
+
+namespace asp {
+
+  double window_ncc(ImageView<float> const& left,  Vector2i const& left_pix,
+                    ImageView<float> const& right, Vector2i const& right_pix,
+                    Vector2i const& half_kernel) {
+
+    double sum_l = 0, sum_r = 0, sum_ll = 0, sum_rr = 0, sum_lr = 0;
+    int num = 0;
+    for (int dy = -half_kernel.y(); dy <= half_kernel.y(); dy++) {
+      for (int dx = -half_kernel.x(); dx <= half_kernel.x(); dx++) {
+        double l = left (left_pix.x()  + dx, left_pix.y()  + dy);
+        double r = right(right_pix.x() + dx, right_pix.y() + dy);
+        sum_l  += l;   sum_r  += r;
+        sum_ll += l*l; sum_rr += r*r; sum_lr += l*r;
+        num++;
+      }
+    }
+    double var_l = sum_ll - sum_l*sum_l/num;
+    double var_r = sum_rr - sum_r*sum_r/num;
+    if (var_l <= 0 || var_r <= 0)
+      return -1.0; // no texture, as bad as it gets
+    return (sum_lr - sum_l*sum_r/num)/std::sqrt(var_l*var_r);
+  }
+
+  int single_pass_consistency_check(ImageView<PixelMask<Vector2f> > & disp,
+                                    BBox2i const& disp_box,
+                                    ImageView<float> const& left,
+                                    BBox2i const& left_box,
+                                    ImageView<float> const& right,
+                                    BBox2i const& right_box,
+                                    Vector2i const& kernel_size,
+                                    double threshold) {
+
+    VW_ASSERT(disp.cols() == disp_box.width() && disp.rows() == disp_box.height(),
+              ArgumentErr() << "single_pass_consistency_check: Wrong disparity box.\n");
+    VW_ASSERT(left.cols() == left_box.width() && left.rows() == left_box.height() &&
+              right.cols() == right_box.width() && right.rows() == right_box.height(),
+              ArgumentErr() << "single_pass_consistency_check: Wrong image boxes.\n");
+
+    Vector2i half_kernel = kernel_size/2;
+    BBox2i left_inner = left_box, right_inner = right_box;
+    left_inner.contract(half_kernel);
+    right_inner.contract(half_kernel);
+
+    // The cost of each left pixel at its own disparity, and for each
+    // right pixel the index of the best left pixel landing on it.
+    int num_right = right_box.width()*right_box.height();
+    std::vector<int>    winner(num_right, -1);
+    std::vector<double> winner_cost(num_right, std::numeric_limits<double>::max());
+    for (int row = 0; row < disp.rows(); row++) {
+      for (int col = 0; col < disp.cols(); col++) {
+        if (!is_valid(disp(col, row)))
+          continue;
+        Vector2i lpix = disp_box.min() + Vector2i(col, row);
+        Vector2i rpix = landing_pixel(lpix, disp(col, row).child());
+        if (!left_inner.contains(lpix) || !right_inner.contains(rpix)) {
+          disp(col, row).invalidate();
+          continue;
+        }
+        double cost = 1.0 - window_ncc(left,  lpix - left_box.min(),
+                                       right, rpix - right_box.min(), half_kernel);
+        int rindex = (rpix.y() - right_box.min().y())*right_box.width()
+                   + (rpix.x() - right_box.min().x());
+        if (cost < winner_cost[rindex]) {
+          winner_cost[rindex] = cost;
+          winner[rindex]      = row*disp.cols() + col;
+        }
+      }
+    }
+
+    // Keep the left pixels whose disparity agrees with that of the
+    // winner where they land. Compare with the disparities from
+    // before this pass invalidates anything.
+    ImageView<PixelMask<Vector2f> > orig = copy(disp);
+    int num_invalidated = 0;
+    for (int row = 0; row < disp.rows(); row++) {
+      for (int col = 0; col < disp.cols(); col++) {
+        if (!is_valid(orig(col, row)))
+          continue;
+        Vector2f d = orig(col, row).child();
+        Vector2i rpix = landing_pixel(disp_box.min() + Vector2i(col, row), d);
+        int rindex = (rpix.y() - right_box.min().y())*right_box.width()
+                   + (rpix.x() - right_box.min().x());
+        int best = winner[rindex];
+        Vector2f best_d = orig(best % disp.cols(), best / disp.cols()).child();
+        if (std::abs(d[0] - best_d[0]) > threshold ||
+            std::abs(d[1] - best_d[1]) > threshold) {
+          disp(col, row).invalidate();
+          num_invalidated++;
+        }
+      }
+    }
+
+    return num_invalidated;
+  }
+
+} // end namespace asp
@@ -0,0 +1,70 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file ConsistencyCheck.h
+///
+/// A uniqueness check of integer disparity, a cheaper stand-in for
+/// the left-right consistency check which needs only the left-to-right
+/// correlation pass. Instead of searching the whole range again from
+/// right to left, each right pixel is matched to the best of the left
+/// pixels whose disparity lands on it (a reverse winner-take-all over
+/// the forward winners). That costs as much as evaluating a single
+/// disparity, rather than all of them, but a right pixel which only
+/// one left pixel lands on always passes, so it removes fewer
+/// outliers than the full check.
+
+#ifndef __ASP_CORE_CONSISTENCY_CHECK_H__
+#define __ASP_CORE_CONSISTENCY_CHECK_H__
+
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+
+namespace asp {
+
+  /// The normalized cross-correlation of the windows of the given
+  /// half-size centered at a left and a right image pixel, which must
+  /// be fully inside the images. It is -1 if either window is flat.
+  double window_ncc(vw::ImageView<float> const& left,  vw::Vector2i const& left_pix,
+                    vw::ImageView<float> const& right, vw::Vector2i const& right_pix,
+                    vw::Vector2i const& half_kernel);
+
+  /// Invalidate the pixels of a tile of left-to-right disparity which
+  /// fail the left-right consistency check. The right-to-left
+  /// disparity of a right pixel is taken from the left pixel landing
+  /// on it with the lowest normalized cross-correlation cost, and a
+  /// left pixel is kept if its disparity agrees with the right-to-left
+  /// one where it lands, to within the threshold.
+  ///
+  /// The left image must cover disp_box expanded by half the kernel,
+  /// and the right one disp_box shifted by all the disparities and
+  /// expanded by half the kernel. The boxes are in the coordinates
+  /// of the full images. Returns the number of pixels invalidated.
+  int single_pass_consistency_check(vw::ImageView<vw::PixelMask<vw::Vector2f> > & disp,
+                                    vw::BBox2i const& disp_box,
+                                    vw::ImageView<float> const& left,
+                                    vw::BBox2i const& left_box,
+                                    vw::ImageView<float> const& right,
+                                    vw::BBox2i const& right_box,
+                                    vw::Vector2i const& kernel_size,
+                                    double threshold);
+
+} // end namespace asp
+
+#endif // __ASP_CORE_CONSISTENCY_CHECK_H__
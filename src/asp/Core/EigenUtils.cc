@@ -19,8 +19,12 @@
 /// \file EigenUtils.cc
 ///
 
+#include <vw/Core/ThreadPool.h>
 #include <asp/Core/EigenUtils.h>
 
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_real_distribution.hpp>
+
 using namespace vw;
 using namespace vw::cartography;
 
@@ -370,6 +374,209 @@ void load_csv(std::string const& file_name,
   return;
 }
 
+// The blocks in which to sample a DEM or point cloud, aligned with
+// the blocks in which the file is stored, and not too small.
+static std::vector<vw::BBox2i> sampling_blocks(std::string const& file_name,
+                                               vw::BBox2i const& pix_box){
+
+  vw::Vector2i block_size(256, 256);
+  {
+    boost::shared_ptr<vw::DiskImageResource> rsrc( new vw::DiskImageResourceGDAL(file_name) );
+    vw::Vector2i native = rsrc->block_read_size();
+    for (int c = 0; c < 2; c++) {
+      if (native[c] > 0)
+        block_size[c] = native[c]*((block_size[c] + native[c] - 1)/native[c]);
+    }
+  }
+
+  vw::BBox2i aligned_box(vw::Vector2i(0, 0), pix_box.max());
+  std::vector<vw::BBox2i> all_blocks
+    = vw::subdivide_bbox(aligned_box, block_size[0], block_size[1]);
+  std::vector<vw::BBox2i> blocks;
+  for (size_t it = 0; it < all_blocks.size(); it++) {
+    vw::BBox2i block = all_blocks[it];
+    block.crop(pix_box);
+    if (!block.empty())
+      blocks.push_back(block);
+  }
+  return blocks;
+}
+
+// How many elements to advance to the next one picked, when each is
+// picked independently with the given probability. This needs one
+// random number per picked element rather than per element.
+static int sampling_gap(double load_ratio, boost::random::mt19937 & generator){
+  if (load_ratio >= 1.0)
+    return 1;
+  boost::random::uniform_real_distribution<double> dist(0.0, 1.0);
+  double u   = 1.0 - dist(generator); // in (0, 1]
+  double gap = 1.0 + std::floor(std::log(u)/std::log(1.0 - load_ratio));
+  return (int)std::min(gap, (double)std::numeric_limits<int>::max());
+}
+
+// Pick the points of a DEM in a block, then convert them to xyz.
+template<typename DemPixelType>
+struct DemBlockSampler {
+  vw::DiskImageView<DemPixelType>    const& m_dem;
+  vw::cartography::GeoReference      const& m_geo;
+  DemPixelType                              m_nodata;
+  vw::BBox2                                 m_lonlat_box;
+
+  DemBlockSampler(vw::DiskImageView<DemPixelType> const& dem,
+                  vw::cartography::GeoReference const& geo,
+                  DemPixelType nodata, vw::BBox2 const& lonlat_box):
+    m_dem(dem), m_geo(geo), m_nodata(nodata), m_lonlat_box(lonlat_box){}
+
+  void operator()(vw::BBox2i const& box, double load_ratio,
+                  boost::random::mt19937 & generator,
+                  std::vector<vw::Vector3> & points) const {
+
+    vw::ImageView<DemPixelType> block = vw::crop(m_dem, box);
+
+    std::vector<vw::Vector3> llh;
+    int num = block.cols()*block.rows();
+    for (int k = sampling_gap(load_ratio, generator) - 1; k < num;
+         k += sampling_gap(load_ratio, generator)) {
+      int col = k % block.cols(), row = k / block.cols();
+      DemPixelType val = block(col, row);
+      if ( val == m_nodata || std::isnan(val) || std::isinf(val) )
+        continue;
+      vw::Vector2 lonlat = m_geo.pixel_to_lonlat(vw::Vector2(box.min().x() + col,
+                                                              box.min().y() + row));
+
+      // Skip points outside the given box
+      if (!m_lonlat_box.empty() && !m_lonlat_box.contains(lonlat))
+        continue;
+
+      llh.push_back(vw::Vector3(lonlat.x(), lonlat.y(), val));
+    }
+
+    vw::cartography::Datum const& datum = m_geo.datum();
+    points.reserve(llh.size());
+    for (size_t it = 0; it < llh.size(); it++) {
+      vw::Vector3 xyz = datum.geodetic_to_cartesian(llh[it]);
+      if ( xyz == vw::Vector3() || !(xyz == xyz) )
+        continue; // invalid and NaN check
+      points.push_back(xyz);
+    }
+  }
+};
+
+// Pick the points of an ASP point cloud in a block.
+struct PcBlockSampler {
+  vw::ImageViewRef<vw::Vector3>      const& m_point_cloud;
+  vw::cartography::GeoReference      const& m_geo;
+  vw::BBox2                                 m_lonlat_box;
+
+  PcBlockSampler(vw::ImageViewRef<vw::Vector3> const& point_cloud,
+                 vw::cartography::GeoReference const& geo,
+                 vw::BBox2 const& lonlat_box):
+    m_point_cloud(point_cloud), m_geo(geo), m_lonlat_box(lonlat_box){}
+
+  void operator()(vw::BBox2i const& box, double load_ratio,
+                  boost::random::mt19937 & generator,
+                  std::vector<vw::Vector3> & points) const {
+
+    vw::ImageView<vw::Vector3> block = vw::crop(m_point_cloud, box);
+
+    int num = block.cols()*block.rows();
+    for (int k = sampling_gap(load_ratio, generator) - 1; k < num;
+         k += sampling_gap(load_ratio, generator)) {
+      vw::Vector3 xyz = block(k % block.cols(), k / block.cols());
+      if ( xyz == vw::Vector3() || !(xyz == xyz) )
+        continue; // invalid and NaN check
+
+      // Skip points outside the given box
+      if (!m_lonlat_box.empty()){
+        vw::Vector3 llh = m_geo.datum().cartesian_to_geodetic(xyz);
+        if ( !m_lonlat_box.contains(subvector(llh, 0, 2)))
+          continue;
+      }
+
+      points.push_back(xyz);
+    }
+  }
+};
+
+// Sample one block. Each block has its own random generator seeded by
+// its index, so the result does not depend on the number of threads.
+template <class SamplerT>
+class SampleBlockTask : public vw::Task, private boost::noncopyable {
+  SamplerT                 const& m_sampler;
+  vw::BBox2i                      m_box;
+  int                             m_seed;
+  double                          m_load_ratio;
+  std::vector<vw::Vector3>      & m_points;
+  vw::Mutex                     & m_mutex;
+  vw::ProgressCallback     const& m_progress;
+  double                          m_inc_amount;
+public:
+  SampleBlockTask(SamplerT const& sampler, vw::BBox2i const& box, int seed,
+                  double load_ratio, std::vector<vw::Vector3> & points,
+                  vw::Mutex & mutex, vw::ProgressCallback const& progress,
+                  double inc_amount):
+    m_sampler(sampler), m_box(box), m_seed(seed), m_load_ratio(load_ratio),
+    m_points(points), m_mutex(mutex), m_progress(progress), m_inc_amount(inc_amount){}
+
+  void operator()() {
+    boost::random::mt19937 generator(m_seed + 1);
+    m_sampler(m_box, m_load_ratio, generator, m_points);
+
+    vw::Mutex::Lock lock(m_mutex);
+    m_progress.report_incremental_progress(m_inc_amount);
+  }
+};
+
+// Sample the given blocks in parallel, then put the points in the
+// matrix in block order, up to the number of points to load.
+template <class SamplerT>
+void sample_blocks(SamplerT const& sampler, std::vector<vw::BBox2i> const& blocks,
+                   int num_points_to_load, double load_ratio,
+                   bool calc_shift, vw::Vector3 & shift,
+                   bool verbose, DoubleMatrix & data){
+
+  vw::TerminalProgressCallback tpc("asp", "\t--> ");
+  vw::ProgressCallback const& progress
+    = verbose ? (vw::ProgressCallback const&)tpc : vw::ProgressCallback::dummy_instance();
+  progress.report_progress(0);
+
+  std::vector< std::vector<vw::Vector3> > block_points(blocks.size());
+  {
+    vw::Mutex mutex;
+    vw::FifoWorkQueue queue(vw::vw_settings().default_num_threads());
+    double inc_amount = 1.0/std::max(1.0, double(blocks.size()));
+    for (size_t it = 0; it < blocks.size(); it++) {
+      boost::shared_ptr< SampleBlockTask<SamplerT> >
+        task(new SampleBlockTask<SamplerT>(sampler, blocks[it], it, load_ratio,
+                                           block_points[it], mutex, progress,
+                                           inc_amount));
+      queue.add_task(task);
+    }
+    queue.join_all();
+  }
+  progress.report_finished();
+
+  size_t num_sampled = 0;
+  for (size_t it = 0; it < block_points.size(); it++)
+    num_sampled += block_points[it].size();
+  int points_count = std::min((size_t)num_points_to_load, num_sampled);
+  data.conservativeResize(DIM+1, points_count);
+
+  int col = 0;
+  for (size_t it = 0; it < block_points.size() && col < points_count; it++) {
+    for (size_t pt = 0; pt < block_points[it].size() && col < points_count; pt++) {
+      vw::Vector3 const& xyz = block_points[it][pt];
+      if (calc_shift && col == 0)
+        shift = xyz;
+      for (int row = 0; row < DIM; row++)
+        data(row, col) = xyz[row] - shift[row];
+      data(DIM, col) = 1; // Extend to be a homogenous coordinate
+      col++;
+    }
+    std::vector<vw::Vector3>().swap(block_points[it]); // free memory as we go
+  }
+}
+
 // Load a DEM
 template<typename DemPixelType>
 void load_dem_pixel_type(std::string const& file_name,
@@ -377,8 +584,6 @@ void load_dem_pixel_type(std::string const& file_name,
                          bool calc_shift, vw::Vector3 & shift,
                          bool verbose, DoubleMatrix & data){
   
-  data.conservativeResize(DIM+1, num_points_to_load);
-
   vw::cartography::GeoReference dem_geo;
   bool has_georef = vw::cartography::read_georeference( dem_geo, file_name );
   if (!has_georef)
@@ -417,58 +622,9 @@ void load_dem_pixel_type(std::string const& file_name,
   int    num_points = pix_box.width()*pix_box.height();
   double load_ratio = (double)num_points_to_load/std::max(1.0, (double)num_points);
 
-  bool shift_was_calc = false;
-  int  points_count   = 0;
-
-  vw::TerminalProgressCallback tpc("asp", "\t--> ");
-  double inc_amount = 1.0 / double(pix_box.width() );
-  if (verbose)
-    tpc.report_progress(0);
-
-  for (int i = pix_box.min().x(); i < pix_box.max().x(); i++ ) {
-
-    for (int j = pix_box.min().y(); j < pix_box.max().y(); j++ ) {
-      if (points_count >= num_points_to_load)
-        break;
-
-      double r = (double)std::rand()/(double)RAND_MAX;
-      if (r > load_ratio)
-        continue;
-
-      if ( dem(i, j) == nodata || std::isnan(dem(i, j)) || std::isinf(dem(i, j)) )
-        continue;
-      
-      vw::Vector2 lonlat = dem_geo.pixel_to_lonlat( vw::Vector2(i,j) );
-
-      // Skip points outside the given box
-      if (!lonlat_box.empty() && !lonlat_box.contains(lonlat))
-        continue;
-
-      vw::Vector3 llh( lonlat.x(), lonlat.y(), dem(i,j) );
-      vw::Vector3 xyz = dem_geo.datum().geodetic_to_cartesian( llh );
-      if ( xyz == vw::Vector3() || !(xyz == xyz) )
-        continue; // invalid and NaN check
-
-      if (calc_shift && !shift_was_calc){
-        shift = xyz;
-        shift_was_calc = true;
-      }
-
-      for (int row = 0; row < DIM; row++)
-        data(row, points_count) = xyz[row] - shift[row];
-      data(DIM, points_count) = 1; // Extend to be a homogenous coordinate
-
-      points_count++;
-    } // end y loop
-
-    if (verbose)
-      tpc.report_incremental_progress( inc_amount );
-  } // end x loop
-  if (verbose)
-    tpc.report_finished();
-
-  data.conservativeResize(Eigen::NoChange, points_count);
-
+  DemBlockSampler<DemPixelType> sampler(dem, dem_geo, nodata, lonlat_box);
+  sample_blocks(sampler, sampling_blocks(file_name, pix_box), num_points_to_load,
+                load_ratio, calc_shift, shift, verbose, data);
 }
 
 // Load a DEM
@@ -503,60 +659,15 @@ vw::int64 load_pc_aux(std::string const& file_name,
 		      vw::cartography::GeoReference const& geo,
 		      bool verbose, DoubleMatrix & data){
 
-  data.conservativeResize(DIM+1, num_points_to_load);
-
-  // To do: Is it faster to to do for_each?
   vw::ImageViewRef<vw::Vector3> point_cloud = read_asp_point_cloud<DIM>(file_name);
 
   // We will randomly pick or not a point with probability load_ratio
   vw::int64 num_total_points = point_cloud.cols()*point_cloud.rows();
   double load_ratio = (double)num_points_to_load/std::max(1.0, (double)num_total_points);
 
-  bool shift_was_calc = false;
-  vw::int64 points_count = 0;
-
-  vw::TerminalProgressCallback tpc("asp", "\t--> ");
-  double inc_amount = 1.0 / double(point_cloud.rows() );
-  if (verbose) tpc.report_progress(0);
-
-  for (int j = 0; j < point_cloud.rows(); j++ ) {
-
-    for ( int i = 0; i < point_cloud.cols(); i++ ) {
-
-      if (points_count >= num_points_to_load)
-        break;
-
-      double r = (double)std::rand()/(double)RAND_MAX;
-      if (r > load_ratio)
-        continue;
-
-      vw::Vector3 xyz = point_cloud(i, j);
-      if ( xyz == vw::Vector3() || !(xyz == xyz) )
-        continue; // invalid and NaN check
-
-      if (calc_shift && !shift_was_calc){
-        shift = xyz;
-        shift_was_calc = true;
-      }
-
-      // Skip points outside the given box
-      if (!lonlat_box.empty()){
-        vw::Vector3 llh = geo.datum().cartesian_to_geodetic(xyz);
-        if ( !lonlat_box.contains(subvector(llh, 0, 2)))
-          continue;
-      }
-
-      for (int row = 0; row < DIM; row++)
-        data(row, points_count) = xyz[row] - shift[row];
-      data(DIM, points_count) = 1;
-
-      points_count++;
-    }
-    if (verbose) tpc.report_incremental_progress( inc_amount );
-  }
-  if (verbose) tpc.report_finished();
-
-  data.conservativeResize(Eigen::NoChange, points_count);
+  PcBlockSampler sampler(point_cloud, geo, lonlat_box);
+  sample_blocks(sampler, sampling_blocks(file_name, bounding_box(point_cloud)),
+                num_points_to_load, load_ratio, calc_shift, shift, verbose, data);
 
   return num_total_points;
 }
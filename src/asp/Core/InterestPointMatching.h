@@ -204,6 +204,13 @@ namespace asp {
                               vw::ip::InterestPointList& ip_list,
                               int    radius = 1 );
 
+  /// Warn if a homography fit has few inliers or a suspicious scale,
+  /// as then the images may be too different for stereo to succeed.
+  void check_homography_matrix(vw::Matrix<double>       const& H,
+                               std::vector<vw::Vector3> const& left_points,
+                               std::vector<vw::Vector3> const& right_points,
+                               std::vector<size_t>      const& indices);
+
   /// Find a rough homography that maps right to left using the camera
   /// and datum information.
   /// - This intersects rays with the datum, then projects them into the other camera.
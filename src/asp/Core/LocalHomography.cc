@@ -24,10 +24,16 @@
 #include <vw/Core/ThreadPool.h>
 #include <vw/FileIO/DiskImageView.h>
 #include <vw/Stereo/DisparityMap.h>
+#include <vw/Math/Geometry.h>
 #include <asp/Core/LocalHomography.h>
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/InterestPointMatching.h>
 
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+
+#include <algorithm>
+
 using namespace vw;
 
 namespace asp {
@@ -54,11 +60,92 @@ namespace asp {
 
   }
 
+  /// Fit a homography mapping the right points to the left ones with
+  /// RANSAC. This is the same as what homography_rectification() does,
+  /// but the random samples are drawn from the given generator rather
+  /// than from the global rand(), so that many fits can run in parallel
+  /// with reproducible results. Returns false if not enough inliers
+  /// were found.
+  static bool seeded_homography_fit(std::vector<Vector3> const& right_points,
+                                    std::vector<Vector3> const& left_points,
+                                    double inlier_threshold, size_t min_num_inliers,
+                                    int num_iterations, boost::random::mt19937 & generator,
+                                    Matrix<double> & H){
+
+    math::HomographyFittingFunctor fitting_func;
+    const size_t num_points  = right_points.size();
+    const size_t sample_size = 4;
+    if (num_points < sample_size || num_points < min_num_inliers)
+      return false;
+
+    boost::random::uniform_int_distribution<size_t> dist(0, num_points - 1);
+
+    std::vector<size_t> best_inliers;
+    Matrix<double> best_H;
+    for (int iter = 0; iter < num_iterations; iter++){
+
+      // Pick distinct random points
+      std::vector<size_t> sample;
+      while (sample.size() < sample_size){
+        size_t index = dist(generator);
+        if (std::find(sample.begin(), sample.end(), index) == sample.end())
+          sample.push_back(index);
+      }
+      std::vector<Vector3> right_sample, left_sample;
+      for (size_t it = 0; it < sample_size; it++){
+        right_sample.push_back(right_points[sample[it]]);
+        left_sample.push_back (left_points [sample[it]]);
+      }
+
+      Matrix<double> curr_H;
+      try {
+        curr_H = fitting_func(right_sample, left_sample);
+      } catch ( const vw::Exception& e ){
+        continue; // degenerate sample
+      }
+
+      std::vector<size_t> inliers;
+      for (size_t it = 0; it < num_points; it++){
+        Vector3 p = curr_H*right_points[it];
+        if (p.z() == 0)
+          continue;
+        p /= p.z();
+        if (norm_2(subvector(p, 0, 2) - subvector(left_points[it], 0, 2)) < inlier_threshold)
+          inliers.push_back(it);
+      }
+      if (inliers.size() > best_inliers.size()){
+        best_inliers = inliers;
+        best_H       = curr_H;
+      }
+    }
+
+    if (best_inliers.size() < min_num_inliers || best_inliers.size() < sample_size)
+      return false;
+    check_homography_matrix(best_H, left_points, right_points, best_inliers);
+
+    // Refit to the inliers, then refine using all points as
+    // homography_rectification() does.
+    std::vector<Vector3> right_inliers, left_inliers;
+    for (size_t it = 0; it < best_inliers.size(); it++){
+      right_inliers.push_back(right_points[best_inliers[it]]);
+      left_inliers.push_back (left_points [best_inliers[it]]);
+    }
+    try {
+      H = fitting_func(right_inliers, left_inliers, best_H);
+      H = fitting_func(right_points, left_points, H);
+    } catch ( const vw::Exception& e ){
+      return false;
+    }
+
+    return true;
+  }
+
   /// Given a disparity map restricted to a subregion, find the homography
   /// transform which aligns best the two images based on this disparity.
   template<class SeedDispT>
   vw::math::Matrix<double> homography_for_disparity(vw::BBox2i subregion,
                                                     SeedDispT const& disparity,
+                                                    boost::random::mt19937 & generator,
                                                     bool & success){
     success = true;
 
@@ -75,7 +162,7 @@ namespace asp {
     split_n_into_k(disparity.cols(), std::min(disparity.cols(), N), partitionx);
     split_n_into_k(disparity.rows(), std::min(disparity.rows(), N), partitiony);
 
-    std::vector<vw::ip::InterestPoint> left_ip, right_ip;
+    std::vector<Vector3> left_points, right_points;
     for (int ix = 0; ix < (int)partitionx.size()-1; ix++){
       for (int iy = 0; iy < (int)partitiony.size()-1; iy++){
 
@@ -94,58 +181,81 @@ namespace asp {
         if (count == 0) continue; // no valid points
 
         // Do the averaging. We must add the box corner to the left and
-        // right interest points.
-        vw::ip::InterestPoint l, r;
-        l.x = subregion.min().x() + lx/count; r.x = subregion.min().x() + rx/count;
-        l.y = subregion.min().y() + ly/count; r.y = subregion.min().y() + ry/count;
-        left_ip.push_back(l);
-        right_ip.push_back(r);
+        // right points.
+        left_points.push_back (Vector3(subregion.min().x() + lx/count,
+                                       subregion.min().y() + ly/count, 1));
+        right_points.push_back(Vector3(subregion.min().x() + rx/count,
+                                       subregion.min().y() + ry/count, 1));
       }
     }
 
-    try {
-      Matrix<double> left_matrix, right_matrix;
-      BBox2i image_size = bounding_box(disparity);
-      bool adjust_left_image_size = true;
-      homography_rectification( adjust_left_image_size,
-                                image_size.size(), image_size.size(),
-                                left_ip, right_ip, left_matrix, right_matrix );
-      // Undoing the shift in origin.
-      right_matrix(0,2) -= left_matrix(0,2);
-      right_matrix(1,2) -= left_matrix(1,2);
-      return right_matrix;
-    }
-    catch ( const vw::ArgumentErr& e ){}
-    catch ( const vw::math::RANSACErr& e ){}
-    success = false;
-    return vw::math::identity_matrix<3>();
+    // Same settings as in homography_rectification()
+    double thresh_factor = stereo_settings().ip_inlier_factor;
+    BBox2i image_size = bounding_box(disparity);
+    double inlier_threshold = norm_2(Vector2(image_size.width(), image_size.height()))
+      * (1.5*thresh_factor);
+    size_t min_num_inliers = left_points.size()*2/3;
+    int num_iterations = 100;
+
+    Matrix<double> H;
+    success = seeded_homography_fit(right_points, left_points, inlier_threshold,
+                                    min_num_inliers, num_iterations, generator, H);
+    if (!success)
+      return vw::math::identity_matrix<3>();
+
+    return H;
   }
 
-  // Task that computes local homography in a given tile
+  // Task that computes local homography in a given tile. Each task
+  // has its own random stream, seeded by the tile index, so the result
+  // does not depend on the number of threads or the order in which
+  // the tasks are run.
   class LocalHomTask: public vw::Task, private boost::noncopyable {
 
     int m_col, m_row;
-    BBox2i m_sub_bbox;
-    // We on purpose store a local deep copy of sub_disparity_crop to
-    // avoid segfault.
-    ImageView < PixelMask<Vector2i> > m_sub_disparity_crop;
+    BBox2i m_bbox;
+    Vector2 m_upscale_factor;
+    // The low-res disparity is shared among all tasks, so each
+    // of them does not need to read it from disk.
+    ImageView< PixelMask<Vector2f> > const& m_sub_disparity;
     ImageView<Matrix3x3> & m_local_hom;
   public:
-    LocalHomTask(int col, int row,
-                 BBox2i sub_bbox,
-                 ImageViewRef < PixelMask<Vector2i> > const& sub_disparity_crop,
+    LocalHomTask(int col, int row, BBox2i bbox, Vector2 upscale_factor,
+                 ImageView< PixelMask<Vector2f> > const& sub_disparity,
                  ImageView<Matrix3x3> & local_hom):
-      m_col(col), m_row(row), m_sub_bbox(sub_bbox),
-      m_sub_disparity_crop(sub_disparity_crop),
-      m_local_hom(local_hom){}
+      m_col(col), m_row(row), m_bbox(bbox), m_upscale_factor(upscale_factor),
+      m_sub_disparity(sub_disparity), m_local_hom(local_hom){}
 
     void operator()() {
-      bool success;
-      // To do: If this function is ever used, the variable 'success'
-      // needs to be treated properly.
-      exit(1); // broken, for now
-      m_local_hom(m_col, m_row)
-        = homography_for_disparity(m_sub_bbox, m_sub_disparity_crop, success);
+
+      boost::random::mt19937 generator(m_col*m_local_hom.rows() + m_row + 1);
+
+      // The low-res version of bbox
+      BBox2i sub_bbox( elem_quot(m_bbox.min(), m_upscale_factor),
+                       elem_quot(m_bbox.max(), m_upscale_factor) );
+
+      // Expand the box until square to make sure the local
+      // homography calculation does not fail. If that does not
+      // help, keep on expanding the box.
+      bool success = false;
+      int len = std::max(sub_bbox.width(), sub_bbox.height());
+      sub_bbox = BBox2i(sub_bbox.max() - Vector2(len, len), sub_bbox.max());
+      sub_bbox.expand(1);
+      Matrix3x3 H;
+      while(1){
+        sub_bbox.crop( bounding_box(m_sub_disparity) );
+        H = homography_for_disparity(sub_bbox, crop(m_sub_disparity, sub_bbox),
+                                     generator, success);
+        if (success) break;
+        vw_out() << "\t--> Failed to find local disparity in box: " << m_bbox  << std::endl;
+        vw_out() << "\t--> Trying again by increasing the local region."  << std::endl;
+        if (sub_bbox == bounding_box(m_sub_disparity)) break; // can't expand more
+        len = std::max(sub_bbox.width(), sub_bbox.height());
+        sub_bbox.expand(len);
+      }
+
+      // Each task writes to its own location, no locking is needed
+      m_local_hom(m_col, m_row) = H;
     }
   };
 
@@ -154,8 +264,11 @@ namespace asp {
 
     DiskImageView< PixelGray<float> > left_sub (opt.out_prefix + "-L_sub.tif");
     DiskImageView< PixelGray<float> > left_img (opt.out_prefix + "-L.tif");
-    DiskImageView< PixelMask<Vector2f> >
-      sub_disparity(opt.out_prefix + "-D_sub.tif");
+
+    // The low-res disparity is small, read it fully in memory once
+    // instead of having each tile read the parts it needs.
+    ImageView< PixelMask<Vector2f> >
+      sub_disparity = DiskImageView< PixelMask<Vector2f> >(opt.out_prefix + "-D_sub.tif");
 
     Vector2 upscale_factor( double(left_img.cols()) / double(left_sub.cols()),
                             double(left_img.rows()) / double(left_sub.rows()) );
@@ -165,56 +278,23 @@ namespace asp {
     int rows = (int)ceil(left_img.rows()/double(ts));
     ImageView<Matrix3x3> local_hom(cols, rows);
 
-    // Calculate the local homographies using multiple threads.
-    // To do: Each thread calls RANSAC, which calls rand(), which
-    // is not thread safe. So for now use just one thread.
-
+    // Calculate the local homographies using multiple threads
     Stopwatch sw;
     sw.start();
 
-    //FifoWorkQueue queue( vw_settings().default_num_threads() );
+    FifoWorkQueue queue( vw_settings().default_num_threads() );
     for (int col = 0; col < cols; col++){
       for (int row = 0; row < rows; row++){
 
         BBox2i bbox(col*ts, row*ts, ts, ts);
         bbox.crop(bounding_box(left_img));
 
-        // The low-res version of bbox
-        BBox2i sub_bbox( elem_quot(bbox.min(), upscale_factor),
-                          elem_quot(bbox.max(), upscale_factor) );
-
-        // Expand the box until square to make sure the local
-        // homography calculation does not fail. If that does not
-        // help, keep on expanding the box.
-        bool success = false;
-        int len = std::max(sub_bbox.width(), sub_bbox.height());
-        sub_bbox = BBox2i(sub_bbox.max() - Vector2(len, len), sub_bbox.max());
-        sub_bbox.expand(1);
-        while(1){
-
-          // This code enables multi-threading. It gives different answers each time,
-          // as multiple threads pull random numbers from the same stream.
-          // This code must be kept disabled until Boost's random function is used
-          // with one random stream for each thread.
-          //boost::shared_ptr<LocalHomTask>
-          //task(new LocalHomTask(col, row, sub_bbox, crop(sub_disparity, sub_bbox),
-          //                        local_hom));
-          //queue.add_task(task);
-
-          sub_bbox.crop( bounding_box(sub_disparity) );
-          local_hom(col, row)
-            = homography_for_disparity(sub_bbox, crop(sub_disparity, sub_bbox), success);
-          if (success) break;
-          vw_out() << "\t--> Failed to find local disparity in box: " << bbox  << std::endl;
-          vw_out() << "\t--> Trying again by increasing the local region."  << std::endl;
-          if (sub_bbox == bounding_box(sub_disparity)) break; // can't expand more
-          len = std::max(sub_bbox.width(), sub_bbox.height());
-          sub_bbox.expand(len);
-        }
-
+        boost::shared_ptr<LocalHomTask>
+          task(new LocalHomTask(col, row, bbox, upscale_factor, sub_disparity, local_hom));
+        queue.add_task(task);
       }
     }
-    //queue.join_all();
+    queue.join_all();
 
     sw.stop();
     vw_out(DebugMessage,"asp") << "Local homographies elapsed time: "
@@ -0,0 +1,204 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Log.h>
+#include <asp/Core/MappedImage.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <map>
+
+using namespace vw;
+
+namespace {
+
+  // TIFF tags
+  enum { TAG_IMAGE_WIDTH = 256, TAG_IMAGE_LENGTH = 257, TAG_BITS_PER_SAMPLE = 258,
+         TAG_COMPRESSION = 259, TAG_SAMPLES_PER_PIXEL = 277, TAG_PLANAR_CONFIG = 284,
+         TAG_TILE_WIDTH = 322, TAG_TILE_LENGTH = 323, TAG_TILE_OFFSETS = 324,
+         TAG_TILE_BYTE_COUNTS = 325, TAG_SAMPLE_FORMAT = 339 };
+
+  // TIFF field types we need, and their sizes
+  enum { TYPE_SHORT = 3, TYPE_LONG = 4, TYPE_LONG8 = 16 };
+
+  bool host_is_little_endian() {
+    boost::uint16_t val = 1;
+    return *(const unsigned char*)&val == 1;
+  }
+
+  // Read a little-endian integer of given size at the given offset,
+  // failing if outside the data.
+  bool read_uint(const char * data, size_t size, boost::uint64_t offset, int num_bytes,
+                 boost::uint64_t & val) {
+    if (offset + num_bytes > size)
+      return false;
+    val = 0;
+    for (int b = num_bytes - 1; b >= 0; b--)
+      val = (val << 8) | (unsigned char)data[offset + b];
+    return true;
+  }
+
+  int type_size(boost::uint64_t type) {
+    if (type == TYPE_SHORT) return 2;
+    if (type == TYPE_LONG)  return 4;
+    if (type == TYPE_LONG8) return 8;
+    return 0;
+  }
+
+} // end anonymous namespace
+
+namespace asp {
+
+  MappedFile::MappedFile(std::string const& file): m_data(NULL), m_size(0) {
+    int fd = open(file.c_str(), O_RDONLY);
+    if (fd < 0)
+      vw_throw(IOErr() << "Cannot open: " << file << "\n");
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+      close(fd);
+      vw_throw(IOErr() << "Cannot find the size of: " << file << "\n");
+    }
+    m_size = st.st_size;
+    void * addr = mmap(NULL, m_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the map stays valid
+    if (addr == MAP_FAILED)
+      vw_throw(IOErr() << "Cannot memory-map: " << file << "\n");
+    m_data = (const char*)addr;
+  }
+
+  MappedFile::~MappedFile() {
+    if (m_data != NULL)
+      munmap((void*)m_data, m_size);
+  }
+
+  bool parse_mapped_tiff_layout(const char * data, size_t size, MappedTiffLayout & layout) {
+
+    if (!host_is_little_endian() || size < 16 || data[0] != 'I' || data[1] != 'I')
+      return false;
+
+    // Classic TIFF has 32-bit offsets, BigTIFF 64-bit ones
+    boost::uint64_t version = 0, ifd_offset = 0, num_entries = 0;
+    read_uint(data, size, 2, 2, version);
+    bool big = (version == 43);
+    if (!big && version != 42)
+      return false;
+    int offset_size = big ? 8 : 4, count_size = big ? 8 : 2, entry_size = big ? 20 : 12;
+    if (!read_uint(data, size, big ? 8 : 4, offset_size, ifd_offset) ||
+        !read_uint(data, size, ifd_offset, count_size, num_entries))
+      return false;
+
+    // The values of the tags we need. Values which do not fit in the
+    // entry are stored at an offset.
+    std::map<int, std::vector<boost::uint64_t> > tags;
+    for (boost::uint64_t e = 0; e < num_entries; e++) {
+      boost::uint64_t entry = ifd_offset + count_size + e*entry_size;
+      boost::uint64_t tag = 0, type = 0, count = 0;
+      if (!read_uint(data, size, entry,     2, tag)  ||
+          !read_uint(data, size, entry + 2, 2, type) ||
+          !read_uint(data, size, entry + 4, offset_size, count))
+        return false;
+      int tsize = type_size(type);
+      if (tsize == 0 || count == 0 || count > size/tsize)
+        continue; // not a tag we use
+      boost::uint64_t values_offset = entry + 4 + offset_size;
+      if (count*tsize > (boost::uint64_t)offset_size &&
+          !read_uint(data, size, values_offset, offset_size, values_offset))
+        return false;
+      std::vector<boost::uint64_t> & values = tags[(int)tag];
+      values.resize(count);
+      for (boost::uint64_t v = 0; v < count; v++)
+        if (!read_uint(data, size, values_offset + v*tsize, tsize, values[v]))
+          return false;
+    }
+
+    // Defaults as in the TIFF specification
+    if (tags[TAG_COMPRESSION].empty())   tags[TAG_COMPRESSION].push_back(1);
+    if (tags[TAG_PLANAR_CONFIG].empty()) tags[TAG_PLANAR_CONFIG].push_back(1);
+    if (tags[TAG_SAMPLE_FORMAT].empty()) tags[TAG_SAMPLE_FORMAT].push_back(TIFF_SAMPLE_UINT);
+    if (tags[TAG_SAMPLES_PER_PIXEL].empty()) tags[TAG_SAMPLES_PER_PIXEL].push_back(1);
+
+    int needed[] = {TAG_IMAGE_WIDTH, TAG_IMAGE_LENGTH, TAG_BITS_PER_SAMPLE,
+                    TAG_TILE_WIDTH, TAG_TILE_LENGTH, TAG_TILE_OFFSETS, TAG_TILE_BYTE_COUNTS};
+    for (size_t t = 0; t < sizeof(needed)/sizeof(int); t++)
+      if (tags[needed[t]].empty())
+        return false; // not tiled
+
+    layout.num_channels = tags[TAG_SAMPLES_PER_PIXEL][0];
+    if (tags[TAG_COMPRESSION][0] != 1 ||
+        (layout.num_channels > 1 && tags[TAG_PLANAR_CONFIG][0] != 1))
+      return false;
+
+    // All channels must have the same type
+    std::vector<boost::uint64_t> const& bits    = tags[TAG_BITS_PER_SAMPLE];
+    std::vector<boost::uint64_t> const& formats = tags[TAG_SAMPLE_FORMAT];
+    for (size_t c = 1; c < bits.size(); c++)
+      if (bits[c] != bits[0]) return false;
+    for (size_t c = 1; c < formats.size(); c++)
+      if (formats[c] != formats[0]) return false;
+    if (bits[0] % 8 != 0)
+      return false;
+
+    layout.cols            = tags[TAG_IMAGE_WIDTH][0];
+    layout.rows            = tags[TAG_IMAGE_LENGTH][0];
+    layout.tile_cols       = tags[TAG_TILE_WIDTH][0];
+    layout.tile_rows       = tags[TAG_TILE_LENGTH][0];
+    layout.bits_per_sample = bits[0];
+    layout.sample_format   = formats[0];
+    if (layout.cols <= 0 || layout.rows <= 0 || layout.tile_cols <= 0 || layout.tile_rows <= 0)
+      return false;
+
+    // Every tile must be present and fully inside the file
+    boost::uint64_t num_tiles
+      = boost::uint64_t((layout.cols + layout.tile_cols - 1)/layout.tile_cols)
+      * ((layout.rows + layout.tile_rows - 1)/layout.tile_rows);
+    boost::uint64_t tile_bytes = boost::uint64_t(layout.tile_cols)*layout.tile_rows
+      * layout.num_channels*(layout.bits_per_sample/8);
+    std::vector<boost::uint64_t> const& offsets = tags[TAG_TILE_OFFSETS];
+    std::vector<boost::uint64_t> const& counts  = tags[TAG_TILE_BYTE_COUNTS];
+    if (offsets.size() != num_tiles || counts.size() != num_tiles)
+      return false;
+    for (size_t t = 0; t < num_tiles; t++)
+      if (offsets[t] == 0 || counts[t] != tile_bytes || offsets[t] + tile_bytes > size)
+        return false;
+    layout.tile_offsets = offsets;
+
+    return true;
+  }
+
+  bool map_tiled_tiff(std::string const& file, boost::shared_ptr<MappedFile> & mapped,
+                      MappedTiffLayout & layout) {
+    try {
+      mapped.reset(new MappedFile(file));
+    } catch (IOErr const& e) {
+      VW_OUT(DebugMessage, "asp") << e.what();
+      mapped.reset();
+      return false;
+    }
+    if (!parse_mapped_tiff_layout(mapped->data(), mapped->size(), layout)) {
+      VW_OUT(DebugMessage, "asp") << "Reading with GDAL: " << file << "\n";
+      mapped.reset();
+      return false;
+    }
+    VW_OUT(DebugMessage, "asp") << "Reading via a memory map: " << file << "\n";
+    return true;
+  }
+
+} // end namespace asp
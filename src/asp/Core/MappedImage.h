@@ -0,0 +1,159 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file MappedImage.h
+///
+/// Read the intermediate images of stereo, such as L.tif, D.tif, and
+/// F.tif, through a read-only memory map, when they are uncompressed
+/// tiled GeoTIFF files (as written with --tif-compress None). The
+/// pixels are then read straight from the page cache, which is shared
+/// by all threads and processes, with no GDAL block cache copies or
+/// locking. Other files are read through GDAL as usual.
+
+#ifndef __ASP_CORE_MAPPED_IMAGE_H__
+#define __ASP_CORE_MAPPED_IMAGE_H__
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/CompoundTypes.h>
+#include <vw/Math/BBox.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelTypeInfo.h>
+#include <vw/FileIO/DiskImageView.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/type_traits/is_floating_point.hpp>
+#include <boost/type_traits/is_signed.hpp>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  /// A file mapped read-only into memory
+  class MappedFile: private boost::noncopyable {
+  public:
+    /// Throws if the file cannot be mapped
+    MappedFile(std::string const& file);
+    ~MappedFile();
+    const char * data() const { return m_data; }
+    size_t size() const { return m_size; }
+  private:
+    const char * m_data;
+    size_t       m_size;
+  };
+
+  /// Values of the TIFF SampleFormat tag
+  enum TiffSampleFormat { TIFF_SAMPLE_UINT = 1, TIFF_SAMPLE_INT = 2, TIFF_SAMPLE_FLOAT = 3 };
+
+  /// Where the tiles of an uncompressed, tiled, pixel-interleaved TIFF are
+  struct MappedTiffLayout {
+    int cols, rows, tile_cols, tile_rows, num_channels, bits_per_sample, sample_format;
+    std::vector<boost::uint64_t> tile_offsets; // row-major order of the tiles
+  };
+
+  /// Parse the first image of a TIFF or BigTIFF file. Return false
+  /// unless it is little-endian (as the host must be), tiled,
+  /// uncompressed, pixel-interleaved, and has all its tiles present.
+  bool parse_mapped_tiff_layout(const char * data, size_t size, MappedTiffLayout & layout);
+
+  /// If the file can be read through a memory map, map it, and return
+  /// true. The file name is printed in debug messages either way.
+  bool map_tiled_tiff(std::string const& file, boost::shared_ptr<MappedFile> & mapped,
+                      MappedTiffLayout & layout);
+
+  /// If the pixels in the file are stored exactly as PixelT is in memory
+  template <class PixelT>
+  bool layout_matches_pixel(MappedTiffLayout const& layout) {
+    typedef typename vw::CompoundChannelType<PixelT>::type channel_type;
+    const int num_channels = vw::CompoundNumChannels<PixelT>::value;
+    int sample_format = TIFF_SAMPLE_UINT;
+    if (boost::is_floating_point<channel_type>::value)
+      sample_format = TIFF_SAMPLE_FLOAT;
+    else if (boost::is_signed<channel_type>::value)
+      sample_format = TIFF_SAMPLE_INT;
+    return sizeof(PixelT)          == num_channels*sizeof(channel_type) &&
+           layout.num_channels     == num_channels                      &&
+           layout.bits_per_sample  == int(8*sizeof(channel_type))       &&
+           layout.sample_format    == sample_format;
+  }
+
+  /// An image whose pixels are read from a memory-mapped TIFF. Copies
+  /// share the same map.
+  template <class PixelT>
+  class MappedImageView: public vw::ImageViewBase<MappedImageView<PixelT> > {
+    boost::shared_ptr<MappedFile> m_file;
+    MappedTiffLayout m_layout;
+    int m_tiles_across;
+  public:
+    typedef PixelT pixel_type;
+    typedef PixelT result_type;
+    typedef vw::ProceduralPixelAccessor<MappedImageView> pixel_accessor;
+
+    MappedImageView(boost::shared_ptr<MappedFile> const& file, MappedTiffLayout const& layout):
+      m_file(file), m_layout(layout),
+      m_tiles_across((layout.cols + layout.tile_cols - 1)/layout.tile_cols){
+      VW_ASSERT(layout_matches_pixel<PixelT>(layout),
+                vw::ArgumentErr() << "MappedImageView: Wrong pixel type for the file.\n");
+    }
+
+    inline vw::int32 cols  () const { return m_layout.cols; }
+    inline vw::int32 rows  () const { return m_layout.rows; }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+    inline result_type operator()( vw::int32 i, vw::int32 j, vw::int32 /*p*/ = 0 ) const {
+      int tile_col = i / m_layout.tile_cols, tile_row = j / m_layout.tile_rows;
+      boost::uint64_t offset = m_layout.tile_offsets[tile_row*m_tiles_across + tile_col]
+        + (boost::uint64_t(j - tile_row*m_layout.tile_rows)*m_layout.tile_cols
+           + (i - tile_col*m_layout.tile_cols))*sizeof(PixelT);
+      // The tiles need not be aligned, so copy rather than cast
+      PixelT pix;
+      std::memcpy(&pix, m_file->data() + offset, sizeof(PixelT));
+      return pix;
+    }
+
+    /// The pixels are already in memory, so there is nothing to prepare.
+    typedef MappedImageView prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& /*bbox*/) const { return *this; }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  /// Open an intermediate image written by ASP. It is memory-mapped
+  /// if it is an uncompressed tiled GeoTIFF with pixels laid out as
+  /// PixelT, and otherwise read with DiskImageView.
+  template <class PixelT>
+  vw::ImageViewRef<PixelT> open_intermediate(std::string const& file) {
+    boost::shared_ptr<MappedFile> mapped;
+    MappedTiffLayout layout;
+    if (map_tiled_tiff(file, mapped, layout) && layout_matches_pixel<PixelT>(layout))
+      return MappedImageView<PixelT>(mapped, layout);
+    return vw::DiskImageView<PixelT>(file);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_MAPPED_IMAGE_H__
@@ -0,0 +1,79 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/FileIO/DiskImageResource.h>
+#include <vw/FileIO/DiskImageResourceGDAL.h>
+#include <asp/Core/NormalizedImage.h>
+#include <asp/Core/MappedImage.h>
+
+#include <boost/shared_ptr.hpp>
+
+using namespace vw;
+
+namespace {
+
+  struct DecodeNormalizedFunc: public ReturnFixedType< PixelGray<float> > {
+    asp::NormalizedImageScale m_scale;
+    DecodeNormalizedFunc(asp::NormalizedImageScale const& scale): m_scale(scale){}
+    PixelGray<float> operator()(PixelGray<uint16> const& pix) const {
+      return m_scale.decode(pix.v());
+    }
+  };
+
+} // end anonymous namespace
+
+namespace asp {
+
+  const std::string NORMALIZED_SCALE_KEY = "ASP_NORMALIZED_SCALE";
+
+  bool read_normalized_scale(std::string const& file, NormalizedImageScale & scale) {
+    boost::shared_ptr<DiskImageResource> rsrc(DiskImageResourcePtr(file));
+    if (rsrc->channel_type() != VW_CHANNEL_UINT16)
+      return false;
+    std::string scale_str;
+    if (!vw::cartography::read_header_string(*rsrc.get(), NORMALIZED_SCALE_KEY, scale_str))
+      return false;
+    std::istringstream is(scale_str);
+    NormalizedImageScale val;
+    if (!(is >> val.min_val >> val.max_val >> val.nodata) || val.max_val <= val.min_val)
+      vw_throw(ArgumentErr() << "Invalid " << NORMALIZED_SCALE_KEY << " in: " << file << "\n");
+    scale = val;
+    return true;
+  }
+
+  bool read_normalized_nodata(std::string const& file, float & nodata) {
+    boost::shared_ptr<DiskImageResource> rsrc(DiskImageResourcePtr(file));
+    if (!rsrc->has_nodata_read())
+      return false;
+    NormalizedImageScale scale;
+    if (read_normalized_scale(file, scale))
+      nodata = scale.nodata;
+    else
+      nodata = rsrc->nodata_read();
+    return true;
+  }
+
+  ImageViewRef< PixelGray<float> > open_normalized_image(std::string const& file) {
+    NormalizedImageScale scale;
+    if (read_normalized_scale(file, scale))
+      return per_pixel_filter(open_intermediate< PixelGray<uint16> >(file),
+                              DecodeNormalizedFunc(scale));
+    return open_intermediate< PixelGray<float> >(file);
+  }
+
+} // end namespace asp
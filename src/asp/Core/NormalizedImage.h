@@ -0,0 +1,132 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file NormalizedImage.h
+///
+/// Write and read the normalized images L.tif and R.tif made by
+/// stereo_pprc. These are float, or, to halve their size and the I/O
+/// of the later stages, 16-bit integers scaled to a range a little
+/// wider than [0, 1], the range the images are normalized to. The
+/// value 0 then stands for no-data. The scaling is kept in the header
+/// of the file, and the readers expand the pixels back to float.
+
+#ifndef __ASP_CORE_NORMALIZED_IMAGE_H__
+#define __ASP_CORE_NORMALIZED_IMAGE_H__
+
+#include <vw/Core/ProgressCallback.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/PixelTypes.h>
+#include <vw/Image/PerPixelViews.h>
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+
+#include <limits>
+#include <map>
+#include <sstream>
+#include <string>
+
+namespace asp {
+
+  /// How a normalized image is stored as 16-bit integers. Values in
+  /// [min_val, max_val] are mapped to [1, 65535], and values outside
+  /// are clamped. The pixels with the value 0 are expanded to nodata.
+  struct NormalizedImageScale {
+    double min_val, max_val, nodata;
+    NormalizedImageScale(): min_val(-1.0), max_val(2.0), nodata(-32768.0){}
+
+    double step() const { return (max_val - min_val)/65534.0; }
+
+    vw::uint16 encode(double val) const {
+      if (val <= nodata)
+        return 0;
+      double q = (val - min_val)/step() + 1.0;
+      if (q < 1.0)     q = 1.0;
+      if (q > 65535.0) q = 65535.0;
+      return vw::uint16(q + 0.5);
+    }
+
+    float decode(vw::uint16 q) const {
+      if (q == 0)
+        return nodata;
+      return min_val + (q - 1)*step();
+    }
+  };
+
+  /// The header keyword with the scale of a 16-bit normalized image
+  extern const std::string NORMALIZED_SCALE_KEY;
+
+  /// Read the scale of a normalized image. Return false if it is not
+  /// stored as 16-bit integers.
+  bool read_normalized_scale(std::string const& file, NormalizedImageScale & scale);
+
+  /// The no-data value of a normalized image, as open_normalized_image() returns it
+  bool read_normalized_nodata(std::string const& file, float & nodata);
+
+  /// Open a normalized image, expanding it to float if stored as
+  /// 16-bit integers. Uncompressed files are memory-mapped.
+  vw::ImageViewRef< vw::PixelGray<float> > open_normalized_image(std::string const& file);
+
+  template <class PixelT>
+  struct EncodeNormalizedFunc: public vw::ReturnFixedType< vw::PixelGray<vw::uint16> > {
+    NormalizedImageScale m_scale;
+    EncodeNormalizedFunc(NormalizedImageScale const& scale): m_scale(scale){}
+    vw::PixelGray<vw::uint16> operator()(PixelT const& pix) const {
+      return m_scale.encode(vw::compound_select_channel<float const&>(pix, 0));
+    }
+  };
+
+  /// Write a normalized image, with no-data pixels set to the given
+  /// value, as float, or as 16-bit integers if compact is true.
+  template <class ImageT>
+  void write_normalized_image(std::string const& filename,
+                              vw::ImageViewBase<ImageT> const& image,
+                              bool has_georef,
+                              vw::cartography::GeoReference const& georef,
+                              bool has_nodata, float nodata,
+                              vw::cartography::GdalWriteOptions const& opt,
+                              bool compact,
+                              vw::ProgressCallback const& progress_callback
+                              = vw::ProgressCallback::dummy_instance()) {
+    if (!compact) {
+      vw::cartography::block_write_gdal_image(filename, image.impl(), has_georef, georef,
+                                              has_nodata, nodata, opt, progress_callback);
+      return;
+    }
+
+    NormalizedImageScale scale;
+    if (has_nodata)
+      scale.nodata = nodata;
+    else
+      scale.nodata = -std::numeric_limits<float>::max(); // all values are valid
+    std::map<std::string, std::string> keywords;
+    std::ostringstream os;
+    os.precision(17);
+    os << scale.min_val << " " << scale.max_val << " " << scale.nodata;
+    keywords[NORMALIZED_SCALE_KEY] = os.str();
+
+    typedef typename ImageT::pixel_type pixel_type;
+    vw::cartography::block_write_gdal_image(filename,
+                                            per_pixel_filter(image.impl(),
+                                                             EncodeNormalizedFunc<pixel_type>(scale)),
+                                            has_georef, georef, has_nodata, 0, opt,
+                                            progress_callback, keywords);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_NORMALIZED_IMAGE_H__
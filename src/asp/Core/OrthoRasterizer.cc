@@ -78,15 +78,17 @@ namespace asp{
   }
 
   // Task to parallelize the generation of bounding boxes for each block.
+  // The block is read once and its bounding boxes are found in the
+  // coordinates of each of the indices being made.
   class SubBlockBoundaryTask : public Task, private boost::noncopyable {
     ImageViewRef<Vector3> m_view;
+    std::vector<PointTransform> const& m_transforms;
     int    m_sub_block_size;
     BBox2i m_image_bbox;
-    BBox3& m_global_bbox;
-    std::vector<BBoxPair>& m_point_image_boundaries;
+    std::vector<PointCloudIndex>& m_indices;
     ImageViewRef<double> const& m_error_image;
     double m_estim_max_error; // used for outlier removal based on percentage
-    std::vector<double> & m_errors_hist;
+    bool   m_remove_outliers_with_pct;
     double m_max_valid_triangulation_error; // used for outlier removal based on thresh
     Mutex& m_mutex;
     const ProgressCallback& m_progress;
@@ -117,99 +119,168 @@ namespace asp{
 
   public:
     SubBlockBoundaryTask( ImageViewRef<Vector3> const& view,
+			  std::vector<PointTransform> const& transforms,
 			  int sub_block_size,
 			  BBox2i const& image_bbox,
-			  BBox3       & global_bbox, 
-			  std::vector<BBoxPair>& boundaries,
+			  std::vector<PointCloudIndex>& indices,
 			  ImageViewRef<double> const& error_image, double estim_max_error,
-			  std::vector<double> & errors_hist,
+			  bool remove_outliers_with_pct,
 			  double max_valid_triangulation_error,
 			  Mutex& mutex, const ProgressCallback& progress, float inc_amt ) :
-      m_view(view.impl()), m_sub_block_size(sub_block_size),
-      m_image_bbox(image_bbox),
-      m_global_bbox(global_bbox), m_point_image_boundaries( boundaries ),
+      m_view(view.impl()), m_transforms(transforms), m_sub_block_size(sub_block_size),
+      m_image_bbox(image_bbox), m_indices(indices),
       m_error_image(error_image), m_estim_max_error(estim_max_error),
-      m_errors_hist(errors_hist), m_max_valid_triangulation_error(max_valid_triangulation_error),
+      m_remove_outliers_with_pct(remove_outliers_with_pct),
+      m_max_valid_triangulation_error(max_valid_triangulation_error),
       m_mutex( mutex ), m_progress( progress ), m_inc_amt( inc_amt ) {}
       
     void operator()() {
-      ImageView<Vector3 > local_image = crop( m_view, m_image_bbox );
+      ImageView<Vector3 > block_image = crop( m_view, m_image_bbox );
 
-      bool remove_outliers_with_pct = (!m_errors_hist.empty());
       ImageView<double> local_error;
-      if (remove_outliers_with_pct || m_max_valid_triangulation_error > 0.0)
+      if (m_remove_outliers_with_pct || m_max_valid_triangulation_error > 0.0)
         local_error = crop( m_error_image, m_image_bbox );
 
       // Further subdivide into boundaries so
       // that prerasterize will only query what it needs.
       std::vector<BBox2i> blocks = subdivide_bbox( m_image_bbox, m_sub_block_size, m_sub_block_size );
-      BBox3 local_union;
-      std::list<BBoxPair> solutions;
-      std::vector<double> local_hist(m_errors_hist.size(), 0);
-      for ( size_t i = 0; i < blocks.size(); i++ ) {
-      
-        BBox3 pts_bdbox;
-        ImageView<Vector3 > local_image2 = crop( local_image, blocks[i] - m_image_bbox.min() );
-        if (m_max_valid_triangulation_error <= 0){
-          GrowBBoxAccumulator accum;
-          for_each_pixel( local_image2, accum );
-          pts_bdbox = accum.bbox;
-        }else{
-          // Skip points with error > m_max_valid_triangulation_error
-          ImageView<double> local_error2 =
-            crop( local_error, blocks[i] - m_image_bbox.min() );
-          for (int col = 0; col < local_image2.cols(); col++){
-            for (int row = 0; row < local_image2.rows(); row++){
-              if (boost::math::isnan(local_image2(col, row).z())) continue;
-              if (local_error2(col, row) > m_max_valid_triangulation_error) continue;
-              pts_bdbox.grow(local_image2(col, row));
-            }
-          }
-	      }
-
-        if ( pts_bdbox.min().x() <= pts_bdbox.max().x() &&
-             pts_bdbox.min().y() <= pts_bdbox.max().y() ) {
-          // pts_bdbox has at least one point. A box of just one
-          // point is considered empty by VW. For that reason,
-          // grow this box to make it definitely non-empty.
-          // Note: for local_union, which will end up contributing
-          // to the global bounding box, we don't use the float_next
-          // gimmick, as we need the precise box.
-          local_union.grow( pts_bdbox );
-          pts_bdbox.max()[0] = boost::math::float_next(pts_bdbox.max()[0]);
-          pts_bdbox.max()[1] = boost::math::float_next(pts_bdbox.max()[1]);
-          solutions.push_back( std::make_pair( pts_bdbox, blocks[i] ) );
-        }
 
-        if (remove_outliers_with_pct){
+      // The errors do not depend on the coordinates of the points
+      int num_bins = m_indices[0].errors_hist.size();
+      std::vector<double> local_hist(num_bins, 0);
+      if (m_remove_outliers_with_pct){
+        for ( size_t i = 0; i < blocks.size(); i++ ) {
           ErrorHistAccumulator error_accum(local_hist, m_estim_max_error);
           for_each_pixel( crop( local_error, blocks[i] - m_image_bbox.min() ),
 		          error_accum );
-
         }
-
       }
 
-      // Append to the global list of boxes and expand the point
-      // cloud bounding box.
-      if ( local_union != BBox3() ) {
-        Mutex::Lock lock( m_mutex );
-        for ( std::list<BBoxPair>::const_iterator it = solutions.begin();
-              it != solutions.end(); it++ ) {
-          m_point_image_boundaries.push_back( *it );
+      for ( size_t k = 0; k < m_indices.size(); k++ ) {
+
+        ImageView<Vector3 > local_image;
+        if (m_transforms.empty())
+          local_image = block_image;
+        else
+          local_image = m_transforms[k](block_image);
+
+        BBox3 local_union;
+        std::list<BBoxPair> solutions;
+        for ( size_t i = 0; i < blocks.size(); i++ ) {
+      
+          BBox3 pts_bdbox;
+          ImageView<Vector3 > local_image2 = crop( local_image, blocks[i] - m_image_bbox.min() );
+          if (m_max_valid_triangulation_error <= 0){
+            GrowBBoxAccumulator accum;
+            for_each_pixel( local_image2, accum );
+            pts_bdbox = accum.bbox;
+          }else{
+            // Skip points with error > m_max_valid_triangulation_error
+            ImageView<double> local_error2 =
+              crop( local_error, blocks[i] - m_image_bbox.min() );
+            for (int col = 0; col < local_image2.cols(); col++){
+              for (int row = 0; row < local_image2.rows(); row++){
+                if (boost::math::isnan(local_image2(col, row).z())) continue;
+                if (local_error2(col, row) > m_max_valid_triangulation_error) continue;
+                pts_bdbox.grow(local_image2(col, row));
+              }
+            }
+	        }
+
+          if ( pts_bdbox.min().x() <= pts_bdbox.max().x() &&
+               pts_bdbox.min().y() <= pts_bdbox.max().y() ) {
+            // pts_bdbox has at least one point. A box of just one
+            // point is considered empty by VW. For that reason,
+            // grow this box to make it definitely non-empty.
+            // Note: for local_union, which will end up contributing
+            // to the global bounding box, we don't use the float_next
+            // gimmick, as we need the precise box.
+            local_union.grow( pts_bdbox );
+            pts_bdbox.max()[0] = boost::math::float_next(pts_bdbox.max()[0]);
+            pts_bdbox.max()[1] = boost::math::float_next(pts_bdbox.max()[1]);
+            solutions.push_back( std::make_pair( pts_bdbox, blocks[i] ) );
+          }
         }
 
-        m_global_bbox.grow( local_union );
+        // Append to the global list of boxes and expand the point
+        // cloud bounding box.
+        if ( local_union != BBox3() ) {
+          Mutex::Lock lock( m_mutex );
+          PointCloudIndex & index = m_indices[k];
+          for ( std::list<BBoxPair>::const_iterator it = solutions.begin();
+                it != solutions.end(); it++ ) {
+            index.boundaries.push_back( *it );
+          }
 
-        if (remove_outliers_with_pct)
-          for (int i = 0; i < (int)m_errors_hist.size(); i++)
-            m_errors_hist[i] += local_hist[i];
+          index.bbox.grow( local_union );
 
-        m_progress.report_incremental_progress( m_inc_amt );
+          if (m_remove_outliers_with_pct)
+            for (int i = 0; i < num_bins; i++)
+              index.errors_hist[i] += local_hist[i];
+        }
       }
+
+      m_progress.report_incremental_progress( m_inc_amt );
     }
   }; // End function operator()
 
+  void index_point_cloud(ImageViewRef<Vector3> const& point_image,
+                         std::vector<PointTransform> const& transforms,
+                         int pc_tile_size,
+                         bool remove_outliers_with_pct,
+                         ImageViewRef<double> const& error_image,
+                         double estim_max_error,
+                         double max_valid_triangulation_error,
+                         std::vector<PointCloudIndex> & indices,
+                         const ProgressCallback& progress){
+
+    VW_OUT(DebugMessage,"asp") << "Computing raster bounding box...\n";
+
+    // Subdivide each block into smaller chunks. Note: small chunks
+    // greatly increase the memory usage and run-time for very large
+    // images (because they are very many). As such, make the chunks
+    // bigger for bigger images.
+    double s = 10000.0;
+    int sub_block_size
+      = int(double(point_image.cols())*double(point_image.rows())/(s*s));
+    sub_block_size = std::max(1, sub_block_size);
+    sub_block_size = int(round(pow(2.0, floor(log(sub_block_size)/log(2.0)))));
+    sub_block_size = std::max(16, sub_block_size);
+    sub_block_size = std::min(OrthoRasterizerView::max_subblock_size(), sub_block_size);
+
+    int num_bins = 1024;
+    indices.clear();
+    indices.resize(std::max(transforms.size(), size_t(1)));
+    for (size_t k = 0; k < indices.size(); k++) {
+      indices[k].sub_block_size = sub_block_size;
+      if (remove_outliers_with_pct){
+        // Need to compute the histogram of all errors in the error image
+        indices[k].errors_hist = std::vector<double>(num_bins, 0.0);
+      }
+    }
+
+    std::vector<BBox2i> blocks =
+      subdivide_bbox( point_image, pc_tile_size, pc_tile_size );
+
+    // Find the bounding box of each subblock, together with other
+    // info, by searching through the image.
+    FifoWorkQueue queue( vw_settings().default_num_threads() );
+    typedef SubBlockBoundaryTask task_type;
+    Mutex mutex;
+    float inc_amt = 1.0 / float(blocks.size());
+    for ( size_t i = 0; i < blocks.size(); i++ ) {
+      boost::shared_ptr<task_type>
+        task( new task_type( point_image, transforms, sub_block_size, blocks[i],
+                             indices, error_image, estim_max_error,
+                             remove_outliers_with_pct,
+                             max_valid_triangulation_error,
+                             mutex, progress, inc_amt ) );
+      queue.add_task( task );
+    }
+    queue.join_all();
+    progress.report_finished();
+  }
+
 
   void remove_outliers(ImageView<Vector3> & image, ImageViewRef<double> const& errors,
 		       double error_cutoff, BBox2i const& box){
@@ -345,7 +416,7 @@ namespace asp{
    std::string const& filter,
    double default_grid_size_multiplier,
    size_t *num_invalid_pixels, vw::Mutex *count_mutex,
-   const ProgressCallback& progress):
+   const ProgressCallback& progress, PointCloudIndex const* index):
     // Ensure all members are initiated, even if to temporary values
     m_point_image(point_image), m_texture(ImageView<float>(1,1)),
     m_bbox(BBox3()), m_snapped_bbox(BBox3()), m_spacing(0.0), m_default_spacing(0.0),
@@ -386,47 +457,18 @@ namespace asp{
     // Compute the bounding box that encompasses tiles within the image
     //
     // They're used for querying what part of the image we need
-    VW_OUT(DebugMessage,"asp") << "Computing raster bounding box...\n";
-
-    int num_bins = 1024;
-    std::vector<double> errors_hist;
-    if (remove_outliers_with_pct){
-      // Need to compute the histogram of all errors in the error image
-      errors_hist = std::vector<double>(num_bins, 0.0);
+    std::vector<PointCloudIndex> local_indices;
+    if (index == NULL){
+      index_point_cloud(m_point_image, std::vector<PointTransform>(),
+                        m_block_size, remove_outliers_with_pct,
+                        error_image, estim_max_error, max_valid_triangulation_error,
+                        local_indices, progress);
+      index = &local_indices[0];
     }
-
-    // Subdivide each block into smaller chunks. Note: small chunks
-    // greatly increase the memory usage and run-time for very large
-    // images (because they are very many). As such, make the chunks
-    // bigger for bigger images.
-    double s = 10000.0;
-    int sub_block_size
-      = int(double(point_image.cols())*double(point_image.rows())/(s*s));
-    sub_block_size = std::max(1, sub_block_size);
-    sub_block_size = int(round(pow(2.0, floor(log(sub_block_size)/log(2.0)))));
-    sub_block_size = std::max(16, sub_block_size);
-    sub_block_size = std::min(max_subblock_size(), sub_block_size);
-    std::vector<BBox2i> blocks =
-      subdivide_bbox( m_point_image, m_block_size, m_block_size );
-
-    // Find the bounding box of each subblock, stored in
-    // m_point_image_boundaries, together with other info by
-    // searching through the image.
-    FifoWorkQueue queue( vw_settings().default_num_threads() );
-    typedef SubBlockBoundaryTask task_type;
-    Mutex mutex;
-    float inc_amt = 1.0 / float(blocks.size());
-    for ( size_t i = 0; i < blocks.size(); i++ ) {
-      boost::shared_ptr<task_type>
-        task( new task_type( m_point_image, sub_block_size, blocks[i],
-                             m_bbox, m_point_image_boundaries,
-                             error_image, estim_max_error, errors_hist,
-                             max_valid_triangulation_error,
-                             mutex, progress, inc_amt ) );
-      queue.add_task( task );
-    }
-    queue.join_all();
-    progress.report_finished();
+    m_bbox = index->bbox;
+    m_point_image_boundaries = index->boundaries;
+    std::vector<double> const& errors_hist = index->errors_hist;
+    int sub_block_size = index->sub_block_size;
 
     if ( m_bbox.empty() )
       vw_throw( ArgumentErr() << "OrthoRasterize: Input point cloud is empty!\n" );
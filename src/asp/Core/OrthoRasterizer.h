@@ -32,12 +32,44 @@
 #include <vw/Math/BBox.h>
 #include <asp/Core/Point2Grid.h>
 
+#include <boost/function.hpp>
+
 namespace asp{
 
   using namespace vw;
 
   typedef std::pair<BBox3, BBox2i> BBoxPair;
 
+  /// Maps a view of a point cloud to the coordinates a rasterizer
+  /// works in, such as a map projection. It must act pixel by pixel.
+  typedef boost::function<ImageViewRef<Vector3>(ImageViewRef<Vector3> const&)> PointTransform;
+
+  /// What OrthoRasterizerView needs to know about a point cloud which
+  /// takes reading all of it: the bounding box of the points, the
+  /// boxes of the points in each sub-block of the cloud, and the
+  /// histogram of triangulation errors if removing outliers by
+  /// percentile.
+  struct PointCloudIndex {
+    BBox3                 bbox;
+    std::vector<BBoxPair> boundaries;
+    std::vector<double>   errors_hist;
+    int                   sub_block_size;
+    PointCloudIndex(): sub_block_size(0) {}
+  };
+
+  /// Index a point cloud for several rasterizers in one pass over it.
+  /// Index k is for the cloud mapped by transforms[k], or for the
+  /// cloud itself if there are no transforms.
+  void index_point_cloud(ImageViewRef<Vector3> const& point_image,
+                         std::vector<PointTransform> const& transforms,
+                         int pc_tile_size,
+                         bool remove_outliers_with_pct,
+                         ImageViewRef<double> const& error_image,
+                         double estim_max_error,
+                         double max_valid_triangulation_error,
+                         std::vector<PointCloudIndex> & indices,
+                         const ProgressCallback& progress);
+
   /// Given a point image and corresponding texture, this class
   /// bins and averages the point cloud on a regular grid over the [x,y]
   /// plane of the point image; producing an evenly sampled ortho-image
@@ -87,6 +119,8 @@ namespace asp{
     static int max_subblock_size(){ return 128;} // is used in point2dem and below
 
     /// Constructor.  You must call initialize_spacing before using the object!!
+    /// If an index of the point image made with index_point_cloud()
+    /// is passed in, the point image is not read here.
     OrthoRasterizerView(ImageViewRef<Vector3> point_image,
                         ImageViewRef<double> texture,
                         double  search_radius_factor,
@@ -106,7 +140,8 @@ namespace asp{
 			double default_grid_size_multiplier,
                         size_t  *num_invalid_pixels,
                         vw::Mutex *count_mutex,
-                        const ProgressCallback& progress);
+                        const ProgressCallback& progress,
+                        PointCloudIndex const* index = NULL);
 
     /// This must be called before the object can be used!
     void initialize_spacing(double spacing=0.0);
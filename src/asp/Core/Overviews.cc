@@ -0,0 +1,105 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file Overviews.cc
+///
+
+#include <asp/Core/Overviews.h>
+
+#include <gdal_priv.h>
+#include <cpl_progress.h>
+
+using namespace vw;
+
+namespace asp {
+
+OverviewResampling parse_overview_resampling(std::string const& name) {
+  if (name == "average")
+    return OVERVIEW_AVERAGE;
+  if (name == "nearest")
+    return OVERVIEW_NEAREST;
+  vw_throw(ArgumentErr() << "Unknown overview resampling method: " << name
+           << ". Options: average, nearest.\n");
+  return OVERVIEW_AVERAGE;
+}
+
+static GDALDataType gdal_data_type(ChannelTypeEnum type) {
+  switch (type) {
+  case VW_CHANNEL_UINT8:   return GDT_Byte;
+  case VW_CHANNEL_INT16:   return GDT_Int16;
+  case VW_CHANNEL_UINT16:  return GDT_UInt16;
+  case VW_CHANNEL_INT32:   return GDT_Int32;
+  case VW_CHANNEL_UINT32:  return GDT_UInt32;
+  case VW_CHANNEL_FLOAT32: return GDT_Float32;
+  case VW_CHANNEL_FLOAT64: return GDT_Float64;
+  default:
+    vw_throw(NoImplErr() << "Unsupported channel type for overviews: " << type << ".\n");
+  }
+  return GDT_Unknown;
+}
+
+void write_internal_overviews(std::string const& filename,
+                              std::vector<OverviewLevelData> const& levels) {
+  if (levels.empty())
+    return;
+
+  GDALAllRegister();
+  GDALDataset * dataset = (GDALDataset*)GDALOpen(filename.c_str(), GA_Update);
+  if (dataset == NULL)
+    vw_throw(IOErr() << "Failed to open " << filename << " to add overviews.\n");
+
+  try {
+    // Create the overviews without computing them, as we have them already
+    std::vector<int> factors;
+    for (size_t level = 0; level < levels.size(); level++)
+      factors.push_back(2 << level);
+    if (dataset->BuildOverviews("NONE", factors.size(), &factors[0], 0, NULL,
+                                GDALDummyProgress, NULL) != CE_None)
+      vw_throw(IOErr() << "Failed to create overviews for " << filename << ".\n");
+
+    for (size_t level = 0; level < levels.size(); level++) {
+
+      OverviewLevelData const& L = levels[level];
+      if (L.num_channels != dataset->GetRasterCount())
+        vw_throw(ArgumentErr() << "Expecting " << dataset->GetRasterCount()
+                 << " bands in the overviews of " << filename << ".\n");
+
+      GDALDataType type    = gdal_data_type(L.channel_type);
+      int channel_size     = channel_size(L.channel_type);
+      int pixel_space      = channel_size*L.num_channels;
+      for (int band = 0; band < L.num_channels; band++) {
+        GDALRasterBand * ov = dataset->GetRasterBand(band + 1)->GetOverview(level);
+        if (ov == NULL || ov->GetXSize() != L.cols || ov->GetYSize() != L.rows)
+          vw_throw(ArgumentErr() << "Unexpected size for overview level " << level + 1
+                   << " of " << filename << ".\n");
+        const char * data = (const char*)L.data + band*channel_size;
+        if (ov->RasterIO(GF_Write, 0, 0, L.cols, L.rows, (void*)data, L.cols, L.rows,
+                         type, pixel_space, pixel_space*L.cols) != CE_None)
+          vw_throw(IOErr() << "Failed to write overview level " << level + 1
+                   << " of " << filename << ".\n");
+      }
+    }
+  } catch (...) {
+    GDALClose(dataset);
+    throw;
+  }
+
+  GDALClose(dataset);
+}
+
+} // end namespace asp
@@ -0,0 +1,303 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file Overviews.h
+///
+/// Build the reduced-resolution overviews of an image from the tiles
+/// being written to disk, rather than re-reading the image later, and
+/// store them as internal overviews of the written GeoTIFF.
+///
+/// The first overview level (reduction factor 2) is filled in as tiles
+/// are rasterized, the coarser ones are formed from it in memory when
+/// the write is done. All levels are kept in memory, which takes about
+/// a third of the size of the full-resolution image. They are appended
+/// to the file after it is written, so they follow the full-resolution
+/// image, unlike in a cloud-optimized GeoTIFF.
+
+#ifndef __ASP_CORE_OVERVIEWS_H__
+#define __ASP_CORE_OVERVIEWS_H__
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Log.h>
+#include <vw/Core/ProgressCallback.h>
+#include <vw/Core/CompoundTypes.h>
+#include <vw/Math/BBox.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewBase.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/PixelTypeInfo.h>
+#include <vw/Cartography/GeoReference.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+
+#include <boost/type_traits/is_integral.hpp>
+
+#include <cmath>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace asp {
+
+  enum OverviewResampling { OVERVIEW_AVERAGE, OVERVIEW_NEAREST };
+
+  /// Parse "average" or "nearest". Throw on anything else.
+  OverviewResampling parse_overview_resampling(std::string const& name);
+
+  /// One overview level, with pixels stored interleaved, as in an ImageView.
+  struct OverviewLevelData {
+    int cols, rows, num_channels;
+    vw::ChannelTypeEnum channel_type;
+    const void * data;
+  };
+
+  /// Add the given levels as internal overviews to an existing GeoTIFF.
+  /// Level k must have the size of the image reduced by a factor of 2^(k+1).
+  void write_internal_overviews(std::string const& filename,
+                                std::vector<OverviewLevelData> const& levels);
+
+  /// Accumulates the overviews of an image of given size as its tiles
+  /// are seen. Tiles may be added from multiple threads, as each
+  /// writes to its own part of the first level.
+  template <class PixelT>
+  class OverviewBuilder {
+    typedef typename vw::CompoundChannelType<PixelT>::type channel_type;
+    static const int num_channels = vw::CompoundNumChannels<PixelT>::value;
+
+  public:
+
+    /// The number of levels is reduced if the image would shrink below
+    /// one pixel.
+    OverviewBuilder(int cols, int rows, int num_levels, std::string const& resampling,
+                    bool has_nodata, double nodata):
+      m_num_levels(0),
+      m_method(parse_overview_resampling(resampling)),
+      m_has_nodata(has_nodata), m_nodata(nodata) {
+
+      int level_cols = cols, level_rows = rows;
+      while (m_num_levels < num_levels && (level_cols > 1 || level_rows > 1)) {
+        level_cols = (level_cols + 1)/2;
+        level_rows = (level_rows + 1)/2;
+        m_num_levels++;
+      }
+      if (m_num_levels > 0)
+        m_first_level.set_size((cols + 1)/2, (rows + 1)/2);
+    }
+
+    int num_levels() const { return m_num_levels; }
+
+    /// The pixels of the first level whose 2x2 footprints start in
+    /// bbox are computed from the given tile, which covers ext_box.
+    /// The latter must contain bbox and extend it to even pixel
+    /// coordinates, or to the image boundary.
+    void add_tile(vw::BBox2i const& bbox, vw::BBox2i const& ext_box,
+                  vw::ImageView<PixelT> const& tile) {
+      if (m_num_levels == 0)
+        return;
+
+      PixelT footprint[4];
+      for (int row = (bbox.min().y() + 1)/2; 2*row < bbox.max().y(); row++) {
+        for (int col = (bbox.min().x() + 1)/2; 2*col < bbox.max().x(); col++) {
+          int num = 0;
+          for (int dy = 0; dy < 2; dy++) {
+            for (int dx = 0; dx < 2; dx++) {
+              int x = 2*col + dx, y = 2*row + dy;
+              if (x < ext_box.max().x() && y < ext_box.max().y())
+                footprint[num++] = tile(x - ext_box.min().x(), y - ext_box.min().y());
+            }
+          }
+          m_first_level(col, row) = reduce(footprint, num);
+        }
+      }
+    }
+
+    /// Form the coarser levels from the first one and add them all as
+    /// internal overviews to the given file, which must have been
+    /// written already.
+    void write(std::string const& filename) const {
+      if (m_num_levels == 0)
+        return;
+
+      std::vector< vw::ImageView<PixelT> > levels(1, m_first_level);
+      PixelT footprint[4];
+      for (int level = 1; level < m_num_levels; level++) {
+        vw::ImageView<PixelT> const& prev = levels.back();
+        vw::ImageView<PixelT> curr((prev.cols() + 1)/2, (prev.rows() + 1)/2);
+        for (int row = 0; row < curr.rows(); row++) {
+          for (int col = 0; col < curr.cols(); col++) {
+            int num = 0;
+            for (int dy = 0; dy < 2; dy++)
+              for (int dx = 0; dx < 2; dx++)
+                if (2*col + dx < prev.cols() && 2*row + dy < prev.rows())
+                  footprint[num++] = prev(2*col + dx, 2*row + dy);
+            curr(col, row) = reduce(footprint, num);
+          }
+        }
+        levels.push_back(curr);
+      }
+
+      std::vector<OverviewLevelData> level_data(levels.size());
+      for (size_t level = 0; level < levels.size(); level++) {
+        level_data[level].cols         = levels[level].cols();
+        level_data[level].rows         = levels[level].rows();
+        level_data[level].num_channels = num_channels;
+        level_data[level].channel_type = vw::ChannelTypeID<channel_type>::value;
+        level_data[level].data         = levels[level].data();
+      }
+      write_internal_overviews(filename, level_data);
+    }
+
+  private:
+
+    bool is_valid(PixelT const& pix) const {
+      bool all_nodata = true;
+      for (int c = 0; c < num_channels; c++) {
+        double val = vw::compound_select_channel<channel_type const&>(pix, c);
+        if (val != val) // NaN
+          return false;
+        if (val != double(channel_type(m_nodata)))
+          all_nodata = false;
+      }
+      return !(m_has_nodata && all_nodata);
+    }
+
+    // Combine the pixels of a footprint into one
+    PixelT reduce(PixelT const* pix, int num) const {
+
+      if (m_method == OVERVIEW_NEAREST)
+        return pix[0];
+
+      double sum[num_channels];
+      for (int c = 0; c < num_channels; c++)
+        sum[c] = 0.0;
+      int num_valid = 0;
+      for (int k = 0; k < num; k++) {
+        if (!is_valid(pix[k]))
+          continue;
+        for (int c = 0; c < num_channels; c++)
+          sum[c] += vw::compound_select_channel<channel_type const&>(pix[k], c);
+        num_valid++;
+      }
+      if (num_valid == 0)
+        return pix[0];
+
+      PixelT result;
+      for (int c = 0; c < num_channels; c++) {
+        double val = sum[c]/num_valid;
+        if (boost::is_integral<channel_type>::value)
+          val = std::floor(val + 0.5);
+        vw::compound_select_channel<channel_type&>(result, c) = channel_type(val);
+      }
+      return result;
+    }
+
+    int m_num_levels;
+    OverviewResampling m_method;
+    bool m_has_nodata;
+    double m_nodata;
+    vw::ImageView<PixelT> m_first_level;
+  };
+
+  /// Pass the tiles of an image through unchanged, while recording
+  /// their contribution to the overviews.
+  template <class ImageT>
+  class OverviewRecorderView: public vw::ImageViewBase<OverviewRecorderView<ImageT> > {
+    typedef typename ImageT::pixel_type PixelT;
+    ImageT                    m_img;
+    OverviewBuilder<PixelT> & m_builder;
+  public:
+    OverviewRecorderView(vw::ImageViewBase<ImageT> const& img, OverviewBuilder<PixelT> & builder):
+      m_img(img.impl()), m_builder(builder){}
+
+    typedef PixelT pixel_type;
+    typedef PixelT result_type;
+    typedef vw::ProceduralPixelAccessor<OverviewRecorderView> pixel_accessor;
+
+    inline vw::int32 cols  () const { return m_img.cols(); }
+    inline vw::int32 rows  () const { return m_img.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+    inline pixel_type operator()( double /*i*/, double /*j*/, vw::int32 /*p*/ = 0 ) const {
+      vw_throw(vw::NoImplErr() << "OverviewRecorderView::operator()(...) is not implemented");
+      return pixel_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      // Extend the box to even coordinates, so the 2x2 footprints
+      // starting in it are fully seen.
+      vw::BBox2i ext_box = bbox;
+      ext_box.max() += vw::Vector2i(ext_box.max().x() % 2, ext_box.max().y() % 2);
+      ext_box.crop(vw::bounding_box(m_img));
+      vw::ImageView<pixel_type> tile = crop(m_img, ext_box);
+      m_builder.add_tile(bbox, ext_box, tile);
+      return prerasterize_type(tile, -ext_box.min().x(), -ext_box.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  template <class ImageT>
+  OverviewRecorderView<ImageT>
+  record_overviews(vw::ImageViewBase<ImageT> const& img,
+                   OverviewBuilder<typename ImageT::pixel_type> & builder) {
+    return OverviewRecorderView<ImageT>(img.impl(), builder);
+  }
+
+  /// Block-write an image, and if num_overview_levels is positive, add
+  /// that many internal overviews to it, built from the tiles as they
+  /// are written.
+  template <class ImageT>
+  void block_write_gdal_image_with_overviews(std::string const& filename,
+                                             vw::ImageViewBase<ImageT> const& image,
+                                             bool has_georef,
+                                             vw::cartography::GeoReference const& georef,
+                                             bool has_nodata, double nodata,
+                                             vw::cartography::GdalWriteOptions const& opt,
+                                             int num_overview_levels,
+                                             std::string const& overview_resampling,
+                                             vw::ProgressCallback const& progress_callback
+                                             = vw::ProgressCallback::dummy_instance(),
+                                             std::map<std::string, std::string> const& keywords
+                                             = std::map<std::string, std::string>()) {
+
+    if (num_overview_levels <= 0) {
+      vw::cartography::block_write_gdal_image(filename, image.impl(), has_georef, georef,
+                                              has_nodata, nodata, opt,
+                                              progress_callback, keywords);
+      return;
+    }
+
+    OverviewBuilder<typename ImageT::pixel_type>
+      builder(image.impl().cols(), image.impl().rows(), num_overview_levels,
+              overview_resampling, has_nodata, nodata);
+    vw::cartography::block_write_gdal_image(filename, record_overviews(image.impl(), builder),
+                                            has_georef, georef, has_nodata, nodata, opt,
+                                            progress_callback, keywords);
+    vw::vw_out() << "Adding " << builder.num_levels() << " internal overview levels to: "
+                 << filename << "\n";
+    builder.write(filename);
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_OVERVIEWS_H__
@@ -33,6 +33,7 @@
 #include <vw/Stereo/DisparityMap.h>
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/NormalizedImage.h>
 #include <asp/Core/PhotometricOutlier.h>
 namespace fs = boost::filesystem;
 
@@ -45,7 +46,7 @@ void asp::photometric_outlier_rejection( vw::cartography::GdalWriteOptions const
                                          std::string & output_disparity,
                                          int kernel_size ) {
   // Projecting right into perspective of left
-  DiskImageView<PixelGray<float> > right_disk_image(prefix+"-R.tif");
+  ImageViewRef<PixelGray<float> > right_disk_image = open_normalized_image(prefix+"-R.tif");
   DiskImageView<PixelMask<Vector2f> > disparity_disk_image( input_disparity );
   stereo::DisparityTransform trans( disparity_disk_image );
 
@@ -61,7 +62,7 @@ void asp::photometric_outlier_rejection( vw::cartography::GdalWriteOptions const
   // Differencing Left and Projected Right
   ImageViewRef<PixelMask<PixelGray<float32> > > right_mask =
     create_mask(right_proj);
-  DiskImageView<PixelGray<float32> > left_image(prefix+"-L.tif");
+  ImageViewRef<PixelGray<float32> > left_image = open_normalized_image(prefix+"-L.tif");
   DiskCacheImageView<PixelGray<float> >
     diff( abs(apply_mask(copy_mask(left_image,right_mask))-right_proj),
           "tif", TerminalProgressCallback("asp","\tDifference:"),
@@ -25,7 +25,11 @@
 #include <asp/Core/PointUtils.h>
 #include <vw/Cartography/Chipper.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 #include <boost/math/special_functions/fpclassify.hpp>
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <gdal_priv.h>
 
 using namespace vw;
 using namespace vw::cartography;
@@ -364,6 +368,242 @@ namespace asp{
   }
 
 
+  boost::uint64_t morton_key(Vector3 const& point){
+
+    // Map each coordinate to an unsigned integer with the same order,
+    // and keep the sign, exponent, and leading mantissa bits.
+    boost::uint32_t lead[2];
+    for (int c = 0; c < 2; c++) {
+      double val = point[c];
+      boost::uint64_t bits;
+      std::memcpy(&bits, &val, sizeof(bits));
+      if (bits >> 63)
+        bits = ~bits;
+      else
+        bits |= (boost::uint64_t(1) << 63);
+      lead[c] = boost::uint32_t(bits >> 32);
+    }
+
+    boost::uint64_t key = 0;
+    for (int b = 31; b >= 0; b--) {
+      key = (key << 1) | ((lead[0] >> b) & 1);
+      key = (key << 1) | ((lead[1] >> b) & 1);
+    }
+    return key;
+  }
+
+  /// Reads back a sorted run, a buffer of the given number of points at a time.
+  class SortedRunReader{
+    std::ifstream m_ifs;
+    std::vector<SortedPointReader::KeyedPoint> m_buf;
+    size_t m_pos, m_buf_size;
+  public:
+    SortedRunReader(std::string const& file, size_t buf_size):
+      m_ifs(file.c_str(), std::ios::binary), m_pos(0), m_buf_size(buf_size){
+      if (!m_ifs)
+        vw_throw( vw::IOErr() << "Unable to open file \"" << file << "\"" );
+      fill();
+    }
+
+    bool done() const { return m_pos >= m_buf.size(); }
+    SortedPointReader::KeyedPoint const& current() const { return m_buf[m_pos]; }
+
+    void advance(){
+      m_pos++;
+      if (m_pos >= m_buf.size())
+        fill();
+    }
+
+  private:
+    void fill(){
+      m_buf.resize(m_buf_size);
+      m_ifs.read(reinterpret_cast<char*>(&m_buf[0]),
+                 m_buf_size*sizeof(SortedPointReader::KeyedPoint));
+      m_buf.resize(m_ifs.gcount()/sizeof(SortedPointReader::KeyedPoint));
+      m_pos = 0;
+    }
+  };
+
+  /// Sort a run and write it to disk.
+  class SortRunTask: public vw::Task, private boost::noncopyable {
+    boost::shared_ptr< std::vector<SortedPointReader::KeyedPoint> > m_run;
+    std::string m_file;
+  public:
+    SortRunTask(boost::shared_ptr< std::vector<SortedPointReader::KeyedPoint> > run,
+                std::string const& file): m_run(run), m_file(file){}
+
+    void operator()(){
+      std::vector<SortedPointReader::KeyedPoint> & run = *m_run;
+      for (size_t it = 0; it < run.size(); it++)
+        run[it].key = morton_key(run[it].point);
+      std::stable_sort(run.begin(), run.end());
+
+      std::ofstream ofs(m_file.c_str(), std::ios::binary);
+      ofs.write(reinterpret_cast<char const*>(&run[0]),
+                run.size()*sizeof(SortedPointReader::KeyedPoint));
+      if (!ofs)
+        vw_throw( vw::IOErr() << "Failed writing file \"" << m_file << "\"" );
+      std::vector<SortedPointReader::KeyedPoint>().swap(run); // release memory
+    }
+  };
+
+  /// Merge sorted runs into one sorted run.
+  static void merge_sorted_runs(std::vector<std::string> const& files, std::string const& out_file,
+                                size_t buf_size){
+
+    typedef std::pair<boost::uint64_t, int> HeapElem;
+    std::greater<HeapElem> comp;
+    std::vector< boost::shared_ptr<SortedRunReader> > runs;
+    std::vector<HeapElem> heap;
+    for (size_t it = 0; it < files.size(); it++) {
+      runs.push_back(boost::shared_ptr<SortedRunReader>(new SortedRunReader(files[it], buf_size)));
+      if (!runs.back()->done())
+        heap.push_back(std::make_pair(runs.back()->current().key, int(it)));
+    }
+    std::make_heap(heap.begin(), heap.end(), comp);
+
+    std::ofstream ofs(out_file.c_str(), std::ios::binary);
+    std::vector<SortedPointReader::KeyedPoint> out;
+    out.reserve(buf_size);
+    while (!heap.empty()) {
+      std::pop_heap(heap.begin(), heap.end(), comp);
+      int run = heap.back().second;
+      heap.pop_back();
+      out.push_back(runs[run]->current());
+      runs[run]->advance();
+      if (!runs[run]->done()) {
+        heap.push_back(std::make_pair(runs[run]->current().key, run));
+        std::push_heap(heap.begin(), heap.end(), comp);
+      }
+      if (out.size() == buf_size || heap.empty()) {
+        ofs.write(reinterpret_cast<char const*>(&out[0]),
+                  out.size()*sizeof(SortedPointReader::KeyedPoint));
+        out.clear();
+      }
+    }
+    if (!ofs)
+      vw_throw( vw::IOErr() << "Failed writing file \"" << out_file << "\"" );
+  }
+
+  SortedPointReader::SortedPointReader(BaseReader & reader, std::string const& tmp_prefix,
+                                       boost::uint64_t run_size): m_mem_index(0){
+
+    VW_ASSERT(run_size > 0, ArgumentErr() << "SortedPointReader: Invalid run size.\n");
+
+    m_has_georef = reader.m_has_georef;
+    m_georef     = reader.m_georef;
+    m_num_points = 0;
+
+    // Read the runs one at a time, sorting them in parallel as they come.
+    // At most as many runs as threads are in memory.
+    int num_threads = vw_settings().default_num_threads();
+    bool done = false;
+    while (!done) {
+      FifoWorkQueue queue(num_threads);
+      for (int count = 0; count < num_threads && !done; count++) {
+        boost::shared_ptr< std::vector<KeyedPoint> > run(new std::vector<KeyedPoint>);
+        run->reserve(std::min(run_size, std::max(reader.m_num_points, boost::uint64_t(1))));
+        KeyedPoint kp;
+        kp.key = 0;
+        while (run->size() < run_size && reader.ReadNextPoint()) {
+          kp.point = reader.GetPoint();
+          run->push_back(kp);
+        }
+        done = (run->size() < run_size);
+        m_num_points += run->size();
+
+        if (done && m_run_files.empty()) {
+          // Everything fits in memory
+          for (size_t it = 0; it < run->size(); it++)
+            (*run)[it].key = morton_key((*run)[it].point);
+          std::stable_sort(run->begin(), run->end());
+          m_mem_points.swap(*run);
+          break;
+        }
+        if (run->empty())
+          break;
+
+        std::ostringstream os;
+        os << tmp_prefix << "-run-" << m_run_files.size() << ".bin";
+        m_run_files.push_back(os.str());
+        boost::shared_ptr<SortRunTask> task(new SortRunTask(run, m_run_files.back()));
+        queue.add_task(task);
+      }
+      queue.join_all();
+    }
+
+    // Merge the runs in groups until few enough are left to keep all
+    // open at once. The merge buffers share the memory of the runs.
+    const size_t MAX_OPEN_RUNS = 256, MIN_BUF_SIZE = 1024;
+    boost::uint64_t mem_points = run_size*num_threads;
+    size_t buf_size = std::max(size_t(mem_points/MAX_OPEN_RUNS), MIN_BUF_SIZE);
+    size_t num_merged = 0;
+    while (m_run_files.size() > MAX_OPEN_RUNS) {
+      std::vector<std::string> group(m_run_files.begin(), m_run_files.begin() + MAX_OPEN_RUNS);
+      std::ostringstream os;
+      os << tmp_prefix << "-merged-" << num_merged++ << ".bin";
+      m_run_files.push_back(os.str());
+      merge_sorted_runs(group, m_run_files.back(), buf_size);
+      for (size_t it = 0; it < group.size(); it++)
+        boost::filesystem::remove(group[it]);
+      m_run_files.erase(m_run_files.begin(), m_run_files.begin() + MAX_OPEN_RUNS);
+    }
+
+    // Prepare to merge the runs
+    if (!m_run_files.empty())
+      buf_size = std::max(size_t(mem_points/m_run_files.size()), MIN_BUF_SIZE);
+    for (size_t it = 0; it < m_run_files.size(); it++) {
+      m_runs.push_back(boost::shared_ptr<SortedRunReader>
+                       (new SortedRunReader(m_run_files[it], buf_size)));
+      if (!m_runs.back()->done())
+        m_heap.push_back(std::make_pair(m_runs.back()->current().key, int(it)));
+    }
+    std::make_heap(m_heap.begin(), m_heap.end(),
+                   std::greater< std::pair<boost::uint64_t, int> >());
+  }
+
+  bool SortedPointReader::ReadNextPoint(){
+
+    if (m_run_files.empty()) {
+      if (m_mem_index >= m_mem_points.size())
+        return false;
+      m_curr_point = m_mem_points[m_mem_index].point;
+      m_mem_index++;
+      return true;
+    }
+
+    if (m_heap.empty())
+      return false;
+
+    std::greater< std::pair<boost::uint64_t, int> > comp;
+    std::pop_heap(m_heap.begin(), m_heap.end(), comp);
+    int run = m_heap.back().second;
+    m_heap.pop_back();
+
+    m_curr_point = m_runs[run]->current().point;
+    m_runs[run]->advance();
+    if (!m_runs[run]->done()) {
+      m_heap.push_back(std::make_pair(m_runs[run]->current().key, run));
+      std::push_heap(m_heap.begin(), m_heap.end(), comp);
+    }
+    return true;
+  }
+
+  Vector3 SortedPointReader::GetPoint(){
+    return m_curr_point;
+  }
+
+  SortedPointReader::~SortedPointReader(){
+    // The runs are closed before their files are removed
+  }
+
+  SortedPointReader::TempFiles::~TempFiles(){
+    for (size_t it = 0; it < size(); it++) {
+      boost::system::error_code ec;
+      boost::filesystem::remove((*this)[it], ec); // must not throw
+    }
+  }
+
   /// Create a point cloud image from a las file. The image will be
   /// created block by block, when it needs to be written to disk. It is
   /// important that the writer invoking this image be single-threaded,
@@ -996,8 +1236,18 @@ void asp::las_or_csv_to_tif(std::string const& in_file,
   }else
     vw_throw( ArgumentErr() << "Unknown file type: " << in_file << "\n");
 
+  // Sort the points spatially first, so that each tile, and then each
+  // block after chipping, covers a small area. The runs being sorted
+  // at the same time take as much memory as a tile of points.
+  boost::uint64_t run_size
+    = std::max(boost::uint64_t(1),
+               boost::uint64_t(TILE_LEN*TILE_LEN)*sizeof(Vector3)
+               /(sizeof(asp::SortedPointReader::KeyedPoint)
+                 *vw_settings().default_num_threads()));
+  asp::SortedPointReader sorted_reader(*reader_ptr, out_file, run_size);
+
   ImageViewRef<Vector3> Img
-    = asp::LasOrCsvToTif_Class< ImageView<Vector3> > (reader_ptr.get(), num_rows, TILE_LEN, block_size);
+    = asp::LasOrCsvToTif_Class< ImageView<Vector3> > (&sorted_reader, num_rows, TILE_LEN, block_size);
 
   // Must use a thread only, as we read the input file serially.
   vw::cartography::write_gdal_image(out_file, Img, *opt, TerminalProgressCallback("asp", "\t--> ") );
@@ -1263,3 +1513,43 @@ std::string asp::get_cloud_type(std::string const& file_name){
 }
 
 
+
+bool asp::has_separate_bands(vw::DiskImageResourceGDAL & rsrc){
+
+  vw::Mutex::Lock lock(vw::DiskImageResourceGDAL::global_lock());
+  boost::shared_ptr<GDALDataset> dataset = rsrc.get_dataset_ptr();
+  if (!dataset)
+    return false;
+
+  // Only GeoTIFF files written with --band-separated-point-cloud. Other
+  // files, such as the VRT mosaics of parallel_stereo, are read as usual.
+  GDALDriver * driver = dataset->GetDriver();
+  if (driver == NULL || std::string(driver->GetDescription()) != "GTiff")
+    return false;
+
+  const char * interleave = dataset->GetMetadataItem("INTERLEAVE", "IMAGE_STRUCTURE");
+  return interleave != NULL && std::string(interleave) == "BAND";
+}
+
+void asp::read_gdal_bands(vw::DiskImageResourceGDAL & rsrc, vw::BBox2i const& bbox,
+                          int first_band, int num_bands, double * data){
+
+  // GDAL datasets are not thread-safe. Take the lock VW uses for all
+  // access to them, as the same file may be open elsewhere.
+  vw::Mutex::Lock lock(vw::DiskImageResourceGDAL::global_lock());
+  boost::shared_ptr<GDALDataset> dataset = rsrc.get_dataset_ptr();
+  if (!dataset)
+    vw_throw(vw::IOErr() << "read_gdal_bands: No file has been opened.\n");
+
+  std::vector<int> band_map(num_bands);
+  for (int band = 0; band < num_bands; band++)
+    band_map[band] = first_band + band + 1; // GDAL bands start from 1
+
+  int pixel_space = num_bands*sizeof(double);
+  if (dataset->RasterIO(GF_Read, bbox.min().x(), bbox.min().y(), bbox.width(), bbox.height(),
+                        data, bbox.width(), bbox.height(), GDT_Float64,
+                        num_bands, &band_map[0],
+                        pixel_space, pixel_space*bbox.width(), sizeof(double)) != CE_None)
+    vw_throw(vw::IOErr() << "Failed to read bands " << first_band << " to "
+             << first_band + num_bands - 1 << " over " << bbox << ".\n");
+}
@@ -25,12 +25,16 @@
 
 #include <string>
 #include <vw/Core/Functors.h>
+#include <vw/Core/Thread.h>
+#include <vw/Math/BBox.h>
 #include <vw/Image/PerPixelViews.h>
 #include <vw/Math/Vector.h>
 #include <vw/Math/Matrix.h>
 #include <vw/Image/ImageViewRef.h>
+#include <vw/Image/Manipulation.h>
 #include <vw/Mosaic/ImageComposite.h>
 #include <vw/FileIO/DiskImageUtils.h>
+#include <vw/FileIO/DiskImageResourceGDAL.h>
 
 #include <asp/Core/Common.h>
 
@@ -233,12 +237,68 @@ namespace asp {
   std::string prefix_from_pointcloud_filename(std::string const& filename);
 
 
+  /// Return true if this image is a GeoTIFF with its bands stored
+  /// separately (GDAL INTERLEAVE=BAND), so that some of them can be
+  /// read without decoding the others.
+  bool has_separate_bands(vw::DiskImageResourceGDAL & rsrc);
+
+  /// Read bands [first_band, first_band + num_bands) of an image
+  /// (starting from 0) over the given box as double, interleaving them
+  /// in the output buffer. Holds the global GDAL lock while reading.
+  void read_gdal_bands(vw::DiskImageResourceGDAL & rsrc, vw::BBox2i const& bbox,
+                       int first_band, int num_bands, double * data);
+
+  /// A view of m consecutive bands of an image. Only those bands are
+  /// read from disk, which saves work if the image has its bands
+  /// stored separately.
+  template<int m>
+  class BandSubsetView: public vw::ImageViewBase< BandSubsetView<m> > {
+    boost::shared_ptr<vw::DiskImageResourceGDAL> m_rsrc;
+    int m_first_band;
+  public:
+    BandSubsetView(boost::shared_ptr<vw::DiskImageResourceGDAL> rsrc, int first_band):
+      m_rsrc(rsrc), m_first_band(first_band){}
+
+    typedef vw::Vector<double, m> pixel_type;
+    typedef pixel_type result_type;
+    typedef vw::ProceduralPixelAccessor<BandSubsetView> pixel_accessor;
+
+    inline vw::int32 cols  () const { return m_rsrc->cols(); }
+    inline vw::int32 rows  () const { return m_rsrc->rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+    inline pixel_type operator()( double /*i*/, double /*j*/, vw::int32 /*p*/ = 0 ) const {
+      vw_throw(vw::NoImplErr() << "BandSubsetView::operator()(...) is not implemented");
+      return pixel_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<pixel_type> tile(bbox.width(), bbox.height());
+      if (!bbox.empty())
+        read_gdal_bands(*m_rsrc, bbox, m_first_band, m, (double*)tile.data());
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
   /// Read a point cloud file in the format written by ASP.
-  /// Given a point cloud with n channels, return the first m channels.
-  /// We must have 1 <= m <= n <= 6.
-  /// If the image was written by subtracting a shift, put that shift back.
+  /// Given a point cloud with n channels, return m channels starting
+  /// with first_channel. We must have 1 <= m <= n <= 6.
+  /// If the image was written by subtracting a shift, put that shift
+  /// back (only when the points themselves are read).
+  /// If the cloud is a GeoTIFF with its bands stored separately, as
+  /// written with --band-separated-point-cloud, only the needed ones
+  /// are read from disk.
   template<int m>
-  vw::ImageViewRef< vw::Vector<double, m> > read_asp_point_cloud(std::string const& filename);
+  vw::ImageViewRef< vw::Vector<double, m> > read_asp_point_cloud(std::string const& filename,
+                                                                 int first_channel = 0);
 
 
   /// Hide these functions from external users
@@ -249,22 +309,25 @@ namespace asp {
     /// Read a texture file
     template<class PixelT>
     typename boost::enable_if<boost::is_same<PixelT, vw::PixelGray<float> >, vw::ImageViewRef<PixelT> >::type
-    read_point_cloud_compatible_file(std::string const& file){
+    read_point_cloud_compatible_file(std::string const& file, int /*first_channel*/){
       return vw::DiskImageView<PixelT>(file);
     }
     /// Read a point cloud file
     template<class PixelT>
     typename boost::disable_if<boost::is_same<PixelT, vw::PixelGray<float> >, vw::ImageViewRef<PixelT> >::type
-    read_point_cloud_compatible_file(std::string const& file){
-      return asp::read_asp_point_cloud< vw::math::VectorSize<PixelT>::value >(file);
+    read_point_cloud_compatible_file(std::string const& file, int first_channel){
+      return asp::read_asp_point_cloud< vw::math::VectorSize<PixelT>::value >(file, first_channel);
     }
 
   } // end namespace point_utils_private
 
   /// Read multiple image files pack them into a single patchwork tiled image.
   /// - Relies on the vw::mosaic::ImageComposite class.
+  /// - For point clouds, the channels are read starting with first_channel.
+  ///   The layout of the composite does not depend on it.
   template<class PixelT>
-  inline vw::ImageViewRef<PixelT> form_point_cloud_composite(std::vector<std::string> const & files, int spacing=0);
+  inline vw::ImageViewRef<PixelT> form_point_cloud_composite(std::vector<std::string> const & files,
+                                                             int spacing=0, int first_channel=0);
 
 
   // Apply an offset to the points in the PointImage
@@ -376,26 +439,81 @@ namespace asp {
     virtual ~PcdReader();
   }; // End class PcdReader
 
+  /// The Morton (Z-order) key of a point by its first two
+  /// coordinates. It needs no bounding box, as it interleaves the
+  /// leading bits of the coordinates mapped to order-preserving
+  /// integers, so nearby points have nearby keys.
+  boost::uint64_t morton_key(vw::Vector3 const& point);
+
+  class SortedRunReader;
+
+  /// Reader returning all the points of another reader in the order
+  /// of their Morton keys, so that points read in succession are
+  /// spatially close. The input is read in runs of at most the given
+  /// number of points, which are sorted in parallel and written to
+  /// temporary files, then the runs are merged on the fly. If the
+  /// input fits in one run no files are written. The runs being sorted
+  /// at the same time, one per thread, and the buffers for merging take
+  /// about as much memory as one run per thread.
+  class SortedPointReader: public BaseReader{
+  public:
+    struct KeyedPoint {
+      boost::uint64_t key;
+      vw::Vector3     point;
+      bool operator<(KeyedPoint const& other) const { return key < other.key; }
+    };
+
+    SortedPointReader(BaseReader & reader, std::string const& tmp_prefix,
+                      boost::uint64_t run_size);
+    virtual bool ReadNextPoint();
+    virtual vw::Vector3 GetPoint();
+    virtual ~SortedPointReader();
+
+  private:
+    /// Files which are removed when this goes away, even if the
+    /// constructor throws part way.
+    struct TempFiles: public std::vector<std::string> {
+      ~TempFiles();
+    };
+
+    std::vector<KeyedPoint>  m_mem_points; ///< Used when there is a single run
+    size_t                   m_mem_index;
+    TempFiles                m_run_files;  ///< Must come before m_runs, to outlive it
+    std::vector< boost::shared_ptr<SortedRunReader> > m_runs;
+    std::vector< std::pair<boost::uint64_t, int> > m_heap; ///< Min-heap of next key and run
+    vw::Vector3              m_curr_point;
+  }; // End class SortedPointReader
+
 //===================================================================================
 // Template function definitions
 
 template<int m>
-vw::ImageViewRef< vw::Vector<double, m> > read_asp_point_cloud(std::string const& filename){
+vw::ImageViewRef< vw::Vector<double, m> > read_asp_point_cloud(std::string const& filename,
+                                                               int first_channel){
 
   vw::Vector3 shift;
   std::string shift_str;
-  boost::shared_ptr<vw::DiskImageResource> rsrc
+  boost::shared_ptr<vw::DiskImageResourceGDAL> rsrc
     ( new vw::DiskImageResourceGDAL(filename) );
   if (vw::cartography::read_header_string(*rsrc.get(), asp::ASP_POINT_OFFSET_TAG_STR, shift_str)){
     shift = vw::str_to_vec<vw::Vector3>(shift_str);
   }
 
-  // Read the first m channels
-  vw::ImageViewRef< vw::Vector<double, m> > out_image
-    = vw::read_channels<m, double>(filename, 0);
+  int num_channels = vw::get_num_channels(filename);
+  VW_ASSERT(first_channel >= 0 && first_channel + m <= num_channels,
+            vw::ArgumentErr() << "Cannot read " << m << " channels starting with channel "
+            << first_channel << " from " << filename << " as it has "
+            << num_channels << " channels.\n");
+
+  // Read m channels. If the bands are stored separately, read only those.
+  vw::ImageViewRef< vw::Vector<double, m> > out_image;
+  if (m < num_channels && has_separate_bands(*rsrc))
+    out_image = BandSubsetView<m>(rsrc, first_channel);
+  else
+    out_image = vw::read_channels<m, double>(filename, first_channel);
 
   // Add the shift back to the first several channels.
-  if (shift != vw::Vector3())
+  if (shift != vw::Vector3() && first_channel == 0)
     out_image = subtract_shift(out_image, -shift);
 
   return out_image;
@@ -405,7 +523,7 @@ vw::ImageViewRef< vw::Vector<double, m> > read_asp_point_cloud(std::string const
 /// Read given files and form an image composite.
 template<class PixelT>
 vw::ImageViewRef<PixelT> form_point_cloud_composite(std::vector<std::string> const & files,
-                                                    int spacing){
+                                                    int spacing, int first_channel){
 
   VW_ASSERT(files.size() >= 1, vw::ArgumentErr() << "Expecting at least one file.\n");
 
@@ -414,7 +532,7 @@ vw::ImageViewRef<PixelT> form_point_cloud_composite(std::vector<std::string> con
 
   for (int i = 0; i < (int)files.size(); i++){
 
-    vw::ImageViewRef<PixelT> I = point_utils_private::read_point_cloud_compatible_file<PixelT>(files[i]);
+    vw::ImageViewRef<PixelT> I = point_utils_private::read_point_cloud_compatible_file<PixelT>(files[i], first_channel);
 
     // We will stack the images in the composite side by side. Images which
     // are wider than tall will be transposed.
@@ -18,7 +18,9 @@
 
 /// \file StereoSettings.h
 ///
+#include <cmath>
 #include <fstream>
+#include <sstream>
 
 #include <vw/Core/RunOnce.h>
 #include <vw/Core/Log.h>
@@ -58,6 +60,21 @@ namespace asp {
     return *stereo_settings_ptr;
   }
 
+  // The images are blurred by the prefilter, which reaches to about
+  // 3.5 sigma, and the kernel is applied to the blurred images. The
+  // pyramid methods do the same at each level, blurring once more
+  // before subsampling, so their reach doubles per level.
+  // refine_tile() reads a little more for the parabola confidence.
+  int subpixel_refinement_halo() {
+    StereoSettings const& s = stereo_settings();
+    int halo = std::max(s.subpixel_kernel[0], s.subpixel_kernel[1]);
+    if (s.pre_filter_mode > 0)
+      halo += int(ceil(3.5*s.slogW)) + 1;
+    if (s.subpixel_mode == 2 || s.subpixel_mode == 3 || s.subpixel_mode == 4)
+      halo = (halo + 2) * (1 << int(s.subpixel_max_levels));
+    return halo + 4;
+  }
+
   void StereoSettings::initialize(vw::cartography::GdalWriteOptions & opt){
     // This is a bug fix. Ensure that all members of this class as
     // well as opt itself are always initialized before using them,
@@ -91,6 +108,7 @@ namespace asp {
     // Must initialize this variable as it is used in mapproject
     // to get a camera pointer, and there we don't parse stereo.default
     disable_correct_velocity_aberration = false;
+    isis_snapshot_tolerance = 0.0;
 
     double nan = std::numeric_limits<double>::quiet_NaN();
     nodata_value = nan;
@@ -110,6 +128,12 @@ namespace asp {
                       "Do stereo in a subregion of the left image [default: use the entire image].")
       ("right-image-crop-win", po::value(&global.right_image_crop_win)->default_value(BBox2i(0, 0, 0, 0), "xoff yoff xsize ysize"),
                       "Do stereo in a subregion of the right image if specified together with left-image-crop-win [default: use the entire image].")
+      ("lon-lat-roi",         po::value(&global.lon_lat_roi_str)->default_value(""),
+                      "Do stereo only for the region with this longitude-latitude box, given as 'lon_min lat_min lon_max lat_max', or polygon, given as 'lon1 lat1 lon2 lat2 lon3 lat3 ...'. Unless crop windows are set, the left and right crop windows are found by projecting the region into the cameras at the heights in --elevation-limit (or via the georeferences of map-projected images). Points outside the region are not triangulated, also when crop windows are set.")
+      ("resumable-output",    po::bool_switch(&global.resumable_output)->default_value(false)->implicit_value(true),
+                      "Keep a journal of the blocks written to the disparities of stereo_corr and stereo_rfne, and to the point cloud, next to these files. If a run is interrupted, running the same command again computes only the blocks not in the journal. A journal made with other options or inputs is discarded. The journal takes as much space as the uncompressed output, and is removed when the output is written.")
+      ("prefetch-mb",         po::value(&global.prefetch_mb)->default_value(256),
+                      "In stereo_rfne and stereo_tri, read the inputs of the next output tiles in the background while the current ones are computed, using at most this much memory (in MB) for the pixels read ahead. Set to 0 to not read ahead.")
       ("force-use-entire-range",   po::bool_switch(&global.force_use_entire_range)->default_value(false)->implicit_value(true),
                      "Normalize images based on the global min and max values from both images. Don't use this option if you are using normalized cross correlation.")
       ("individually-normalize",   po::bool_switch(&global.individually_normalize)->default_value(false)->implicit_value(true),
@@ -150,6 +174,8 @@ namespace asp {
        "Skip the step of performing datum-based rough homography if it fails.")
       ("skip-image-normalization", po::bool_switch(&global.skip_image_normalization)->default_value(false)->implicit_value(true),
        "Skip the step of normalizing the values of input images and removing nodata-pixels. Create instead symbolic links to original images.")
+      ("compact-normalized-images", po::bool_switch(&global.compact_normalized_images)->default_value(false)->implicit_value(true),
+       "Store the normalized images L.tif and R.tif as 16-bit integers scaled to the range of the normalized values, rather than as float. This halves their size and the time to read them in the later stages, with a precision of about 5e-5.")
       ("part-of-multiview-run", po::bool_switch(&global.part_of_multiview_run)->default_value(false)->implicit_value(true),
        "If the current run is part of a larger multiview run.")
       ("datum",                    po::value(&global.datum)->default_value("WGS_1984"),
@@ -173,6 +199,8 @@ namespace asp {
                      "Correlation cost metric. [0 Absolute, 1 Squared, 2 Normalized Cross Correlation, 3 Census Transform (SGM only), 4 Ternary Census Transform (SGM only)]")
       ("xcorr-threshold",        po::value(&global.xcorr_threshold)->default_value(2),
                      "L-R vs R-L agreement threshold in pixels.")
+      ("xcorr-single-pass",      po::bool_switch(&global.xcorr_single_pass)->default_value(false)->implicit_value(true),
+                     "At the full-resolution level of block matching, replace the L-R vs R-L check with a uniqueness check, which needs no second correlation pass: each right image pixel keeps only the best left image pixel landing on it. This is weaker than the L-R check, as a right pixel claimed by a single left pixel always passes. The coarser levels still do the L-R check.")
       ("min-xcorr-level",        po::value(&global.min_xcorr_level)->default_value(0),
                      "Minimum level to run xcorr check on (SGM only).")
       ("corr-kernel",            po::value(&global.corr_kernel)->default_value(Vector2i(21,21),"21 21"),
@@ -249,7 +277,9 @@ namespace asp {
       ("disable-v-subpixel",  po::bool_switch(&global.disable_v_subpixel)->default_value(false)->implicit_value(true),
                               "Disable calculation of subpixel in vertical direction.")
       ("subpixel-max-levels", po::value(&global.subpixel_max_levels)->default_value(2),
-                              "Max pyramid levels to process when using the BayesEM refinement. (0 is just a single level).");
+                              "Max pyramid levels to process when using the BayesEM refinement. (0 is just a single level).")
+      ("subpixel-confidence-threshold", po::value(&global.subpixel_confidence_threshold)->default_value(0.0),
+                              "With subpixel modes 2 and 3, first do parabola fitting, and use the slower method only for pixels where the confidence in the fit, between 0 and 1, is below this. Set to 0 to use the slower method everywhere.");
 
     po::options_description experimental_subpixel_options("Experimental Subpixel Options");
     experimental_subpixel_options.add_options()
@@ -339,8 +369,12 @@ namespace asp {
                                             "How much to round the output point cloud values, in meters (more rounding means less precision but potentially smaller size on disk). The inverse of a power of 2 is suggested. Default: 1/2^10 for Earth and proportionally less for smaller bodies.")
       ("save-double-precision-point-cloud", po::bool_switch(&global.save_double_precision_point_cloud)->default_value(false)->implicit_value(true),
                                             "Save the final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at twice the storage).")
+      ("band-separated-point-cloud",        po::bool_switch(&global.band_separated_point_cloud)->default_value(false)->implicit_value(true),
+                                            "Store each band of the output point cloud separately rather than interleaving them per pixel, so that tools which need only the points or only the triangulation error read just those bands.")
       ("compute-point-cloud-center-only",   po::bool_switch(&global.compute_point_cloud_center_only)->default_value(false)->implicit_value(true),
                                             "Only compute the center of triangulated point cloud and exit.")
+      ("preview-dem",                       po::bool_switch(&global.preview_dem)->default_value(false)->implicit_value(true),
+                                            "Triangulate the low-resolution disparity D_sub instead of the filtered disparity, write a coarse DEM and error map with the suffixes -DEM_preview.tif and -IntersectionErr_preview.tif, and exit. This needs only the low-resolution disparity, so it can be run right after it is computed.")
       ("skip-point-cloud-center-comp", po::bool_switch(&global.skip_point_cloud_center_comp)->default_value(false)->implicit_value(true),
        "Skip the computation of the point cloud center. This option is used in parallel_stereo.")
       ("compute-error-vector",              po::bool_switch(&global.compute_error_vector)->default_value(false)->implicit_value(true),
@@ -349,6 +383,10 @@ namespace asp {
        "Compute the piecewise adjustments as part of jitter correction, and then stop.")
       ("skip-computing-piecewise-adjustments", po::bool_switch(&global.skip_computing_piecewise_adjustments)->default_value(false)->implicit_value(true),
        "Skip computing the piecewise adjustments for jitter, they should have been done by now.")
+      ("mapproj-tx-table-tolerance", po::value(&global.mapproj_tx_table_tolerance)->default_value(0),
+       "With map-projected images, interpolate the transform to the original camera pixels from a grid computed for each tile, in the grid cells where the interpolation error at the cell center and edge midpoints is no more than this many pixels, and use the exact transform elsewhere. The error is only checked at these points, so it is not a bound. The default of 0 always uses the exact transform.")
+      ("mapproj-tx-table-spacing", po::value(&global.mapproj_tx_table_spacing)->default_value(16),
+       "The spacing, in pixels, of the grid used with --mapproj-tx-table-tolerance.")
       ;
   }
 
@@ -390,12 +428,21 @@ namespace asp {
        "Apply the velocity aberration correction for Digital Globe cameras.");
   }
 
+  IsisDescription::IsisDescription() : po::options_description("ISIS Options") {
+    StereoSettings& global = stereo_settings();
+    (*this).add_options()
+      ("isis-snapshot-tolerance", po::value(&global.isis_snapshot_tolerance)->default_value(0.0),
+       "If positive, sample the position and pointing of ISIS linescan cameras once into in-memory tables and use those instead of ISIS, if they agree with ISIS to within this many pixels.");
+  }
+
   UndocOptsDescription::UndocOptsDescription() : po::options_description("Undocumented Options") {
     StereoSettings& global = stereo_settings();
     (*this).add_options()
       ("trans-crop-win", po::value(&global.trans_crop_win)->default_value(BBox2i(0, 0, 0, 0), "xoff yoff xsize ysize"), "Left image crop window in respect to L.tif. This is an internal option. [default: use the entire image].")
       ("attach-georeference-to-lowres-disparity", po::bool_switch(&global.attach_georeference_to_lowres_disparity)->default_value(false)->implicit_value(true),
-       "If input images are georeferenced, make D_sub and D_sub_spread georeferenced.");
+       "If input images are georeferenced, make D_sub and D_sub_spread georeferenced.")
+      ("tile-costs-job-size", po::value(&global.tile_costs_job_size)->default_value(Vector2i(0, 0), "0 0"),
+       "Print the number of valid pixels and the disparity search area for each tile of a grid with tiles of this size, as used by parallel_stereo.");
   }
 
   po::options_description
@@ -409,6 +456,7 @@ namespace asp {
     cfg_options.add( TriangulationDescription() );
     cfg_options.add( GUIDescription()           );
     cfg_options.add( DGDescription()            );
+    cfg_options.add( IsisDescription()          );
     cfg_options.add( UndocOptsDescription()     );
 
     return cfg_options;
@@ -423,6 +471,34 @@ namespace asp {
                ArgumentErr() << "\"" <<  alignment_method
                << "\" is not a valid option for ALIGNMENT_METHOD." );
 
+    // Parse the region of interest. Four values are a box, and more
+    // are the vertices of a polygon.
+    lon_lat_roi.clear();
+    if (lon_lat_roi_str != "") {
+      std::string roi_str = lon_lat_roi_str;
+      boost::algorithm::replace_all(roi_str, ",", " ");
+      std::istringstream is(roi_str);
+      std::vector<double> vals;
+      double val;
+      while (is >> val)
+        vals.push_back(val);
+      VW_ASSERT( (vals.size() == 4 || vals.size() >= 6) && vals.size() % 2 == 0 && is.eof(),
+                 ArgumentErr() << "\"" << lon_lat_roi_str
+                 << "\" is not a valid longitude-latitude box or polygon." );
+      if (vals.size() == 4) {
+        BBox2 box;
+        box.grow(Vector2(vals[0], vals[1]));
+        box.grow(Vector2(vals[2], vals[3]));
+        lon_lat_roi.push_back(box.min());
+        lon_lat_roi.push_back(Vector2(box.max().x(), box.min().y()));
+        lon_lat_roi.push_back(box.max());
+        lon_lat_roi.push_back(Vector2(box.min().x(), box.max().y()));
+      } else {
+        for (size_t it = 0; it < vals.size(); it += 2)
+          lon_lat_roi.push_back(Vector2(vals[it], vals[it+1]));
+      }
+    }
+
     to_lower( universe_center );
     trim( universe_center );
     VW_ASSERT( universe_center == "camera" || universe_center == "zero" ||
@@ -59,6 +59,7 @@ namespace asp {
   struct TriangulationDescription : public boost::program_options::options_description { TriangulationDescription(); };
   struct GUIDescription           : public boost::program_options::options_description { GUIDescription          (); };
   struct DGDescription            : public boost::program_options::options_description { DGDescription           (); };
+  struct IsisDescription          : public boost::program_options::options_description { IsisDescription         (); };
   struct UndocOptsDescription     : public boost::program_options::options_description { UndocOptsDescription    (); };
 
   boost::program_options::options_description
@@ -86,6 +87,10 @@ namespace asp {
     // Do stereo in given regions only.
     vw::BBox2 left_image_crop_win;
     vw::BBox2 right_image_crop_win;
+    std::string lon_lat_roi_str;         ///< Region to process in lon-lat, as given
+    std::vector<vw::Vector2> lon_lat_roi; ///< That region, as a polygon
+    bool resumable_output;               ///< Journal the output blocks, to resume if interrupted
+    int  prefetch_mb;                    ///< Memory for reading inputs ahead of the tiles computed
 
     bool   force_use_entire_range;          /// Use entire dynamic range of image
     bool   individually_normalize;          /// If > 1, normalize the images
@@ -116,6 +121,7 @@ namespace asp {
     int    nodata_stddev_kernel;            ///< Kernel size of the nadata stddev calculation
     bool   skip_rough_homography;           ///< Use this if datum-based rough homography fails. 
     bool   skip_image_normalization;        ///< Skip the step of normalizing the values of input images and removing nodata-pixels. Create instead symbolic links to original images.
+    bool   compact_normalized_images;       ///< Store the normalized images L.tif and R.tif as 16-bit integers.
     bool   part_of_multiview_run;           ///< If this run is part of a larger multiview run
     std::string datum;                      ///< The datum to use with RPC camera models
 
@@ -141,6 +147,7 @@ namespace asp {
                                       // 3 = census transform
                                       // 3 = ternary census transform
     float        xcorr_threshold;     // L-R vs R-L agreement threshold in pixels
+    bool         xcorr_single_pass;   // Derive the R-L result from the L-R pass
     int          min_xcorr_level;     // Min level to perform xcorr check at, if specified.
     vw::Vector2i corr_kernel;         // Correlation kernel
     vw::BBox2i   search_range;        // Correlation search range
@@ -175,6 +182,7 @@ namespace asp {
     vw::Vector2i subpixel_kernel;     // Subpixel correlation kernel
     bool disable_h_subpixel, disable_v_subpixel;
     vw::uint16 subpixel_max_levels;   // Max pyramid levels to process. 0 hits only once.
+    double subpixel_confidence_threshold; // Modes 2 and 3 only where parabola is worse
 
     // Experimental Subpixel Options (mode 3 only)
     int subpixel_em_iter;
@@ -226,9 +234,13 @@ namespace asp {
     bool   use_least_squares;                 // Use a more rigorous triangulation
     bool   save_double_precision_point_cloud; // Save final point cloud in double precision rather than bringing the points closer to origin and saving as float (marginally more precision at 2x the storage).
     double point_cloud_rounding_error;        // How much to round the output point cloud values
+    bool   band_separated_point_cloud;        // Store the point cloud bands separately rather than interleaved
     bool   compute_point_cloud_center_only;   // Only compute the center of triangulated point cloud and exit.
+    bool   preview_dem;                       // Grid the low-resolution disparity into a coarse DEM and exit.
     bool   skip_point_cloud_center_comp;
     bool   unalign_disparity;                 // Compute disparity between unaligned images
+    double mapproj_tx_table_tolerance;        // Max error, in pixels, of the tabulated map-projection transform
+    int    mapproj_tx_table_spacing;          // Grid spacing, in pixels, of the tabulated map-projection transform
     
     // stereo_gui options
     int grid_cols;
@@ -245,9 +257,13 @@ namespace asp {
     // DG Options
     bool disable_correct_velocity_aberration;
 
+    // ISIS Options
+    double isis_snapshot_tolerance; // Use tabulated ISIS linescan cameras if accurate to this many pixels
+
     // Undocumented options. We don't want these exposed to the user.
     vw::BBox2i trans_crop_win;        // Left image crop window in respect to L.tif.
     bool attach_georeference_to_lowres_disparity;
+    vw::Vector2i tile_costs_job_size; // Print the cost of each parallel_stereo tile of this size
 
     // Internal variable, to ensure we always initialize this class before using it
     bool initialized_stereo_settings;
@@ -258,6 +274,10 @@ namespace asp {
   /// is invoked.  You must *always* access the stereo settings through this function.
   StereoSettings& stereo_settings();
 
+  /// How far beyond a tile subpixel refinement with the current
+  /// settings reads the images and the integer disparity.
+  int subpixel_refinement_halo();
+
   /// Custom readers for Boost Program Options
   class asp_config_file_iterator : public boost::program_options::detail::common_config_file_iterator {
     boost::shared_ptr<std::basic_istream<char> > is;
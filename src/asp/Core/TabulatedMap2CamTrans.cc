@@ -0,0 +1,157 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TabulatedMap2CamTrans.cc
+///
+
+#include <vw/Core/Exception.h>
+#include <vw/Camera/CameraModel.h>
+#include <asp/Core/TabulatedMap2CamTrans.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vw;
+
+namespace asp {
+
+TabulatedMap2CamTrans::TabulatedMap2CamTrans(cartography::Map2CamTrans const& exact_tx,
+                                             double tolerance, int grid_spacing):
+  m_exact_tx(exact_tx), m_tolerance(tolerance), m_spacing(grid_spacing) {
+
+  VW_ASSERT(m_spacing > 0, ArgumentErr() << "TabulatedMap2CamTrans: The grid spacing "
+            << "must be positive.\n");
+  m_invalid_pix = camera::CameraModel::invalid_pixel();
+}
+
+// Bilinear interpolation in the cell with given upper-left node
+Vector2 TabulatedMap2CamTrans::interp(Table const& table, int col, int row,
+                                      double dx, double dy) const {
+  return (1 - dx)*(1 - dy)*table.nodes(col,     row    )
+    +          dx *(1 - dy)*table.nodes(col + 1, row    )
+    +     (1 - dx)*     dy *table.nodes(col,     row + 1)
+    +          dx *     dy *table.nodes(col + 1, row + 1);
+}
+
+Vector2 TabulatedMap2CamTrans::reverse(Vector2 const& p) const {
+
+  // Keep a local handle on the table, it may be replaced by reverse_bbox()
+  boost::shared_ptr<Table> table = m_table;
+  if (!table)
+    return m_exact_tx.reverse(p);
+
+  double x = (p.x() - table->origin.x())/double(table->spacing);
+  double y = (p.y() - table->origin.y())/double(table->spacing);
+  int col = (int)floor(x), row = (int)floor(y);
+  if (col < 0 || row < 0 || col >= table->good.cols() || row >= table->good.rows() ||
+      !table->good(col, row))
+    return m_exact_tx.reverse(p);
+
+  return interp(*table, col, row, x - col, y - row);
+}
+
+BBox2i TabulatedMap2CamTrans::reverse_bbox(BBox2i const& bbox) const {
+
+  m_table.reset();
+  if (m_tolerance <= 0 || bbox.empty())
+    return m_exact_tx.reverse_bbox(bbox); // This caches the DEM in the exact transform
+
+  boost::shared_ptr<Table> table(new Table);
+  table->origin  = bbox.min();
+  table->spacing = m_spacing;
+  int num_cols = (bbox.width()  + m_spacing - 1)/m_spacing; // cells
+  int num_rows = (bbox.height() + m_spacing - 1)/m_spacing;
+
+  // The last grid nodes may be a bit beyond the box. Cache the DEM
+  // for all of them. This does not evaluate the transform, unlike
+  // Map2CamTrans::reverse_bbox(), which does so at every pixel.
+  BBox2i grid_box(bbox.min(), bbox.min() + m_spacing*Vector2i(num_cols, num_rows)
+                  + Vector2i(1, 1));
+  m_exact_tx.cache_dem(grid_box);
+
+  // Evaluate the exact transform at the nodes. The output box is
+  // found from these and the check points below.
+  BBox2 out_box;
+  table->nodes.set_size(num_cols + 1, num_rows + 1);
+  std::vector<bool> valid_node((num_cols + 1)*(num_rows + 1));
+  for (int row = 0; row <= num_rows; row++) {
+    for (int col = 0; col <= num_cols; col++) {
+      Vector2 pix = bbox.min() + m_spacing*Vector2(col, row);
+      Vector2 val = m_invalid_pix;
+      try {
+        val = m_exact_tx.reverse(pix);
+      } catch(...) {}
+      table->nodes(col, row) = val;
+      valid_node[row*(num_cols + 1) + col] = (val != m_invalid_pix);
+      if (val != m_invalid_pix)
+        out_box.grow(val);
+    }
+  }
+
+  // A cell can be interpolated in if all of its corners are valid and
+  // the interpolated values agree with the exact ones at the cell
+  // center and the midpoints of its edges. This is a sampled check,
+  // not a bound on the error between these points.
+  static const double check_pts[][2] = {{0.5, 0.5}, {0.5, 0.0}, {0.0, 0.5},
+                                        {0.5, 1.0}, {1.0, 0.5}};
+  double max_dev = 0.0; // the largest deviation of the transform from the grid seen
+  table->good.set_size(num_cols, num_rows);
+  for (int row = 0; row < num_rows; row++) {
+    for (int col = 0; col < num_cols; col++) {
+      bool corners_valid = valid_node[row*(num_cols + 1) + col    ] &&
+                           valid_node[row*(num_cols + 1) + col + 1] &&
+                           valid_node[(row + 1)*(num_cols + 1) + col    ] &&
+                           valid_node[(row + 1)*(num_cols + 1) + col + 1];
+      bool good = corners_valid;
+      for (int k = 0; k < 5; k++) {
+        double dx = check_pts[k][0], dy = check_pts[k][1];
+        Vector2 pix = bbox.min() + m_spacing*Vector2(col + dx, row + dy);
+        Vector2 exact = m_invalid_pix;
+        try {
+          exact = m_exact_tx.reverse(pix);
+        } catch(...) {}
+        if (exact == m_invalid_pix) {
+          good = false;
+          continue;
+        }
+        out_box.grow(exact);
+        if (!corners_valid)
+          continue;
+        double dev = norm_2(exact - interp(*table, col, row, dx, dy));
+        max_dev = std::max(max_dev, dev);
+        if (dev > m_tolerance)
+          good = false;
+      }
+      table->good(col, row) = good;
+    }
+  }
+
+  // If nothing projected into the camera, only the exact search over
+  // all pixels can tell where the box is
+  if (out_box.empty())
+    return m_exact_tx.reverse_bbox(bbox);
+
+  // The transform between the samples may stray from them by about as
+  // much as it strays from the grid at the check points. Add a pixel
+  // for the rounding to integer.
+  out_box.expand(max_dev + 1.0);
+  m_table = table;
+  return grow_bbox_to_int(out_box);
+}
+
+} // end namespace asp
@@ -0,0 +1,85 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TabulatedMap2CamTrans.h
+///
+/// A Map2CamTrans which, for each tile it is asked to cache, tabulates
+/// the map-projected to camera pixel transform on a coarse grid and
+/// interpolates in it. Grid cells where the interpolation is not
+/// within a given tolerance of the exact transform, at a few points
+/// sampled in each cell, use the exact transform instead.
+
+#ifndef __ASP_CORE_TABULATED_MAP2CAMTRANS_H__
+#define __ASP_CORE_TABULATED_MAP2CAMTRANS_H__
+
+#include <vw/Math/BBox.h>
+#include <vw/Math/Vector.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Transform.h>
+#include <vw/Cartography/Map2CamTrans.h>
+
+#include <boost/shared_ptr.hpp>
+
+namespace asp {
+
+  class TabulatedMap2CamTrans : public vw::TransformBase<TabulatedMap2CamTrans> {
+  public:
+
+    /// Wrap the exact transform. A non-positive tolerance disables the
+    /// tabulation, and then this behaves exactly as the wrapped transform.
+    TabulatedMap2CamTrans(vw::cartography::Map2CamTrans const& exact_tx,
+                          double tolerance, int grid_spacing);
+
+    /// Convert a camera pixel to a map-projected pixel. This is not
+    /// tabulated, as it is not used per pixel in the stereo stages.
+    vw::Vector2 forward(vw::Vector2 const& p) const { return m_exact_tx.forward(p); }
+
+    /// Convert a map-projected pixel to a camera pixel. If p is in a
+    /// tabulated cell which passed the error check, interpolate,
+    /// otherwise use the exact transform.
+    vw::Vector2 reverse(vw::Vector2 const& p) const;
+
+    /// Cache the DEM for this box in the exact transform, as
+    /// Map2CamTrans does, and also tabulate the transform over it.
+    /// The returned box is found from the grid nodes and the sampled
+    /// points, grown by a margin, rather than from every pixel.
+    vw::BBox2i reverse_bbox(vw::BBox2i const& bbox) const;
+
+  private:
+
+    // The table for the last box passed to reverse_bbox(). It is not
+    // modified after creation, so copies of this object can share it.
+    struct Table {
+      vw::Vector2i                origin;
+      int                         spacing;
+      vw::ImageView<vw::Vector2>  nodes;    // exact values at the grid nodes
+      vw::ImageView<vw::uint8>    good;     // cells where interpolation is accurate
+    };
+
+    vw::Vector2 interp(Table const& table, int col, int row, double dx, double dy) const;
+
+    vw::cartography::Map2CamTrans m_exact_tx;
+    double                        m_tolerance;
+    int                           m_spacing;
+    vw::Vector2                   m_invalid_pix;
+    mutable boost::shared_ptr<Table> m_table;
+  };
+
+} // end namespace asp
+
+#endif // __ASP_CORE_TABULATED_MAP2CAMTRANS_H__
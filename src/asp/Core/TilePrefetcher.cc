@@ -0,0 +1,176 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Log.h>
+#include <asp/Core/TilePrefetcher.h>
+
+#include <algorithm>
+
+using namespace vw;
+
+namespace {
+
+  // Read the inputs of one tile
+  class PrefetchTask: public vw::Task, private boost::noncopyable {
+    asp::TilePrefetcher & m_prefetcher;
+    int m_tile_id;
+  public:
+    PrefetchTask(asp::TilePrefetcher & prefetcher, int tile_id):
+      m_prefetcher(prefetcher), m_tile_id(tile_id){}
+    void operator()() { m_prefetcher.load_tile(m_tile_id); }
+  };
+
+} // end anonymous namespace
+
+namespace asp {
+
+  std::vector<BBox2i> write_schedule(BBox2i const& region, Vector2i const& tile_size) {
+    std::vector<BBox2i> tiles;
+    for (int row = 0; row < region.height(); row += tile_size.y()) {
+      for (int col = 0; col < region.width(); col += tile_size.x()) {
+        BBox2i tile(col, row, tile_size.x(), tile_size.y());
+        tile.crop(BBox2i(0, 0, region.width(), region.height()));
+        tile += region.min();
+        tiles.push_back(tile);
+      }
+    }
+    return tiles;
+  }
+
+  TilePrefetcher::TileKey TilePrefetcher::tile_key(BBox2i const& tile) {
+    return TileKey(std::make_pair(tile.min().x(), tile.min().y()),
+                   std::make_pair(tile.max().x(), tile.max().y()));
+  }
+
+  TilePrefetcher::TilePrefetcher(std::vector<BBox2i> const& tiles, boost::uint64_t budget_bytes,
+                                 int num_threads):
+    m_tiles(tiles), m_states(tiles.size(), TILE_WAITING), m_tile_bytes(tiles.size(), 0),
+    m_budget(budget_bytes), m_held(0), m_next(0), m_first_unstarted(0),
+    m_queue(std::max(num_threads, 1)) {
+    for (size_t it = 0; it < m_tiles.size(); it++)
+      m_tile_ids[tile_key(m_tiles[it])] = it;
+  }
+
+  TilePrefetcher::~TilePrefetcher() {
+    m_queue.join_all();
+  }
+
+  void TilePrefetcher::add_input(boost::shared_ptr<PrefetchInputBase> input) {
+    Mutex::Lock lock(m_mutex);
+    m_inputs.push_back(input);
+  }
+
+  void TilePrefetcher::begin_tile(BBox2i const& tile) {
+    Mutex::Lock lock(m_mutex);
+    std::map<TileKey, int>::const_iterator it = m_tile_ids.find(tile_key(tile));
+    if (it == m_tile_ids.end())
+      return;
+    int tile_id = it->second;
+
+    // Reading the inputs again would only compete with the read in progress
+    while (m_states[tile_id] == TILE_LOADING || m_states[tile_id] == TILE_SKIPPED)
+      m_loaded.wait(lock);
+    m_states[tile_id] = TILE_STARTED;
+
+    // The tiles are started in the order of the schedule, so those
+    // before this one which were read and not started are not computed.
+    for (size_t it = m_first_unstarted; it < size_t(tile_id); it++) {
+      if (m_states[it] == TILE_LOADED) {
+        release_tile(it);
+        m_states[it] = TILE_DONE;
+      } else if (m_states[it] == TILE_LOADING) {
+        m_states[it] = TILE_SKIPPED; // released once read
+      }
+    }
+    m_first_unstarted = std::max(m_first_unstarted, size_t(tile_id) + 1);
+
+    schedule_ahead();
+  }
+
+  void TilePrefetcher::end_tile(BBox2i const& tile) {
+    Mutex::Lock lock(m_mutex);
+    std::map<TileKey, int>::const_iterator it = m_tile_ids.find(tile_key(tile));
+    if (it == m_tile_ids.end())
+      return;
+    int tile_id = it->second;
+
+    m_states[tile_id] = TILE_DONE;
+    release_tile(tile_id);
+
+    schedule_ahead();
+  }
+
+  void TilePrefetcher::release_tile(int tile_id) {
+    for (size_t k = 0; k < m_inputs.size(); k++)
+      m_inputs[k]->release(tile_id);
+    m_held -= m_tile_bytes[tile_id];
+    m_tile_bytes[tile_id] = 0;
+  }
+
+  void TilePrefetcher::schedule_ahead() {
+    while (m_next < m_tiles.size()) {
+      if (m_states[m_next] != TILE_WAITING) { // started already
+        m_next++;
+        continue;
+      }
+
+      boost::uint64_t num_bytes = 0;
+      for (size_t k = 0; k < m_inputs.size(); k++)
+        num_bytes += m_inputs[k]->num_bytes(m_inputs[k]->footprint(m_tiles[m_next]));
+      if (num_bytes > m_budget) { // will be read when computed
+        m_next++;
+        continue;
+      }
+      if (m_held + num_bytes > m_budget)
+        return;
+
+      m_states[m_next]     = TILE_LOADING;
+      m_tile_bytes[m_next] = num_bytes;
+      m_held += num_bytes;
+      boost::shared_ptr<PrefetchTask> task(new PrefetchTask(*this, m_next));
+      m_queue.add_task(task);
+      m_next++;
+    }
+  }
+
+  void TilePrefetcher::load_tile(int tile_id) {
+    // The inputs are read without holding the lock. A failed read is
+    // not fatal, as the tile then reads what it needs itself.
+    try {
+      for (size_t k = 0; k < m_inputs.size(); k++) {
+        BBox2i box = m_inputs[k]->footprint(m_tiles[tile_id]);
+        if (!box.empty())
+          m_inputs[k]->load(tile_id, box);
+      }
+    } catch (std::exception const& e) {
+      VW_OUT(DebugMessage, "asp") << "Failed to read ahead the tile " << m_tiles[tile_id]
+                                  << ": " << e.what() << "\n";
+    }
+
+    Mutex::Lock lock(m_mutex);
+    if (m_states[tile_id] == TILE_SKIPPED) {
+      release_tile(tile_id);
+      m_states[tile_id] = TILE_DONE;
+      schedule_ahead();
+    } else {
+      m_states[tile_id] = TILE_LOADED;
+    }
+    m_loaded.notify_all();
+  }
+
+} // end namespace asp
@@ -0,0 +1,310 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file TilePrefetcher.h
+///
+/// Read the inputs of a tiled computation ahead of time. An output
+/// image is written in tiles in a known order, and the part of each
+/// input needed for a tile is that tile, shifted by a range of
+/// offsets (such as a disparity search range), and grown by a halo
+/// (such as half a correlation kernel). While the threads writing the
+/// output compute the current tiles, the inputs for the next ones are
+/// read in the background, as far ahead as a memory budget allows.
+
+#ifndef __ASP_CORE_TILE_PREFETCHER_H__
+#define __ASP_CORE_TILE_PREFETCHER_H__
+
+#include <vw/Core/Exception.h>
+#include <vw/Core/Thread.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/Math/BBox.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/ImageViewRef.h>
+#include <vw/Image/Manipulation.h>
+#include <vw/Image/EdgeExtension.h>
+
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+
+#include <map>
+#include <vector>
+
+namespace asp {
+
+  /// The tiles an image of this size is written in, in the order
+  /// block_write_gdal_image writes them, shifted by region.min().
+  std::vector<vw::BBox2i> write_schedule(vw::BBox2i const& region, vw::Vector2i const& tile_size);
+
+  /// An input which can be read ahead. The pixels read for each tile
+  /// are kept until the tile is done.
+  class PrefetchInputBase: private boost::noncopyable {
+  public:
+    virtual ~PrefetchInputBase(){}
+
+    /// The box of the input needed for an output tile. May be empty.
+    virtual vw::BBox2i footprint(vw::BBox2i const& tile) const = 0;
+
+    /// Memory needed to hold the pixels in a box
+    virtual boost::uint64_t num_bytes(vw::BBox2i const& box) const = 0;
+
+    /// Read the pixels in a box for the given tile
+    virtual void load(int tile_id, vw::BBox2i const& box) = 0;
+
+    /// Forget the pixels read for the given tile
+    virtual void release(int tile_id) = 0;
+  };
+
+  template <class PixelT>
+  class PrefetchInput: public PrefetchInputBase {
+    vw::ImageViewRef<PixelT> m_source;
+    vw::Vector2i m_halo;
+    vw::BBox2i   m_shift;
+    std::map<int, std::pair<vw::BBox2i, vw::ImageView<PixelT> > > m_buffers;
+    vw::Mutex    m_mutex;
+  public:
+
+    /// An output pixel p needs the input pixels within the halo of p +
+    /// s, for all s in the shift box (both ends included).
+    PrefetchInput(vw::ImageViewRef<PixelT> const& source, vw::Vector2i const& halo,
+                  vw::BBox2i const& shift):
+      m_source(source), m_halo(halo), m_shift(shift){}
+
+    vw::ImageViewRef<PixelT> const& source() const { return m_source; }
+
+    virtual vw::BBox2i footprint(vw::BBox2i const& tile) const {
+      vw::BBox2i box(tile.min() + m_shift.min() - m_halo,
+                     tile.max() + m_shift.max() + m_halo);
+      box.crop(bounding_box(m_source));
+      return box;
+    }
+
+    virtual boost::uint64_t num_bytes(vw::BBox2i const& box) const {
+      return boost::uint64_t(box.width())*box.height()*sizeof(PixelT);
+    }
+
+    virtual void load(int tile_id, vw::BBox2i const& box) {
+      vw::ImageView<PixelT> buf = crop(m_source, box);
+      vw::Mutex::Lock lock(m_mutex);
+      m_buffers[tile_id] = std::make_pair(box, buf);
+    }
+
+    virtual void release(int tile_id) {
+      vw::Mutex::Lock lock(m_mutex);
+      m_buffers.erase(tile_id);
+    }
+
+    /// Find pixels read ahead which cover the given box. Copies of an
+    /// ImageView share the pixels, so they stay valid if released.
+    bool find(vw::BBox2i const& box, vw::BBox2i & buf_box, vw::ImageView<PixelT> & buf) {
+      vw::Mutex::Lock lock(m_mutex);
+      typedef typename std::map<int, std::pair<vw::BBox2i, vw::ImageView<PixelT> > >::const_iterator
+        iter_type;
+      for (iter_type it = m_buffers.begin(); it != m_buffers.end(); it++) {
+        if (it->second.first.contains(box)) {
+          buf_box = it->second.first;
+          buf     = it->second.second;
+          return true;
+        }
+      }
+      return false;
+    }
+  };
+
+  /// Read the inputs for the tiles of an output ahead of the threads
+  /// computing them. The tiles are read in order, by a few threads of
+  /// its own, while the pixels read and not yet used take at most the
+  /// given number of bytes. A tile whose inputs alone exceed that is
+  /// not read ahead.
+  class TilePrefetcher: private boost::noncopyable {
+  public:
+    TilePrefetcher(std::vector<vw::BBox2i> const& tiles, boost::uint64_t budget_bytes,
+                   int num_threads = 2);
+
+    /// Waits for the reads in progress
+    ~TilePrefetcher();
+
+    /// Add an input. Must be done before the first tile is started.
+    void add_input(boost::shared_ptr<PrefetchInputBase> input);
+
+    /// Called before computing a tile. If its inputs are being read,
+    /// wait for that. Then start reading ahead of it. The tiles before
+    /// it in the schedule which were read but not started are taken
+    /// as skipped, such as those resumed from a journal, and their
+    /// inputs are freed. Tiles not in the schedule are ignored.
+    void begin_tile(vw::BBox2i const& tile);
+
+    /// Called once a tile is computed, to free its inputs
+    void end_tile(vw::BBox2i const& tile);
+
+    /// Read the inputs of a tile. Done by the background threads.
+    void load_tile(int tile_id);
+
+  private:
+    enum TileState { TILE_WAITING, TILE_LOADING, TILE_LOADED, TILE_STARTED, TILE_DONE,
+                     TILE_SKIPPED }; // skipped while loading
+    typedef std::pair< std::pair<int, int>, std::pair<int, int> > TileKey;
+
+    static TileKey tile_key(vw::BBox2i const& tile);
+
+    // Queue the reads for the next tiles which fit in the budget. The
+    // mutex must be locked.
+    void schedule_ahead();
+
+    // Free the inputs read for a tile. The mutex must be locked.
+    void release_tile(int tile_id);
+
+    std::vector<vw::BBox2i>      m_tiles;
+    std::map<TileKey, int>       m_tile_ids;
+    std::vector<TileState>       m_states;
+    std::vector<boost::uint64_t> m_tile_bytes;
+    std::vector<boost::shared_ptr<PrefetchInputBase> > m_inputs;
+    boost::uint64_t m_budget, m_held;
+    size_t          m_next, m_first_unstarted;
+    vw::Mutex       m_mutex;
+    vw::Condition   m_loaded;
+    vw::FifoWorkQueue m_queue;
+  };
+
+  /// An input image which is read from the pixels prefetched for the
+  /// current tiles, when these cover the requested box, and otherwise
+  /// from the image itself.
+  template <class PixelT>
+  class PrefetchedView: public vw::ImageViewBase<PrefetchedView<PixelT> > {
+    boost::shared_ptr<PrefetchInput<PixelT> > m_input;
+  public:
+    typedef PixelT pixel_type;
+    typedef PixelT result_type;
+    typedef vw::ProceduralPixelAccessor<PrefetchedView> pixel_accessor;
+
+    PrefetchedView(boost::shared_ptr<PrefetchInput<PixelT> > const& input): m_input(input){}
+
+    inline vw::int32 cols  () const { return m_input->source().cols(); }
+    inline vw::int32 rows  () const { return m_input->source().rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+    inline result_type operator()( vw::int32 i, vw::int32 j, vw::int32 p = 0 ) const {
+      return m_input->source()(i, j, p);
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::BBox2i buf_box;
+      vw::ImageView<pixel_type> buf;
+      if (!m_input->find(bbox, buf_box, buf)) {
+        buf_box = bbox;
+        buf     = crop(m_input->source(), bbox);
+      }
+      return prerasterize_type(buf, -buf_box.min().x(), -buf_box.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  /// Register an image as an input of the prefetcher, and return the
+  /// view to use instead of it.
+  template <class PixelT>
+  PrefetchedView<PixelT> prefetch_input(vw::ImageViewRef<PixelT> const& source,
+                                        vw::Vector2i const& halo, vw::BBox2i const& shift,
+                                        TilePrefetcher & prefetcher) {
+    boost::shared_ptr<PrefetchInput<PixelT> > input(new PrefetchInput<PixelT>(source, halo, shift));
+    prefetcher.add_input(input);
+    return PrefetchedView<PixelT>(input);
+  }
+
+  /// Tell the prefetcher when each tile of an output is computed. The
+  /// tile boxes must be those of the schedule the prefetcher was made
+  /// with.
+  template <class ImageT>
+  class PrefetchScheduleView: public vw::ImageViewBase<PrefetchScheduleView<ImageT> > {
+    ImageT           m_img;
+    TilePrefetcher & m_prefetcher;
+
+    // End the tile even if computing it throws
+    struct TileGuard {
+      TilePrefetcher & prefetcher;
+      vw::BBox2i       tile;
+      TileGuard(TilePrefetcher & p, vw::BBox2i const& t): prefetcher(p), tile(t) {
+        prefetcher.begin_tile(tile);
+      }
+      ~TileGuard() { prefetcher.end_tile(tile); }
+    };
+
+  public:
+    typedef typename ImageT::pixel_type pixel_type;
+    typedef pixel_type result_type;
+    typedef vw::ProceduralPixelAccessor<PrefetchScheduleView> pixel_accessor;
+
+    PrefetchScheduleView(vw::ImageViewBase<ImageT> const& img, TilePrefetcher & prefetcher):
+      m_img(img.impl()), m_prefetcher(prefetcher){}
+
+    inline vw::int32 cols  () const { return m_img.cols(); }
+    inline vw::int32 rows  () const { return m_img.rows(); }
+    inline vw::int32 planes() const { return 1; }
+
+    inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
+
+    inline pixel_type operator()( double /*i*/, double /*j*/, vw::int32 /*p*/ = 0 ) const {
+      vw_throw(vw::NoImplErr() << "PrefetchScheduleView::operator()(...) is not implemented");
+      return pixel_type();
+    }
+
+    typedef vw::CropView<vw::ImageView<pixel_type> > prerasterize_type;
+    inline prerasterize_type prerasterize(vw::BBox2i const& bbox) const {
+      vw::ImageView<pixel_type> tile;
+      {
+        TileGuard guard(m_prefetcher, bbox);
+        tile = crop(m_img, bbox);
+      }
+      return prerasterize_type(tile, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+    }
+
+    template <class DestT>
+    inline void rasterize(DestT const& dest, vw::BBox2i const& bbox) const {
+      vw::rasterize(prerasterize(bbox), dest, bbox);
+    }
+  };
+
+  template <class ImageT>
+  PrefetchScheduleView<ImageT>
+  prefetch_tiles(vw::ImageViewBase<ImageT> const& img, TilePrefetcher & prefetcher) {
+    return PrefetchScheduleView<ImageT>(img.impl(), prefetcher);
+  }
+
+  /// Read the pixels of an image in a box into memory, and present
+  /// them as the whole image, with zeros outside the box. Code which
+  /// reads the image pixel by pixel, within the box, then gets the
+  /// pixels read ahead for the box, and the same result.
+  template <class ImageT>
+  vw::ImageViewRef<typename ImageT::pixel_type>
+  crop_to_footprint(ImageT const& image, vw::BBox2i box) {
+    typedef typename ImageT::pixel_type PixelT;
+    box.crop(bounding_box(image));
+    vw::ImageView<PixelT> buf = crop(image, box);
+    return crop(edge_extend(buf, vw::ZeroEdgeExtension()), -box.min().x(), -box.min().y(),
+                image.cols(), image.rows());
+  }
+
+} // end namespace asp
+
+#endif // __ASP_CORE_TILE_PREFETCHER_H__
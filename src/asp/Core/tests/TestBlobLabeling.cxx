@@ -0,0 +1,117 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <asp/Core/BlobLabeling.h>
+
+#include <algorithm>
+#include <vector>
+
+using namespace vw;
+using namespace asp;
+
+TEST( BlobLabeling, label_tile ) {
+  ImageView<uint8> mask(6,4);
+  fill(mask, 0);
+  fill(crop(mask, 1, 1, 2, 2), 1);
+  mask(5,3) = 1;
+
+  ImageView<int32> labels;
+  // The background, the square, and the corner pixel
+  EXPECT_EQ( 3, label_tile_components(mask, labels) );
+  EXPECT_EQ( 0, labels(0,0) );
+  EXPECT_EQ( 1, labels(1,1) );
+  EXPECT_EQ( 1, labels(2,2) );
+  EXPECT_EQ( 2, labels(5,3) );
+  EXPECT_EQ( 0, labels(4,3) );
+}
+
+// The result must be the same no matter how the image is tiled
+TEST( BlobLabeling, tiling_invariance ) {
+  const int cols = 57, rows = 43;
+  ImageView<uint8> mask(cols, rows);
+  srand(3);
+  for (int col = 0; col < cols; col++)
+    for (int row = 0; row < rows; row++)
+      mask(col, row) = (rand() % 100 < 55);
+
+  BBox2i full(0, 0, cols, rows);
+  TiledBlobIndex ref_index;
+  ref_index.add_tile(full, mask);
+  ref_index.finalize(6, 10);
+  ImageView<uint8> ref_status;
+  std::vector<TiledBlobIndex::HoleInfo> ref_holes;
+  ref_index.classify(mask, full, ref_status, ref_holes);
+  EXPECT_GT( ref_index.num_holes_filled(),  0 );
+  EXPECT_GT( ref_index.num_blobs_removed(), 0 );
+
+  int tile_sizes[] = {5, 8, 13};
+  for (int k = 0; k < 3; k++) {
+    int ts = tile_sizes[k];
+    TiledBlobIndex index;
+    for (int row = 0; row < rows; row += ts) {
+      for (int col = 0; col < cols; col += ts) {
+        BBox2i tile(col, row, std::min(ts, cols - col), std::min(ts, rows - row));
+        index.add_tile(tile, crop(mask, tile));
+      }
+    }
+    index.finalize(6, 10);
+    EXPECT_EQ( ref_index.num_holes_filled(),  index.num_holes_filled()  );
+    EXPECT_EQ( ref_index.num_blobs_removed(), index.num_blobs_removed() );
+
+    ImageView<uint8> status;
+    std::vector<TiledBlobIndex::HoleInfo> holes;
+    index.classify(mask, full, status, holes);
+    EXPECT_EQ( ref_holes.size(), holes.size() );
+    for (int col = 0; col < cols; col++)
+      for (int row = 0; row < rows; row++)
+        EXPECT_EQ( ref_status(col, row), status(col, row) );
+  }
+}
+
+TEST( BlobLabeling, fill_and_remove ) {
+  ImageView<PixelMask<float> > img(9,9);
+  fill(img, PixelMask<float>(2.0));
+
+  // A one-pixel hole, and a small island in a large empty area
+  img(2,2).invalidate();
+  for (int col = 5; col < 9; col++)
+    for (int row = 0; row < 9; row++)
+      img(col, row).invalidate();
+  img(7,4) = PixelMask<float>(5.0);
+
+  TiledBlobIndex index;
+  for (int row = 0; row < 9; row += 4) {
+    for (int col = 0; col < 9; col += 4) {
+      BBox2i tile(col, row, std::min(4, 9 - col), std::min(4, 9 - row));
+      ImageView<PixelMask<float> > tile_img = crop(img, tile);
+      index.add_tile(tile, per_pixel_filter(tile_img, ValidMaskFunctor()));
+    }
+  }
+  index.finalize(2, 1);
+  EXPECT_EQ( 1, index.num_holes_filled()  );
+  EXPECT_EQ( 1, index.num_blobs_removed() );
+
+  ImageView<PixelMask<float> > out = fill_holes_and_remove_blobs(img, index);
+  EXPECT_TRUE( is_valid(out(2,2)) );
+  EXPECT_NEAR( 2.0, out(2,2).child(), 1e-6 );
+  EXPECT_FALSE( is_valid(out(7,4)) );
+  EXPECT_TRUE( is_valid(out(0,0)) );
+}
@@ -0,0 +1,106 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <asp/Core/BlockJournal.h>
+
+#include <boost/filesystem.hpp>
+
+using namespace vw;
+using namespace asp;
+using namespace vw::test;
+
+TEST( BlockJournal, resume ) {
+
+  UnlinkName output("TestBlockJournal.tif");
+  UnlinkName journal_file(BlockJournal::journal_file(output));
+  std::string description = journal_description<float>(8, 4, Vector2i(4, 4));
+
+  ImageView<float> img(8, 4);
+  for (int row = 0; row < img.rows(); row++)
+    for (int col = 0; col < img.cols(); col++)
+      img(col, row) = col + 10*row;
+  ImageView<float> left  = crop(img, BBox2i(0, 0, 4, 4));
+  ImageView<float> right = crop(img, BBox2i(4, 0, 4, 4));
+  size_t num_bytes = 16*sizeof(float);
+
+  {
+    BlockJournal journal(output, description);
+    EXPECT_EQ(0u, journal.num_resumed_blocks());
+    journal.add_block(BBox2i(0, 0, 4, 4), left.data(),  num_bytes);
+    journal.add_block(BBox2i(4, 0, 4, 4), right.data(), num_bytes);
+  }
+
+  // Simulate dying while appending one more block
+  {
+    std::ofstream fh(journal_file.c_str(), std::ios::binary | std::ios::app);
+    fh << "partial";
+  }
+
+  {
+    BlockJournal journal(output, description);
+    EXPECT_EQ(2u, journal.num_resumed_blocks());
+    ImageView<float> tile(4, 4);
+    ASSERT_TRUE(journal.read_block(BBox2i(4, 0, 4, 4), tile.data(), num_bytes));
+    for (int row = 0; row < tile.rows(); row++)
+      for (int col = 0; col < tile.cols(); col++)
+        EXPECT_EQ(img(col + 4, row), tile(col, row));
+    EXPECT_FALSE(journal.read_block(BBox2i(0, 4, 4, 4), tile.data(), num_bytes));
+
+    // Blocks added after resuming are found too
+    journal.add_block(BBox2i(0, 4, 4, 4), left.data(), num_bytes);
+    EXPECT_TRUE(journal.read_block(BBox2i(0, 4, 4, 4), tile.data(), num_bytes));
+  }
+
+  // A journal made with other options or inputs is not used
+  {
+    UnlinkName input("TestBlockJournalInput.txt");
+    {
+      std::ofstream fh(input.c_str());
+      fh << "input";
+    }
+    const char* args[] = {"prog", "--option", "1"};
+    set_journal_command_line(3, const_cast<char**>(args));
+    std::string fingerprint = journal_fingerprint(output);
+    add_journal_input(input);
+    EXPECT_NE(fingerprint, journal_fingerprint(output));
+    fingerprint = journal_fingerprint(output);
+    {
+      std::ofstream fh(input.c_str(), std::ios::app);
+      fh << " changed"; // a new size
+    }
+    EXPECT_NE(fingerprint, journal_fingerprint(output));
+
+    {
+      BlockJournal journal(output, description);
+      EXPECT_EQ(0u, journal.num_resumed_blocks());
+      journal.add_block(BBox2i(0, 0, 4, 4), left.data(), num_bytes);
+    }
+    BlockJournal journal(output, description);
+    EXPECT_EQ(1u, journal.num_resumed_blocks());
+  }
+
+  // A journal for another image is not used
+  {
+    BlockJournal journal(output, journal_description<double>(8, 4, Vector2i(4, 4)));
+    EXPECT_EQ(0u, journal.num_resumed_blocks());
+    journal.remove();
+    EXPECT_FALSE(boost::filesystem::exists(journal_file));
+  }
+}
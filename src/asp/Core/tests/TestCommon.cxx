@@ -128,3 +128,22 @@ TEST( Common, StereoMultiCmdCheck ) {
   EXPECT_EQ("dem.tif" , dem_path);
 
 } // End test StereoMultiCmdCheck
+
+TEST( Common, PointInPolygon ) {
+
+  // An L-shaped polygon
+  std::vector<Vector2> poly;
+  poly.push_back(Vector2(0, 0));
+  poly.push_back(Vector2(2, 0));
+  poly.push_back(Vector2(2, 1));
+  poly.push_back(Vector2(1, 1));
+  poly.push_back(Vector2(1, 2));
+  poly.push_back(Vector2(0, 2));
+
+  EXPECT_TRUE (point_in_polygon(Vector2(0.5, 0.5), poly));
+  EXPECT_TRUE (point_in_polygon(Vector2(1.5, 0.5), poly));
+  EXPECT_TRUE (point_in_polygon(Vector2(0.5, 1.5), poly));
+  EXPECT_FALSE(point_in_polygon(Vector2(1.5, 1.5), poly));
+  EXPECT_FALSE(point_in_polygon(Vector2(-1,  0.5), poly));
+  EXPECT_FALSE(point_in_polygon(Vector2(0.5, 3.0), poly));
+}
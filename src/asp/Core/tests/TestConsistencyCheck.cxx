@@ -0,0 +1,80 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Manipulation.h>
+#include <asp/Core/ConsistencyCheck.h>
+
+#include <cstdlib>
+
+using namespace vw;
+using namespace asp;
+
+// A textured right image, and a left image which is the right one
+// shifted by 3 pixels, so the true disparity is (3, 0).
+namespace {
+  void make_images(ImageView<float> & left, ImageView<float> & right) {
+    srand(7);
+    right.set_size(60, 60);
+    for (int row = 0; row < right.rows(); row++)
+      for (int col = 0; col < right.cols(); col++)
+        right(col, row) = float(rand() % 256);
+    left.set_size(60, 60);
+    fill(left, 0);
+    for (int row = 0; row < left.rows(); row++)
+      for (int col = 0; col + 3 < left.cols(); col++)
+        left(col, row) = right(col + 3, row);
+  }
+}
+
+TEST( ConsistencyCheck, single_pass ) {
+  ImageView<float> left, right;
+  make_images(left, right);
+  BBox2i image_box(0, 0, 60, 60), disp_box(10, 10, 20, 20);
+
+  ImageView<PixelMask<Vector2f> > disp(20, 20);
+  fill(disp, PixelMask<Vector2f>(Vector2f(3, 0)));
+  EXPECT_EQ( 0, single_pass_consistency_check(disp, disp_box, left, image_box,
+                                              right, image_box, Vector2i(5, 5), 1.0) );
+
+  // A wrong disparity landing where a correct one does loses to it
+  disp(5, 5) = PixelMask<Vector2f>(Vector2f(4, 0));
+  EXPECT_EQ( 1, single_pass_consistency_check(disp, disp_box, left, image_box,
+                                              right, image_box, Vector2i(5, 5), 0.5) );
+  EXPECT_FALSE( is_valid(disp(5, 5)) );
+  EXPECT_TRUE ( is_valid(disp(6, 5)) );
+
+  // With a threshold of one pixel it is kept
+  disp(5, 5) = PixelMask<Vector2f>(Vector2f(4, 0));
+  EXPECT_EQ( 0, single_pass_consistency_check(disp, disp_box, left, image_box,
+                                              right, image_box, Vector2i(5, 5), 1.0) );
+}
+
+TEST( ConsistencyCheck, window_ncc ) {
+  ImageView<float> left, right;
+  make_images(left, right);
+  Vector2i half_kernel(3, 3);
+  EXPECT_NEAR( 1.0, window_ncc(left, Vector2i(20, 20), right, Vector2i(23, 20), half_kernel), 1e-6 );
+  EXPECT_LT  ( window_ncc(left, Vector2i(20, 20), right, Vector2i(24, 20), half_kernel), 0.9 );
+
+  // A flat window
+  ImageView<float> flat(60, 60);
+  fill(flat, 5.0);
+  EXPECT_EQ( -1.0, window_ncc(flat, Vector2i(20, 20), right, Vector2i(23, 20), half_kernel) );
+}
@@ -0,0 +1,80 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/FileIO/DiskImageView.h>
+#include <vw/Cartography/GeoReferenceUtils.h>
+#include <asp/Core/MappedImage.h>
+
+using namespace vw;
+using namespace asp;
+using namespace vw::test;
+
+TEST( MappedImage, matches_gdal ) {
+
+  // A disparity with some invalid pixels, not a multiple of the tile size
+  ImageView<PixelMask<Vector2f> > disp(45, 37);
+  for (int row = 0; row < disp.rows(); row++) {
+    for (int col = 0; col < disp.cols(); col++) {
+      disp(col, row) = PixelMask<Vector2f>(Vector2f(col + 0.5, -row));
+      if ((col + row) % 7 == 0)
+        disp(col, row).invalidate();
+    }
+  }
+
+  cartography::GdalWriteOptions opt;
+  opt.raster_tile_size = Vector2i(16, 16);
+  cartography::GeoReference georef;
+  bool has_georef = false, has_nodata = false;
+  double nodata = 0;
+
+  UnlinkName raw("TestMappedImage-raw.tif");
+  opt.gdal_options["COMPRESS"] = "NONE";
+  cartography::block_write_gdal_image(raw, disp, has_georef, georef,
+                                      has_nodata, nodata, opt);
+
+  boost::shared_ptr<MappedFile> mapped;
+  MappedTiffLayout layout;
+  ASSERT_TRUE(map_tiled_tiff(raw, mapped, layout));
+  EXPECT_EQ(disp.cols(), layout.cols);
+  EXPECT_EQ(disp.rows(), layout.rows);
+  EXPECT_TRUE (layout_matches_pixel<PixelMask<Vector2f> >(layout));
+  EXPECT_FALSE(layout_matches_pixel<PixelMask<Vector2i> >(layout));
+  EXPECT_FALSE(layout_matches_pixel<float>(layout));
+
+  ImageViewRef<PixelMask<Vector2f> > mapped_disp
+    = open_intermediate<PixelMask<Vector2f> >(raw);
+  DiskImageView<PixelMask<Vector2f> > gdal_disp(raw);
+  ImageView<PixelMask<Vector2f> > from_map  = mapped_disp;
+  ImageView<PixelMask<Vector2f> > from_gdal = gdal_disp;
+  for (int row = 0; row < disp.rows(); row++) {
+    for (int col = 0; col < disp.cols(); col++) {
+      EXPECT_EQ(is_valid(from_gdal(col, row)), is_valid(from_map(col, row)));
+      EXPECT_VECTOR_EQ(from_gdal(col, row).child(), from_map(col, row).child());
+    }
+  }
+
+  // Compressed files are read with GDAL
+  UnlinkName lzw("TestMappedImage-lzw.tif");
+  opt.gdal_options["COMPRESS"] = "LZW";
+  cartography::block_write_gdal_image(lzw, disp, has_georef, georef,
+                                      has_nodata, nodata, opt);
+  EXPECT_FALSE(map_tiled_tiff(lzw, mapped, layout));
+}
@@ -0,0 +1,69 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <asp/Core/NormalizedImage.h>
+
+using namespace vw;
+using namespace asp;
+using namespace vw::test;
+
+TEST( NormalizedImage, scale ) {
+  NormalizedImageScale scale;
+  EXPECT_EQ(0,     scale.encode(scale.nodata));
+  EXPECT_EQ(1,     scale.encode(-5.0));  // clamped
+  EXPECT_EQ(65535, scale.encode(7.0));   // clamped
+  EXPECT_EQ(scale.nodata, scale.decode(0));
+  for (double val = -0.25; val < 1.25; val += 0.01)
+    EXPECT_NEAR(val, scale.decode(scale.encode(val)), scale.step()/2 + 1e-7);
+}
+
+TEST( NormalizedImage, write_read ) {
+
+  ImageView<PixelGray<float> > img(37, 21);
+  for (int row = 0; row < img.rows(); row++)
+    for (int col = 0; col < img.cols(); col++)
+      img(col, row) = -0.2 + 1.4*(col + row*img.cols())/double(img.cols()*img.rows());
+  float nodata = -32768.0;
+  img(3, 4) = nodata;
+
+  cartography::GdalWriteOptions opt;
+  opt.raster_tile_size = Vector2i(16, 16);
+  cartography::GeoReference georef;
+  bool has_georef = false, has_nodata = true;
+
+  bool compact[] = {false, true};
+  for (int c = 0; c < 2; c++) {
+    UnlinkName file("TestNormalizedImage.tif");
+    write_normalized_image(file, img, has_georef, georef, has_nodata, nodata, opt, compact[c]);
+
+    NormalizedImageScale scale;
+    EXPECT_EQ(compact[c], read_normalized_scale(file, scale));
+    float file_nodata = 0;
+    EXPECT_TRUE(read_normalized_nodata(file, file_nodata));
+    EXPECT_EQ(nodata, file_nodata);
+
+    ImageView<PixelGray<float> > out = open_normalized_image(file);
+    ASSERT_EQ(img.cols(), out.cols());
+    ASSERT_EQ(img.rows(), out.rows());
+    for (int row = 0; row < img.rows(); row++)
+      for (int col = 0; col < img.cols(); col++)
+        EXPECT_NEAR(img(col, row).v(), out(col, row).v(), 1e-4);
+  }
+}
@@ -18,6 +18,7 @@
 
 #include <test/Helpers.h>
 #include <asp/Core/PointUtils.h>
+#include <boost/filesystem.hpp>
 
 using namespace vw;
 using namespace asp;
@@ -152,3 +153,63 @@ TEST( PointUtils, PcdReader ) {
 }
 
 
+
+// Serves points from memory, to test readers built on top of other readers.
+class VectorReader: public asp::BaseReader{
+  std::vector<vw::Vector3> m_points;
+  size_t m_index;
+public:
+  VectorReader(std::vector<vw::Vector3> const& points): m_points(points), m_index(0){
+    m_num_points = points.size();
+    m_has_georef = false;
+  }
+  virtual bool ReadNextPoint(){ return ++m_index <= m_points.size(); }
+  virtual vw::Vector3 GetPoint(){ return m_points[m_index-1]; }
+};
+
+TEST( PointUtils, MortonKey ) {
+  // The key increases with both coordinates, across signs too
+  EXPECT_LT(morton_key(Vector3(1, 1, 0)),   morton_key(Vector3(2, 2, 0)));
+  EXPECT_LT(morton_key(Vector3(-2, -2, 0)), morton_key(Vector3(-1, -1, 0)));
+  EXPECT_LT(morton_key(Vector3(-1, -1, 0)), morton_key(Vector3(1, 1, 0)));
+  // The third coordinate is ignored
+  EXPECT_EQ(morton_key(Vector3(3, 4, 5)),   morton_key(Vector3(3, 4, -5)));
+}
+
+TEST( PointUtils, SortedPointReader ) {
+
+  std::vector<vw::Vector3> points;
+  for (int i = 0; i < 600; i++)
+    points.push_back(Vector3((i*37) % 601 - 300.0, (i*53) % 599 - 298.0, i));
+
+  // A run size giving so many runs that some are merged first, one
+  // which forces a merge of several runs from disk, and one that
+  // keeps everything in memory.
+  int run_sizes[] = {1, 7, 1000};
+  for (int r = 0; r < 3; r++) {
+    VectorReader reader(points);
+    std::vector<vw::Vector3> sorted;
+    {
+      SortedPointReader sorted_reader(reader, "TestSortedPointReader", run_sizes[r]);
+      EXPECT_EQ(points.size(), sorted_reader.m_num_points);
+      while (sorted_reader.ReadNextPoint())
+        sorted.push_back(sorted_reader.GetPoint());
+    }
+    ASSERT_EQ(points.size(), sorted.size());
+
+    // The run files are gone with the reader
+    EXPECT_FALSE(boost::filesystem::exists("TestSortedPointReader-run-0.bin"));
+    EXPECT_FALSE(boost::filesystem::exists("TestSortedPointReader-merged-0.bin"));
+
+    // The points come in order, and each input point comes once,
+    // as told by its unique third coordinate.
+    std::vector<int> seen(points.size(), 0);
+    for (size_t i = 0; i < sorted.size(); i++) {
+      if (i > 0)
+        EXPECT_LE(morton_key(sorted[i-1]), morton_key(sorted[i]));
+      seen[int(sorted[i][2])]++;
+    }
+    for (size_t i = 0; i < seen.size(); i++)
+      EXPECT_EQ(1, seen[i]);
+  }
+}
@@ -0,0 +1,204 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Image/Filter.h>
+#include <vw/Image/PixelMask.h>
+#include <vw/Stereo/SubpixelView.h>
+#include <asp/Core/StereoSettings.h>
+#include <asp/Core/TilePrefetcher.h>
+
+using namespace vw;
+using namespace asp;
+using namespace vw::test;
+
+TEST( TilePrefetcher, schedule ) {
+  std::vector<BBox2i> tiles = write_schedule(BBox2i(10, 20, 50, 30), Vector2i(32, 16));
+  ASSERT_EQ(4u, tiles.size());
+  EXPECT_EQ(BBox2i(10, 20, 32, 16), tiles[0]);
+  EXPECT_EQ(BBox2i(42, 20, 18, 16), tiles[1]);
+  EXPECT_EQ(BBox2i(10, 36, 32, 14), tiles[2]);
+  EXPECT_EQ(BBox2i(42, 36, 18, 14), tiles[3]);
+
+  ImageView<float> img(100, 100);
+  PrefetchInput<float> input(img, Vector2i(2, 3), BBox2i(Vector2i(-5, 0), Vector2i(5, 1)));
+  EXPECT_EQ(BBox2i(Vector2i(3, 17), Vector2i(49, 40)),
+            input.footprint(BBox2i(10, 20, 32, 16)));
+  EXPECT_EQ(BBox2i(Vector2i(0, 0), Vector2i(11, 5)),
+            input.footprint(BBox2i(0, 0, 4, 1)));
+}
+
+TEST( TilePrefetcher, same_result ) {
+
+  ImageView<float> img(70, 45);
+  for (int row = 0; row < img.rows(); row++)
+    for (int col = 0; col < img.cols(); col++)
+      img(col, row) = col + 100*row;
+
+  // The kernel of the filter needs a halo of 1, and the tiles are
+  // computed the way block_write_gdal_image would.
+  Vector2i tile_size(16, 16);
+  std::vector<BBox2i> tiles = write_schedule(bounding_box(img), tile_size);
+  ImageView<float> expected = box_filter(img, Vector2i(3, 3));
+
+  // A budget with room for a few tiles, and one with none
+  boost::uint64_t budgets[] = {4*20*20*sizeof(float), 0};
+  for (int b = 0; b < 2; b++) {
+    TilePrefetcher prefetcher(tiles, budgets[b]);
+    ImageViewRef<float> input = prefetch_input(ImageViewRef<float>(img), Vector2i(1, 1),
+                                               BBox2i(0, 0, 0, 0), prefetcher);
+    ImageViewRef<float> output = prefetch_tiles(box_filter(input, Vector2i(3, 3)), prefetcher);
+    ImageView<float> result(img.cols(), img.rows());
+    for (size_t t = 0; t < tiles.size(); t++)
+      crop(result, tiles[t]) = crop(output, tiles[t]);
+    for (int row = 0; row < img.rows(); row++)
+      for (int col = 0; col < img.cols(); col++)
+        EXPECT_NEAR(expected(col, row), result(col, row), 1e-3);
+  }
+}
+
+TEST( TilePrefetcher, served_from_buffer ) {
+
+  ImageView<float> img(40, 30);
+  fill(img, 1.0);
+  boost::shared_ptr<PrefetchInput<float> >
+    input(new PrefetchInput<float>(img, Vector2i(0, 0), BBox2i(0, 0, 0, 0)));
+  PrefetchedView<float> view(input);
+
+  // Change the image once a box is read ahead. A crop inside that box
+  // must come from the pixels read before, and one outside from the image.
+  BBox2i box(5, 5, 20, 10);
+  input->load(0, box);
+  fill(img, 2.0);
+
+  BBox2i covered(8, 6, 10, 5);
+  BBox2i buf_box;
+  ImageView<float> buf;
+  EXPECT_TRUE(input->find(covered, buf_box, buf));
+  EXPECT_EQ(box, buf_box);
+  ImageView<float> inside = crop(view, covered);
+  for (int row = 0; row < inside.rows(); row++)
+    for (int col = 0; col < inside.cols(); col++)
+      EXPECT_EQ(1.0, inside(col, row));
+
+  BBox2i uncovered(20, 10, 10, 10);
+  EXPECT_FALSE(input->find(uncovered, buf_box, buf));
+  ImageView<float> outside = crop(view, uncovered);
+  EXPECT_EQ(2.0, outside(0, 0));
+
+  // Once released, the image is read again
+  input->release(0);
+  ImageView<float> released = crop(view, covered);
+  EXPECT_EQ(2.0, released(0, 0));
+}
+
+TEST( TilePrefetcher, skipped_tiles ) {
+
+  ImageView<float> img(64, 16);
+  fill(img, 1.0);
+  std::vector<BBox2i> tiles = write_schedule(bounding_box(img), Vector2i(16, 16));
+  ASSERT_EQ(4u, tiles.size());
+
+  // Room for two tiles read ahead. The second and third tiles are
+  // read ahead of the first, then skipped, as when resuming from a
+  // journal, so their pixels must be freed.
+  boost::shared_ptr<PrefetchInput<float> >
+    input(new PrefetchInput<float>(img, Vector2i(0, 0), BBox2i(0, 0, 0, 0)));
+  {
+    TilePrefetcher prefetcher(tiles, 2*16*16*sizeof(float));
+    prefetcher.add_input(input);
+    prefetcher.begin_tile(tiles[0]);
+    prefetcher.end_tile(tiles[0]);
+    prefetcher.begin_tile(tiles[3]);
+    prefetcher.end_tile(tiles[3]);
+  } // waits for the reads in progress
+
+  BBox2i buf_box;
+  ImageView<float> buf;
+  for (int t = 0; t < 4; t++)
+    EXPECT_FALSE(input->find(tiles[t], buf_box, buf));
+}
+
+// Subpixel refinement in the given mode, as stereo_rfne does it
+ImageViewRef<PixelMask<Vector2f> >
+refine(int mode, ImageViewRef<PixelMask<Vector2f> > const& disp,
+       ImageViewRef<PixelGray<float> > const& left,
+       ImageViewRef<PixelGray<float> > const& right) {
+  StereoSettings const& s = stereo_settings();
+  stereo::PrefilterModeType prefilter
+    = static_cast<stereo::PrefilterModeType>(s.pre_filter_mode);
+  if (mode == 1)
+    return stereo::parabola_subpixel(disp, left, right, prefilter, s.slogW,
+                                     s.subpixel_kernel);
+  if (mode == 2)
+    return stereo::bayes_em_subpixel(disp, left, right, prefilter, s.slogW,
+                                     s.subpixel_kernel, s.subpixel_max_levels);
+  if (mode == 3)
+    return stereo::affine_subpixel(disp, left, right, prefilter, s.slogW,
+                                   s.subpixel_kernel, s.subpixel_max_levels);
+  return stereo::lk_subpixel(disp, left, right, prefilter, s.slogW,
+                             s.subpixel_kernel, s.subpixel_max_levels);
+}
+
+TEST( TilePrefetcher, refinement_footprint ) {
+
+  // A textured image, seen 2 pixels to the right in the right image
+  ImageView<PixelGray<float> > left(64, 48), right(64, 48);
+  for (int row = 0; row < left.rows(); row++) {
+    for (int col = 0; col < left.cols(); col++) {
+      left (col, row) = sin(0.7*col) * cos(0.45*row) + 0.5*sin(0.013*col*row);
+      right(col, row) = sin(0.7*(col-2)) * cos(0.45*row) + 0.5*sin(0.013*(col-2)*row);
+    }
+  }
+  ImageView<PixelMask<Vector2f> > disp(left.cols(), left.rows());
+  fill(disp, PixelMask<Vector2f>(Vector2f(2, 0)));
+
+  StereoSettings & s = stereo_settings();
+  s.subpixel_kernel     = Vector2i(7, 7);
+  s.pre_filter_mode     = 2;
+  s.slogW               = 1.4;
+  s.subpixel_max_levels = 2;
+
+  // Each tile refined from the inputs read within the halo must be
+  // the same as refined from the whole inputs.
+  std::vector<BBox2i> tiles = write_schedule(bounding_box(left), Vector2i(32, 32));
+  for (int mode = 1; mode <= 4; mode++) {
+    s.subpixel_mode = mode;
+    for (size_t t = 0; t < tiles.size(); t++) {
+      BBox2i box = tiles[t];
+      box.expand(subpixel_refinement_halo());
+      BBox2i right_box(box.min() + Vector2i(2, 0), box.max() + Vector2i(3, 1));
+
+      ImageView<PixelMask<Vector2f> > expected
+        = crop(refine(mode, disp, left, right), tiles[t]);
+      ImageView<PixelMask<Vector2f> > result
+        = crop(refine(mode, crop_to_footprint(disp, box), crop_to_footprint(left, box),
+                      crop_to_footprint(right, right_box)), tiles[t]);
+      for (int row = 0; row < expected.rows(); row++) {
+        for (int col = 0; col < expected.cols(); col++) {
+          ASSERT_EQ(is_valid(expected(col, row)), is_valid(result(col, row)));
+          if (!is_valid(expected(col, row)))
+            continue;
+          EXPECT_NEAR(expected(col, row).child()[0], result(col, row).child()[0], 1e-4);
+          EXPECT_NEAR(expected(col, row).child()[1], result(col, row).child()[1], 1e-4);
+        }
+      }
+    }
+  }
+}
@@ -22,6 +22,7 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <QPolygon>
 #include <QtGui>
 #include <QtWidgets>
@@ -996,4 +997,372 @@ void PointList::push_back(std::list<vw::Vector2> pts) {
   }
 }
 
+void PointGridIndex::build(std::vector<vw::ip::InterestPoint> const& ip) {
+
+  m_num_pts = ip.size();
+  m_cell_start.clear();
+  m_cell_pts.clear();
+  m_reps.clear();
+  if (ip.empty())
+    return;
+
+  BBox2 box;
+  for (size_t it = 0; it < ip.size(); it++)
+    box.grow(Vector2(ip[it].x, ip[it].y));
+
+  // Aim for a few points per cell on average, while making sure a
+  // long and thin box does not result in very many cells.
+  double wid = box.width(), hgt = box.height(), num = ip.size();
+  m_cell_size = std::max(sqrt(4.0*wid*hgt/num), 4.0*(wid + hgt)/num);
+  if (m_cell_size <= 0)
+    m_cell_size = 1.0;
+  m_origin = box.min();
+  int cols = int(wid/m_cell_size) + 1;
+  int rows = int(hgt/m_cell_size) + 1;
+
+  // Sort the points by cell. Within a cell they stay in increasing order.
+  std::vector<int> cell_of(ip.size());
+  m_cell_start.assign(cols*rows + 1, 0);
+  for (size_t it = 0; it < ip.size(); it++) {
+    int col = std::min(int((ip[it].x - m_origin.x())/m_cell_size), cols - 1);
+    int row = std::min(int((ip[it].y - m_origin.y())/m_cell_size), rows - 1);
+    cell_of[it] = row*cols + col;
+    m_cell_start[cell_of[it] + 1]++;
+  }
+  for (size_t cell = 1; cell < m_cell_start.size(); cell++)
+    m_cell_start[cell] += m_cell_start[cell - 1];
+  std::vector<int> pos(m_cell_start.begin(), m_cell_start.end() - 1);
+  m_cell_pts.resize(ip.size());
+  for (size_t it = 0; it < ip.size(); it++)
+    m_cell_pts[pos[cell_of[it]]++] = it;
+
+  // The finest level of representatives, then coarser ones, each
+  // having half the size of the previous one in each dimension.
+  ImageView<int> reps(cols, rows);
+  for (int row = 0; row < rows; row++) {
+    for (int col = 0; col < cols; col++) {
+      int cell = row*cols + col;
+      reps(col, row) = (m_cell_start[cell] < m_cell_start[cell + 1]) ?
+        m_cell_pts[m_cell_start[cell]] : -1;
+    }
+  }
+  m_reps.push_back(reps);
+  while (cols > 1 || rows > 1) {
+    ImageView<int> coarse((cols + 1)/2, (rows + 1)/2);
+    fill(coarse, -1);
+    for (int row = 0; row < rows; row++) {
+      for (int col = 0; col < cols; col++) {
+        int val = m_reps.back()(col, row);
+        int & rep = coarse(col/2, row/2);
+        if (val >= 0 && (rep < 0 || val < rep))
+          rep = val;
+      }
+    }
+    m_reps.push_back(coarse);
+    cols = coarse.cols();
+    rows = coarse.rows();
+  }
+}
+
+void PointGridIndex::query(std::vector<vw::ip::InterestPoint> const& ip,
+                           BBox2 const& box, double min_spacing,
+                           std::vector<int> & indices) const {
+
+  indices.clear();
+  if (m_num_pts == 0 || m_num_pts != ip.size() || box.empty())
+    return;
+
+  // Use the coarsest level whose cells are no bigger than min_spacing
+  int level = 0;
+  double cell_size = m_cell_size;
+  while (level + 1 < int(m_reps.size()) && 2*cell_size <= min_spacing) {
+    level++;
+    cell_size *= 2;
+  }
+
+  ImageView<int> const& reps = m_reps[level];
+  int beg_col = std::max(int(floor((box.min().x() - m_origin.x())/cell_size)), 0);
+  int beg_row = std::max(int(floor((box.min().y() - m_origin.y())/cell_size)), 0);
+  int end_col = std::min(int(floor((box.max().x() - m_origin.x())/cell_size)), reps.cols() - 1);
+  int end_row = std::min(int(floor((box.max().y() - m_origin.y())/cell_size)), reps.rows() - 1);
+
+  for (int row = beg_row; row <= end_row; row++) {
+    for (int col = beg_col; col <= end_col; col++) {
+
+      if (level > 0) {
+        int it = reps(col, row);
+        if (it >= 0 && box.contains(Vector2(ip[it].x, ip[it].y)))
+          indices.push_back(it);
+        continue;
+      }
+
+      int cell = row*reps.cols() + col;
+      for (int k = m_cell_start[cell]; k < m_cell_start[cell + 1]; k++) {
+        int it = m_cell_pts[k];
+        if (box.contains(Vector2(ip[it].x, ip[it].y)))
+          indices.push_back(it);
+      }
+    }
+  }
+
+  std::sort(indices.begin(), indices.end());
+}
+
+// Distance from a point to a segment
+static double distToSegment(double x, double y, double x0, double y0, double x1, double y1) {
+  double dx = x1 - x0, dy = y1 - y0;
+  double len2 = dx*dx + dy*dy;
+  double t = 0.0;
+  if (len2 > 0)
+    t = std::max(0.0, std::min(1.0, ((x - x0)*dx + (y - y0)*dy)/len2));
+  double ex = x0 + t*dx - x, ey = y0 + t*dy - y;
+  return sqrt(ex*ex + ey*ey);
+}
+
+// For each vertex of a polygon, find the largest Douglas-Peucker
+// tolerance at which it is still kept. The endpoints of an open
+// polygon, and the first vertex of a closed one and the vertex
+// farthest from it, are always kept.
+static void simplificationRank(int n, const double * x, const double * y, bool isClosed,
+                               std::vector<double> & rank) {
+
+  double big = std::numeric_limits<double>::max();
+  rank.assign(n, big);
+  if (n <= 2)
+    return;
+
+  // Each segment is given by its endpoints, with index n standing for
+  // vertex 0, and by the rank of the vertex which created it.
+  struct Seg { int beg, end; double cap; };
+  std::vector<Seg> segs;
+  if (isClosed) {
+    int far = 1;
+    double far_dist = -1.0;
+    for (int v = 1; v < n; v++) {
+      double d = (x[v] - x[0])*(x[v] - x[0]) + (y[v] - y[0])*(y[v] - y[0]);
+      if (d > far_dist) {
+        far_dist = d;
+        far = v;
+      }
+    }
+    Seg s1 = {0, far, big}, s2 = {far, n, big};
+    segs.push_back(s1);
+    segs.push_back(s2);
+  } else {
+    Seg s = {0, n - 1, big};
+    segs.push_back(s);
+  }
+
+  while (!segs.empty()) {
+    Seg s = segs.back();
+    segs.pop_back();
+    if (s.end - s.beg < 2)
+      continue;
+
+    int e = s.end % n, mid = s.beg + 1;
+    double max_dist = -1.0;
+    for (int v = s.beg + 1; v < s.end; v++) {
+      double d = distToSegment(x[v], y[v], x[s.beg], y[s.beg], x[e], y[e]);
+      if (d > max_dist) {
+        max_dist = d;
+        mid = v;
+      }
+    }
+
+    // A vertex cannot outlive the vertices which made it a candidate
+    rank[mid] = std::min(max_dist, s.cap);
+    Seg s1 = {s.beg, mid, rank[mid]}, s2 = {mid, s.end, rank[mid]};
+    segs.push_back(s1);
+    segs.push_back(s2);
+  }
+}
+
+void PolyLayerIndex::build(std::vector<vw::geometry::dPoly> const& polyVec) {
+
+  *this = PolyLayerIndex();
+
+  // Put all polygons of all layers together
+  m_start.push_back(0);
+  for (size_t layerIter = 0; layerIter < polyVec.size(); layerIter++) {
+
+    vw::geometry::dPoly const& poly = polyVec[layerIter]; // alias
+    int                   numPolys  = poly.get_numPolys();
+    const int           * numVerts  = poly.get_numVerts();
+    const double        * xv        = poly.get_xv();
+    const double        * yv        = poly.get_yv();
+    std::vector<char>     isClosed  = poly.get_isPolyClosed();
+    std::vector<string>   colors    = poly.get_colors();
+    std::vector<string>   layers    = poly.get_layers();
+
+    int start = 0;
+    for (int pIter = 0; pIter < numPolys; pIter++) {
+
+      if (pIter > 0) start += numVerts[pIter - 1];
+      int pSize = numVerts[pIter];
+      if (pSize <= 0)
+        continue;
+
+      BBox2 box;
+      for (int vIter = 0; vIter < pSize; vIter++) {
+        m_xv.push_back(xv[start + vIter]);
+        m_yv.push_back(yv[start + vIter]);
+        box.grow(Vector2(xv[start + vIter], yv[start + vIter]));
+      }
+      m_start.push_back(m_xv.size());
+      m_isPolyClosed.push_back(isClosed[pIter]);
+      m_colors.push_back(colors[pIter]);
+      m_layers.push_back(layers[pIter]);
+      m_boxes.push_back(box);
+    }
+  }
+  m_num_polys = m_boxes.size();
+  if (m_num_polys == 0)
+    return;
+
+  BBox2 all_box;
+  for (int pIter = 0; pIter < m_num_polys; pIter++) {
+    all_box.grow(m_boxes[pIter].min()); // a box may be degenerate, so grow by corners
+    all_box.grow(m_boxes[pIter].max());
+  }
+  double wid = all_box.width(), hgt = all_box.height();
+
+  // Rank the vertices, and form the simplification levels. The first
+  // stored level is the finest one which drops at least half of the
+  // vertices, and the last one is coarse enough to keep no more than
+  // the vertices which are always kept.
+  std::vector<double> rank(m_xv.size()), poly_rank;
+  for (int pIter = 0; pIter < m_num_polys; pIter++) {
+    int beg = m_start[pIter], num = m_start[pIter + 1] - beg;
+    simplificationRank(num, &m_xv[beg], &m_yv[beg], m_isPolyClosed[pIter], poly_rank);
+    std::copy(poly_rank.begin(), poly_rank.end(), rank.begin() + beg);
+  }
+  double diag = sqrt(wid*wid + hgt*hgt);
+  if (diag > 0) {
+    double tol = diag/double(1 << 30);
+    while (tol <= diag) {
+      std::vector<int> verts, starts(1, 0);
+      for (int pIter = 0; pIter < m_num_polys; pIter++) {
+        for (int v = m_start[pIter]; v < m_start[pIter + 1]; v++) {
+          if (rank[v] > tol)
+            verts.push_back(v);
+        }
+        starts.push_back(verts.size());
+      }
+      if (m_level_verts.empty() && 2*verts.size() > m_xv.size()) {
+        tol *= 2;
+        continue;
+      }
+      if (m_level_verts.empty())
+        m_first_tol = tol;
+      m_level_verts.push_back(verts);
+      m_level_start.push_back(starts);
+      tol *= 2;
+    }
+  }
+
+  // The grid of bounding boxes, with about one polygon per cell
+  m_origin = all_box.min();
+  m_cell_size = std::max(sqrt(wid*hgt/m_num_polys), std::max(wid, hgt)/m_num_polys);
+  if (m_cell_size <= 0)
+    m_cell_size = 1.0;
+  m_cols = int(wid/m_cell_size) + 1;
+  m_rows = int(hgt/m_cell_size) + 1;
+
+  const int max_cells_per_poly = 16;
+  std::vector<int> beg_col(m_num_polys), end_col(m_num_polys),
+    beg_row(m_num_polys), end_row(m_num_polys);
+  m_cell_start.assign(m_cols*m_rows + 1, 0);
+  for (int pIter = 0; pIter < m_num_polys; pIter++) {
+    BBox2 const& box = m_boxes[pIter];
+    beg_col[pIter] = std::min(int((box.min().x() - m_origin.x())/m_cell_size), m_cols - 1);
+    end_col[pIter] = std::min(int((box.max().x() - m_origin.x())/m_cell_size), m_cols - 1);
+    beg_row[pIter] = std::min(int((box.min().y() - m_origin.y())/m_cell_size), m_rows - 1);
+    end_row[pIter] = std::min(int((box.max().y() - m_origin.y())/m_cell_size), m_rows - 1);
+    if ((end_col[pIter] - beg_col[pIter] + 1)*(end_row[pIter] - beg_row[pIter] + 1)
+        > max_cells_per_poly) {
+      m_big_polys.push_back(pIter);
+      continue;
+    }
+    for (int row = beg_row[pIter]; row <= end_row[pIter]; row++)
+      for (int col = beg_col[pIter]; col <= end_col[pIter]; col++)
+        m_cell_start[row*m_cols + col + 1]++;
+  }
+  for (size_t cell = 1; cell < m_cell_start.size(); cell++)
+    m_cell_start[cell] += m_cell_start[cell - 1];
+  std::vector<int> pos(m_cell_start.begin(), m_cell_start.end() - 1);
+  m_cell_polys.resize(m_cell_start.back());
+  for (int pIter = 0; pIter < m_num_polys; pIter++) {
+    if (!m_big_polys.empty() && std::binary_search(m_big_polys.begin(), m_big_polys.end(), pIter))
+      continue;
+    for (int row = beg_row[pIter]; row <= end_row[pIter]; row++)
+      for (int col = beg_col[pIter]; col <= end_col[pIter]; col++)
+        m_cell_polys[pos[row*m_cols + col]++] = pIter;
+  }
+}
+
+void PolyLayerIndex::extract(BBox2 const& box, double tol, vw::geometry::dPoly & out) const {
+
+  out.reset();
+  if (m_num_polys == 0 || box.empty())
+    return;
+
+  // The candidates are the polygons in the cells overlapping the box,
+  // and the big ones.
+  std::vector<int> ids = m_big_polys;
+  int beg_col = std::max(int(floor((box.min().x() - m_origin.x())/m_cell_size)), 0);
+  int beg_row = std::max(int(floor((box.min().y() - m_origin.y())/m_cell_size)), 0);
+  int end_col = std::min(int(floor((box.max().x() - m_origin.x())/m_cell_size)), m_cols - 1);
+  int end_row = std::min(int(floor((box.max().y() - m_origin.y())/m_cell_size)), m_rows - 1);
+  for (int row = beg_row; row <= end_row; row++) {
+    for (int col = beg_col; col <= end_col; col++) {
+      int cell = row*m_cols + col;
+      ids.insert(ids.end(), m_cell_polys.begin() + m_cell_start[cell],
+                 m_cell_polys.begin() + m_cell_start[cell + 1]);
+    }
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+
+  // The coarsest level whose tolerance is no more than tol, if any
+  int level = -1;
+  if (tol > 0 && !m_level_verts.empty() && m_first_tol <= tol) {
+    level = 0;
+    double level_tol = m_first_tol;
+    while (level + 1 < int(m_level_verts.size()) && 2*level_tol <= tol) {
+      level++;
+      level_tol *= 2;
+    }
+  }
+
+  std::vector<double> xv, yv;
+  for (size_t it = 0; it < ids.size(); it++) {
+
+    int pIter = ids[it];
+    BBox2 const& pbox = m_boxes[pIter];
+    if (pbox.min().x() > box.max().x() || pbox.max().x() < box.min().x() ||
+        pbox.min().y() > box.max().y() || pbox.max().y() < box.min().y())
+      continue;
+
+    xv.clear();
+    yv.clear();
+    if (tol > 0 && std::max(pbox.width(), pbox.height()) <= tol) {
+      xv.push_back(m_xv[m_start[pIter]]);
+      yv.push_back(m_yv[m_start[pIter]]);
+    } else if (level < 0) {
+      xv.assign(m_xv.begin() + m_start[pIter], m_xv.begin() + m_start[pIter + 1]);
+      yv.assign(m_yv.begin() + m_start[pIter], m_yv.begin() + m_start[pIter + 1]);
+    } else {
+      std::vector<int> const& verts  = m_level_verts[level];
+      std::vector<int> const& starts = m_level_start[level];
+      for (int k = starts[pIter]; k < starts[pIter + 1]; k++) {
+        xv.push_back(m_xv[verts[k]]);
+        yv.push_back(m_yv[verts[k]]);
+      }
+    }
+
+    out.appendPolygon(xv.size(), vw::geometry::vecPtr(xv), vw::geometry::vecPtr(yv),
+                      m_isPolyClosed[pIter], m_colors[pIter], m_layers[pIter]);
+  }
+}
+
 }} // namespace vw::gui
@@ -296,6 +296,77 @@ namespace vw { namespace gui {
     void push_back(std::list<vw::Vector2> pts);
   };
 
+  /// A grid over a set of interest points, so that the ones in a given
+  /// box can be found without visiting all of them. Also kept is a
+  /// pyramid of coarser grids with one representative point per cell,
+  /// used to thin out the points when zoomed out.
+  class PointGridIndex {
+  public:
+    PointGridIndex(): m_num_pts(0), m_cell_size(1.0) {}
+
+    /// Bin the given points. Any previous contents are discarded.
+    void build(std::vector<vw::ip::InterestPoint> const& ip);
+
+    /// Number of points the index was built with.
+    size_t num_points() const { return m_num_pts; }
+
+    /// Find the indices of the points in the given box. If min_spacing
+    /// is positive, return at most about one point per square of that
+    /// size. The output is sorted.
+    void query(std::vector<vw::ip::InterestPoint> const& ip,
+               BBox2 const& box, double min_spacing,
+               std::vector<int> & indices) const;
+
+  private:
+    size_t      m_num_pts;
+    vw::Vector2 m_origin;
+    double      m_cell_size;  // for the finest grid, doubled at each coarser level
+    std::vector<int> m_cell_start, m_cell_pts; // finest grid, in compressed row form
+    std::vector< ImageView<int> > m_reps; // per level, the smallest point index in each cell
+  };
+
+  /// The polygons of a set of vector layers, with their bounding boxes
+  /// kept in a grid, and with simplified versions of them for coarser
+  /// zoom levels. The simplification is Douglas-Peucker, with the
+  /// tolerance doubling from one level to the next.
+  class PolyLayerIndex {
+  public:
+    PolyLayerIndex(): m_num_polys(0), m_first_tol(0.0), m_cell_size(1.0),
+                      m_cols(0), m_rows(0) {}
+
+    /// Index the polygons of all given layers. Any previous contents are discarded.
+    void build(std::vector<vw::geometry::dPoly> const& polyVec);
+
+    bool empty() const { return m_num_polys == 0; }
+
+    /// Put in out the polygons whose bounding boxes intersect the given
+    /// box, simplified so that they deviate from the originals by at
+    /// most tol. A polygon smaller than that becomes a single point.
+    /// With tol = 0 the polygons are returned unchanged.
+    void extract(BBox2 const& box, double tol, vw::geometry::dPoly & out) const;
+
+  private:
+    int m_num_polys;
+    std::vector<double>      m_xv, m_yv;
+    std::vector<int>         m_start;      // where each polygon starts in m_xv, m_yv
+    std::vector<char>        m_isPolyClosed;
+    std::vector<std::string> m_colors, m_layers;
+    std::vector<BBox2>       m_boxes;
+
+    // The vertices kept at each simplification level, and where each
+    // polygon's vertices start there. Levels which would keep most
+    // vertices are not stored.
+    double m_first_tol;
+    std::vector< std::vector<int> > m_level_verts, m_level_start;
+
+    // The grid of polygon bounding boxes. Polygons overlapping too
+    // many cells are kept separately.
+    vw::Vector2 m_origin;
+    double m_cell_size;
+    int m_cols, m_rows;
+    std::vector<int> m_cell_start, m_cell_polys, m_big_polys;
+  };
+
   /// Class to create a file list on the left side of the window
   class chooseFilesDlg: public QWidget{
     Q_OBJECT
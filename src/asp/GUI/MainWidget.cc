@@ -172,7 +172,7 @@ namespace vw { namespace gui {
       m_image_files(image_files), m_matches(matches),  m_use_georef(use_georef),
       m_view_matches(view_matches), m_zoom_all_to_same_region(zoom_all_to_same_region),
       m_allowMultipleSelections(allowMultipleSelections), m_can_emit_zoom_all_signal(false),
-      m_polyEditMode(false), m_polyVecIndex(0),
+      m_polyEditMode(false), m_polyVecIndex(0), m_polyIndexValid(false),
       m_pixelTol(6), m_backgroundColor(QColor("black")) {
 
     installEventFilter(this);
@@ -1037,8 +1037,31 @@ namespace vw { namespace gui {
         highlight_last = true;
     }
 
+    // The matches may have been added or deleted since the index was built
+    if (m_ip_index.num_points() != ip.size())
+      m_ip_index.build(ip);
+
+    // Find the points in the visible regions. When zoomed out, draw
+    // at most about one point per couple of screen pixels, as the rest
+    // would just overlap.
+    double min_spacing = pixelToWorldDist(2.0);
+    std::vector<int> indices, region_indices;
+    for (std::list<BBox2i>::const_iterator i=valid_regions.begin(); i!=valid_regions.end(); ++i) {
+      m_ip_index.query(ip, screen2world(BBox2(*i)), min_spacing, region_indices);
+      indices.insert(indices.end(), region_indices.begin(), region_indices.end());
+    }
+    if (valid_regions.size() > 1) {
+      std::sort(indices.begin(), indices.end());
+      indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+    }
+
+    // The point being edited is always shown
+    if (highlight_last && (indices.empty() || indices.back() != int(ip.size()) - 1))
+      indices.push_back(ip.size() - 1);
+
     // For each IP...
-    for (size_t ip_iter = 0; ip_iter < ip.size(); ip_iter++) {
+    for (size_t ind_iter = 0; ind_iter < indices.size(); ind_iter++) {
+      size_t ip_iter = indices[ind_iter];
       // Generate the pixel coord of the point
       double x = ip[ip_iter].x;
       double y = ip[ip_iter].y;
@@ -1193,42 +1216,38 @@ namespace vw { namespace gui {
                             poly);
     }
     
-    // Plot the polygon being drawn now, and pre-existing polygons
-    for (size_t polyIter = 0; polyIter < m_polyVec.size() + 1; polyIter++){
-      
-      vw::geometry::dPoly poly;
-      
-      if (polyIter == 0) {
+    // Plot the polygon being drawn now
+    if (!m_currPolyX.empty() && m_polyEditMode) {
 
-        if (m_currPolyX.empty() || !m_polyEditMode)
-          continue;
+      if (!m_images[m_polyVecIndex].has_georef) // this should not happen
+        vw_throw(ArgumentErr() << "Expecting images with georeference.\n");
 
-        if (!m_images[m_polyVecIndex].has_georef) // this should not happen
-          vw_throw(ArgumentErr() << "Expecting images with georeference.\n");
+      vw::geometry::dPoly poly;
+      poly.appendPolygon(m_currPolyX.size(),  
+                         vw::geometry::vecPtr(m_currPolyX),  
+                         vw::geometry::vecPtr(m_currPolyY),  
+                         isPolyClosed, polyColorStr, layer);
+      MainWidget::projPolyToWorld(poly);
+      MainWidget::plotDPoly(plotPoints, plotEdges, m_showPolysFilled->isChecked(),
+                            m_showIndices->isChecked(),
+                            lineWidth,  
+			    drawVertIndex, polyColor, paint, poly);
+    }
 
-        poly.reset();
-        poly.appendPolygon(m_currPolyX.size(),  
-                           vw::geometry::vecPtr(m_currPolyX),  
-                           vw::geometry::vecPtr(m_currPolyY),  
-                           isPolyClosed, polyColorStr, layer);
-      }else{
-        poly = m_polyVec[polyIter-1]; // make a deep copy
-      }
+    // Plot the pre-existing polygons. Only the ones in view are drawn,
+    // simplified to within half a pixel, unless all their vertices
+    // must be seen.
+    if (!m_polyVec.empty()) {
 
-      double val1 = vw::geometry::signedPolyArea(poly.get_totalNumVerts(),
-                                                 poly.get_xv(), poly.get_yv());
-
-      // Convert to world units
-      int            numVerts  = poly.get_totalNumVerts();
-      double *             xv  = poly.get_xv();
-      double *             yv  = poly.get_yv();
-      for (int vIter = 0; vIter < numVerts; vIter++){
-        Vector2 P = projpoint2world(Vector2(xv[vIter], yv[vIter]), m_polyVecIndex); 
-        xv[vIter] = P.x();
-        yv[vIter] = P.y();
+      if (!m_polyIndexValid) {
+        std::vector<vw::geometry::dPoly> worldPolyVec = m_polyVec; // deep copy
+        for (size_t polyIter = 0; polyIter < worldPolyVec.size(); polyIter++)
+          MainWidget::projPolyToWorld(worldPolyVec[polyIter]);
+        m_polyIndex.build(worldPolyVec);
+        m_polyIndexValid = true;
       }
 
-      if (polyIter > 0 && m_polyEditMode && m_moveVertex->isChecked()) {
+      if (m_polyEditMode && m_moveVertex->isChecked()) {
         drawVertIndex = 1; // to draw a little square at each movable vertex
         plotPoints = true;
       }else{
@@ -1236,17 +1255,16 @@ namespace vw { namespace gui {
         plotPoints = false;
       }
 
-      double val2 = vw::geometry::signedPolyArea(poly.get_totalNumVerts(),
-                                                 poly.get_xv(), poly.get_yv());
-
-      // If the conversion to world coords flips the orientation, correct for that.
-      // TODO: This seems necessary. More thought is needed. 
-      if (val1 * val2 < 0)
-        poly.reverse();
+      bool showIndices = m_showIndices->isChecked();
+      double tol = (plotPoints || showIndices) ? 0.0 : pixelToWorldDist(0.5);
+      BBox2 view = screen2world(BBox2(Vector2(0, 0),
+                                      Vector2(m_window_width, m_window_height)));
+      view.expand(pixelToWorldDist(2*lineWidth));
 
+      vw::geometry::dPoly poly;
+      m_polyIndex.extract(view, tol, poly);
       MainWidget::plotDPoly(plotPoints, plotEdges, m_showPolysFilled->isChecked(),
-                            m_showIndices->isChecked(),
-                            lineWidth,  
+                            showIndices, lineWidth,  
 			    drawVertIndex, polyColor, paint, poly);
     }
 
@@ -1386,6 +1404,7 @@ namespace vw { namespace gui {
       m_polyVec[m_editPolyVecIndex].changeVertexValue(m_editIndexInCurrPoly,
                                                       m_editVertIndexInCurrPoly,
                                                       P.x(), P.y());
+      m_polyIndexValid = false;
       
       // This will redraw just the polygons, not the pixmap
       update();
@@ -1608,6 +1627,30 @@ namespace vw { namespace gui {
     return norm_2(p-q);
   }
   
+  // Convert a polygon from projected units to world units
+  void MainWidget::projPolyToWorld(vw::geometry::dPoly & poly){
+
+    double val1 = vw::geometry::signedPolyArea(poly.get_totalNumVerts(),
+                                               poly.get_xv(), poly.get_yv());
+
+    int            numVerts  = poly.get_totalNumVerts();
+    double *             xv  = poly.get_xv();
+    double *             yv  = poly.get_yv();
+    for (int vIter = 0; vIter < numVerts; vIter++){
+      Vector2 P = projpoint2world(Vector2(xv[vIter], yv[vIter]), m_polyVecIndex); 
+      xv[vIter] = P.x();
+      yv[vIter] = P.y();
+    }
+
+    double val2 = vw::geometry::signedPolyArea(poly.get_totalNumVerts(),
+                                               poly.get_xv(), poly.get_yv());
+
+    // If the conversion to world coords flips the orientation, correct for that.
+    // TODO: This seems necessary. More thought is needed. 
+    if (val1 * val2 < 0)
+      poly.reverse();
+  }
+
   void MainWidget::appendToPolyVec(const vw::geometry::dPoly & P){
     
     // Append the new polygon to the list of polygons. If we have several
@@ -1618,6 +1661,7 @@ namespace vw { namespace gui {
     }else{
       m_polyVec.back().appendPolygons(P);
     }
+    m_polyIndexValid = false;
     
     return;
   }
@@ -1733,6 +1777,7 @@ namespace vw { namespace gui {
 	vertIndexInCurrPoly < 0) return;
     
     m_polyVec[polyVecIndex].eraseVertex(polyIndexInCurrPoly, vertIndexInCurrPoly);
+    m_polyIndexValid = false;
 
     // This will redraw just the polygons, not the pixmap
     update();
@@ -1794,6 +1839,7 @@ namespace vw { namespace gui {
       // Overwrite the polygon
       m_polyVec[layerIter] = poly_out;
     }
+    m_polyIndexValid = false;
 
     // The selection has done its job
     m_stereoCropWin = BBox2();
@@ -1840,6 +1886,7 @@ namespace vw { namespace gui {
     m_polyVec[polyVecIndex].insertVertex(polyIndexInCurrPoly,
 					 vertIndexInCurrPoly + 1,
 					 P.x(), P.y());
+    m_polyIndexValid = false;
     
     // This will redraw just the polygons, not the pixmap
     update();
@@ -1850,6 +1897,7 @@ namespace vw { namespace gui {
   // Merge existing polygons
   void MainWidget::mergePolys(){
     vw::gui::mergePolys(m_polyVec);
+    m_polyIndexValid = false;
   }
   
   // Save the currently created vector layer
@@ -2214,6 +2262,7 @@ namespace vw { namespace gui {
 	  m_polyVec[m_editPolyVecIndex].changeVertexValue(m_editIndexInCurrPoly,
 							  m_editVertIndexInCurrPoly,
 							  P.x(), P.y());
+	  m_polyIndexValid = false;
 	  
 
 	  // These are no longer needed for the time being
@@ -2583,6 +2632,7 @@ namespace vw { namespace gui {
     }
 
     m_view_matches = view_matches;
+    m_ip_index = PointGridIndex(); // the matches may have changed, rebuild when drawn
     refreshPixmap();
   }
 
@@ -117,6 +117,8 @@ namespace vw { namespace gui {
     void drawOneVertex(int x0, int y0, QColor color, int lineWidth,
                        int drawVertIndex, QPainter &paint);
     
+    void projPolyToWorld(vw::geometry::dPoly & poly);
+
     void plotDPoly(bool plotPoints, bool plotEdges,
                    bool plotFilled, bool showIndices, int lineWidth,
                    int drawVertIndex, // 0 is a good choice here
@@ -343,6 +345,7 @@ public slots:
     std::set<int> m_indicesWithAction;
     
     bool m_view_matches; ///< Control if IP's are drawn
+    PointGridIndex m_ip_index; ///< Spatial index of the IP's for this image
 
     bool m_zoom_all_to_same_region; // if all widgets are forced to zoom to same region
     bool & m_allowMultipleSelections; // alias, this is controlled from MainWindow for all widgets
@@ -378,6 +381,8 @@ public slots:
     bool m_polyEditMode;
     std::vector<vw::geometry::dPoly> m_polyVec;
     int m_polyVecIndex; // which of the current images owns the poly vector layer
+    PolyLayerIndex m_polyIndex; // m_polyVec in world coordinates, indexed for drawing
+    bool m_polyIndexValid;      // must be set to false when m_polyVec changes
     vw::Vector2 m_startPix; // The first poly vertex being drawn in world coords
     std::vector<double> m_currPolyX, m_currPolyY;
     int m_editPolyVecIndex, m_editIndexInCurrPoly, m_editVertIndexInCurrPoly; 
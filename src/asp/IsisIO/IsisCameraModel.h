@@ -101,6 +101,12 @@ namespace camera {
       return m_interface->target_name();
     }
 
+    // Use in-memory tables of the camera instead of ISIS, if they are
+    // accurate to within the given tolerance, in pixels.
+    bool use_snapshot( double tolerance ) {
+      return m_interface->use_snapshot( tolerance );
+    }
+
   protected:
     boost::shared_ptr<asp::isis::IsisInterface> m_interface;
 
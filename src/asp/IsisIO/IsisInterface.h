@@ -63,6 +63,12 @@ namespace isis {
     virtual vw::Vector3 camera_center  ( vw::Vector2 const& pix = vw::Vector2() ) const = 0;
     virtual vw::Quat    camera_pose    ( vw::Vector2 const& pix = vw::Vector2() ) const = 0;
 
+    /// Sample the camera once into in-memory tables and use them
+    /// instead of ISIS for the standard methods, if they agree with
+    /// ISIS to within the given tolerance, in pixels. Returns whether
+    /// the tables are used. Only some camera types support this.
+    virtual bool use_snapshot( double /*tolerance*/ ) { return false; }
+
     // General information
     //------------------------------------------------------
     int         lines         () const;
@@ -15,12 +15,14 @@
 //  limitations under the License.
 // __END_LICENSE__
 
+#include <vw/Core/Log.h>
 #include <vw/Math/LevenbergMarquardt.h>
 #include <vw/Math/Matrix.h>
 #include <vw/Camera/CameraModel.h>
 #include <asp/IsisIO/IsisInterfaceLineScan.h>
 
 #include <algorithm>
+#include <limits>
 #include <vector>
 
 #include <Camera.h>
@@ -36,7 +38,7 @@ using namespace asp;
 using namespace asp::isis;
 
 // Construct
-IsisInterfaceLineScan::IsisInterfaceLineScan( std::string const& filename ) : IsisInterface(filename), m_alphacube( *m_cube ) {
+IsisInterfaceLineScan::IsisInterfaceLineScan( std::string const& filename ) : IsisInterface(filename), m_alphacube( *m_cube ), m_use_snapshot(false) {
 
   // Gutting Isis::Camera
   m_distortmap = m_camera->DistortionMap();
@@ -118,6 +120,8 @@ EphemerisLMA::operator()( EphemerisLMA::domain_type const& x ) const {
 
 Vector2
 IsisInterfaceLineScan::point_to_pixel( Vector3 const& point ) const {
+  if ( m_use_snapshot )
+    return m_snapshot.point_to_pixel( point );
 
   // First seed LMA with an ephemeris time in the middle of the image
   double middle = lines() / 2;
@@ -171,6 +175,8 @@ IsisInterfaceLineScan::point_to_pixel( Vector3 const& point ) const {
 
 Vector3
 IsisInterfaceLineScan::pixel_to_vector( Vector2 const& pix ) const {
+  if ( m_use_snapshot )
+    return m_snapshot.pixel_to_vector( pix );
   Vector2 px = pix + Vector2(1,1);
   SetTime( px, true );
 
@@ -190,6 +196,8 @@ IsisInterfaceLineScan::pixel_to_vector( Vector2 const& pix ) const {
 
 Vector3
 IsisInterfaceLineScan::camera_center( Vector2 const& pix ) const {
+  if ( m_use_snapshot )
+    return m_snapshot.camera_center( pix[1] );
   Vector2 px = pix + Vector2(1,1);
   SetTime( px, true );
   return m_center;
@@ -197,7 +205,89 @@ IsisInterfaceLineScan::camera_center( Vector2 const& pix ) const {
 
 Quat
 IsisInterfaceLineScan::camera_pose( Vector2 const& pix ) const {
+  if ( m_use_snapshot )
+    return m_snapshot.camera_pose( pix[1] );
   Vector2 px = pix + Vector2(1,1);
   SetTime( px, true );
   return m_pose;
 }
+
+bool IsisInterfaceLineScan::use_snapshot( double tolerance ) {
+
+  // The tables must be built with ISIS
+  m_use_snapshot = false;
+  if ( tolerance <= 0 )
+    return false;
+
+  // Ephemeris and pointing, per group of lines. The last node is at
+  // the last line, so the interpolation never extrapolates in the image.
+  const int line_spacing = 16, sample_spacing = 8;
+  int num_lines = std::max( 2, (lines()   - 1 + line_spacing   - 1) / line_spacing   + 1 );
+  int num_samps = std::max( 2, (samples() - 1 + sample_spacing - 1) / sample_spacing + 1 );
+  double line_step = std::max( 1.0, lines()   - 1.0 ) / ( num_lines - 1 );
+  double samp_step = std::max( 1.0, samples() - 1.0 ) / ( num_samps - 1 );
+
+  std::vector<double> times( num_lines );
+  std::vector<Vector3> centers( num_lines );
+  std::vector<Quat> poses( num_lines );
+  for ( int k = 0; k < num_lines; k++ ) {
+    Vector2 pix( 0, k*line_step );
+    centers[k] = camera_center( pix );
+    poses[k]   = camera_pose( pix );
+    times[k]   = m_camera->time().Et(); // at the line set above
+  }
+
+  // The look directions in the camera frame, per group of samples
+  double mid_line = ( lines() - 1 ) / 2.0;
+  Quat mid_pose_inv = inverse( camera_pose( Vector2( 0, mid_line ) ) );
+  std::vector<Vector3> dirs( num_samps );
+  for ( int k = 0; k < num_samps; k++ ) {
+    Vector2 pix( k*samp_step, mid_line );
+    dirs[k] = mid_pose_inv.rotate( pixel_to_vector( pix ) );
+  }
+
+  try {
+    m_snapshot.set_tables( line_step, times, centers, poses, samp_step, dirs );
+  } catch ( const vw::Exception& e ) {
+    vw_out(WarningMessage) << "Cannot tabulate the ISIS camera: " << e.what()
+                           << "Will use ISIS instead.\n";
+    return false;
+  }
+
+  // Compare with ISIS on a grid of pixels. Project points at about
+  // the distance to the planet surface, and back.
+  Vector3 radii = target_radii();
+  double mean_radius = ( radii[0] + radii[1] + radii[2] ) / 3.0;
+  double max_err = 0;
+  const int num_check = 9;
+  for ( int row = 0; row < num_check; row++ ) {
+    for ( int col = 0; col < num_check; col++ ) {
+      Vector2 pix( ( samples() - 1.0 ) * col / ( num_check - 1.0 ),
+                   ( lines()   - 1.0 ) * row / ( num_check - 1.0 ) );
+      Vector3 ctr = camera_center( pix );
+      double range = std::max( 1000.0, norm_2( ctr ) - mean_radius );
+      Vector3 point = ctr + range * pixel_to_vector( pix );
+      double err;
+      try {
+        Vector2 snap_pix = m_snapshot.point_to_pixel( point );
+        err = std::max( norm_2( snap_pix - pix ),
+                        norm_2( snap_pix - point_to_pixel( point ) ) );
+      } catch ( const vw::Exception& ) {
+        err = std::numeric_limits<double>::max();
+      }
+      max_err = std::max( max_err, err );
+    }
+  }
+
+  if ( max_err > tolerance ) {
+    vw_out(WarningMessage) << "The tabulated ISIS camera differs from ISIS by up to "
+                           << max_err << " pixels, which is more than the tolerance of "
+                           << tolerance << ". Will use ISIS instead.\n";
+    return false;
+  }
+
+  vw_out() << "Using the tabulated ISIS camera, which differs from ISIS by up to "
+           << max_err << " pixels.\n";
+  m_use_snapshot = true;
+  return true;
+}
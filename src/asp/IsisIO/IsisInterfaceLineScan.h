@@ -26,6 +26,7 @@
 #include <vw/Math/Vector.h>
 #include <vw/Math/Quaternion.h>
 #include <asp/IsisIO/IsisInterface.h>
+#include <asp/IsisIO/LineScanSnapshot.h>
 
 #include <string>
 
@@ -57,6 +58,11 @@ namespace isis {
     virtual vw::Vector3 camera_center  ( vw::Vector2 const& pix = vw::Vector2(1,1) ) const;
     virtual vw::Quat    camera_pose    ( vw::Vector2 const& pix = vw::Vector2(1,1) ) const;
 
+    /// Tabulate the ephemeris and pointing per group of lines, and the
+    /// look directions per group of samples, check them against ISIS,
+    /// and if they are accurate use them from now on.
+    virtual bool use_snapshot( double tolerance );
+
   protected:
 
     // Custom Variables
@@ -73,6 +79,9 @@ namespace isis {
     mutable vw::Quat    m_pose;
     void SetTime( vw::Vector2 const& px,
                   bool calc=false ) const;
+
+    LineScanSnapshot m_snapshot;
+    bool             m_use_snapshot;
   };
 
 }}
@@ -0,0 +1,313 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <vw/Core/Exception.h>
+#include <vw/Camera/CameraModel.h>
+#include <asp/IsisIO/LineScanSnapshot.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace vw;
+using namespace asp;
+using namespace asp::isis;
+
+namespace {
+
+  // Interpolate in a table with nodes at multiples of step, using the
+  // cubic through the four nearest nodes, or fewer if that is all
+  // there is. Beyond the table ends the end cubics are extended.
+  template <class T>
+  T interp_table(std::vector<T> const& table, double step, double x) {
+
+    int num = table.size();
+    if (num == 1)
+      return table[0];
+
+    double t = x/step;
+    if (num < 4) {
+      int i = std::max(0, std::min(num - 2, int(std::floor(t))));
+      double u = t - i;
+      return (1.0 - u)*table[i] + u*table[i+1];
+    }
+
+    int i = std::max(0, std::min(num - 4, int(std::floor(t)) - 1));
+    double u = t - i;
+    double w0 = -(u - 1.0)*(u - 2.0)*(u - 3.0)/6.0;
+    double w1 =  u*(u - 2.0)*(u - 3.0)/2.0;
+    double w2 = -u*(u - 1.0)*(u - 3.0)/2.0;
+    double w3 =  u*(u - 1.0)*(u - 2.0)/6.0;
+    return w0*table[i] + w1*table[i+1] + w2*table[i+2] + w3*table[i+3];
+  }
+
+  // The rotation vector of a quaternion, taking the shorter rotation
+  Vector3 rotation_vector(Quat q) {
+    if (q.w() < 0)
+      q = Quat(-q.w(), -q.x(), -q.y(), -q.z());
+    return q.axis_angle();
+  }
+
+  // Find a zero of f between a and b with the Illinois variant of
+  // regula falsi if f changes sign there, and otherwise with the
+  // secant method started from a and b. The functor returns false
+  // where f is not defined.
+  template <class FuncT>
+  bool find_zero(FuncT const& f, double a, double fa, double b, double fb,
+                 double tol, double & zero) {
+
+    const int max_iter = 100;
+    if (fa == 0) { zero = a; return true; }
+    if (fb == 0) { zero = b; return true; }
+
+    if (fa*fb < 0) {
+      int side = 0;
+      double prev = a;
+      for (int iter = 0; iter < max_iter; iter++) {
+        double c = (a*fb - b*fa)/(fb - fa), fc;
+        if (!f(c, fc))
+          return false;
+        if (fc == 0 || std::abs(c - prev) < tol) {
+          zero = c;
+          return true;
+        }
+        prev = c;
+        if (fc*fb > 0) {
+          b = c; fb = fc;
+          if (side == -1) fa /= 2.0;
+          side = -1;
+        } else {
+          a = c; fa = fc;
+          if (side == 1) fb /= 2.0;
+          side = 1;
+        }
+      }
+      return false;
+    }
+
+    for (int iter = 0; iter < max_iter; iter++) {
+      if (fb == fa)
+        return false;
+      double c = b - fb*(b - a)/(fb - fa), fc;
+      if (!f(c, fc))
+        return false;
+      a = b; fa = fb;
+      b = c; fb = fc;
+      if (fb == 0 || std::abs(b - a) < tol) {
+        zero = b;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The x/z ratio of the look direction at a sample, minus a target
+  struct SampleResidual {
+    std::vector<double> const& m_table;
+    double m_step, m_target;
+    SampleResidual(std::vector<double> const& table, double step, double target):
+      m_table(table), m_step(step), m_target(target) {}
+    bool operator()(double sample, double & val) const {
+      val = interp_table(m_table, m_step, sample) - m_target;
+      return true;
+    }
+  };
+
+  // How far a point is from the detector at a given line
+  struct LineResidual {
+    LineScanSnapshot const& m_snap;
+    Vector3 const& m_point;
+    LineResidual(LineScanSnapshot const& snap, Vector3 const& point):
+      m_snap(snap), m_point(point) {}
+    bool operator()(double line, double & val) const {
+      double sample;
+      return m_snap.line_residual(m_point, line, val, sample);
+    }
+  };
+
+} // end anonymous namespace
+
+void LineScanSnapshot::set_tables(double line_step,
+                                  std::vector<double>  const& times,
+                                  std::vector<Vector3> const& centers,
+                                  std::vector<Quat>    const& poses,
+                                  double sample_step,
+                                  std::vector<Vector3> const& sample_dirs) {
+
+  if (times.empty() || times.size() != centers.size() || times.size() != poses.size())
+    vw_throw(ArgumentErr() << "LineScanSnapshot: Inconsistent line tables.\n");
+  if (sample_dirs.size() < 2)
+    vw_throw(ArgumentErr() << "LineScanSnapshot: Need at least two sample directions.\n");
+  if (line_step <= 0 || sample_step <= 0)
+    vw_throw(ArgumentErr() << "LineScanSnapshot: The table spacing must be positive.\n");
+
+  m_line_step   = line_step;
+  m_sample_step = sample_step;
+  m_times       = times;
+  m_centers     = centers;
+
+  // Interpolate the poses as rotation vectors relative to the middle
+  // one, which are small and vary smoothly.
+  m_ref_pose = normalize(poses[poses.size()/2]);
+  Quat ref_inv = inverse(m_ref_pose);
+  m_rotations.resize(poses.size());
+  for (size_t k = 0; k < poses.size(); k++)
+    m_rotations[k] = rotation_vector(ref_inv*normalize(poses[k]));
+
+  m_sample_x.resize(sample_dirs.size());
+  m_sample_y.resize(sample_dirs.size());
+  for (size_t k = 0; k < sample_dirs.size(); k++) {
+    Vector3 const& dir = sample_dirs[k];
+    if (dir[2] <= 0)
+      vw_throw(ArgumentErr() << "LineScanSnapshot: The sample directions must "
+               << "point along the positive z axis of the camera.\n");
+    m_sample_x[k] = dir[0]/dir[2];
+    m_sample_y[k] = dir[1]/dir[2];
+  }
+
+  // The sample is found from x, so x must be monotonic in the sample.
+  m_x_increasing = (m_sample_x.back() > m_sample_x.front());
+  for (size_t k = 1; k < m_sample_x.size(); k++) {
+    if (m_sample_x[k] == m_sample_x[k-1] ||
+        (m_sample_x[k] > m_sample_x[k-1]) != m_x_increasing)
+      vw_throw(ArgumentErr() << "LineScanSnapshot: The sample directions "
+               << "are not monotonic across the detector.\n");
+  }
+}
+
+double LineScanSnapshot::ephemeris_time(double line) const {
+  return interp_table(m_times, m_line_step, line);
+}
+
+Vector3 LineScanSnapshot::camera_center(double line) const {
+  return interp_table(m_centers, m_line_step, line);
+}
+
+Quat LineScanSnapshot::camera_pose(double line) const {
+  return m_ref_pose*axis_angle_to_quaternion(interp_table(m_rotations, m_line_step, line));
+}
+
+Vector3 LineScanSnapshot::sample_direction(double sample) const {
+  return normalize(Vector3(interp_table(m_sample_x, m_sample_step, sample),
+                           interp_table(m_sample_y, m_sample_step, sample), 1.0));
+}
+
+Vector3 LineScanSnapshot::pixel_to_vector(Vector2 const& pix) const {
+  return camera_pose(pix[1]).rotate(sample_direction(pix[0]));
+}
+
+bool LineScanSnapshot::sample_from_x(double x, double & sample) const {
+
+  // Bracket x between two nodes with binary search. If it is beyond
+  // the detector, start from the end nodes.
+  int num = m_sample_x.size();
+  int lo = 0, hi = num - 1;
+  bool inside = m_x_increasing ?
+    (m_sample_x[lo] <= x && x <= m_sample_x[hi]) :
+    (m_sample_x[hi] <= x && x <= m_sample_x[lo]);
+  if (inside) {
+    while (hi - lo > 1) {
+      int mid = (lo + hi)/2;
+      if ((m_sample_x[mid] <= x) == m_x_increasing)
+        lo = mid;
+      else
+        hi = mid;
+    }
+  } else if ((x > m_sample_x[hi]) == m_x_increasing) {
+    lo = hi - 1;
+  } else {
+    hi = lo + 1;
+  }
+
+  SampleResidual f(m_sample_x, m_sample_step, x);
+  return find_zero(f, lo*m_sample_step, m_sample_x[lo] - x,
+                   hi*m_sample_step, m_sample_x[hi] - x, 1e-8, sample);
+}
+
+bool LineScanSnapshot::line_residual(Vector3 const& point, double line,
+                                     double & residual, double & sample) const {
+
+  Vector3 dir = inverse(camera_pose(line)).rotate(point - camera_center(line));
+  if (dir[2] <= 0)
+    return false;
+  if (!sample_from_x(dir[0]/dir[2], sample))
+    return false;
+  residual = dir[1]/dir[2] - interp_table(m_sample_y, m_sample_step, sample);
+  return true;
+}
+
+Vector2 LineScanSnapshot::point_to_pixel(Vector3 const& point) const {
+
+  if (empty())
+    vw_throw(camera::PointToPixelErr() << "LineScanSnapshot: No tables were set.\n");
+
+  // Scan the lines coarsely for where the residual changes sign,
+  // keeping the change closest to zero, as a point may be seen more
+  // than once only far from the image.
+  const int num_scan = 17;
+  double last_line = (m_times.size() - 1)*m_line_step;
+  std::vector<double> lines(num_scan), vals(num_scan);
+  std::vector<bool> valid(num_scan);
+  double sample = 0;
+  int best = -1;
+  for (int k = 0; k < num_scan; k++) {
+    lines[k] = last_line*k/(num_scan - 1.0);
+    valid[k] = line_residual(point, lines[k], vals[k], sample);
+    if (valid[k] && (best < 0 || std::abs(vals[k]) < std::abs(vals[best])))
+      best = k;
+  }
+  if (best < 0)
+    vw_throw(camera::PointToPixelErr() << "LineScanSnapshot: The point is "
+             << "behind the camera.\n");
+
+  int a = -1;
+  double min_val = std::numeric_limits<double>::max();
+  for (int k = 0; k + 1 < num_scan; k++) {
+    if (!valid[k] || !valid[k+1] || vals[k]*vals[k+1] > 0)
+      continue;
+    double val = std::min(std::abs(vals[k]), std::abs(vals[k+1]));
+    if (val < min_val) {
+      min_val = val;
+      a = k;
+    }
+  }
+
+  // Without a sign change the point is seen beyond the first or last
+  // line, so start the secant method from the closest lines.
+  if (a < 0) {
+    a = best;
+    if (a + 1 >= num_scan || (a > 0 && valid[a-1]))
+      a--;
+    if (a < 0 || !valid[a] || !valid[a+1])
+      vw_throw(camera::PointToPixelErr() << "LineScanSnapshot: Unable to "
+               << "project point into linescan camera.\n");
+  }
+
+  LineResidual f(*this, point);
+  double line;
+  if (!find_zero(f, lines[a], vals[a], lines[a+1], vals[a+1], 1e-8, line))
+    vw_throw(camera::PointToPixelErr() << "LineScanSnapshot: Unable to "
+             << "project point into linescan camera.\n");
+
+  double residual;
+  if (!line_residual(point, line, residual, sample))
+    vw_throw(camera::PointToPixelErr() << "LineScanSnapshot: Unable to "
+             << "project point into linescan camera.\n");
+
+  return Vector2(sample, line);
+}
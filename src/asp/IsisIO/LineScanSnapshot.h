@@ -0,0 +1,95 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+/// \file LineScanSnapshot.h
+///
+/// The ephemeris time, position, and pointing of a linescan camera,
+/// sampled once at equally spaced image lines, and the look directions
+/// of the detector in the camera frame, sampled at equally spaced
+/// samples. Projection with these tables is done with cubic
+/// interpolation, without calling ISIS, so it is thread-safe.
+///
+/// Unlike the BaseEquation classes, nothing is cached on evaluation,
+/// so all methods are const and can be called from multiple threads.
+///
+#ifndef __ASP_ISIS_LINESCAN_SNAPSHOT_H__
+#define __ASP_ISIS_LINESCAN_SNAPSHOT_H__
+
+#include <vw/Math/Vector.h>
+#include <vw/Math/Quaternion.h>
+
+#include <vector>
+
+namespace asp {
+namespace isis {
+
+  class LineScanSnapshot {
+  public:
+    LineScanSnapshot(): m_line_step(0), m_sample_step(0), m_x_increasing(true) {}
+
+    /// Set the tables. Node k of the line tables is at line k*line_step,
+    /// and node k of the sample table at sample k*sample_step (pixels
+    /// start from 0). The poses take vectors from the camera frame to
+    /// the world frame. The sample directions are in the camera frame,
+    /// and must have positive z.
+    void set_tables(double line_step,
+                    std::vector<double>      const& times,
+                    std::vector<vw::Vector3> const& centers,
+                    std::vector<vw::Quat>    const& poses,
+                    double sample_step,
+                    std::vector<vw::Vector3> const& sample_dirs);
+
+    bool empty() const { return m_times.empty(); }
+
+    double      ephemeris_time (double line) const;
+    vw::Vector3 camera_center  (double line) const;
+    vw::Quat    camera_pose    (double line) const;
+    vw::Vector3 pixel_to_vector(vw::Vector2 const& pix) const;
+
+    /// Find the line at which the point is seen by the detector, and
+    /// then the sample. Throws PointToPixelErr on failure.
+    /// Lines and samples start from 0, as in the camera models.
+    vw::Vector2 point_to_pixel (vw::Vector3 const& point) const;
+
+    /// At a given line, how far the point is from the detector, in
+    /// units of the camera focal length, and the sample nearest to it.
+    /// The residual is zero when the point is seen at that line.
+    /// Return false if the point is behind the camera.
+    bool line_residual(vw::Vector3 const& point, double line,
+                       double & residual, double & sample) const;
+
+  private:
+
+    // The camera-frame look direction for a sample
+    vw::Vector3 sample_direction(double sample) const;
+
+    // Find the sample whose look direction has the given x/z ratio.
+    bool sample_from_x(double x, double & sample) const;
+
+    double m_line_step, m_sample_step;
+    std::vector<double>      m_times;
+    std::vector<vw::Vector3> m_centers;
+    vw::Quat                 m_ref_pose;
+    std::vector<vw::Vector3> m_rotations;  // axis-angle, relative to m_ref_pose
+    std::vector<double>      m_sample_x, m_sample_y; // x/z and y/z of the directions
+    bool                     m_x_increasing;
+  };
+
+}}
+
+#endif//__ASP_ISIS_LINESCAN_SNAPSHOT_H__
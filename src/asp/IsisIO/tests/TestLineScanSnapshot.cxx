@@ -0,0 +1,97 @@
+// __BEGIN_LICENSE__
+//  Copyright (c) 2009-2013, United States Government as represented by the
+//  Administrator of the National Aeronautics and Space Administration. All
+//  rights reserved.
+//
+//  The NGT platform is licensed under the Apache License, Version 2.0 (the
+//  "License"); you may not use this file except in compliance with the
+//  License. You may obtain a copy of the License at
+//  http://www.apache.org/licenses/LICENSE-2.0
+//
+//  Unless required by applicable law or agreed to in writing, software
+//  distributed under the License is distributed on an "AS IS" BASIS,
+//  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//  See the License for the specific language governing permissions and
+//  limitations under the License.
+// __END_LICENSE__
+
+
+#include <test/Helpers.h>
+
+#include <vw/Camera/CameraModel.h>
+
+#include <asp/IsisIO/LineScanSnapshot.h>
+
+using namespace vw;
+using namespace asp::isis;
+
+// A synthetic nadir-looking linescan camera, flying along y at 100 km
+// altitude while slowly rolling, with a slightly curved detector.
+namespace {
+  const int    NUM_LINES = 1000, NUM_SAMPLES = 500;
+  const double DT = 1e-3, SPEED = 3000.0, FOCAL = 5000.0;
+
+  double  test_time(double line) { return 100.0 + DT*line; }
+  Vector3 test_center(double line) {
+    return Vector3(0, SPEED*DT*line, 1e5);
+  }
+  Quat test_pose(double line) {
+    // Looking down, with the camera y axis along -y
+    return Quat(0, 1, 0, 0)*axis_angle_to_quaternion(Vector3(0, 2e-3*line/NUM_LINES, 0));
+  }
+  Vector3 test_dir(double sample) {
+    double x = (sample - NUM_SAMPLES/2.0)/FOCAL;
+    return normalize(Vector3(x, 1e-3 + 0.01*x*x, 1.0));
+  }
+
+  LineScanSnapshot make_snapshot() {
+    const double line_step = (NUM_LINES - 1)/64.0, sample_step = (NUM_SAMPLES - 1)/64.0;
+    std::vector<double>  times;
+    std::vector<Vector3> centers, dirs;
+    std::vector<Quat>    poses;
+    for (int k = 0; k <= 64; k++) {
+      times.push_back  (test_time  (k*line_step));
+      centers.push_back(test_center(k*line_step));
+      poses.push_back  (test_pose  (k*line_step));
+      dirs.push_back   (test_dir   (k*sample_step));
+    }
+    LineScanSnapshot snap;
+    snap.set_tables(line_step, times, centers, poses, sample_step, dirs);
+    return snap;
+  }
+}
+
+TEST(LineScanSnapshot, interpolation) {
+  LineScanSnapshot snap = make_snapshot();
+  for (double line = 0; line < NUM_LINES; line += 37.3) {
+    EXPECT_NEAR(test_time(line), snap.ephemeris_time(line), 1e-9);
+    EXPECT_VECTOR_NEAR(test_center(line), snap.camera_center(line), 1e-6);
+    for (double sample = 0; sample < NUM_SAMPLES; sample += 23.7) {
+      Vector3 exact = test_pose(line).rotate(test_dir(sample));
+      EXPECT_VECTOR_NEAR(exact, snap.pixel_to_vector(Vector2(sample, line)), 1e-9);
+    }
+  }
+}
+
+TEST(LineScanSnapshot, point_to_pixel) {
+  LineScanSnapshot snap = make_snapshot();
+  for (double line = 0; line < NUM_LINES; line += 51.1) {
+    for (double sample = 0; sample < NUM_SAMPLES; sample += 31.9) {
+      Vector2 pix(sample, line);
+      Vector3 point = snap.camera_center(line) + 9e4*snap.pixel_to_vector(pix);
+      EXPECT_VECTOR_NEAR(pix, snap.point_to_pixel(point), 1e-4);
+    }
+  }
+
+  // A point behind the camera
+  EXPECT_THROW(snap.point_to_pixel(Vector3(0, 0, 2e5)), camera::PointToPixelErr);
+}
+
+TEST(LineScanSnapshot, bad_tables) {
+  LineScanSnapshot snap;
+  std::vector<double>  times(2, 0.0);
+  std::vector<Vector3> centers(2), dirs(2, Vector3(0, 0, 1));
+  std::vector<Quat>    poses(2, Quat(1, 0, 0, 0));
+  // The directions do not vary across the detector
+  EXPECT_THROW(snap.set_tables(1.0, times, centers, poses, 1.0, dirs), ArgumentErr);
+}
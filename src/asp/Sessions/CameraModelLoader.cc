@@ -113,7 +113,11 @@ boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_ASTER_camera_
 boost::shared_ptr<vw::camera::CameraModel> CameraModelLoader::load_isis_camera_model(std::string const& path) const
 {
 #if defined(ASP_HAVE_PKG_ISISIO) && ASP_HAVE_PKG_ISISIO == 1
-  return CameraModelPtr(new vw::camera::IsisCameraModel(path));
+  boost::shared_ptr<vw::camera::IsisCameraModel> cam(new vw::camera::IsisCameraModel(path));
+  double tolerance = stereo_settings().isis_snapshot_tolerance;
+  if (tolerance > 0)
+    cam->use_snapshot(tolerance);
+  return cam;
 #endif
   // If ISIS was not enabled in the build, just throw an exception.
   vw::vw_throw( vw::NoImplErr() << "\nCannot load ISIS files because ISIS was not enabled in the build!.\n");
@@ -30,6 +30,7 @@
 
 #include <asp/Core/StereoSettings.h>
 #include <asp/Core/Common.h>
+#include <asp/Core/MappedImage.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Core/InterestPointMatching.h>
 #include <asp/Core/BundleAdjustUtils.h>
@@ -296,7 +297,7 @@ namespace asp {
 
   ImageViewRef<PixelMask<Vector2f> >
   StereoSession::pre_pointcloud_hook(std::string const& input_file) {
-    return DiskImageView<PixelMask<Vector2f> >( input_file );
+    return asp::open_intermediate<PixelMask<Vector2f> >( input_file );
   }
 
   void StereoSession::post_pointcloud_hook(std::string const& input_file,
@@ -476,6 +477,73 @@ void StereoSession::get_input_image_crops(vw::BBox2i &left_image_crop, vw::BBox2
     right_image_crop = BBox2i(0, 0, right_size[0], right_size[1]);
 }
 
+void StereoSession::lon_lat_roi_crop_wins(std::vector<vw::Vector2> const& lon_lat_roi,
+                                          vw::Vector2 const& height_range,
+                                          vw::BBox2i & left_win, vw::BBox2i & right_win){
+
+  // Sample the polygon edges and a grid over its interior
+  const int NUM_SAMPLES = 20;
+  BBox2 roi_box;
+  for (size_t it = 0; it < lon_lat_roi.size(); it++)
+    roi_box.grow(lon_lat_roi[it]);
+  std::vector<Vector2> samples;
+  for (size_t it = 0; it < lon_lat_roi.size(); it++) {
+    Vector2 a = lon_lat_roi[it], b = lon_lat_roi[(it + 1) % lon_lat_roi.size()];
+    for (int k = 0; k < NUM_SAMPLES; k++)
+      samples.push_back(a + (b - a)*double(k)/NUM_SAMPLES);
+  }
+  for (int i = 0; i <= NUM_SAMPLES; i++) {
+    for (int j = 0; j <= NUM_SAMPLES; j++) {
+      Vector2 ll = roi_box.min() + elem_prod(roi_box.size(), Vector2(i, j))/double(NUM_SAMPLES);
+      if (asp::point_in_polygon(ll, lon_lat_roi))
+        samples.push_back(ll);
+    }
+  }
+
+  std::string image_files[2] = {m_left_image_file, m_right_image_file};
+  BBox2i * wins[2] = {&left_win, &right_win};
+
+  boost::shared_ptr<camera::CameraModel> cams[2];
+  bool map_projected = this->uses_map_projected_inputs();
+  if (!map_projected)
+    this->camera_models(cams[0], cams[1]);
+
+  for (int s = 0; s < 2; s++) {
+    BBox2 win;
+    if (map_projected) {
+      cartography::GeoReference georef;
+      if (!cartography::read_georeference(georef, image_files[s]))
+        vw_throw(ArgumentErr() << "Missing georeference in: " << image_files[s] << ".\n");
+      for (size_t it = 0; it < samples.size(); it++)
+        win.grow(georef.lonlat_to_pixel(samples[it]));
+    } else {
+      cartography::Datum datum = this->get_datum(cams[s].get(), false);
+      for (size_t it = 0; it < samples.size(); it++) {
+        for (int h = 0; h < 2; h++) {
+          Vector3 xyz = datum.geodetic_to_cartesian(Vector3(samples[it][0], samples[it][1],
+                                                            height_range[h]));
+          try {
+            win.grow(cams[s]->point_to_pixel(xyz));
+          } catch (...) {} // the point is not seen by the camera
+        }
+      }
+    }
+
+    // Leave room for the correlation and subpixel kernels
+    BBox2i int_win;
+    if (!win.empty()) {
+      int_win = grow_bbox_to_int(win);
+      int margin = std::max(max(stereo_settings().corr_kernel),
+                            max(stereo_settings().subpixel_kernel));
+      int_win.expand(margin);
+      int_win.crop(BBox2i(Vector2i(0, 0), file_image_size(image_files[s])));
+    }
+    if (int_win.empty())
+      vw_throw(ArgumentErr() << "The region given by --lon-lat-roi is not seen in: "
+               << image_files[s] << ".\n");
+    *wins[s] = int_win;
+  }
+}
 
 // TODO: Find a better place for these functions!
 
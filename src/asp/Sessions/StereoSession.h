@@ -33,6 +33,7 @@
 #include <boost/filesystem/operations.hpp>
 #include <asp/Core/Common.h>
 #include <asp/Core/StereoSettings.h>
+#include <asp/Core/NormalizedImage.h>
 
 namespace asp {
 
@@ -213,6 +214,14 @@ namespace asp {
     /// Get the crop ROI applied to the two input images.
     void get_input_image_crops(vw::BBox2i &left_image_crop, vw::BBox2i &right_image_crop) const;
 
+    /// Find the windows in the left and right input images which see
+    /// the given polygon in longitude-latitude. Map-projected images
+    /// are looked up via their georeferences, otherwise the polygon is
+    /// projected into the cameras at heights in the given range.
+    void lon_lat_roi_crop_wins(std::vector<vw::Vector2> const& lon_lat_roi,
+                               vw::Vector2 const& height_range,
+                               vw::BBox2i & left_win, vw::BBox2i & right_win);
+
     // All Stereo Session children must define the following which are not defined in the the parent:
     //   typedef VWStereoModel stereo_model_type;
     //   typedef VWTransform   tx_type; ///< Transform from image coordinates on disk to original untransformed image pixels.
@@ -31,6 +31,7 @@
 
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Camera/RPCStereoModel.h>
+#include <asp/Core/TabulatedMap2CamTrans.h>
 #include <asp/Sessions/CameraModelLoader.h>
 
 namespace asp {
@@ -73,11 +74,11 @@ namespace asp {
 
   /// Utility for converting DISKTRANSFORM_TYPE into the corresponding class
   template <STEREOSESSION_DISKTRANSFORM_TYPE T> struct DiskTransformType2Class       { typedef vw::HomographyTransform       type; };
-  template <> struct DiskTransformType2Class<DISKTRANSFORM_TYPE_MAP_PROJECT_RPC    > { typedef vw::cartography::Map2CamTrans type; };
-  template <> struct DiskTransformType2Class<DISKTRANSFORM_TYPE_MAP_PROJECT_ISIS   > { typedef vw::cartography::Map2CamTrans type; };
-  template <> struct DiskTransformType2Class<DISKTRANSFORM_TYPE_MAP_PROJECT_PINHOLE> { typedef vw::cartography::Map2CamTrans type; };
-  template <> struct DiskTransformType2Class<DISKTRANSFORM_TYPE_MAP_PROJECT_SPOT5> { typedef vw::cartography::Map2CamTrans type; };
-  template <> struct DiskTransformType2Class<DISKTRANSFORM_TYPE_MAP_PROJECT_ASTER> { typedef vw::cartography::Map2CamTrans type; };
+  template <> struct DiskTransformType2Class<DISKTRANSFORM_TYPE_MAP_PROJECT_RPC    > { typedef asp::TabulatedMap2CamTrans type; };
+  template <> struct DiskTransformType2Class<DISKTRANSFORM_TYPE_MAP_PROJECT_ISIS   > { typedef asp::TabulatedMap2CamTrans type; };
+  template <> struct DiskTransformType2Class<DISKTRANSFORM_TYPE_MAP_PROJECT_PINHOLE> { typedef asp::TabulatedMap2CamTrans type; };
+  template <> struct DiskTransformType2Class<DISKTRANSFORM_TYPE_MAP_PROJECT_SPOT5> { typedef asp::TabulatedMap2CamTrans type; };
+  template <> struct DiskTransformType2Class<DISKTRANSFORM_TYPE_MAP_PROJECT_ASTER> { typedef asp::TabulatedMap2CamTrans type; };
 
   /// Utility for converting STEREOMODEL_TYPE into the corresponding class
   template <STEREOSESSION_STEREOMODEL_TYPE T> struct StereoModelType2Class { typedef vw::stereo::StereoModel type; };
@@ -181,7 +181,9 @@ void StereoSessionConcrete<DISKTRANSFORM_TYPE,STEREOMODEL_TYPE>::
 
 // TODO: Move this function somewhere else!
 /// Computes a Map2CamTrans given a DEM, image, and a sensor model.
-inline cartography::Map2CamTrans
+/// It is wrapped in a transform which tabulates it per tile, within
+/// the tolerance set by --mapproj-tx-table-tolerance.
+inline TabulatedMap2CamTrans
 getTransformFromMapProject(const std::string &input_dem_path,
                            const std::string &img_file_path,
                            boost::shared_ptr<vw::camera::CameraModel> map_proj_model_ptr) {
@@ -195,10 +197,13 @@ getTransformFromMapProject(const std::string &input_dem_path,
 
   bool call_from_mapproject = false;
   DiskImageView<float> img(img_file_path);
-  return cartography::Map2CamTrans(map_proj_model_ptr.get(),
-                                   image_georef, dem_georef, input_dem_path,
-                                   Vector2(img.cols(), img.rows()),
-                                   call_from_mapproject);
+  cartography::Map2CamTrans exact_tx(map_proj_model_ptr.get(),
+                                     image_georef, dem_georef, input_dem_path,
+                                     Vector2(img.cols(), img.rows()),
+                                     call_from_mapproject);
+  return TabulatedMap2CamTrans(exact_tx,
+                               stereo_settings().mapproj_tx_table_tolerance,
+                               stereo_settings().mapproj_tx_table_spacing);
 }
 
 // Redirect to the correct function depending on the template parameters
@@ -176,10 +176,11 @@ void write_preprocessed_isis_image( vw::cartography::GdalWriteOptions const& opt
     }
 
     vw_out() << "\t--> Writing normalized image: " << out_file << "\n";
-    block_write_gdal_image( out_file, apply_mask(applied_image, output_nodata),
-			    has_georef, georef,
-			    has_nodata, output_nodata, opt,
-			    TerminalProgressCallback("asp", "\t  "+tag+":  "));
+    asp::write_normalized_image( out_file, apply_mask(applied_image, output_nodata),
+				 has_georef, georef,
+				 has_nodata, output_nodata, opt,
+				 stereo_settings().compact_normalized_images,
+				 TerminalProgressCallback("asp", "\t  "+tag+":  "));
 
   }else{
 
@@ -199,10 +200,11 @@ void write_preprocessed_isis_image( vw::cartography::GdalWriteOptions const& opt
     }
 
     vw_out() << "\t--> Writing normalized image: " << out_file << "\n";
-    block_write_gdal_image( out_file, applied_image,
-			    has_georef, georef,
-			    has_nodata, output_nodata, opt,
-			    TerminalProgressCallback("asp", "\t  "+tag+":  "));
+    asp::write_normalized_image( out_file, applied_image,
+				 has_georef, georef,
+				 has_nodata, output_nodata, opt,
+				 stereo_settings().compact_normalized_images,
+				 TerminalProgressCallback("asp", "\t  "+tag+":  "));
   }
 
 }
@@ -222,19 +222,21 @@ void asp::StereoSessionPinhole::pre_preprocessing_hook(bool adjust_left_image_si
 
   vw_out() << "\t--> Writing pre-aligned images.\n";
   vw_out() << "\t--> Writing: " << left_output_file << ".\n";
-  block_write_gdal_image( left_output_file, apply_mask(Limg, output_nodata),
-                          has_left_georef, left_georef,
-                          has_nodata, output_nodata,
-                          options,
-                          TerminalProgressCallback("asp","\t  L:  ") );
+  asp::write_normalized_image( left_output_file, apply_mask(Limg, output_nodata),
+                               has_left_georef, left_georef,
+                               has_nodata, output_nodata,
+                               options,
+                               stereo_settings().compact_normalized_images,
+                               TerminalProgressCallback("asp","\t  L:  ") );
   vw_out() << "\t--> Writing: " << right_output_file << ".\n";
-  block_write_gdal_image( right_output_file,
-                          apply_mask(crop(edge_extend(Rimg, ext_nodata),
-                                          bounding_box(Limg)), output_nodata),
-                          has_right_georef, right_georef,
-                          has_nodata, output_nodata,
-                          options,
-                          TerminalProgressCallback("asp","\t  R:  ") );
+  asp::write_normalized_image( right_output_file,
+                               apply_mask(crop(edge_extend(Rimg, ext_nodata),
+                                               bounding_box(Limg)), output_nodata),
+                               has_right_georef, right_georef,
+                               has_nodata, output_nodata,
+                               options,
+                               stereo_settings().compact_normalized_images,
+                               TerminalProgressCallback("asp","\t  R:  ") );
 }
 
 namespace asp {
@@ -19,6 +19,7 @@
 /// \file bundle_adjust.cc
 ///
 
+#include <vw/Core/ThreadPool.h>
 #include <vw/FileIO/KML.h>
 #include <vw/Camera/CameraUtilities.h>
 #include <asp/Core/Macros.h>
@@ -263,8 +264,9 @@ struct Options : public vw::cartography::GdalWriteOptions {
   std::string datum_str, camera_position_file, initial_transform_file,
     csv_format_str, csv_proj4_str, reference_terrain, disparity_list, intrinsics_to_float_str,
     heights_from_dem;
-  double semi_major, semi_minor, position_filter_dist;
-  int num_ba_passes, max_num_reference_points;
+  double semi_major, semi_minor, position_filter_dist, partition_tolerance;
+  int num_ba_passes, max_num_reference_points, partition_size, partition_iterations,
+    partition_boundary_min_obs;
   std::string remove_outliers_params_str;
   vw::Vector<double, 4> remove_outliers_params;
   vw::Vector2 remove_outliers_by_disp_params;
@@ -291,8 +293,9 @@ struct Options : public vw::cartography::GdalWriteOptions {
              robust_threshold(0), report_level(0), min_matches(0),
              max_iterations(0), overlap_limit(0), save_iteration(false),
              create_pinhole(false), fix_gcp_xyz(false), solve_intrinsics(false),
-             semi_major(0), semi_minor(0), position_filter_dist(-1),
+             semi_major(0), semi_minor(0), position_filter_dist(-1), partition_tolerance(0),
              num_ba_passes(1), max_num_reference_points(-1),
+             partition_size(0), partition_iterations(0), partition_boundary_min_obs(0),
              datum(cartography::Datum(UNSPECIFIED_DATUM, "User Specified Spheroid",
                                       "Reference Meridian", 1, 1, 0)),
              ip_detect_method(0), num_scales(-1), skip_rough_homography(false),
@@ -1268,6 +1271,27 @@ void write_residual_map(std::string const& output_prefix, CameraRelationNetwork<
     
 } // End function write_residual_map
 
+/// Evaluates the residuals of the problem, in the order in which
+/// their blocks were added.
+class ResidualSource {
+public:
+  virtual ~ResidualSource(){}
+  virtual void evaluate(ceres::Problem::EvaluateOptions const& eval_options,
+                        std::vector<double> & residuals) = 0;
+};
+
+/// The residuals of a problem assembled in full
+class ProblemResiduals: public ResidualSource {
+  ceres::Problem & m_problem;
+public:
+  ProblemResiduals(ceres::Problem & problem): m_problem(problem){}
+  virtual void evaluate(ceres::Problem::EvaluateOptions const& eval_options,
+                        std::vector<double> & residuals) {
+    double cost = 0;
+    m_problem.Evaluate(eval_options, &cost, &residuals, 0, 0);
+  }
+};
+
 /// Compute the residuals
 void compute_residuals(bool apply_loss_function,
 		       Options const& opt, size_t num_cameras,
@@ -1276,20 +1300,19 @@ void compute_residuals(bool apply_loss_function,
 		       size_t num_gcp_residuals, 
                        std::vector<vw::Vector3> const& reference_vec,
 		       CameraRelationNetwork<JFeature> & crn,
-		       ceres::Problem &problem,
+		       ResidualSource & residual_source,
 		       std::vector<double> & residuals // output
 		       ) {
   
   // TODO: Associate residuals with cameras!
   // Generate some additional diagnostic info
-  double cost = 0;
   ceres::Problem::EvaluateOptions eval_options;
   eval_options.apply_loss_function = apply_loss_function;
   if (opt.stereo_session_string == "isis")
     eval_options.num_threads = 1;
   else
     eval_options.num_threads = opt.num_threads;
-  problem.Evaluate(eval_options, &cost, &residuals, 0, 0);
+  residual_source.evaluate(eval_options, residuals);
   const size_t num_residuals = residuals.size();
   
   // Verify our residual calculations are correct
@@ -1319,11 +1342,11 @@ void write_residual_logs(std::string const& residual_prefix, bool apply_loss_fun
 			 CameraRelationNetwork<JFeature> & crn,
 			 const double *points, const size_t num_points,
 			 std::set<int>  const& outlier_xyz,
-			 ceres::Problem &problem) {
+			 ResidualSource & residual_source) {
   
   std::vector<double> residuals;
   compute_residuals(apply_loss_function, opt, num_cameras, num_camera_params, num_point_params,  
-		    cam_residual_counts,  num_gcp_residuals, reference_vec, crn, problem,  
+		    cam_residual_counts,  num_gcp_residuals, reference_vec, crn, residual_source,
 		    residuals // output
 		    );
     
@@ -1470,7 +1493,7 @@ int update_outliers(ControlNetwork                  & cnet,
                     std::vector<size_t> const& cam_residual_counts,
                     size_t num_gcp_residuals,
                     std::vector<vw::Vector3> const& reference_vec, 
-                    ceres::Problem &problem) {
+                    ResidualSource & residual_source) {
   
   vw_out() << "Removing pixel outliers in preparation for another solver attempt.\n";
 
@@ -1480,7 +1503,7 @@ int update_outliers(ControlNetwork                  & cnet,
   std::vector<double> residuals;
   compute_residuals(apply_loss_function,  
                     opt, num_cameras, num_camera_params, num_point_params,  cam_residual_counts,  
-                    num_gcp_residuals, reference_vec, crn, problem,
+                    num_gcp_residuals, reference_vec, crn, residual_source,
                     residuals // output
                    );
 
@@ -1663,6 +1686,584 @@ void create_interp_dem(std::string & dem_file,
   }
 }
 
+// Ceres solver options for a problem with the given number of cameras
+void set_solver_options(Options const& opt, int num_cameras,
+                        ceres::Solver::Options & options){
+  options.gradient_tolerance = 1e-16;
+  options.function_tolerance = 1e-16;
+  options.parameter_tolerance = opt.parameter_tolerance; // default is 1e-8
+
+  options.max_num_iterations = opt.max_iterations;
+  options.max_num_consecutive_invalid_steps = std::max(5, opt.max_iterations/5); // try hard
+  options.minimizer_progress_to_stdout = true;//(opt.report_level >= vw::ba::ReportFile);
+
+  if (opt.stereo_session_string == "isis")
+    options.num_threads = 1;
+  else
+    options.num_threads = opt.num_threads;
+
+  // Set solver options according to the recommendations in the Ceres solving FAQs
+  options.linear_solver_type = ceres::SPARSE_SCHUR;
+  if (num_cameras < 100)
+    options.linear_solver_type = ceres::DENSE_SCHUR;
+  if (num_cameras > 3500) {
+    options.use_explicit_schur_complement = true; // This is supposed to help with speed in a certain size range
+    options.linear_solver_type  = ceres::ITERATIVE_SCHUR;
+    options.preconditioner_type = ceres::SCHUR_JACOBI;
+  }
+  if (num_cameras > 7000)
+    options.use_explicit_schur_complement = false; // Only matters with ITERATIVE_SCHUR
+
+  //options.ordering_type = ceres::SCHUR;
+  //options.eta = 1e-3; // FLAGS_eta;
+  //options->max_solver_time_in_seconds = FLAGS_max_solver_time;
+  //options->use_nonmonotonic_steps = FLAGS_nonmonotonic_steps;
+  //if (FLAGS_line_search) {
+  //  options->minimizer_type = ceres::LINE_SEARCH;
+  //}
+}
+
+//=========================================================================
+// Partitioned bundle adjustment. The cameras are grouped into clusters
+// along the interest point matches. Each cluster is solved on its own,
+// together with all the points its cameras see, while the cameras of
+// other clusters seeing those points are held fixed. The clusters are
+// then stitched by a solve of the cameras with many observations of
+// points seen from other clusters. No problem with all the cameras and
+// points is ever assembled.
+
+// An observation of a point in a camera. The sigma includes the
+// weighting by the number of cameras seeing the point.
+struct PointObservation {
+  int     icam;
+  Vector2 pixel, sigma;
+  PointObservation(int icam_in, Vector2 const& pixel_in, Vector2 const& sigma_in):
+    icam(icam_in), pixel(pixel_in), sigma(sigma_in){}
+};
+
+/// Greedily grow clusters of at most the given size, starting each
+/// one from the first camera not yet in a cluster and adding the
+/// camera sharing the most points with those already in. Returns the
+/// number of clusters.
+int partition_cameras(std::vector< std::map<int, int> > const& cam_links,
+                      int partition_size, std::vector<int> & cam_cluster){
+
+  int num_cameras = cam_links.size();
+  cam_cluster.assign(num_cameras, -1);
+
+  int num_clusters = 0;
+  for (int seed = 0; seed < num_cameras; seed++) {
+    if (cam_cluster[seed] >= 0)
+      continue;
+
+    std::map<int, int> frontier; // candidate camera -> shared points with the cluster
+    int icam = seed, cluster_size = 0;
+    while (1) {
+      cam_cluster[icam] = num_clusters;
+      cluster_size++;
+      frontier.erase(icam);
+      for (std::map<int, int>::const_iterator it = cam_links[icam].begin();
+           it != cam_links[icam].end(); it++) {
+        if (cam_cluster[it->first] < 0)
+          frontier[it->first] += it->second;
+      }
+
+      if (cluster_size >= partition_size || frontier.empty())
+        break;
+
+      std::map<int, int>::const_iterator best = frontier.begin();
+      for (std::map<int, int>::const_iterator it = frontier.begin(); it != frontier.end(); it++) {
+        if (it->second > best->second)
+          best = it;
+      }
+      icam = best->first;
+    }
+    num_clusters++;
+  }
+
+  return num_clusters;
+}
+
+/// Optimize the given free cameras together with the given points,
+/// using all observations of these points. The cameras which are not
+/// free are held fixed. Works on copies of the cameras and points, so
+/// that several of these can run at the same time. If solve is false,
+/// only find the cost of this part of the problem.
+template <class ModelT>
+class PartitionSolveTask : public vw::Task, private boost::noncopyable {
+  ModelT                                             & m_ba_model;
+  Options                                      const & m_opt;
+  ControlNetwork                                     & m_cnet;
+  std::vector< std::vector<PointObservation> > const & m_point_obs;
+  std::vector<double>                          const & m_orig_cameras_vec;
+  std::set<int>    m_free_cams;
+  std::vector<int> m_pts;
+  int              m_num_camera_params, m_num_threads;
+  bool             m_solve;
+
+public:
+  std::map<int, std::vector<double> > m_cameras, m_points;
+  double m_cost;
+
+  PartitionSolveTask(ModelT & ba_model, Options const& opt, ControlNetwork & cnet,
+                     std::vector< std::vector<PointObservation> > const& point_obs,
+                     std::vector<double> const& orig_cameras_vec,
+                     std::set<int> const& free_cams, std::vector<int> const& pts,
+                     int num_camera_params, int num_point_params,
+                     double const* cameras, double const* points, int num_threads,
+                     bool solve = true):
+    m_ba_model(ba_model), m_opt(opt), m_cnet(cnet), m_point_obs(point_obs),
+    m_orig_cameras_vec(orig_cameras_vec), m_free_cams(free_cams), m_pts(pts),
+    m_num_camera_params(num_camera_params), m_num_threads(num_threads), m_solve(solve),
+    m_cost(0.0) {
+
+    for (size_t it = 0; it < m_pts.size(); it++) {
+      int ipt = m_pts[it];
+      m_points[ipt].assign(points + ipt*num_point_params,
+                           points + (ipt+1)*num_point_params);
+      for (size_t ob = 0; ob < m_point_obs[ipt].size(); ob++) {
+        int icam = m_point_obs[ipt][ob].icam;
+        if (m_cameras.find(icam) == m_cameras.end())
+          m_cameras[icam].assign(cameras + icam*num_camera_params,
+                                 cameras + (icam+1)*num_camera_params);
+      }
+    }
+
+    // The cost includes the constraints on all free cameras
+    if (!m_solve) {
+      for (std::set<int>::const_iterator it = m_free_cams.begin(); it != m_free_cams.end(); it++) {
+        if (m_cameras.find(*it) == m_cameras.end())
+          m_cameras[*it].assign(cameras + (*it)*num_camera_params,
+                                cameras + (*it + 1)*num_camera_params);
+      }
+    }
+  }
+
+  void operator()() {
+
+    if (m_pts.empty() && m_solve)
+      return; // cameras without any matches stay as they are
+
+    ceres::Problem problem;
+    for (size_t it = 0; it < m_pts.size(); it++) {
+      int ipt = m_pts[it];
+      double * point = &m_points[ipt][0];
+      for (size_t ob = 0; ob < m_point_obs[ipt].size(); ob++) {
+        PointObservation const& obs = m_point_obs[ipt][ob];
+        double * camera = &m_cameras[obs.icam][0];
+        add_residual_block(m_ba_model, obs.pixel, obs.sigma, obs.icam, ipt,
+                           camera, point, NULL, m_opt.intrinsics_to_float,
+                           get_loss_function(m_opt), problem);
+        if (m_free_cams.find(obs.icam) == m_free_cams.end() ||
+            m_opt.fixed_cameras_indices.find(obs.icam) != m_opt.fixed_cameras_indices.end())
+          problem.SetParameterBlockConstant(camera);
+      }
+
+      if (m_cnet[ipt].type() != ControlPoint::GroundControlPoint)
+        continue;
+      ceres::CostFunction* cost_function;
+      if (!m_opt.use_llh_error)
+        cost_function = XYZError::Create(m_cnet[ipt].position(), m_cnet[ipt].sigma());
+      else
+        cost_function = LLHError::Create(m_cnet[ipt].position(), m_cnet[ipt].sigma(),
+                                         m_opt.datum);
+      problem.AddResidualBlock(cost_function, new ceres::TrivialLoss(), point);
+      if (m_opt.fix_gcp_xyz)
+        problem.SetParameterBlockConstant(point);
+    }
+
+    // The same constraints on the free cameras as for the full problem
+    for (std::set<int>::const_iterator it = m_free_cams.begin(); it != m_free_cams.end(); it++) {
+      int icam = *it;
+      if (m_cameras.find(icam) == m_cameras.end())
+        continue; // not seeing any of the points
+      typename ModelT::camera_vector_t orig_cam;
+      for (int q = 0; q < m_num_camera_params; q++)
+        orig_cam[q] = m_orig_cameras_vec[icam * m_num_camera_params + q];
+      double * camera = &m_cameras[icam][0];
+      if (m_opt.camera_weight > 0)
+        problem.AddResidualBlock(CamError<ModelT>::Create(orig_cam, m_opt.camera_weight),
+                                 new ceres::TrivialLoss(), camera);
+      if (m_opt.rotation_weight > 0 || m_opt.translation_weight > 0)
+        problem.AddResidualBlock(RotTransError<ModelT>::Create(orig_cam, m_opt.rotation_weight,
+                                                               m_opt.translation_weight),
+                                 new ceres::TrivialLoss(), camera);
+    }
+
+    if (!m_solve) {
+      ceres::Problem::EvaluateOptions eval_options;
+      eval_options.num_threads = m_num_threads;
+      problem.Evaluate(eval_options, &m_cost, NULL, NULL, NULL);
+      return;
+    }
+
+    ceres::Solver::Options options;
+    set_solver_options(m_opt, m_free_cams.size(), options);
+    options.num_threads = m_num_threads;
+    options.minimizer_progress_to_stdout = false;
+    ceres::Solver::Summary summary;
+    ceres::Solve(options, &problem, &summary);
+    m_cost = summary.final_cost;
+    vw_out(DebugMessage, "bundle_adjust") << summary.BriefReport() << "\n";
+  }
+};
+
+/// The cost of the problem, found by evaluating each cluster with the
+/// points it owns. Each point and camera is in exactly one cluster,
+/// so these add up to the cost of the full problem.
+template <class ModelT>
+double partition_cost(ModelT                                             & ba_model,
+                      Options                                      const & opt,
+                      ControlNetwork                                     & cnet,
+                      std::vector< std::vector<PointObservation> > const & point_obs,
+                      std::vector<double>                          const & orig_cameras_vec,
+                      std::vector< std::set<int> >                 const & cluster_cams,
+                      std::vector< std::vector<int> >              const & cluster_own_pts,
+                      int num_camera_params, int num_point_params,
+                      double const* cameras, double const* points, int num_threads){
+
+  typedef PartitionSolveTask<ModelT> TaskT;
+  std::vector< boost::shared_ptr<TaskT> > tasks;
+  FifoWorkQueue queue(num_threads);
+  for (size_t cluster = 0; cluster < cluster_cams.size(); cluster++) {
+    bool solve = false;
+    boost::shared_ptr<TaskT> task(new TaskT(ba_model, opt, cnet, point_obs, orig_cameras_vec,
+                                            cluster_cams[cluster], cluster_own_pts[cluster],
+                                            num_camera_params, num_point_params,
+                                            cameras, points, 1, solve));
+    tasks.push_back(task);
+    queue.add_task(task);
+  }
+  queue.join_all();
+
+  double cost = 0.0;
+  for (size_t it = 0; it < tasks.size(); it++)
+    cost += tasks[it]->m_cost;
+  return cost;
+}
+
+/// The residuals of a problem solved by partitions, in the same order
+/// as in the full problem. The residual blocks are added and evaluated
+/// for one camera at a time, so the full problem is never in memory.
+/// Intrinsics, a reference terrain, and heights from a DEM are not
+/// supported, as with the partitioned solve.
+template <class ModelT>
+class PartitionedResiduals: public ResidualSource {
+  ModelT                          & m_ba_model;
+  Options                   const & m_opt;
+  ControlNetwork                  & m_cnet;
+  CameraRelationNetwork<JFeature> & m_crn;
+  int m_num_camera_params, m_num_point_params, m_num_cameras, m_num_points;
+  std::vector<double>       const & m_orig_cameras_vec;
+  double                          * m_cameras;
+  double                          * m_points;
+  std::set<int>             const & m_outlier_xyz;
+
+  // Evaluate the blocks added so far and append their residuals
+  static void evaluate_part(ceres::Problem & problem,
+                            ceres::Problem::EvaluateOptions const& eval_options,
+                            std::vector<double> & residuals) {
+    if (problem.NumResidualBlocks() == 0)
+      return;
+    double cost = 0;
+    std::vector<double> part;
+    problem.Evaluate(eval_options, &cost, &part, NULL, NULL);
+    residuals.insert(residuals.end(), part.begin(), part.end());
+  }
+
+public:
+  PartitionedResiduals(ModelT & ba_model, Options const& opt, ControlNetwork & cnet,
+                       CameraRelationNetwork<JFeature> & crn,
+                       int num_camera_params, int num_point_params,
+                       int num_cameras, int num_points,
+                       std::vector<double> const& orig_cameras_vec,
+                       double * cameras, double * points,
+                       std::set<int> const& outlier_xyz):
+    m_ba_model(ba_model), m_opt(opt), m_cnet(cnet), m_crn(crn),
+    m_num_camera_params(num_camera_params), m_num_point_params(num_point_params),
+    m_num_cameras(num_cameras), m_num_points(num_points),
+    m_orig_cameras_vec(orig_cameras_vec), m_cameras(cameras), m_points(points),
+    m_outlier_xyz(outlier_xyz){}
+
+  virtual void evaluate(ceres::Problem::EvaluateOptions const& eval_options,
+                        std::vector<double> & residuals) {
+
+    residuals.clear();
+    typedef CameraNode<JFeature>::iterator crn_iter;
+
+    // How many times each point is seen, for the overlap weights
+    std::vector<int> count(m_num_points, 0);
+    if (m_opt.overlap_exponent > 0) {
+      for (int icam = 0; icam < m_num_cameras; icam++) {
+        for (crn_iter fiter = m_crn[icam].begin(); fiter != m_crn[icam].end(); fiter++) {
+          int ipt = (**fiter).m_point_id;
+          if (m_outlier_xyz.find(ipt) == m_outlier_xyz.end())
+            count[ipt]++;
+        }
+      }
+    }
+
+    // The pixel residuals, camera by camera
+    for (int icam = 0; icam < m_num_cameras; icam++) {
+      ceres::Problem problem;
+      double * camera = m_cameras + icam * m_num_camera_params;
+      for (crn_iter fiter = m_crn[icam].begin(); fiter != m_crn[icam].end(); fiter++) {
+        int ipt = (**fiter).m_point_id;
+        if (m_outlier_xyz.find(ipt) != m_outlier_xyz.end())
+          continue; // skip outliers
+        Vector2 pixel_sigma = (**fiter).m_scale;
+        if (pixel_sigma != pixel_sigma) // nan check
+          pixel_sigma = Vector2(1, 1);
+        if (m_opt.overlap_exponent > 0 && count[ipt] > 1)
+          pixel_sigma /= pow(count[ipt] - 1.0, m_opt.overlap_exponent);
+        add_residual_block(m_ba_model, (**fiter).m_location, pixel_sigma, icam, ipt,
+                           camera, m_points + ipt * m_num_point_params, NULL,
+                           m_opt.intrinsics_to_float, get_loss_function(m_opt), problem);
+      }
+      evaluate_part(problem, eval_options, residuals);
+    }
+
+    // The ground control points
+    {
+      ceres::Problem problem;
+      for (int ipt = 0; ipt < m_num_points; ipt++) {
+        if (m_cnet[ipt].type() != ControlPoint::GroundControlPoint)
+          continue;
+        if (m_outlier_xyz.find(ipt) != m_outlier_xyz.end())
+          continue; // skip outliers
+        ceres::CostFunction* cost_function;
+        if (!m_opt.use_llh_error)
+          cost_function = XYZError::Create(m_cnet[ipt].position(), m_cnet[ipt].sigma());
+        else
+          cost_function = LLHError::Create(m_cnet[ipt].position(), m_cnet[ipt].sigma(),
+                                           m_opt.datum);
+        problem.AddResidualBlock(cost_function, new ceres::TrivialLoss(),
+                                 m_points + ipt * m_num_point_params);
+      }
+      evaluate_part(problem, eval_options, residuals);
+    }
+
+    // The camera constraints, first all those from --camera-weight
+    for (int pass = 0; pass < 2; pass++) {
+      if (pass == 0 && m_opt.camera_weight <= 0)
+        continue;
+      if (pass == 1 && m_opt.rotation_weight <= 0 && m_opt.translation_weight <= 0)
+        continue;
+      ceres::Problem problem;
+      for (int icam = 0; icam < m_num_cameras; icam++) {
+        typename ModelT::camera_vector_t orig_cam;
+        for (int q = 0; q < m_num_camera_params; q++)
+          orig_cam[q] = m_orig_cameras_vec[icam * m_num_camera_params + q];
+        ceres::CostFunction* cost_function;
+        if (pass == 0)
+          cost_function = CamError<ModelT>::Create(orig_cam, m_opt.camera_weight);
+        else
+          cost_function = RotTransError<ModelT>::Create(orig_cam, m_opt.rotation_weight,
+                                                        m_opt.translation_weight);
+        problem.AddResidualBlock(cost_function, new ceres::TrivialLoss(),
+                                 m_cameras + icam * m_num_camera_params);
+      }
+      evaluate_part(problem, eval_options, residuals);
+    }
+  }
+};
+
+/// Solve the bundle adjustment problem by partitioning the cameras
+/// into clusters, as an alternative to a single ceres::Solve call.
+template <class ModelT>
+void solve_partitioned(ModelT                          & ba_model,
+                       Options                   const & opt,
+                       ControlNetwork                  & cnet,
+                       CameraRelationNetwork<JFeature> & crn,
+                       int                               num_camera_params,
+                       int                               num_point_params,
+                       int                               num_cameras,
+                       int                               num_points,
+                       std::vector<double>       const & orig_cameras_vec,
+                       double                          * cameras,
+                       double                          * points,
+                       std::set<int>             const & outlier_xyz){
+
+  // The observations of each point, with the same weights as in the full problem
+  typedef CameraNode<JFeature>::iterator crn_iter;
+  std::vector< std::vector<PointObservation> > point_obs(num_points);
+  for (int icam = 0; icam < num_cameras; icam++) {
+    for (crn_iter fiter = crn[icam].begin(); fiter != crn[icam].end(); fiter++) {
+      int ipt = (**fiter).m_point_id;
+      if (outlier_xyz.find(ipt) != outlier_xyz.end())
+        continue; // skip outliers
+      Vector2 pixel_sigma = (**fiter).m_scale;
+      if (pixel_sigma != pixel_sigma) // nan check
+        pixel_sigma = Vector2(1, 1);
+      point_obs[ipt].push_back(PointObservation(icam, (**fiter).m_location, pixel_sigma));
+    }
+  }
+  if (opt.overlap_exponent > 0) {
+    for (int ipt = 0; ipt < num_points; ipt++) {
+      int count = point_obs[ipt].size();
+      if (count <= 1)
+        continue;
+      double delta = pow(count - 1.0, opt.overlap_exponent);
+      for (size_t ob = 0; ob < point_obs[ipt].size(); ob++)
+        point_obs[ipt][ob].sigma /= delta;
+    }
+  }
+
+  // Link the cameras by the number of points they share
+  std::vector< std::map<int, int> > cam_links(num_cameras);
+  for (int ipt = 0; ipt < num_points; ipt++) {
+    for (size_t a = 0; a < point_obs[ipt].size(); a++) {
+      for (size_t b = 0; b < point_obs[ipt].size(); b++) {
+        if (a != b)
+          cam_links[point_obs[ipt][a].icam][point_obs[ipt][b].icam]++;
+      }
+    }
+  }
+
+  std::vector<int> cam_cluster;
+  int num_clusters = partition_cameras(cam_links, opt.partition_size, cam_cluster);
+  std::vector< std::set<int> > cluster_cams(num_clusters);
+  for (int icam = 0; icam < num_cameras; icam++)
+    cluster_cams[cam_cluster[icam]].insert(icam);
+
+  // Each cluster gets the points seen by its cameras. For finding the
+  // cost, each point is owned by the cluster with the most cameras
+  // seeing it. The points seen from several clusters are on the
+  // boundary. The cameras with more than a few observations of such
+  // points are reconciled by optimizing them with all points they see.
+  std::vector< std::vector<int> > cluster_pts(num_clusters), cluster_own_pts(num_clusters);
+  std::vector< std::map<int, int> > point_weights(num_points); // cluster -> observations
+  std::vector<int> cross_obs(num_cameras, 0);
+  for (int ipt = 0; ipt < num_points; ipt++) {
+    for (size_t ob = 0; ob < point_obs[ipt].size(); ob++)
+      point_weights[ipt][cam_cluster[point_obs[ipt][ob].icam]]++;
+    int owner = -1, owner_weight = 0;
+    for (std::map<int, int>::const_iterator it = point_weights[ipt].begin();
+         it != point_weights[ipt].end(); it++) {
+      cluster_pts[it->first].push_back(ipt);
+      if (it->second > owner_weight) {
+        owner = it->first;
+        owner_weight = it->second;
+      }
+    }
+    if (owner >= 0)
+      cluster_own_pts[owner].push_back(ipt);
+    if (point_weights[ipt].size() > 1) {
+      for (size_t ob = 0; ob < point_obs[ipt].size(); ob++)
+        cross_obs[point_obs[ipt][ob].icam]++;
+    }
+  }
+  std::set<int> boundary_cams;
+  for (int icam = 0; icam < num_cameras; icam++) {
+    if (cross_obs[icam] > opt.partition_boundary_min_obs)
+      boundary_cams.insert(icam);
+  }
+  std::vector<int> boundary_pts;
+  for (int ipt = 0; ipt < num_points; ipt++) {
+    for (size_t ob = 0; ob < point_obs[ipt].size(); ob++) {
+      if (boundary_cams.find(point_obs[ipt][ob].icam) != boundary_cams.end()) {
+        boundary_pts.push_back(ipt);
+        break;
+      }
+    }
+  }
+
+  vw_out() << "Solving " << num_cameras << " cameras in " << num_clusters
+           << " clusters, with " << boundary_cams.size() << " boundary cameras.\n";
+
+  // ISIS camera models are not thread-safe
+  int num_threads = opt.num_threads;
+  if (opt.stereo_session_string == "isis")
+    num_threads = 1;
+
+  double cost = partition_cost(ba_model, opt, cnet, point_obs, orig_cameras_vec,
+                               cluster_cams, cluster_own_pts, num_camera_params,
+                               num_point_params, cameras, points, num_threads);
+  vw_out() << "Initial cost: " << cost << "\n";
+
+  for (int iter = 0; iter < opt.partition_iterations; iter++) {
+
+    vw_out() << "Partition iteration " << iter + 1 << " of "
+             << opt.partition_iterations << ".\n";
+
+    // Solve the clusters in parallel. The tasks copy the cameras and
+    // points as they are before any cluster is solved.
+    typedef PartitionSolveTask<ModelT> TaskT;
+    std::vector< boost::shared_ptr<TaskT> > tasks;
+    FifoWorkQueue queue(num_threads);
+    for (int cluster = 0; cluster < num_clusters; cluster++) {
+      boost::shared_ptr<TaskT> task(new TaskT(ba_model, opt, cnet, point_obs, orig_cameras_vec,
+                                              cluster_cams[cluster], cluster_pts[cluster],
+                                              num_camera_params, num_point_params,
+                                              cameras, points, 1));
+      tasks.push_back(task);
+      queue.add_task(task);
+    }
+    queue.join_all();
+
+    // Each cluster owns its cameras. A point is the average of its
+    // estimates, weighted by the number of cameras seeing it in each cluster.
+    std::vector<double> point_sums(num_points*num_point_params, 0.0);
+    for (int cluster = 0; cluster < num_clusters; cluster++) {
+      TaskT const& task = *tasks[cluster];
+      for (std::set<int>::const_iterator it = cluster_cams[cluster].begin();
+           it != cluster_cams[cluster].end(); it++) {
+        std::map<int, std::vector<double> >::const_iterator cam = task.m_cameras.find(*it);
+        if (cam != task.m_cameras.end())
+          std::copy(cam->second.begin(), cam->second.end(), cameras + (*it)*num_camera_params);
+      }
+      for (size_t it = 0; it < cluster_pts[cluster].size(); it++) {
+        int ipt = cluster_pts[cluster][it];
+        double wt = point_weights[ipt][cluster];
+        std::vector<double> const& pt = task.m_points.find(ipt)->second;
+        for (int q = 0; q < num_point_params; q++)
+          point_sums[ipt*num_point_params + q] += wt*pt[q];
+      }
+    }
+    for (int ipt = 0; ipt < num_points; ipt++) {
+      if (point_obs[ipt].empty())
+        continue;
+      double wt = point_obs[ipt].size();
+      for (int q = 0; q < num_point_params; q++)
+        points[ipt*num_point_params + q] = point_sums[ipt*num_point_params + q]/wt;
+    }
+    tasks.clear();
+
+    // Reconcile the clusters along their boundaries
+    if (!boundary_cams.empty()) {
+      TaskT boundary_task(ba_model, opt, cnet, point_obs, orig_cameras_vec,
+                          boundary_cams, boundary_pts, num_camera_params, num_point_params,
+                          cameras, points, num_threads);
+      boundary_task();
+      for (std::set<int>::const_iterator it = boundary_cams.begin();
+           it != boundary_cams.end(); it++) {
+        std::map<int, std::vector<double> >::const_iterator cam
+          = boundary_task.m_cameras.find(*it);
+        if (cam != boundary_task.m_cameras.end())
+          std::copy(cam->second.begin(), cam->second.end(), cameras + (*it)*num_camera_params);
+      }
+      for (size_t it = 0; it < boundary_pts.size(); it++) {
+        int ipt = boundary_pts[it];
+        std::vector<double> const& pt = boundary_task.m_points.find(ipt)->second;
+        std::copy(pt.begin(), pt.end(), points + ipt*num_point_params);
+      }
+    }
+
+    // Stop once the alternation no longer makes progress
+    double new_cost = partition_cost(ba_model, opt, cnet, point_obs, orig_cameras_vec,
+                                     cluster_cams, cluster_own_pts, num_camera_params,
+                                     num_point_params, cameras, points, num_threads);
+    vw_out() << "Cost after partition iteration " << iter + 1 << ": " << new_cost << "\n";
+    bool converged = (fabs(cost - new_cost) <= opt.partition_tolerance*cost);
+    cost = new_cost;
+    if (converged) {
+      vw_out() << "The relative change in cost is below " << opt.partition_tolerance
+               << ", stopping.\n";
+      break;
+    }
+  }
+}
+
 template <class ModelT>
 int do_ba_ceres_one_pass(ModelT                          & ba_model,
                           Options                         & opt,
@@ -1681,6 +2282,9 @@ int do_ba_ceres_one_pass(ModelT                          & ba_model,
                           double                          * points,
                           std::set<int>                   & outlier_xyz){
 
+  // When partitioning, the residual blocks are only counted here. The
+  // clusters build their own problems, and so do the residuals.
+  bool partitioned = (opt.partition_size > 0 && num_cameras > opt.partition_size);
   ceres::Problem problem;
 
   // Add the cost function component for difference of pixel observations
@@ -1760,16 +2364,18 @@ int do_ba_ceres_one_pass(ModelT                          & ba_model,
         pixel_sigma /= delta;
       }
       
-      ceres::LossFunction* loss_function = get_loss_function(opt);
+      if (!partitioned) {
+        ceres::LossFunction* loss_function = get_loss_function(opt);
 
-      // Call function to select the appropriate Ceres residual block to add.
-      add_residual_block(ba_model, observation, pixel_sigma, icam, ipt,
-                         camera, point, scaled_intrinsics_ptr, opt.intrinsics_to_float,
-                         loss_function, problem);
+        // Call function to select the appropriate Ceres residual block to add.
+        add_residual_block(ba_model, observation, pixel_sigma, icam, ipt,
+                           camera, point, scaled_intrinsics_ptr, opt.intrinsics_to_float,
+                           loss_function, problem);
 
-      // Fix this camera if requested
-      if (opt.fixed_cameras_indices.find(icam) != opt.fixed_cameras_indices.end()) 
-	problem.SetParameterBlockConstant(camera);
+        // Fix this camera if requested
+        if (opt.fixed_cameras_indices.find(icam) != opt.fixed_cameras_indices.end())
+          problem.SetParameterBlockConstant(camera);
+      }
             
       if (opt.heights_from_dem != "") {
         // For non-GCP points, copy the heights for xyz points from the DEM.
@@ -1813,7 +2419,10 @@ int do_ba_ceres_one_pass(ModelT                          & ba_model,
       continue; // skip outliers
     
     num_gcp++;
-    
+    ++num_gcp_residuals;
+    if (partitioned)
+      continue;
+
     Vector3 observation = cnet[ipt].position();
     Vector3 xyz_sigma   = cnet[ipt].sigma();
 
@@ -1829,7 +2438,6 @@ int do_ba_ceres_one_pass(ModelT                          & ba_model,
 
     double * point  = points  + ipt * num_point_params;
     problem.AddResidualBlock(cost_function, loss_function, point);
-    ++num_gcp_residuals;
 
     if (opt.fix_gcp_xyz) 
       problem.SetParameterBlockConstant(point);
@@ -1837,7 +2445,7 @@ int do_ba_ceres_one_pass(ModelT                          & ba_model,
 
   // Add camera constraints
   // - Error goes up as cameras move and rotate from their input positions.
-  if (opt.camera_weight > 0){
+  if (opt.camera_weight > 0 && !partitioned){
 
     for (int icam = 0; icam < num_cameras; icam++){
 
@@ -1859,7 +2467,7 @@ int do_ba_ceres_one_pass(ModelT                          & ba_model,
   // Finer level control of only rotation and translation.
   // This will need to be merged with the above but note that the loss is NULL here. 
   // - Error goes up as cameras move and rotate from their input positions.
-  if (opt.rotation_weight > 0 || opt.translation_weight > 0){
+  if ((opt.rotation_weight > 0 || opt.translation_weight > 0) && !partitioned){
 
     for (int icam = 0; icam < num_cameras; icam++){
 
@@ -2084,6 +2692,16 @@ int do_ba_ceres_one_pass(ModelT                          & ba_model,
   if (kmlPointSkip < 1)
     kmlPointSkip = 1;
 
+  // Where the residuals come from
+  ProblemResiduals problem_residuals(problem);
+  PartitionedResiduals<ModelT> partitioned_residuals(ba_model, opt, cnet, crn,
+                                                     num_camera_params, num_point_params,
+                                                     num_cameras, num_points, orig_cameras_vec,
+                                                     cameras, points, outlier_xyz);
+  ResidualSource * residual_source = &problem_residuals;
+  if (partitioned)
+    residual_source = &partitioned_residuals;
+
   std::string residual_prefix = opt.out_prefix + "-initial_residuals_loss_function";
   std::string point_kml_path  = opt.out_prefix + "-initial_points.kml";
     
@@ -2092,11 +2710,11 @@ int do_ba_ceres_one_pass(ModelT                          & ba_model,
 
     write_residual_logs(residual_prefix, true,  opt, num_cameras, num_camera_params,
                         num_point_params, cam_residual_counts, num_gcp_residuals,
-                        reference_vec, crn, points, num_points, outlier_xyz, problem);
+                        reference_vec, crn, points, num_points, outlier_xyz, *residual_source);
     residual_prefix = opt.out_prefix + "-initial_residuals_no_loss_function";
     write_residual_logs(residual_prefix, false, opt, num_cameras, num_camera_params,
                         num_point_params, cam_residual_counts, num_gcp_residuals,
-                        reference_vec, crn, points, num_points, outlier_xyz, problem);
+                        reference_vec, crn, points, num_points, outlier_xyz, *residual_source);
 
 
       
@@ -2105,48 +2723,23 @@ int do_ba_ceres_one_pass(ModelT                          & ba_model,
                         "http://maps.google.com/mapfiles/kml/shapes/placemark_circle.png");
   }
 
-  // Solve the problem
-  ceres::Solver::Options options;
-  options.gradient_tolerance = 1e-16;
-  options.function_tolerance = 1e-16;
-  options.parameter_tolerance = opt.parameter_tolerance; // default is 1e-8
-
-  options.max_num_iterations = opt.max_iterations;
-  options.max_num_consecutive_invalid_steps = std::max(5, opt.max_iterations/5); // try hard
-  options.minimizer_progress_to_stdout = true;//(opt.report_level >= vw::ba::ReportFile);
-
-  if (opt.stereo_session_string == "isis")
-    options.num_threads = 1;
-  else
-    options.num_threads = opt.num_threads;
-
-  // Set solver options according to the recommendations in the Ceres solving FAQs
-  options.linear_solver_type = ceres::SPARSE_SCHUR;
-  if (num_cameras < 100)
-    options.linear_solver_type = ceres::DENSE_SCHUR;
-  if (num_cameras > 3500) {
-    options.use_explicit_schur_complement = true; // This is supposed to help with speed in a certain size range
-    options.linear_solver_type  = ceres::ITERATIVE_SCHUR;
-    options.preconditioner_type = ceres::SCHUR_JACOBI;
-  }
-  if (num_cameras > 7000)
-    options.use_explicit_schur_complement = false; // Only matters with ITERATIVE_SCHUR
-
-  //options.ordering_type = ceres::SCHUR;
-  //options.eta = 1e-3; // FLAGS_eta;
-  //options->max_solver_time_in_seconds = FLAGS_max_solver_time;
-  //options->use_nonmonotonic_steps = FLAGS_nonmonotonic_steps;
-  //if (FLAGS_line_search) {
-  //  options->minimizer_type = ceres::LINE_SEARCH;
-  //}
-
-  vw_out() << "Starting the Ceres optimizer..." << std::endl;
-  ceres::Solver::Summary summary;
-  ceres::Solve(options, &problem, &summary);
-  vw_out() << summary.FullReport() << "\n";
-  if (summary.termination_type == ceres::NO_CONVERGENCE){
-    // Print a clarifying message, so the user does not think that the algorithm failed.
-    vw_out() << "Found a valid solution, but did not reach the actual minimum." << std::endl;
+  if (partitioned) {
+    solve_partitioned(ba_model, opt, cnet, crn, num_camera_params, num_point_params,
+                      num_cameras, num_points, orig_cameras_vec, cameras, points,
+                      outlier_xyz);
+  } else {
+    // Solve the problem
+    ceres::Solver::Options options;
+    set_solver_options(opt, num_cameras, options);
+
+    vw_out() << "Starting the Ceres optimizer..." << std::endl;
+    ceres::Solver::Summary summary;
+    ceres::Solve(options, &problem, &summary);
+    vw_out() << summary.FullReport() << "\n";
+    if (summary.termination_type == ceres::NO_CONVERGENCE){
+      // Print a clarifying message, so the user does not think that the algorithm failed.
+      vw_out() << "Found a valid solution, but did not reach the actual minimum." << std::endl;
+    }
   }
 
   // Multiply the original intrinsics by the scaled optimized values
@@ -2165,12 +2758,12 @@ int do_ba_ceres_one_pass(ModelT                          & ba_model,
   write_residual_logs(residual_prefix, true,  opt, num_cameras, num_camera_params,
                       num_point_params, cam_residual_counts,
                       num_gcp_residuals, reference_vec, crn,
-                      points, num_points, outlier_xyz, problem);
+                      points, num_points, outlier_xyz, *residual_source);
   residual_prefix = opt.out_prefix + "-final_residuals_no_loss_function";
   write_residual_logs(residual_prefix, false, opt, num_cameras, num_camera_params,
                       num_point_params, cam_residual_counts,
                       num_gcp_residuals, reference_vec, crn,
-                      points, num_points, outlier_xyz, problem);
+                      points, num_points, outlier_xyz, *residual_source);
 
   point_kml_path = opt.out_prefix + "-final_points.kml";
   record_points_to_kml(point_kml_path, opt.datum, points, num_points, outlier_xyz,
@@ -2207,7 +2800,7 @@ int do_ba_ceres_one_pass(ModelT                          & ba_model,
                       outlier_xyz,   // in-out
                       opt, num_cameras, num_camera_params, num_point_params,
                       cam_residual_counts,  
-                      num_gcp_residuals, reference_vec, problem);
+                      num_gcp_residuals, reference_vec, *residual_source);
 
   // Create a match file with clean points.
   // TODO: Make this a function.
@@ -3270,6 +3863,14 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
      "How many interest points to detect in each 1024^2 image tile (default: automatic determination).")
     ("num-passes",             po::value(&opt.num_ba_passes)->default_value(1),
      "How many passes of bundle adjustment to do. If more than one, outliers will be removed between passes using --remove-outliers-params, and re-optimization will take place. Match files and residual files with the outliers removed will be written to disk.")
+    ("partition-size",         po::value(&opt.partition_size)->default_value(0),
+     "If positive and there are more cameras than this, partition the cameras into clusters of at most this many cameras using the interest point matches, solve the clusters in parallel, then reconcile them by re-optimizing the cameras and points at the cluster boundaries. Not supported with intrinsics, a reference terrain, or --heights-from-dem.")
+    ("partition-iterations",   po::value(&opt.partition_iterations)->default_value(3),
+     "The most times to alternate between solving the clusters and the boundary, when --partition-size is set.")
+    ("partition-boundary-min-obs", po::value(&opt.partition_boundary_min_obs)->default_value(10),
+     "When reconciling the clusters, re-optimize only the cameras with more than this many observations of points also seen from other clusters.")
+    ("partition-tolerance",    po::value(&opt.partition_tolerance)->default_value(1e-3),
+     "Stop alternating between the clusters and the boundary once the cost changes by less than this fraction of it.")
     ("remove-outliers-params",        po::value(&opt.remove_outliers_params_str)->default_value("75.0 3.0 2.0 3.0", "'pct factor err1 err2'"),
      "Outlier removal based on percentage, when more than one bundle adjustment pass is used. Triangulated points with reprojection error in pixels larger than min(max('pct'-th percentile * 'factor', err1), err2) will be removed as outliers. Hence, never remove errors smaller than err1 but always remove those bigger than err2. Specify as a list in quotes. Default: '75.0 3.0 2.0 3.0'.")
     ("remove-outliers-by-disparity-params",  po::value(&opt.remove_outliers_by_disp_params)->default_value(Vector2(90.0,3.0), "pct factor"),
@@ -3385,6 +3986,19 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   if (opt.create_pinhole && opt.input_prefix != "")
     vw_throw( ArgumentErr() << "Cannot use initial adjustments with pinhole cameras. Read the cameras directly.\n");
 
+  if (opt.partition_size < 0 || opt.partition_iterations < 1)
+    vw_throw( ArgumentErr() << "The partition size must be non-negative and the number "
+              << "of partition iterations must be positive.\n");
+
+  if (opt.partition_boundary_min_obs < 0 || opt.partition_tolerance < 0)
+    vw_throw( ArgumentErr() << "The partition boundary observations and tolerance "
+              << "must be non-negative.\n");
+
+  if (opt.partition_size > 0 && (opt.solve_intrinsics || opt.reference_terrain != "" ||
+                                 opt.heights_from_dem != ""))
+    vw_throw( ArgumentErr() << "Cannot partition the problem when solving for intrinsics "
+              << "or when using a reference terrain or heights from a DEM.\n");
+
   vw::string_replace(opt.remove_outliers_params_str, ",", " "); // replace any commas
   opt.remove_outliers_params = vw::str_to_vec<vw::Vector<double, 4> >(opt.remove_outliers_params_str);
   
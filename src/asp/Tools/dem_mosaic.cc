@@ -320,25 +320,26 @@ std::string processed_proj4(std::string const& srs){
 }
 
 struct Options : vw::cartography::GdalWriteOptions {
-  string dem_list_file, out_prefix, target_srs_string, output_type, tile_list_str, this_dem_as_reference;
+  string dem_list_file, out_prefix, target_srs_string, output_type, tile_list_str, this_dem_as_reference, overview_resampling;
   vector<string> dem_files;
   double tr, geo_tile_size;
   bool   has_out_nodata;
   double out_nodata_value;
-  int    tile_size, tile_index, erode_len, priority_blending_len, extra_crop_len, hole_fill_len, block_size, save_dem_weight;
+  int    tile_size, tile_index, erode_len, priority_blending_len, extra_crop_len, hole_fill_len, block_size, save_dem_weight, num_overview_levels;
   double  weights_exp, weights_blur_sigma, dem_blur_sigma;
   double nodata_threshold;
-  bool   first, last, min, max, block_max, mean, stddev, median, count, save_index_map, use_centerline_weights, first_dem_as_reference, propagate_nodata;
+  bool   first, last, min, max, block_max, mean, stddev, median, count, save_index_map, use_centerline_weights, first_dem_as_reference, propagate_nodata, resumable_output;
   std::set<int> tile_list;
   BBox2 projwin;
   Options(): tr(0), geo_tile_size(0), has_out_nodata(false), tile_index(-1),
 	     erode_len(0), priority_blending_len(0), extra_crop_len(0),
-	     hole_fill_len(0), block_size(0), save_dem_weight(-1), 
+	     hole_fill_len(0), block_size(0), save_dem_weight(-1), num_overview_levels(0),
 	     weights_exp(0), weights_blur_sigma(0.0), dem_blur_sigma(0.0),
 	     nodata_threshold(std::numeric_limits<double>::quiet_NaN()),
 	     first(false), last(false), min(false), max(false), block_max(false),
 	     mean(false), stddev(false), median(false), count(false), save_index_map(false),
-	     use_centerline_weights(false), first_dem_as_reference(false), projwin(BBox2()) {}
+	     use_centerline_weights(false), first_dem_as_reference(false), resumable_output(false),
+	     projwin(BBox2()) {}
 };
 
 /// Return the number of no-blending options selected.
@@ -1268,6 +1269,12 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
      "The output DEM will have the same size, grid, and georeference as this one, but it will not be used in the mosaic.")
     ("save-index-map",   po::bool_switch(&opt.save_index_map)->default_value(false),
      "For each output pixel, save the index of the input DEM it came from (applicable only for --first, --last, --min, and --max). A text file with the index assigned to each input DEM is saved as well.")
+    ("num-overview-levels", po::value(&opt.num_overview_levels)->default_value(0),
+     "Add this many internal overviews (reductions by factors of 2, 4, 8, etc.) to each output tile, built while writing it, so no separate pass with gdaladdo is needed. They are kept in memory until the tile is written.")
+    ("overview-resampling", po::value(&opt.overview_resampling)->default_value("average"),
+     "The resampling method for the overviews. Options: average (of valid pixels), nearest.")
+    ("resumable-output",    po::bool_switch(&opt.resumable_output)->default_value(false),
+     "Keep a journal of the blocks written to each output tile, next to it. If the run is interrupted, running the same command again computes only the blocks not in the journal. A journal made with other options or inputs is discarded. The journal takes as much space as the uncompressed tile, and is removed when the tile is written.")
     ("threads",             po::value<int>(&opt.num_threads)->default_value(4),
 	   "Number of threads to use.")
     ("help,h", "Display this help message.");
@@ -1284,6 +1291,7 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
 			     allow_unregistered, unregistered );
 
   // Error checking
+  asp::parse_overview_resampling(opt.overview_resampling);
   if (opt.out_prefix == "")
     vw_throw(ArgumentErr() << "No output prefix was specified.\n"
 			   << usage << general_options );
@@ -1414,6 +1422,12 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   // Turn on logging to file
   asp::log_to_file(argc, argv, "", opt.out_prefix);
 
+  // A journaled output is resumed only with the same options and
+  // inputs, which may be given in a list file.
+  asp::set_journal_command_line(argc, argv);
+  for (size_t it = 0; it < opt.dem_files.size(); it++)
+    asp::add_journal_input(opt.dem_files[it]);
+
   if (!vm.count("output-nodata-value")){
     // Set a default out_nodata_value, but remember that this is
     // set internally, not by the user.
@@ -1766,37 +1780,49 @@ int main( int argc, char *argv[] ) {
       TerminalProgressCallback tpc("asp", "\t--> ");
       if (opt.output_type == "Float32") 
         asp::save_with_temp_big_blocks(block_size, dem_tile, out_dem, crop_georef,
-                                       opt.out_nodata_value, opt, tpc);
+                                       opt.out_nodata_value, opt, tpc,
+                                       opt.num_overview_levels, opt.overview_resampling,
+                                       opt.resumable_output);
       else if (opt.output_type == "Byte") 
         asp::save_with_temp_big_blocks(block_size, dem_tile,
 				       per_pixel_filter(out_dem, RoundAndClamp<uint8, RealT>()),
                                        crop_georef,
                                        vw::round_and_clamp<uint8>(opt.out_nodata_value),
-                                       opt, tpc);
+                                       opt, tpc,
+                                       opt.num_overview_levels, opt.overview_resampling,
+                                       opt.resumable_output);
       else if (opt.output_type == "UInt16") 
         asp::save_with_temp_big_blocks(block_size, dem_tile,
 				       per_pixel_filter(out_dem, RoundAndClamp<uint16, RealT>()),
                                        crop_georef,
                                        vw::round_and_clamp<uint16>(opt.out_nodata_value),
-                                       opt, tpc);
+                                       opt, tpc,
+                                       opt.num_overview_levels, opt.overview_resampling,
+                                       opt.resumable_output);
       else if (opt.output_type == "Int16") 
         asp::save_with_temp_big_blocks(block_size, dem_tile,
 				       per_pixel_filter(out_dem, RoundAndClamp<int16, RealT>()),
                                        crop_georef,
                                        vw::round_and_clamp<int16>(opt.out_nodata_value),
-                                       opt, tpc);
+                                       opt, tpc,
+                                       opt.num_overview_levels, opt.overview_resampling,
+                                       opt.resumable_output);
       else if (opt.output_type == "UInt32") 
         asp::save_with_temp_big_blocks(block_size, dem_tile,
 				       per_pixel_filter(out_dem, RoundAndClamp<uint32, RealT>()),
                                        crop_georef,
                                        vw::round_and_clamp<uint32>(opt.out_nodata_value),
-                                       opt, tpc);
+                                       opt, tpc,
+                                       opt.num_overview_levels, opt.overview_resampling,
+                                       opt.resumable_output);
       else if (opt.output_type == "Int32") 
         asp::save_with_temp_big_blocks(block_size, dem_tile,
 				       per_pixel_filter(out_dem, RoundAndClamp<int32, RealT>()),
                                        crop_georef,
                                        vw::round_and_clamp<int32>(opt.out_nodata_value),
-                                       opt, tpc);
+                                       opt, tpc,
+                                       opt.num_overview_levels, opt.overview_resampling,
+                                       opt.resumable_output);
       else
         vw_throw( NoImplErr() << "Unsupported output type: " << opt.output_type << ".\n" );
 
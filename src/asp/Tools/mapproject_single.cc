@@ -127,8 +127,9 @@ struct Options : vw::cartography::GdalWriteOptions {
   bool isQuery, noGeoHeaderInfo;
 
   // Settings
-  std::string target_srs_string, output_type, metadata;
-  double nodata_value, tr, mpp, ppd, datum_offset;
+  std::string target_srs_string, output_type, metadata, overview_resampling;
+  double nodata_value, tr, mpp, ppd, datum_offset, isis_snapshot_tolerance;
+  int num_overview_levels;
   BBox2 target_projwin, target_pixelwin;
 };
 
@@ -158,10 +159,16 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
      "Limit the map-projected image to this region, with the corners given in pixels (xmin ymin xmax ymax). Max is exclusive.")
     ("bundle-adjust-prefix", po::value(&opt.bundle_adjust_prefix),
      "Use the camera adjustment obtained by previously running bundle_adjust with this output prefix.")
+    ("isis-snapshot-tolerance", po::value(&opt.isis_snapshot_tolerance)->default_value(0.0),
+     "If positive, sample the position and pointing of ISIS linescan cameras once into in-memory tables and use those instead of ISIS, if they agree with ISIS to within this many pixels.")
     ("ot",  po::value(&opt.output_type)->default_value("Float32"), "Output data type, when the input is single channel. Supported types: Byte, UInt16, Int16, UInt32, Int32, Float32. If the output type is a kind of integer, values are rounded and then clamped to the limits of that type. This option will be ignored for multi-channel images, when the output type is set to be the same as the input type.")
     ("mo",  po::value(&opt.metadata)->default_value(""), "Write metadata to the output file. Provide as a string in quotes if more than one item, separated by a space, such as 'VAR1=VALUE1 VAR2=VALUE2'. Neither the variable names nor the values should contain spaces.")
     ("no-geoheader-info", po::bool_switch(&opt.noGeoHeaderInfo)->default_value(false),
-     "Suppress writing some auxiliary information in geoheaders.");
+     "Suppress writing some auxiliary information in geoheaders.")
+    ("num-overview-levels", po::value(&opt.num_overview_levels)->default_value(0),
+     "Add this many internal overviews (reductions by factors of 2, 4, 8, etc.) to the output image, built while writing it, so no separate pass with gdaladdo is needed. They are kept in memory until the write is done.")
+    ("overview-resampling", po::value(&opt.overview_resampling)->default_value("average"),
+     "The resampling method for the overviews. Options: average (of valid pixels), nearest.");
   
   general_options.add( vw::cartography::GdalWriteOptionsDescription(opt) );
 
@@ -189,6 +196,8 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   if ( !vm.count("dem") || !vm.count("camera-image") || !vm.count("camera-model") )
     vw_throw( ArgumentErr() << usage << general_options );
 
+  asp::parse_overview_resampling(opt.overview_resampling); // validate
+
   // We support map-projecting using the DG camera model, however, these images
   // cannot be used later to do stereo, as that process expects the images
   // to be map-projected using the RPC model.
@@ -204,6 +213,7 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   // Need this to be able to load adjusted camera models. That will happen
   // in the stereo session.
   asp::stereo_settings().bundle_adjust_prefix = opt.bundle_adjust_prefix;
+  asp::stereo_settings().isis_snapshot_tolerance = opt.isis_snapshot_tolerance;
 
   if (fs::path(opt.dem_file).extension() != "") {
     // A path to a real DEM file was provided, load it!
@@ -304,13 +314,21 @@ void write_parallel_cond( std::string              const& filename,
   bool has_georef = true;
 
   // ISIS is not thread safe so we must switch out base on what the session is.
+  // Either way, the overviews, if any, are built from the tiles being written.
   vw_out() << "Writing: " << filename << "\n";
   if ( session_type == "isis" ) {
-    vw::cartography::write_gdal_image(filename, image.impl(), has_georef, georef,
-                          has_nodata, nodata_val, opt, tpc, keywords);
+    asp::OverviewBuilder<typename ImageT::pixel_type>
+      overviews(image.impl().cols(), image.impl().rows(), opt.num_overview_levels,
+                opt.overview_resampling, has_nodata, nodata_val);
+    vw::cartography::write_gdal_image(filename, asp::record_overviews(image.impl(), overviews),
+                                      has_georef, georef,
+                                      has_nodata, nodata_val, opt, tpc, keywords);
+    overviews.write(filename);
   } else {
-    vw::cartography::block_write_gdal_image(filename, image.impl(), has_georef, georef,
-                                has_nodata, nodata_val, opt, tpc, keywords);
+    asp::block_write_gdal_image_with_overviews(filename, image.impl(), has_georef, georef,
+                                               has_nodata, nodata_val, opt,
+                                               opt.num_overview_levels,
+                                               opt.overview_resampling, tpc, keywords);
   }
 
 }
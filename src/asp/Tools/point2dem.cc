@@ -77,16 +77,17 @@ struct Options : vw::cartography::GdalWriteOptions {
   bool        has_alpha, do_normalize, do_ortho, do_error, no_dem;
   double      rounding_error;
   std::string target_srs_string;
+  std::vector<std::string> extra_srs_strings;
   BBox2       target_projwin;
   int         fsaa, dem_hole_fill_len, ortho_hole_fill_len, ortho_hole_fill_extra_len;
   bool        remove_outliers_with_pct;
   Vector2     remove_outliers_params;
   double      max_valid_triangulation_error;
   Vector2     median_filter_params;
-  int         erode_len;
-  std::string csv_format_str, csv_proj4_str, filter;
+  int         erode_len, num_overview_levels;
+  std::string csv_format_str, csv_proj4_str, filter, overview_resampling;
   double      search_radius_factor, sigma_factor, default_grid_size_multiplier;
-  bool        use_surface_sampling;
+  bool        use_surface_sampling, resumable_output;
   bool        has_las_or_csv_or_pcd;
   Vector2i    max_output_size;
 
@@ -98,9 +99,9 @@ struct Options : vw::cartography::GdalWriteOptions {
 	      semi_major(0), semi_minor(0), fsaa(1),
 	      dem_hole_fill_len(0), ortho_hole_fill_len(0), ortho_hole_fill_extra_len(0),
 	      remove_outliers_with_pct(true), max_valid_triangulation_error(0),
-	      erode_len(0), search_radius_factor(0), sigma_factor(0),
+	      erode_len(0), num_overview_levels(0), search_radius_factor(0), sigma_factor(0),
 	      default_grid_size_multiplier(1.0), use_surface_sampling(false),
-	      has_las_or_csv_or_pcd(false), max_output_size(9999999, 9999999){}
+	      resumable_output(false), has_las_or_csv_or_pcd(false), max_output_size(9999999, 9999999){}
 };
 
 void parse_input_clouds_textures(std::vector<std::string> const& files,
@@ -343,6 +344,8 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   po::options_description projection_options("Projection options");
   projection_options.add_options()
     ("t_srs",         po::value(&opt.target_srs_string)->default_value(""), "Specify the output projection (PROJ.4 string). Can also be an URL or in WKT format, as in GDAL.")
+    ("extra-t_srs",   po::value(&opt.extra_srs_strings),
+     "Also write the outputs in this projection, with each of the DEM spacings. Can be repeated. The cloud is read and indexed only once for all projections. The outputs for the extra grids have _1, _2, etc., appended to the output prefix.")
     ("t_projwin",     po::value(&opt.target_projwin),
      "The output DEM will have corners with these georeferenced coordinates.")
     ("dem-spacing,s", po::value(&dem_spacing1)->default_value(""),
@@ -413,7 +416,13 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     ("use-surface-sampling", po::bool_switch(&opt.use_surface_sampling)->default_value(false),
      "Use the older algorithm, interpret the point cloud as a surface made up of triangles and interpolate into it (prone to aliasing).")
     ("fsaa",   po::value<int>(&opt.fsaa)->default_value(1),            "Oversampling amount to perform antialiasing (obsolete).")
-    ("no-dem", po::bool_switch(&opt.no_dem)->default_value(false), "Skip writing a DEM.");
+    ("no-dem", po::bool_switch(&opt.no_dem)->default_value(false), "Skip writing a DEM.")
+    ("num-overview-levels", po::value(&opt.num_overview_levels)->default_value(0),
+     "Add this many internal overviews (reductions by factors of 2, 4, 8, etc.) to the output GeoTIFF files, built while writing them, so no separate pass with gdaladdo is needed. They are kept in memory until the write is done.")
+    ("overview-resampling", po::value(&opt.overview_resampling)->default_value("average"),
+     "The resampling method for the overviews. Options: average (of valid pixels), nearest.")
+    ("resumable-output", po::bool_switch(&opt.resumable_output)->default_value(false),
+     "Keep a journal of the blocks written to each output GeoTIFF, next to it. If the run is interrupted, running the same command again computes only the blocks not in the journal. A journal made with other options or inputs is discarded. The journal takes as much space as the uncompressed output, and is removed when the output is written.");
   
   general_options.add( manipulation_options );
   general_options.add( projection_options );
@@ -438,6 +447,8 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
     vw_throw( ArgumentErr() << "Missing input point clouds.\n"
 			    << usage << general_options );
   std::vector<std::string> input_files = vm["input-files"].as< std::vector<std::string> >();
+
+  asp::parse_overview_resampling(opt.overview_resampling); // validate
   parse_input_clouds_textures(input_files, usage, general_options, opt);
 
   if (opt.median_filter_params[0] < 0 || opt.median_filter_params[1] < 0){
@@ -487,6 +498,11 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
 			    << "output DEM resolution must be set.\n" );
   }
 
+  if (!opt.extra_srs_strings.empty() && opt.target_projwin != BBox2()){
+    vw_throw( ArgumentErr() << "The --t_projwin option cannot be used with --extra-t_srs, "
+			    << "as the projections have different coordinates.\n" );
+  }
+
   if ( opt.out_prefix.empty() )
     opt.out_prefix = asp::prefix_from_pointcloud_filename( opt.pointcloud_files[0] );
 
@@ -580,6 +596,9 @@ void handle_arguments( int argc, char *argv[], Options& opt ) {
   // Turn on logging to file
   asp::log_to_file(argc, argv, "", opt.out_prefix);
 
+  // A journaled output is resumed only with the same options and inputs
+  asp::set_journal_command_line(argc, argv);
+
   // reference_spheroid and datum are aliases.
   boost::to_lower(opt.reference_spheroid);
   boost::to_lower(opt.datum);
@@ -724,7 +743,9 @@ namespace asp{
     TerminalProgressCallback tpc("asp", imgName + ": ");
     if ( opt.output_file_type == "tif" )
       asp::save_with_temp_big_blocks(block_size, output_file, img, georef,
-                                     opt.nodata_value, opt, tpc);
+                                     opt.nodata_value, opt, tpc,
+                                     opt.num_overview_levels, opt.overview_resampling,
+                                     opt.resumable_output);
     else
       vw::cartography::write_gdal_image(output_file, img, georef, opt, tpc);
   } // End function save_image
@@ -1034,11 +1055,11 @@ void do_software_rasterization( asp::OrthoRasterizerView& rasterizer,
 
     int hole_fill_len = 0;
     if (num_channels == 4){
-      // The error is a scalar.
-      ImageViewRef<Vector4> point_disk_image
-        = asp::form_point_cloud_composite<Vector4>
-        (opt.pointcloud_files, asp::OrthoRasterizerView::max_subblock_size());
-      ImageViewRef<double> error_channel = select_channel(point_disk_image,3);
+      // The error is a scalar. Read just that channel.
+      ImageViewRef< Vector<double, 1> > error_disk_image
+        = asp::form_point_cloud_composite< Vector<double, 1> >
+        (opt.pointcloud_files, asp::OrthoRasterizerView::max_subblock_size(), 3);
+      ImageViewRef<double> error_channel = select_channel(error_disk_image, 0);
       rasterizer.set_texture( error_channel );
       rasterizer_fsaa = generate_fsaa_raster( rasterizer, opt );
       save_image(opt,
@@ -1173,55 +1194,117 @@ void do_software_rasterization( asp::OrthoRasterizerView& rasterizer,
 } // End do_software_rasterization
 
 
-// Wrapper for do_software_rasterization that goes through all spacing values
-void do_software_rasterization_multi_spacing(const ImageViewRef<Vector3>& proj_point_input,
-                                             Options& opt,
-                                             cartography::GeoReference& georef,
-                                             ImageViewRef<double> const& error_image,
-                                             double estim_max_error) {
-  // Perform the slow initialization that can be shared by all output resolutions
+// Map a cartesian point cloud to the projected coordinates of a DEM,
+// with the longitude in the range centered at the given one, and with
+// the user's offset.
+struct ProjectPointCloud {
+  cartography::GeoReference m_georef;
+  double  m_avg_lon;
+  Vector3 m_offset;
+  ProjectPointCloud(cartography::GeoReference const& georef, double avg_lon,
+                    Vector3 const& offset):
+    m_georef(georef), m_avg_lon(avg_lon), m_offset(offset){}
+
+  ImageViewRef<Vector3> operator()(ImageViewRef<Vector3> const& point_image) const {
+    // We trade off readability here to avoid ImageViewRef dereferences
+    if (m_offset != Vector3())
+      return geodetic_to_point  // GDC to XYZ
+        (asp::point_image_offset  // Add user coordinate offset
+         (asp::recenter_longitude(cartesian_to_geodetic(point_image, m_georef), // XYZ to GDC, then normalize longitude
+                                  m_avg_lon),
+          m_offset),
+         m_georef);
+    return geodetic_to_point
+      (asp::recenter_longitude
+       (cartesian_to_geodetic(point_image, m_georef),
+        m_avg_lon),
+       m_georef);
+  }
+};
+
+// Wrapper for do_software_rasterization that goes through all
+// projections and spacing values. The cloud is indexed for all
+// projections in one pass, and the slow initialization of each
+// projection's rasterizer is shared by all its spacings.
+void do_software_rasterization_multi_grid(const ImageViewRef<Vector3>& point_image,
+                                          Options& opt,
+                                          std::vector<cartography::GeoReference>& georefs,
+                                          double avg_lon,
+                                          ImageViewRef<double> const& error_image,
+                                          double estim_max_error) {
+
+  Vector3 offset(opt.lon_offset, opt.lat_offset, opt.height_offset);
+  if (offset != Vector3())
+    vw_out() << "\t--> Applying offset: " << opt.lon_offset
+             << " " << opt.lat_offset << " " << opt.height_offset << "\n";
+
+  std::vector<asp::PointTransform> transforms;
+  for (size_t k = 0; k < georefs.size(); k++)
+    transforms.push_back(ProjectPointCloud(georefs[k], avg_lon, offset));
+
+  // Perform the slow initialization that can be shared by all output grids
   Stopwatch sw1;
   sw1.start();
-  vw::Mutex count_mutex; // Need to pass in by pointer due to C++ class restrictions
-  size_t num_invalid_pixels = 0; // Need to pass in by pointer because we can't get back the number from
-                                 //  the original rasterizer object otherwise for some reason.
-  asp::OrthoRasterizerView
-    rasterizer(proj_point_input.impl(), select_channel(proj_point_input.impl(),2),
-               opt.search_radius_factor, opt.sigma_factor, opt.use_surface_sampling,
-               asp::ASPGlobalOptions::tri_tile_size(), // to efficiently process the cloud
-               opt.target_projwin,
-               opt.remove_outliers_with_pct, opt.remove_outliers_params,
-               error_image, estim_max_error, opt.max_valid_triangulation_error,
-               opt.median_filter_params, opt.erode_len, opt.has_las_or_csv_or_pcd,
-               opt.filter, opt.default_grid_size_multiplier,
-               &num_invalid_pixels, &count_mutex,
-               TerminalProgressCallback("asp","QuadTree: "));
-
+  std::vector<asp::PointCloudIndex> indices;
+  asp::index_point_cloud(point_image, transforms,
+                         asp::ASPGlobalOptions::tri_tile_size(), // to efficiently process the cloud
+                         opt.remove_outliers_with_pct, error_image, estim_max_error,
+                         opt.max_valid_triangulation_error, indices,
+                         TerminalProgressCallback("asp","QuadTree: "));
   sw1.stop();
   vw_out(DebugMessage,"asp") << "Quad time: " << sw1.elapsed_seconds() << std::endl;
 
-  // Perform other rasterizer configuration
-  rasterizer.set_use_alpha(opt.has_alpha);
-  rasterizer.set_use_minz_as_default(false);
-  rasterizer.set_default_value(opt.nodata_value);
-
   std::string base_out_prefix = opt.out_prefix;
-
-  // Call the function for each dem spacing
-  for (size_t i = 0; i < opt.dem_spacing.size(); i++) {
-    double this_spacing = opt.dem_spacing[i];
-    
-    // Required second init step for each spacing
-    rasterizer.initialize_spacing(this_spacing);
-
-    // Each spacing gets a variation of the output prefix
-    if (i == 0)
-      opt.out_prefix = base_out_prefix;
-    else // Write later iterations to a different path.
-      opt.out_prefix = base_out_prefix + "_" + vw::num_to_str(i);
-    do_software_rasterization(rasterizer, opt, georef, error_image,
-                              estim_max_error, &num_invalid_pixels);
-  } // End loop through spacings
+  int grid_count = 0;
+  for (size_t k = 0; k < georefs.size(); k++) {
+
+    vw::Mutex count_mutex; // Need to pass in by pointer due to C++ class restrictions
+    size_t num_invalid_pixels = 0; // Need to pass in by pointer because we can't get back the number from
+                                   //  the original rasterizer object otherwise for some reason.
+    ImageViewRef<Vector3> proj_point_input = transforms[k](point_image);
+    asp::OrthoRasterizerView
+      rasterizer(proj_point_input.impl(), select_channel(proj_point_input.impl(),2),
+                 opt.search_radius_factor, opt.sigma_factor, opt.use_surface_sampling,
+                 asp::ASPGlobalOptions::tri_tile_size(), // to efficiently process the cloud
+                 opt.target_projwin,
+                 opt.remove_outliers_with_pct, opt.remove_outliers_params,
+                 error_image, estim_max_error, opt.max_valid_triangulation_error,
+                 opt.median_filter_params, opt.erode_len, opt.has_las_or_csv_or_pcd,
+                 opt.filter, opt.default_grid_size_multiplier,
+                 &num_invalid_pixels, &count_mutex,
+                 TerminalProgressCallback("asp","QuadTree: "), &indices[k]);
+
+    // The index was copied into the rasterizer
+    indices[k] = asp::PointCloudIndex();
+
+    // Perform other rasterizer configuration
+    rasterizer.set_use_alpha(opt.has_alpha);
+    rasterizer.set_use_minz_as_default(false);
+    rasterizer.set_default_value(opt.nodata_value);
+
+    // Call the function for each dem spacing
+    for (size_t i = 0; i < opt.dem_spacing.size(); i++) {
+      double this_spacing = opt.dem_spacing[i];
+
+      // Undo what writing the previous grid's error image or DRG did
+      rasterizer.set_point_image(proj_point_input);
+      rasterizer.set_texture(select_channel(proj_point_input, 2));
+
+      // Required second init step for each spacing
+      rasterizer.initialize_spacing(this_spacing);
+
+      // Each grid gets a variation of the output prefix
+      if (grid_count == 0)
+        opt.out_prefix = base_out_prefix;
+      else // Write later iterations to a different path.
+        opt.out_prefix = base_out_prefix + "_" + vw::num_to_str(grid_count);
+      grid_count++;
+
+      cartography::GeoReference georef = georefs[k];
+      do_software_rasterization(rasterizer, opt, georef, error_image,
+                                estim_max_error, &num_invalid_pixels);
+    } // End loop through spacings
+  } // End loop through projections
 
   opt.out_prefix = base_out_prefix; // Restore the original value
 }
@@ -1282,6 +1365,16 @@ int main( int argc, char *argv[] ) {
       asp::set_srs_string(opt.target_srs_string, have_user_datum, user_datum, output_georef);
     }
 
+    // Additional projections to write the products in
+    std::vector<GeoReference> extra_georefs;
+    for (size_t k = 0; k < opt.extra_srs_strings.size(); k++) {
+      GeoReference georef;
+      if (has_pc_georef)
+        georef = pc_georef;
+      asp::set_srs_string(opt.extra_srs_strings[k], have_user_datum, user_datum, georef);
+      extra_georefs.push_back(georef);
+    }
+
     // Convert any input LAS or CSV files to ASP's point cloud tif format
     // - The output and input datum will match unless the input data files
     //   themselves specify a different datum.
@@ -1363,33 +1456,16 @@ int main( int argc, char *argv[] ) {
     // TODO: Do we need the recenter code now that we have this?
     // TODO: Modify other code so we don't have to handle this one special case!
     // Forcing the georef object outside its comfort zone is not safe for all projections!
-    if (output_georef.overall_proj4_str().find("+proj=aea") == std::string::npos)
-      output_georef.set_lon_center(avg_lon < 100);
-    
-    // We trade off readability here to avoid ImageViewRef dereferences
-    if (opt.lon_offset != 0 || opt.lat_offset != 0 || opt.height_offset != 0) {
-      vw_out() << "\t--> Applying offset: " << opt.lon_offset
-               << " " << opt.lat_offset << " " << opt.height_offset << "\n";
-      do_software_rasterization_multi_spacing
-        (geodetic_to_point  // GDC to XYZ
-            (asp::point_image_offset  // Add user coordinate offset
-              (asp::recenter_longitude(cartesian_to_geodetic(point_image,output_georef), // XYZ to GDC, then normalize longitude
-			               avg_lon),
-           Vector3(opt.lon_offset,
-	           opt.lat_offset,
-	           opt.height_offset)),
-             output_georef),
-         opt, output_georef, error_image, estim_max_error);
-    } else {
-      do_software_rasterization_multi_spacing
-        (geodetic_to_point
-            (asp::recenter_longitude
-              (cartesian_to_geodetic(point_image, output_georef),
-               avg_lon),
-             output_georef),
-        opt, output_georef, error_image, estim_max_error);
+    std::vector<GeoReference> georefs(1, output_georef);
+    georefs.insert(georefs.end(), extra_georefs.begin(), extra_georefs.end());
+    for (size_t k = 0; k < georefs.size(); k++) {
+      if (georefs[k].overall_proj4_str().find("+proj=aea") == std::string::npos)
+        georefs[k].set_lon_center(avg_lon < 100);
     }
 
+    do_software_rasterization_multi_grid(point_image, opt, georefs, avg_lon,
+                                         error_image, estim_max_error);
+
     // Wipe the temporary files
     for (int i = 0; i < (int)tmp_tifs.size(); i++)
       if (fs::exists(tmp_tifs[i])) fs::remove(tmp_tifs[i]);
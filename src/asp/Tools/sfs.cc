@@ -35,6 +35,7 @@
 #include <vw/Image/AntiAliasing.h>
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
 #include <asp/Core/Macros.h>
 #include <asp/Core/Common.h>
 #include <asp/Sessions/StereoSessionFactory.h>
@@ -980,7 +981,8 @@ struct Options : public vw::cartography::GdalWriteOptions {
     use_blending_weights,
     float_dem_at_boundary, fix_dem, float_reflectance_model, query, save_sparingly;
   double smoothness_weight, init_dem_height, nodata_val, initial_dem_constraint_weight,
-    albedo_constraint_weight, camera_position_step_size, rpc_penalty_weight, unreliable_intensity_threshold;
+    albedo_constraint_weight, camera_position_step_size, rpc_penalty_weight, unreliable_intensity_threshold,
+    isis_snapshot_tolerance;
   vw::BBox2 crop_win;
 
   Options():max_iterations(0), max_coarse_iterations(0), reflectance_type(0),
@@ -999,7 +1001,7 @@ struct Options : public vw::cartography::GdalWriteOptions {
 	    smoothness_weight(0), initial_dem_constraint_weight(0.0),
 	    albedo_constraint_weight(0.0),
 	    camera_position_step_size(1.0), rpc_penalty_weight(0.0),
-            unreliable_intensity_threshold(0.0),
+            unreliable_intensity_threshold(0.0), isis_snapshot_tolerance(0.0),
 	    crop_win(BBox2i(0, 0, 0, 0)){}
 };
 
@@ -1423,75 +1425,30 @@ double ComputeReflectance(Vector3 const& cameraPosition,
   return input_img_reflectance;
 }
 
-bool computeReflectanceAndIntensity(double left_h, double center_h, double right_h,
-				    double bottom_h, double top_h,
-				    int col, int row,
-				    ImageView<double> const& dem,
-				    cartography::GeoReference const& geo,
-				    bool model_shadows,
-				    double max_dem_height,
-				    double gridx, double gridy,
-				    ModelParams const& model_params,
-				    GlobalParams const& global_params,
-				    BBox2i const& crop_box,
-				    MaskedImgT const & image,
-				    DoubleImgT const & blend_weight,
-				    CameraModel const* camera,
-				    PixelMask<double> & reflectance,
-				    PixelMask<double> & intensity,
-				    double            & weight,
-                                    const double * coeffs) {
+// Compute the reflectance and intensity at a DEM grid point given
+// its xyz position and the normal to the DEM there.
+bool computeReflectanceAndIntensityFromNormal(Vector3 const& base, Vector3 const& normal,
+                                              int col, int row,
+                                              ImageView<double> const& dem,
+                                              cartography::GeoReference const& geo,
+                                              bool model_shadows,
+                                              double max_dem_height,
+                                              double gridx, double gridy,
+                                              ModelParams const& model_params,
+                                              GlobalParams const& global_params,
+                                              BBox2i const& crop_box,
+                                              MaskedImgT const & image,
+                                              DoubleImgT const & blend_weight,
+                                              CameraModel const* camera,
+                                              PixelMask<double> & reflectance,
+                                              PixelMask<double> & intensity,
+                                              double            & weight,
+                                              const double * coeffs) {
 
   // Set output values
   reflectance = 0.0; reflectance.invalidate();
   intensity   = 0.0; intensity.invalidate();
   weight      = 0.0;
-  
-  if (col >= dem.cols() - 1 || row >= dem.rows() - 1) return false;
-  if (crop_box.empty()) return false;
-    
-  // TODO: Investigate various ways of finding the normal.
-
-  // The xyz position at the center grid point
-  Vector2 lonlat = geo.pixel_to_lonlat(Vector2(col, row));
-  double h = center_h;
-  Vector3 lonlat3 = Vector3(lonlat(0), lonlat(1), h);
-  Vector3 base = geo.datum().geodetic_to_cartesian(lonlat3);
-
-  // The xyz position at the left grid point
-  lonlat = geo.pixel_to_lonlat(Vector2(col-1, row));
-  h = left_h;
-  lonlat3 = Vector3(lonlat(0), lonlat(1), h);
-  Vector3 left = geo.datum().geodetic_to_cartesian(lonlat3);
-
-  // The xyz position at the right grid point
-  lonlat = geo.pixel_to_lonlat(Vector2(col+1, row));
-  h = right_h;
-  lonlat3 = Vector3(lonlat(0), lonlat(1), h);
-  Vector3 right = geo.datum().geodetic_to_cartesian(lonlat3);
-
-  // The xyz position at the bottom grid point
-  lonlat = geo.pixel_to_lonlat(Vector2(col, row+1));
-  h = bottom_h;
-  lonlat3 = Vector3(lonlat(0), lonlat(1), h);
-  Vector3 bottom = geo.datum().geodetic_to_cartesian(lonlat3);
-
-  // The xyz position at the top grid point
-  lonlat = geo.pixel_to_lonlat(Vector2(col, row-1));
-  h = top_h;
-  lonlat3 = Vector3(lonlat(0), lonlat(1), h);
-  Vector3 top = geo.datum().geodetic_to_cartesian(lonlat3);
-
-#if 0
-  // two-point normal
-  Vector3 dx = right - base;
-  Vector3 dy = bottom - base;
-#else
-  // four-point normal (centered)
-  Vector3 dx = right - left;
-  Vector3 dy = bottom - top;
-#endif
-  Vector3 normal = -normalize(cross_prod(dx, dy)); // so normal points up
 
   // Update the camera position for the given pixel (camera position
   // is pixel-dependent for for linescan cameras.
@@ -1569,6 +1526,189 @@ bool computeReflectanceAndIntensity(double left_h, double center_h, double right
   return true;
 }
 
+bool computeReflectanceAndIntensity(double left_h, double center_h, double right_h,
+				    double bottom_h, double top_h,
+				    int col, int row,
+				    ImageView<double> const& dem,
+				    cartography::GeoReference const& geo,
+				    bool model_shadows,
+				    double max_dem_height,
+				    double gridx, double gridy,
+				    ModelParams const& model_params,
+				    GlobalParams const& global_params,
+				    BBox2i const& crop_box,
+				    MaskedImgT const & image,
+				    DoubleImgT const & blend_weight,
+				    CameraModel const* camera,
+				    PixelMask<double> & reflectance,
+				    PixelMask<double> & intensity,
+				    double            & weight,
+                                    const double * coeffs) {
+
+  // Set output values
+  reflectance = 0.0; reflectance.invalidate();
+  intensity   = 0.0; intensity.invalidate();
+  weight      = 0.0;
+  
+  if (col >= dem.cols() - 1 || row >= dem.rows() - 1) return false;
+  if (crop_box.empty()) return false;
+    
+  // TODO: Investigate various ways of finding the normal.
+
+  // The xyz position at the center grid point
+  Vector2 lonlat = geo.pixel_to_lonlat(Vector2(col, row));
+  double h = center_h;
+  Vector3 lonlat3 = Vector3(lonlat(0), lonlat(1), h);
+  Vector3 base = geo.datum().geodetic_to_cartesian(lonlat3);
+
+  // The xyz position at the left grid point
+  lonlat = geo.pixel_to_lonlat(Vector2(col-1, row));
+  h = left_h;
+  lonlat3 = Vector3(lonlat(0), lonlat(1), h);
+  Vector3 left = geo.datum().geodetic_to_cartesian(lonlat3);
+
+  // The xyz position at the right grid point
+  lonlat = geo.pixel_to_lonlat(Vector2(col+1, row));
+  h = right_h;
+  lonlat3 = Vector3(lonlat(0), lonlat(1), h);
+  Vector3 right = geo.datum().geodetic_to_cartesian(lonlat3);
+
+  // The xyz position at the bottom grid point
+  lonlat = geo.pixel_to_lonlat(Vector2(col, row+1));
+  h = bottom_h;
+  lonlat3 = Vector3(lonlat(0), lonlat(1), h);
+  Vector3 bottom = geo.datum().geodetic_to_cartesian(lonlat3);
+
+  // The xyz position at the top grid point
+  lonlat = geo.pixel_to_lonlat(Vector2(col, row-1));
+  h = top_h;
+  lonlat3 = Vector3(lonlat(0), lonlat(1), h);
+  Vector3 top = geo.datum().geodetic_to_cartesian(lonlat3);
+
+#if 0
+  // two-point normal
+  Vector3 dx = right - base;
+  Vector3 dy = bottom - base;
+#else
+  // four-point normal (centered)
+  Vector3 dx = right - left;
+  Vector3 dy = bottom - top;
+#endif
+  Vector3 normal = -normalize(cross_prod(dx, dy)); // so normal points up
+
+  return computeReflectanceAndIntensityFromNormal(base, normal, col, row, dem, geo,
+                                                  model_shadows, max_dem_height,
+                                                  gridx, gridy,
+                                                  model_params, global_params,
+                                                  crop_box, image, blend_weight, camera,
+                                                  reflectance, intensity, weight,
+                                                  coeffs);
+}
+
+// Compute the reflectance and intensity over a tile of the DEM.
+// The DEM grid points are converted to xyz once per tile, rather than
+// once for each neighbor whose normal they contribute to.
+class ReflectanceAndIntensityTask: public vw::Task, private boost::noncopyable {
+  BBox2i                            m_bbox;
+  ImageView<double>         const & m_dem;
+  cartography::GeoReference const & m_geo;
+  bool                              m_model_shadows;
+  double                            m_max_dem_height;
+  double                            m_gridx, m_gridy;
+  ModelParams               const & m_model_params;
+  GlobalParams              const & m_global_params;
+  BBox2i                    const & m_crop_box;
+  MaskedImgT                const & m_image;
+  DoubleImgT                const & m_blend_weight;
+  CameraModel               const * m_camera;
+  ImageView< PixelMask<double> >  & m_reflectance;
+  ImageView< PixelMask<double> >  & m_intensity;
+  ImageView< double            >  & m_weight;
+  const double                    * m_coeffs;
+
+public:
+  ReflectanceAndIntensityTask(BBox2i const& bbox,
+                              ImageView<double> const& dem,
+                              cartography::GeoReference const& geo,
+                              bool model_shadows, double max_dem_height,
+                              double gridx, double gridy,
+                              ModelParams const& model_params,
+                              GlobalParams const& global_params,
+                              BBox2i const& crop_box,
+                              MaskedImgT const & image,
+                              DoubleImgT const & blend_weight,
+                              CameraModel const* camera,
+                              ImageView< PixelMask<double> > & reflectance,
+                              ImageView< PixelMask<double> > & intensity,
+                              ImageView< double            > & weight,
+                              const double * coeffs):
+    m_bbox(bbox), m_dem(dem), m_geo(geo), m_model_shadows(model_shadows),
+    m_max_dem_height(max_dem_height), m_gridx(gridx), m_gridy(gridy),
+    m_model_params(model_params), m_global_params(global_params),
+    m_crop_box(crop_box), m_image(image), m_blend_weight(blend_weight),
+    m_camera(camera), m_reflectance(reflectance), m_intensity(intensity),
+    m_weight(weight), m_coeffs(coeffs){}
+
+  virtual void operator()() {
+
+    // Init the reflectance and intensity as invalid. Each task
+    // writes to its own tile, no locking is needed.
+    for (int row = m_bbox.min().y(); row < m_bbox.max().y(); row++) {
+      for (int col = m_bbox.min().x(); col < m_bbox.max().x(); col++) {
+        m_reflectance(col, row).invalidate();
+        m_intensity(col, row).invalidate();
+        m_weight(col, row) = 0.0;
+      }
+    }
+
+    if (m_crop_box.empty())
+      return;
+
+    // The xyz positions of the tile and its one-pixel border
+    BBox2i ext_box = m_bbox;
+    ext_box.expand(1);
+    ext_box.crop(bounding_box(m_dem));
+    ImageView<Vector3> xyz(ext_box.width(), ext_box.height());
+    for (int row = 0; row < xyz.rows(); row++) {
+      for (int col = 0; col < xyz.cols(); col++) {
+        int dem_col = col + ext_box.min().x(), dem_row = row + ext_box.min().y();
+        Vector2 lonlat = m_geo.pixel_to_lonlat(Vector2(dem_col, dem_row));
+        xyz(col, row) = m_geo.datum().geodetic_to_cartesian
+          (Vector3(lonlat(0), lonlat(1), m_dem(dem_col, dem_row)));
+      }
+    }
+
+    // Skip the DEM boundary, as the normal there cannot be found
+    BBox2i inner_box = m_bbox;
+    inner_box.crop(BBox2i(1, 1, m_dem.cols() - 2, m_dem.rows() - 2));
+    for (int row = inner_box.min().y(); row < inner_box.max().y(); row++) {
+      for (int col = inner_box.min().x(); col < inner_box.max().x(); col++) {
+        int c = col - ext_box.min().x(), r = row - ext_box.min().y();
+
+        // four-point normal (centered), as for a single grid point
+        Vector3 dx = xyz(c + 1, r) - xyz(c - 1, r);
+        Vector3 dy = xyz(c, r + 1) - xyz(c, r - 1);
+        Vector3 normal = -normalize(cross_prod(dx, dy)); // so normal points up
+
+        computeReflectanceAndIntensityFromNormal(xyz(c, r), normal, col, row,
+                                                 m_dem, m_geo,
+                                                 m_model_shadows, m_max_dem_height,
+                                                 m_gridx, m_gridy,
+                                                 m_model_params, m_global_params,
+                                                 m_crop_box, m_image, m_blend_weight,
+                                                 m_camera,
+                                                 m_reflectance(col, row),
+                                                 m_intensity(col, row),
+                                                 m_weight(col, row),
+                                                 m_coeffs);
+      }
+    }
+  }
+};
+
+// Compute the reflectance and intensity over the whole DEM, using
+// multiple threads. The camera must be safe to use from multiple
+// threads if num_threads is more than 1.
 void computeReflectanceAndIntensity(ImageView<double> const& dem,
 				    cartography::GeoReference const& geo,
 				    bool model_shadows,
@@ -1583,13 +1723,14 @@ void computeReflectanceAndIntensity(ImageView<double> const& dem,
 				    ImageView< PixelMask<double> > & reflectance,
 				    ImageView< PixelMask<double> > & intensity,
 				    ImageView< double            > & weight,
-                                    const double * coeffs) {
+                                    const double * coeffs,
+                                    int num_threads) {
 
   // Update max_dem_height
   max_dem_height = -std::numeric_limits<double>::max();
   if (model_shadows) {
-    for (int col = 0; col < dem.cols(); col++) {
-      for (int row = 0; row < dem.rows(); row++) {
+    for (int row = 0; row < dem.rows(); row++) {
+      for (int col = 0; col < dem.cols(); col++) {
         if (dem(col, row) > max_dem_height) {
           max_dem_height = dem(col, row);
         }
@@ -1597,34 +1738,26 @@ void computeReflectanceAndIntensity(ImageView<double> const& dem,
     }
     vw_out() << "Maximum DEM height: " << max_dem_height << std::endl;
   }
-  
-  // Init the reflectance and intensity as invalid
+
   reflectance.set_size(dem.cols(), dem.rows());
   intensity.set_size(dem.cols(), dem.rows());
   weight.set_size(dem.cols(), dem.rows());
-  for (int col = 0; col < dem.cols(); col++) {
-    for (int row = 0; row < dem.rows(); row++) {
-      reflectance(col, row).invalidate();
-      intensity(col, row).invalidate();
-      weight(col, row) = 0.0;
-    }
-  }
 
-  for (int col = 1; col < dem.cols()-1; col++) {
-    for (int row = 1; row < dem.rows()-1; row++) {
-      computeReflectanceAndIntensity(dem(col-1, row), dem(col, row),
-				     dem(col+1, row),
-				     dem(col, row+1), dem(col, row-1),
-				     col, row, dem,  geo,
-				     model_shadows, max_dem_height,
-				     gridx, gridy,
-				     model_params, global_params,
-				     crop_box, image, blend_weight, camera,
-				     reflectance(col, row), intensity(col, row),
-                                     weight(col, row),
-                                     coeffs);
+  int ts = 256; // tile size
+  FifoWorkQueue queue(std::max(num_threads, 1));
+  for (int row = 0; row < dem.rows(); row += ts) {
+    for (int col = 0; col < dem.cols(); col += ts) {
+      BBox2i bbox(col, row, ts, ts);
+      bbox.crop(bounding_box(dem));
+      boost::shared_ptr<ReflectanceAndIntensityTask>
+        task(new ReflectanceAndIntensityTask(bbox, dem, geo, model_shadows, max_dem_height,
+                                             gridx, gridy, model_params, global_params,
+                                             crop_box, image, blend_weight, camera,
+                                             reflectance, intensity, weight, coeffs));
+      queue.add_task(task);
     }
   }
+  queue.join_all();
 
   return;
 }
@@ -1642,10 +1775,14 @@ std::string model_coeffs_file_name(std::string const& prefix){
 void interp_image(ImageView<double> const& coarse_image, double scale,
 		  ImageView<double> & fine_image){
 
-  ImageViewRef<double> coarse_interp = interpolate(coarse_image,
-					 BicubicInterpolation(), ConstantEdgeExtension());
-  for (int col = 0; col < fine_image.cols(); col++) {
-    for (int row = 0; row < fine_image.rows(); row++) {
+  // Interpolate directly in the coarse image, not through an
+  // ImageViewRef, and traverse the fine image in memory order.
+  InterpolationView<EdgeExtensionView<ImageView<double>, ConstantEdgeExtension>,
+                    BicubicInterpolation>
+    coarse_interp = interpolate(coarse_image,
+				BicubicInterpolation(), ConstantEdgeExtension());
+  for (int row = 0; row < fine_image.rows(); row++) {
+    for (int col = 0; col < fine_image.cols(); col++) {
       fine_image(col, row) = coarse_interp(col*scale, row*scale);
     }
   }
@@ -1846,7 +1983,7 @@ public:
                                        (*g_blend_weights)[dem_iter][image_iter],
                                        (*g_cameras)[dem_iter][image_iter].get(),
                                        reflectance, intensity, blend_weight, 
-                                       g_coeffs);
+                                       g_coeffs, g_opt->num_threads);
 
         // dem_nodata equals to dem if the image has valid pixels and no shadows
         if (g_opt->save_dem_with_nodata) {
@@ -2489,6 +2626,8 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
      "Save a copy of the DEM while using a no-data value at a DEM grid point where all images show shadows. To be used if shadow thresholds are set.")
     ("use-approx-camera-models",   po::bool_switch(&opt.use_approx_camera_models)->default_value(false)->implicit_value(true),
      "Use approximate camera models for speed.")
+    ("isis-snapshot-tolerance", po::value(&opt.isis_snapshot_tolerance)->default_value(0.0),
+     "If positive, sample the position and pointing of ISIS linescan cameras once into in-memory tables and use those instead of ISIS, if they agree with ISIS to within this many pixels.")
     ("use-rpc-approximation",   po::bool_switch(&opt.use_rpc_approximation)->default_value(false)->implicit_value(true),
      "Use RPC approximations for the camera models instead of approximate tabulated camera models (invoke with --use-approx-camera-models).")
     ("rpc-penalty-weight", po::value(&opt.rpc_penalty_weight)->default_value(0.1),
@@ -2713,6 +2852,7 @@ void handle_arguments(int argc, char *argv[], Options& opt) {
   // Need this to be able to load adjusted camera models. That will happen
   // in the stereo session.
   asp::stereo_settings().bundle_adjust_prefix = opt.bundle_adjust_prefix;
+  asp::stereo_settings().isis_snapshot_tolerance = opt.isis_snapshot_tolerance;
 
   if (opt.input_images.size() <= 1 && opt.float_albedo && 
       opt.initial_dem_constraint_weight <= 0 && opt.albedo_constraint_weight <= 0.0)
@@ -3611,6 +3751,9 @@ int main(int argc, char* argv[]) {
     if (!opt.save_computed_intensity_only) {
       
       std::vector<double> local_exposures_vec(num_images, 0);
+
+      // The exact ISIS camera models can be used from one thread only
+      int num_threads = opt.use_approx_camera_models ? opt.num_threads : 1;
       for (int image_iter = 0; image_iter < num_images; image_iter++) {
 
 	std::vector<double> exposures_per_dem;
@@ -3631,7 +3774,7 @@ int main(int argc, char* argv[]) {
 					 blend_weights_vec[0][dem_iter][image_iter],
 					 cameras[dem_iter][image_iter].get(),
 					 reflectance, intensity, weight,
-					 &opt.model_coeffs_vec[0]);
+					 &opt.model_coeffs_vec[0], num_threads);
 
           // TODO: Below is not the optimal way of finding the exposure!
           // Find it as the analytical minimum using calculus.
@@ -3751,12 +3894,12 @@ int main(int argc, char* argv[]) {
                                                       (pixel_cast< PixelMask<double> >
                                                        (albedos[level-1][dem_iter]), sub_scale));
 
-        // We must write the subsampled images to disk, and then read
+        // The resampling is done once per level, rather than each time
+        // within the optimization loop. Cropped images are small, and
+        // their subsampled versions are kept in memory. Otherwise we
+        // must write the subsampled images to disk, and then read
         // them back, as VW cannot access individual pixels of the
-        // monstrosities created using the logic below, and even if it
-        // could, it is best if resampling is done once, and offline,
-        // rather than redoing it each time within the optimization
-        // loop.
+        // monstrosities created using the logic below.
         for (int image_iter = 0; image_iter < num_images; image_iter++) {
 
           if (opt.skip_images[dem_iter].find(image_iter)
@@ -3765,57 +3908,54 @@ int main(int argc, char* argv[]) {
           fs::path image_path(opt.input_images[image_iter]);
           std::ostringstream os; os << "-level" << level;
           if (num_dems > 1)      os << "-clip"  << dem_iter;
-          std::string sub_image = opt.out_prefix + "-"
-            + image_path.stem().string() + os.str() + ".tif";
-          vw_out() << "Writing subsampled image: " << sub_image << "\n";
-          bool has_img_georef = false;
-          GeoReference img_georef;
-          bool has_img_nodata = true;
           int tile_size = 256;
-          int sub_threads = 1;
-          TerminalProgressCallback tpc("asp", ": ");
-          vw::cartography::block_write_gdal_image
-            (sub_image,
-             apply_mask
-             (block_rasterize
+          if (opt.crop_input_images) {
+            // The coarser image is formed from the finer one which is
+            // in memory, so this can use multiple threads.
+            ImageView< PixelMask<float> > memory_img
+              = block_rasterize
               (vw::cache_tile_aware_render
                (vw::resample_aa
                 (masked_images_vec[level-1][dem_iter][image_iter], sub_scale),
                 Vector2i(tile_size, tile_size) * sub_scale),
-               Vector2i(tile_size, tile_size), sub_threads), img_nodata_val),
-             has_img_georef, img_georef, has_img_nodata, img_nodata_val, opt, tpc);
-          // Read it right back
-          if (opt.crop_input_images) {
-            // Read it fully in memory, as we cropped it before
-            ImageView<float> memory_img = copy(DiskImageView<float>(sub_image));
-            masked_images_vec[level][dem_iter][image_iter]
-              = create_mask(memory_img, img_nodata_val);
+               Vector2i(tile_size, tile_size), opt.num_threads);
+            masked_images_vec[level][dem_iter][image_iter] = memory_img;
           }else{
+            std::string sub_image = opt.out_prefix + "-"
+              + image_path.stem().string() + os.str() + ".tif";
+            vw_out() << "Writing subsampled image: " << sub_image << "\n";
+            bool has_img_georef = false;
+            GeoReference img_georef;
+            bool has_img_nodata = true;
+            int sub_threads = 1;
+            TerminalProgressCallback tpc("asp", ": ");
+            vw::cartography::block_write_gdal_image
+              (sub_image,
+               apply_mask
+               (block_rasterize
+                (vw::cache_tile_aware_render
+                 (vw::resample_aa
+                  (masked_images_vec[level-1][dem_iter][image_iter], sub_scale),
+                  Vector2i(tile_size, tile_size) * sub_scale),
+                 Vector2i(tile_size, tile_size), sub_threads), img_nodata_val),
+               has_img_georef, img_georef, has_img_nodata, img_nodata_val, opt, tpc);
             // Read just a handle, as the full image could be huge
             masked_images_vec[level][dem_iter][image_iter]
               = create_mask(DiskImageView<float>(sub_image), img_nodata_val);
           }
         
+          // The weights exist only for cropped images, keep them in memory
           if (blend_weights_vec[level-1][dem_iter][image_iter].cols() > 0 &&
               blend_weights_vec[level-1][dem_iter][image_iter].rows() > 0 ) {
-            fs::path weight_path(opt.input_images[image_iter]);
-            std::string sub_weight = opt.out_prefix + "-wt-"
-              + weight_path.stem().string() + os.str() + ".tif";
-            vw_out() << "Writing subsampled weight: " << sub_weight << "\n";
-          
-            vw::cartography::block_write_gdal_image
-              (sub_weight,
-               apply_mask
-               (block_rasterize
-                (vw::cache_tile_aware_render
-                 (vw::resample_aa
-                  (create_mask(blend_weights_vec[level-1][dem_iter][image_iter],
-                               dem_nodata_val), sub_scale),
-                  Vector2i(tile_size,tile_size) * sub_scale),
-                 Vector2i(tile_size, tile_size), sub_threads), dem_nodata_val),
-               has_img_georef, img_georef, has_img_nodata, dem_nodata_val, opt, tpc);
-
-            ImageView<double> memory_weight = copy(DiskImageView<double>(sub_weight));
+            ImageView<double> memory_weight
+              = apply_mask
+              (block_rasterize
+               (vw::cache_tile_aware_render
+                (vw::resample_aa
+                 (create_mask(blend_weights_vec[level-1][dem_iter][image_iter],
+                              dem_nodata_val), sub_scale),
+                 Vector2i(tile_size,tile_size) * sub_scale),
+                Vector2i(tile_size, tile_size), opt.num_threads), dem_nodata_val);
             blend_weights_vec[level][dem_iter][image_iter] = memory_weight;
           }
         
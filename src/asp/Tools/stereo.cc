@@ -388,6 +388,10 @@ namespace asp {
     std::string prog_name = extract_prog_name(argv[0]);
     if (prog_name.find("stereo_parse") == std::string::npos) 
       asp::log_to_file(argc, argv, opt.stereo_default_filename, opt.out_prefix);
+
+    // A journaled output is resumed only with the same options
+    asp::set_journal_command_line(argc, argv);
+    asp::add_journal_input(opt.stereo_default_filename);
     
     // There are two crop win boxes, in respect to original left
     // image, named left_image_crop_win, and in respect to the
@@ -405,6 +409,36 @@ namespace asp {
     stereo_settings().right_image_crop_win = BBox2i(br.min().x(), br.min().y(), br.max().x(), br.max().y());
     stereo_settings().trans_crop_win       = BBox2i(bt.min().x(), bt.min().y(), bt.max().x(), bt.max().y());
 
+    // Unless crop windows were given, derive them from the region to
+    // process in longitude-latitude, if any. This needs the session, so
+    // create it now.
+    bool session_created = false;
+    if (!stereo_settings().lon_lat_roi.empty() &&
+        stereo_settings().left_image_crop_win  == BBox2i(0, 0, 0, 0) &&
+        stereo_settings().right_image_crop_win == BBox2i(0, 0, 0, 0)) {
+
+      Vector2 height_range = stereo_settings().elevation_limit;
+      if (height_range[0] >= height_range[1]) {
+        vw_out(WarningMessage) << "No --elevation-limit was set. Projecting the region given "
+                               << "by --lon-lat-roi into the cameras at zero height.\n";
+        height_range = Vector2(0, 0);
+      }
+
+      opt.session.reset(asp::StereoSessionFactory::create(opt.stereo_session_string, opt,// i/o
+                                                          opt.in_file1,   opt.in_file2,
+                                                          opt.cam_file1,  opt.cam_file2,
+                                                          opt.out_prefix, opt.input_dem));
+      session_created = true;
+
+      BBox2i left_win, right_win;
+      opt.session->lon_lat_roi_crop_wins(stereo_settings().lon_lat_roi, height_range,
+                                         left_win, right_win);
+      stereo_settings().left_image_crop_win  = left_win;
+      stereo_settings().right_image_crop_win = right_win;
+      vw_out() << "\t--> Crop windows from the lon-lat region: " << left_win
+               << " and " << right_win << ".\n";
+    }
+
     // Ensure the crop windows are always contained in the images.
     boost::shared_ptr<vw::DiskImageResource> left_resource, right_resource;
     left_resource  = vw::DiskImageResourcePtr(opt.in_file1);
@@ -524,10 +558,11 @@ namespace asp {
     
     // The StereoSession call automatically determines the type of
     // object to create from the input parameters.
-    opt.session.reset(asp::StereoSessionFactory::create(opt.stereo_session_string, opt,// i/o
-                                                        opt.in_file1,   opt.in_file2,
-                                                        opt.cam_file1,  opt.cam_file2,
-                                                        opt.out_prefix, opt.input_dem));
+    if (!session_created)
+      opt.session.reset(asp::StereoSessionFactory::create(opt.stereo_session_string, opt,// i/o
+                                                          opt.in_file1,   opt.in_file2,
+                                                          opt.cam_file1,  opt.cam_file2,
+                                                          opt.out_prefix, opt.input_dem));
     // Run a set of checks to make sure the settings are compatible
     // - Since we already created the session, any errors are fatal.
     user_safety_checks(opt);
@@ -31,6 +31,10 @@
 #include <asp/Tools/stereo.h>
 #include <asp/Core/DemDisparity.h>
 #include <asp/Core/LocalHomography.h>
+#include <asp/Core/ConsistencyCheck.h>
+#include <asp/Core/BlockJournal.h>
+#include <asp/Core/MappedImage.h>
+#include <asp/Core/NormalizedImage.h>
 #include <asp/Sessions/StereoSession.h>
 #include <asp/Sessions/StereoSessionPinhole.h>
 #include <xercesc/util/PlatformUtils.hpp>
@@ -455,20 +459,16 @@ double compute_ip(ASPGlobalOptions & opt, std::string & match_filename) {
 
   vw_out() << "No IP file found, computing IP now.\n";
   
-  // Load the images
-  boost::shared_ptr<DiskImageResource> left_rsrc (DiskImageResourcePtr(left_image_path )),
-                                       right_rsrc(DiskImageResourcePtr(right_image_path));
-
   // Read the no-data values written to disk previously when
   // the normalized left and right sub-images were created.
   float left_nodata_value  = numeric_limits<float>::quiet_NaN();
   float right_nodata_value = numeric_limits<float>::quiet_NaN();
-  if (left_rsrc->has_nodata_read ()) left_nodata_value  = left_rsrc->nodata_read();
-  if (right_rsrc->has_nodata_read()) right_nodata_value = right_rsrc->nodata_read();
+  asp::read_normalized_nodata(left_image_path,  left_nodata_value );
+  asp::read_normalized_nodata(right_image_path, right_nodata_value);
   
   // These images should be small enough to fit in memory
-  ImageView<float> left_image  = DiskImageView<float>(left_rsrc);
-  ImageView<float> right_image = DiskImageView<float>(right_rsrc);
+  ImageView<float> left_image  = select_channel(asp::open_normalized_image(left_image_path ), 0);
+  ImageView<float> right_image = select_channel(asp::open_normalized_image(right_image_path), 0);
 
   // No interest point operations have been performed before
   vw_out() << "\t    * Locating Interest Points\n";
@@ -849,10 +849,10 @@ void lowres_correlation( ASPGlobalOptions & opt ) {
 /// This correlator takes a low resolution disparity image as an input
 /// so that it may narrow its search range for each tile that is processed.
 class SeededCorrelatorView : public ImageViewBase<SeededCorrelatorView> {
-  DiskImageView<PixelGray<float> >   m_left_image;
-  DiskImageView<PixelGray<float> >   m_right_image;
-  DiskImageView<vw::uint8> m_left_mask;
-  DiskImageView<vw::uint8> m_right_mask;
+  ImageViewRef<PixelGray<float> >    m_left_image;
+  ImageViewRef<PixelGray<float> >    m_right_image;
+  ImageViewRef<vw::uint8>  m_left_mask;
+  ImageViewRef<vw::uint8>  m_right_mask;
   ImageViewRef<PixelMask<Vector2f> > m_sub_disp;
   ImageViewRef<PixelMask<Vector2i> > m_sub_disp_spread;
   ImageView<Matrix3x3> const& m_local_hom;
@@ -868,8 +868,8 @@ class SeededCorrelatorView : public ImageViewBase<SeededCorrelatorView> {
 public:
 
   // Set these input types here instead of making them template arguments
-  typedef DiskImageView<PixelGray<float> >   ImageType;
-  typedef DiskImageView<vw::uint8>           MaskType;
+  typedef ImageViewRef<PixelGray<float> >    ImageType;
+  typedef ImageViewRef<vw::uint8>            MaskType;
   typedef ImageViewRef<PixelMask<Vector2f> > DispSeedImageType;
   typedef ImageViewRef<PixelMask<Vector2i> > SpreadImageType;
   typedef ImageType::pixel_type InputPixelType;
@@ -911,6 +911,53 @@ public:
     return pixel_type();
   }
 
+  /// Rasterize the forward correlation of a tile and remove the
+  /// pixels failing the single-pass uniqueness check against the
+  /// right image it was correlated with.
+  template <class RightT>
+  CropView<ImageView<pixel_type> >
+  single_pass_check(ImageView<pixel_type> const& tile, BBox2i const& bbox,
+                    RightT const& right_image) const {
+
+    ImageView<pixel_type> disp = tile;
+    BBox2f disp_range;
+    bool has_valid = false;
+    for (int row = 0; row < disp.rows(); row++) {
+      for (int col = 0; col < disp.cols(); col++) {
+        if (!is_valid(disp(col, row)))
+          continue;
+        if (!has_valid)
+          disp_range = BBox2f(disp(col, row).child(), disp(col, row).child());
+        else
+          disp_range.grow(disp(col, row).child());
+        has_valid = true;
+      }
+    }
+
+    if (has_valid) {
+      // The image pixels the check needs, with the patches around them
+      int half_kernel = std::max(m_kernel_size[0], m_kernel_size[1])/2;
+      BBox2i left_box = bbox;
+      left_box.expand(half_kernel);
+      BBox2i right_box = bbox;
+      right_box.min() += Vector2i(floor(disp_range.min().x()), floor(disp_range.min().y()));
+      right_box.max() += Vector2i(ceil (disp_range.max().x()), ceil (disp_range.max().y()));
+      right_box.expand(half_kernel + 1);
+
+      ImageView<float> left  = crop(edge_extend(select_channel(m_left_image, 0),
+                                                ZeroEdgeExtension()), left_box);
+      ImageView<float> right = crop(edge_extend(select_channel(right_image, 0),
+                                                ZeroEdgeExtension()), right_box);
+      int num_removed = single_pass_consistency_check(disp, bbox, left, left_box,
+                                                      right, right_box, m_kernel_size,
+                                                      stereo_settings().xcorr_threshold);
+      VW_OUT(DebugMessage, "stereo") << "Single-pass uniqueness check removed "
+                                     << num_removed << " pixels in " << bbox << "\n";
+    }
+
+    return prerasterize_type(disp, -bbox.min().x(), -bbox.min().y(), cols(), rows());
+  }
+
   /// Does the work
   typedef CropView<ImageView<pixel_type> > prerasterize_type;
   inline prerasterize_type prerasterize(BBox2i const& bbox) const {
@@ -1022,6 +1069,18 @@ public:
     SemiGlobalMatcher::SgmSubpixelMode sgm_subpixel_mode = get_sgm_subpixel_mode();
     Vector2i sgm_search_buffer = stereo_settings().sgm_search_buffer;
 
+    // With --xcorr-single-pass, the full-resolution level of block
+    // matching is run forward only, and the uniqueness check is done on
+    // the result afterwards. The coarser levels keep the regular L-R
+    // check, as their outlier rejection protects the search ranges of
+    // the finer ones.
+    int  min_xcorr_level = stereo_settings().min_xcorr_level;
+    bool single_pass = (stereo_settings().xcorr_single_pass &&
+                        stereo_settings().xcorr_threshold >= 0 &&
+                        stereo_settings().stereo_algorithm == vw::stereo::CORRELATION_WINDOW);
+    if (single_pass)
+      min_xcorr_level = std::max(min_xcorr_level, 1);
+
     // Now we are ready to actually perform correlation
     const int rm_half_kernel = 5; // Filter kernel size used by CorrelationView
     if (use_local_homography){
@@ -1035,7 +1094,7 @@ public:
                           m_kernel_size,  m_cost_mode,
                           m_corr_timeout, m_seconds_per_op,
                           stereo_settings().xcorr_threshold,
-                          stereo_settings().min_xcorr_level,
+                          min_xcorr_level,
                           rm_half_kernel,
                           stereo_settings().corr_max_levels,
                           static_cast<vw::stereo::CorrelationAlgorithm>(stereo_settings().stereo_algorithm), 
@@ -1043,6 +1102,8 @@ public:
                           sgm_subpixel_mode, sgm_search_buffer, stereo_settings().corr_memory_limit_mb,
                           stereo_settings().corr_blob_filter_area,
                           stereo_settings().stereo_debug );
+      if (single_pass)
+        return single_pass_check(crop(corr_view.prerasterize(bbox), bbox), bbox, right_trans_img);
       return corr_view.prerasterize(bbox);
     }else{
       typedef vw::stereo::PyramidCorrelationView<ImageType, ImageType, MaskType, MaskType > CorrView;
@@ -1054,7 +1115,7 @@ public:
                           m_kernel_size,  m_cost_mode,
                           m_corr_timeout, m_seconds_per_op,
                           stereo_settings().xcorr_threshold,
-                          stereo_settings().min_xcorr_level,
+                          min_xcorr_level,
                           rm_half_kernel,
                           stereo_settings().corr_max_levels,
                           static_cast<vw::stereo::CorrelationAlgorithm>(stereo_settings().stereo_algorithm), 
@@ -1062,6 +1123,8 @@ public:
                           sgm_subpixel_mode, sgm_search_buffer, stereo_settings().corr_memory_limit_mb,
                           stereo_settings().corr_blob_filter_area,
                           stereo_settings().stereo_debug );
+      if (single_pass)
+        return single_pass_check(crop(corr_view.prerasterize(bbox), bbox), bbox, m_right_image);
       return corr_view.prerasterize(bbox);
     }
     
@@ -1113,11 +1176,15 @@ void stereo_correlation( ASPGlobalOptions& opt ) {
   vw_out(DebugMessage) << "\t   Prefilter Size:  " << stereo_settings().slogW << endl;
   vw_out() << "\t--------------------------------------------------\n";
 
-  // Load up for the actual native resolution processing
-  DiskImageView<PixelGray<float> > left_disk_image (opt.out_prefix+"-L.tif"),
-                                   right_disk_image(opt.out_prefix+"-R.tif");
-  DiskImageView<vw::uint8> Lmask(opt.out_prefix + "-lMask.tif"),
-                           Rmask(opt.out_prefix + "-rMask.tif");
+  // Load up for the actual native resolution processing. These are
+  // memory-mapped if written uncompressed, and expanded to float if
+  // stored as 16-bit integers.
+  ImageViewRef<PixelGray<float> > left_disk_image
+    = asp::open_normalized_image(opt.out_prefix+"-L.tif");
+  ImageViewRef<PixelGray<float> > right_disk_image
+    = asp::open_normalized_image(opt.out_prefix+"-R.tif");
+  ImageViewRef<vw::uint8> Lmask = asp::open_intermediate<vw::uint8>(opt.out_prefix + "-lMask.tif");
+  ImageViewRef<vw::uint8> Rmask = asp::open_intermediate<vw::uint8>(opt.out_prefix + "-rMask.tif");
   ImageViewRef<PixelMask<Vector2f> > sub_disp;
   std::string dsub_file   = opt.out_prefix+"-D_sub.tif";
   std::string spread_file = opt.out_prefix+"-D_sub_spread.tif";
@@ -1195,6 +1262,12 @@ void stereo_correlation( ASPGlobalOptions& opt ) {
   double nodata          = -32768.0;
 
   string d_file = opt.out_prefix + "-D.tif";
+
+  // The disparity depends on these besides the options
+  const char* inputs[] = {"-L.tif", "-R.tif", "-lMask.tif", "-rMask.tif", "-D_sub.tif",
+                          "-D_sub_spread.tif", "-local_hom.txt"};
+  for (size_t it = 0; it < sizeof(inputs)/sizeof(inputs[0]); it++)
+    asp::add_journal_input(opt.out_prefix + inputs[it]);
   vw_out() << "Writing: " << d_file << "\n";
   if (stereo_settings().stereo_algorithm > vw::stereo::CORRELATION_WINDOW) {
     // SGM performs subpixel correlation in this step, so write out floats.
@@ -1211,10 +1284,11 @@ void stereo_correlation( ASPGlobalOptions& opt ) {
 			        
   } else {
     // Otherwise cast back to integer results to save on storage space.
-    vw::cartography::block_write_gdal_image(d_file, 
+    asp::block_write_gdal_image_resumable(d_file,
               pixel_cast<PixelMask<Vector2i> >(fullres_disparity),
 			        has_left_georef, left_georef,
 			        has_nodata, nodata, opt,
+			        stereo_settings().resumable_output,
 			        TerminalProgressCallback("asp", "\t--> Correlation :") );
   }
 
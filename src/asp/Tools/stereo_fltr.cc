@@ -25,12 +25,14 @@
 #include <vw/Cartography/GeoReferenceUtils.h>
 #include <vw/Image/BlobIndex.h>
 #include <vw/Image/ErodeView.h>
-#include <vw/Image/InpaintView.h>
 
 #include <asp/Core/ThreadedEdgeMask.h>
+#include <asp/Core/BlobLabeling.h>
 #include <asp/Sessions/StereoSession.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
+#include <boost/filesystem/operations.hpp>
+
 using namespace vw;
 using namespace asp;
 using namespace std;
@@ -137,69 +139,6 @@ texture_aware_disparity_filter( ImageViewBase<ImageT    > const& img,
 
 
 
-// Erode blobs from given image by iterating through tiles, biasing
-// each tile by a factor of blob size, removing blobs in the tile,
-// then shrinking the tile back. The bias is necessary to help avoid
-// fragmenting (and then unnecessarily removing) blobs.
-template <class ImageT>
-class PerTileErode: public ImageViewBase<PerTileErode<ImageT> >{
-  ImageT m_img;
-public:
-  PerTileErode( ImageViewBase<ImageT>   const& img):
-    m_img(img.impl()){}
-
-  // Image View interface
-  typedef typename ImageT::pixel_type pixel_type;
-  typedef pixel_type                  result_type;
-  typedef ProceduralPixelAccessor<PerTileErode> pixel_accessor;
-
-  inline int32 cols  () const { return m_img.cols(); }
-  inline int32 rows  () const { return m_img.rows(); }
-  inline int32 planes() const { return 1; }
-
-  inline pixel_accessor origin() const { return pixel_accessor( *this, 0, 0 ); }
-
-  inline pixel_type operator()( double /*i*/, double /*j*/, int32 /*p*/ = 0 ) const {
-    vw_throw(NoImplErr() << "PerTileErode::operator()(...) is not implemented");
-    return pixel_type();
-  }
-
-  typedef CropView<ImageView<pixel_type> > prerasterize_type;
-  inline prerasterize_type prerasterize(BBox2i const& bbox) const {
-
-    int area = stereo_settings().erode_max_size;
-
-    // We look a beyond the current tile, to avoid cutting blobs
-    // if possible. Skinny blobs will be cut though.
-    int bias = 2*int(ceil(sqrt(double(area))));
-
-    BBox2i bbox2 = bbox;
-    bbox2.expand(bias);
-    bbox2.crop(bounding_box(m_img));
-    ImageView<pixel_type> tile_img = crop(m_img, bbox2);
-
-    int tile_size = max(bbox2.width(), bbox2.height()); // don't subsplit
-    BlobIndexThreaded smallBlobIndex(tile_img, area, tile_size);
-    ImageView<pixel_type> clean_tile_img = applyErodeView(tile_img,
-                                                          smallBlobIndex);
-    return prerasterize_type(clean_tile_img,
-                             -bbox2.min().x(), -bbox2.min().y(),
-                             cols(), rows() );
-  }
-
-  template <class DestT>
-  inline void rasterize(DestT const& dest, BBox2i bbox) const {
-    vw::rasterize(prerasterize(bbox), dest, bbox);
-  }
-};
-
-template <class ImageT>
-PerTileErode<ImageT>
-per_tile_erode( ImageViewBase<ImageT> const& img) {
-  typedef PerTileErode<ImageT> return_type;
-  return return_type( img.impl() );
-}
-
 // Run several cleanup passes with desired cleanup mode.
 template <class ViewT>
 struct MultipleDisparityCleanUp {
@@ -233,8 +172,8 @@ struct MultipleDisparityCleanUp {
 };
 
 template <class ImageT>
-void write_good_pixel_and_filtered( ImageViewBase<ImageT> const& inputview,
-                                    ASPGlobalOptions const& opt ) {
+void write_good_pixel_map( ImageViewBase<ImageT> const& inputview,
+                           ASPGlobalOptions const& opt ) {
   // Write Good Pixel Map
   // Sub-sampling so that the user can actually view it.
   double sub_scale = double( min( inputview.impl().cols(),
@@ -272,75 +211,80 @@ void write_good_pixel_and_filtered( ImageViewBase<ImageT> const& inputview,
     ( goodPixelFile, goodPixelImage, has_left_georef, good_pixel_georef,
       has_nodata, nodata,
       opt, TerminalProgressCallback("asp", "\t--> Good pixel map: ") );
+}
 
+/// Remove a temporary file when going out of scope, also on failure
+struct TempFileRemover {
+  std::string m_file;
+  TempFileRemover(std::string const& file): m_file(file){}
+  ~TempFileRemover() {
+    boost::system::error_code ec; // don't throw from a destructor
+    boost::filesystem::remove(m_file, ec);
+  }
+};
+
+template <class ImageT>
+void write_good_pixel_and_filtered( ImageViewBase<ImageT> const& inputview,
+                                    ASPGlobalOptions const& opt ) {
+
+  cartography::GeoReference left_georef;
+  bool has_left_georef = read_georeference(left_georef,  opt.out_prefix + "-L.tif");
+  bool has_nodata = false;
+  double nodata = -32768.0;
+
+  bool fillHoles       = stereo_settings().enable_fill_holes;
   bool removeSmallBlobs = (stereo_settings().erode_max_size > 0);
 
   string outF = opt.out_prefix + "-F.tif";
 
-  // Fill holes
-  if(stereo_settings().enable_fill_holes) {
-    // Generate a list of blobs below a maximum size
-    // - This requires the entire input image to be read in
-    //    and produces a single blob list for the entire image.
-    vw_out() << "\t--> Filling holes with inpainting method.\n";
-    BlobIndexThreaded smallHoleIndex( invert_mask( inputview.impl() ),
-                                      stereo_settings().fill_hole_max_size,
-                                      vw::vw_settings().default_tile_size(),
-                                      vw::vw_settings().default_num_threads()
-                                      );
-    vw_out() << "\t    * Identified " << smallHoleIndex.num_blobs() << " holes\n";
-    bool use_grassfire = true;
-    typename ImageT::pixel_type default_inpaint_val;
-
-
-    if (!removeSmallBlobs) { // Skip small blob removal
-      // Write out the image to disk, filling in the blobs in the process
-      vw_out() << "Writing: " << outF << endl;
-      vw::cartography::block_write_gdal_image( outF,
-                                   inpaint(inputview.impl(), smallHoleIndex,
-                                           use_grassfire, default_inpaint_val),
-                                   has_left_georef, left_georef,
-                                   has_nodata, nodata, opt,
-                                   TerminalProgressCallback
-                                   ("asp","\t--> Filtering: ") );
-    }
-    else { // Add small blob removal step
-      // Write out the image to disk, filling in and removing blobs in the process
-      // - Blob removal is done second to make sure inner-blob holes are removed.
-      vw_out() << "Writing: " << outF << endl;
-      vw::cartography::block_write_gdal_image( outF,
-                                   per_tile_erode
-                                   (inpaint(inputview.impl(),
-                                            smallHoleIndex,
-                                            use_grassfire,
-                                            default_inpaint_val) ),
-                                   has_left_georef, left_georef,
-                                   has_nodata, nodata, opt,
-                                   TerminalProgressCallback
-                                   ("asp","\t--> Filtering: ") );
-    }
-
-  } else { // No hole filling
-    if (!removeSmallBlobs) { // Skip small blob removal
-      vw_out() << "Writing: " << outF << endl;
-      vw::cartography::block_write_gdal_image( outF, inputview.impl(),
-                                   has_left_georef, left_georef,
-                                   has_nodata, nodata, opt,
-                                   TerminalProgressCallback
-                                   ("asp", "\t--> Filtering: ") );
-    }
-    else { // Add small blob removal step
-      vw_out() << "\t--> Removing small blobs.\n";
-      // Write out the image to disk, removing the blobs in the process
-      vw_out() << "Writing: " << outF << endl;
-      vw::cartography::block_write_gdal_image(outF, per_tile_erode(inputview.impl()),
-                                  has_left_georef, left_georef,
-                                  has_nodata, nodata, opt,
-                                  TerminalProgressCallback
-                                  ("asp","\t--> Filtering: ") );
-    }
+  if (!fillHoles && !removeSmallBlobs) {
+    write_good_pixel_map(inputview, opt);
+    vw_out() << "Writing: " << outF << endl;
+    vw::cartography::block_write_gdal_image( outF, inputview.impl(),
+                                 has_left_georef, left_georef,
+                                 has_nodata, nodata, opt,
+                                 TerminalProgressCallback
+                                 ("asp", "\t--> Filtering: ") );
+    return;
+  }
 
-  } // End no hole filling case
+  // This takes two passes. The first evaluates the filter chain once,
+  // writing it to a temporary file while labeling the holes and blobs
+  // of each tile as it goes by. The labels are merged across tile
+  // seams at the end of it, as a hole or blob may span the whole
+  // image, so both hole filling and blob removal are exact and do not
+  // depend on the tiling. The second pass reads the temporary file
+  // back to write the final image.
+  // - Blob removal is done second to make sure inner-blob holes are removed.
+  typedef typename ImageT::pixel_type PixelT;
+  string unfilteredF = opt.out_prefix + "-F-unfiltered.tif";
+  TempFileRemover unfiltered_remover(unfilteredF);
+  TiledBlobIndex blob_index;
+  vw_out() << "Writing: " << unfilteredF << endl;
+  vw::cartography::block_write_gdal_image( unfilteredF,
+                               label_blobs(inputview.impl(), blob_index),
+                               has_left_georef, left_georef,
+                               has_nodata, nodata, opt,
+                               TerminalProgressCallback
+                               ("asp", "\t--> Filtering: ") );
+
+  blob_index.finalize(fillHoles ? stereo_settings().fill_hole_max_size : 0,
+                      stereo_settings().erode_max_size);
+  if (fillHoles)
+    vw_out() << "\t    * Filling " << blob_index.num_holes_filled() << " holes\n";
+  if (removeSmallBlobs)
+    vw_out() << "\t    * Removing " << blob_index.num_blobs_removed() << " small blobs\n";
+
+  DiskImageView<PixelT> unfiltered_image(unfilteredF);
+  write_good_pixel_map(unfiltered_image, opt);
+
+  vw_out() << "Writing: " << outF << endl;
+  vw::cartography::block_write_gdal_image( outF,
+                               fill_holes_and_remove_blobs(unfiltered_image, blob_index),
+                               has_left_georef, left_georef,
+                               has_nodata, nodata, opt,
+                               TerminalProgressCallback
+                               ("asp", "\t--> Hole filling and blob removal: ") );
 } //end write_good_pixel_and_filtered
 
 void stereo_filtering( ASPGlobalOptions& opt ) {
@@ -368,7 +312,8 @@ void stereo_filtering( ASPGlobalOptions& opt ) {
       mask_buffer = max( stereo_settings().subpixel_kernel );
 
 
-    DiskImageView<PixelGray<float> > left_disk_image (opt.out_prefix+"-L.tif");
+    ImageViewRef<PixelGray<float> > left_disk_image
+      = asp::open_normalized_image(opt.out_prefix+"-L.tif");
 
     vw_out() << "\t--> Cleaning up disparity map prior to filtering processes ("
              << stereo_settings().rm_cleanup_passes << " pass).\n";
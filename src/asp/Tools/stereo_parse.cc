@@ -168,6 +168,82 @@ int main( int argc, char* argv[] ) {
       } // End has_left_georef
     } // End georef attach ?
 
+    // Estimate how much work each tile of parallel_stereo will be,
+    // from the low-resolution mask and disparity, so that tiles with
+    // no valid pixels or disparities can be skipped and expensive ones split.
+    Vector2i job_size = stereo_settings().tile_costs_job_size;
+    std::string left_mask_sub_file = opt.out_prefix + "-lMask_sub.tif";
+    if (job_size.x() > 0 && job_size.y() > 0 &&
+        fs::exists(left_image_file) && fs::exists(left_mask_sub_file)) {
+
+      Vector2i image_size = file_image_size(left_image_file);
+      ImageView<uint8> mask_sub;
+      read_image(mask_sub, left_mask_sub_file);
+      Vector2 mask_scale(double(mask_sub.cols())/image_size.x(),
+                         double(mask_sub.rows())/image_size.y());
+
+      // D_sub is not there with seed mode 0
+      std::string d_sub_file = opt.out_prefix + "-D_sub.tif";
+      bool has_d_sub = fs::exists(d_sub_file);
+      ImageView<PixelMask<Vector2f> > d_sub;
+      Vector2 disp_scale(1, 1);
+      if (has_d_sub) {
+        read_image(d_sub, d_sub_file);
+        disp_scale = Vector2(double(d_sub.cols())/image_size.x(),
+                             double(d_sub.rows())/image_size.y());
+      }
+
+      // Must be the same grid as in parallel_stereo. Each low-res box
+      // is grown by a pixel, to not lose valid pixels to the subsampling.
+      int tiles_nx = (image_size.x() + job_size.x() - 1)/job_size.x();
+      int tiles_ny = (image_size.y() + job_size.y() - 1)/job_size.y();
+      int count = 0;
+      for (int j = 0; j < tiles_ny; j++) {
+        for (int i = 0; i < tiles_nx; i++) {
+          BBox2i tile(i*job_size.x(), j*job_size.y(), job_size.x(), job_size.y());
+          tile.crop(BBox2i(0, 0, image_size.x(), image_size.y()));
+
+          BBox2i mask_box(floor(elem_prod(Vector2(tile.min()), mask_scale)),
+                          ceil (elem_prod(Vector2(tile.max()), mask_scale)));
+          mask_box.expand(1);
+          mask_box.crop(bounding_box(mask_sub));
+          int num_valid = 0;
+          for (int row = mask_box.min().y(); row < mask_box.max().y(); row++)
+            for (int col = mask_box.min().x(); col < mask_box.max().x(); col++)
+              if (mask_sub(col, row) > 0)
+                num_valid++;
+
+          // The area of the full-resolution search range, or -1 if unknown
+          double search_area = -1;
+          if (has_d_sub) {
+            BBox2i disp_box(floor(elem_prod(Vector2(tile.min()), disp_scale)),
+                            ceil (elem_prod(Vector2(tile.max()), disp_scale)));
+            disp_box.expand(1);
+            disp_box.crop(bounding_box(d_sub));
+            BBox2f range;
+            bool has_valid = false;
+            for (int row = disp_box.min().y(); row < disp_box.max().y(); row++) {
+              for (int col = disp_box.min().x(); col < disp_box.max().x(); col++) {
+                if (is_valid(d_sub(col, row))) {
+                  range.grow(d_sub(col, row).child());
+                  has_valid = true;
+                }
+              }
+            }
+            search_area = 0;
+            if (has_valid)
+              search_area = (range.width()/disp_scale.x() + 1.0) *
+                            (range.height()/disp_scale.y() + 1.0);
+          }
+
+          vw_out() << "tile_cost_" << count << "," << tile.min().x() << ","
+                   << tile.min().y() << "," << tile.width() << "," << tile.height()
+                   << "," << num_valid << "," << search_area << endl;
+          count++;
+        }
+      }
+    }
+
     xercesc::XMLPlatformUtils::Terminate();
   } ASP_STANDARD_CATCHES;
 
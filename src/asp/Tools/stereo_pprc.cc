@@ -142,13 +142,10 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
                                         left_image_file, right_image_file);
 
 
-  boost::shared_ptr<DiskImageResource>
-    left_rsrc (vw::DiskImageResourcePtr(left_image_file)),
-    right_rsrc(vw::DiskImageResourcePtr(right_image_file));
-
-  // Load the normalized images.
-  DiskImageView<PixelGray<float> > left_image (left_rsrc ),
-                                   right_image(right_rsrc);
+  // Load the normalized images, expanding them to float if stored
+  // as 16-bit integers.
+  ImageViewRef<PixelGray<float> > left_image  = asp::open_normalized_image(left_image_file ),
+                                  right_image = asp::open_normalized_image(right_image_file);
 
   // If we crop the images, we must always rebuild the masks
   // and subsample the images and masks.
@@ -209,10 +206,8 @@ void stereo_preprocessing(bool adjust_left_image_size, ASPGlobalOptions& opt) {
     // Read the no-data values of L.tif and R.tif.
     float left_nodata_value  = numeric_limits<float>::quiet_NaN();
     float right_nodata_value = numeric_limits<float>::quiet_NaN();
-    if ( left_rsrc->has_nodata_read() )
-      left_nodata_value  = left_rsrc->nodata_read();
-    if ( right_rsrc->has_nodata_read() )
-      right_nodata_value = right_rsrc->nodata_read();
+    asp::read_normalized_nodata(left_image_file,  left_nodata_value );
+    asp::read_normalized_nodata(right_image_file, right_nodata_value);
 
     // We need to treat the following special case: if the user
     // skipped image normalization, so we are still using the original
@@ -26,6 +26,11 @@
 #include <vw/Stereo/EMSubpixelCorrelatorView.h>
 #include <vw/Stereo/DisparityMap.h>
 #include <asp/Core/LocalHomography.h>
+#include <asp/Core/ConsistencyCheck.h>
+#include <asp/Core/BlockJournal.h>
+#include <asp/Core/MappedImage.h>
+#include <asp/Core/NormalizedImage.h>
+#include <asp/Core/TilePrefetcher.h>
 #include <asp/Sessions/StereoSession.h>
 #include <xercesc/util/PlatformUtils.hpp>
 
@@ -167,6 +172,151 @@ refine_disparity(Image1T const& left_image,
   return refined_disp;
 }
 
+// How well the parabola fit can be trusted at each valid pixel of a
+// box of integer disparity, in [0, 1]. This is the correlation at the
+// integer disparity, which is low where the images disagree, and is
+// zero where the left window is flat or the correlation is not
+// peaked along both axes there, which is where the fit goes wrong.
+template <class Image1T, class Image2T>
+ImageView<float>
+parabola_confidence(Image1T const& left_image, Image2T const& right_image,
+                    ImageView<PixelMask<Vector2f> > const& integer_disp,
+                    BBox2i const& box){
+
+  // A small window is enough to tell a good fit from a bad one
+  const int half_win = 3;
+  Vector2i half_kernel(half_win, half_win);
+
+  ImageView<float> confidence(integer_disp.cols(), integer_disp.rows());
+  fill(confidence, 0.0);
+
+  BBox2i disp_range;
+  bool has_valid = false;
+  for (int row = 0; row < integer_disp.rows(); row++) {
+    for (int col = 0; col < integer_disp.cols(); col++) {
+      if (!is_valid(integer_disp(col, row)))
+        continue;
+      Vector2i d(round(integer_disp(col, row).child()[0]),
+                 round(integer_disp(col, row).child()[1]));
+      if (!has_valid)
+        disp_range = BBox2i(d, d);
+      else
+        disp_range.grow(d);
+      has_valid = true;
+    }
+  }
+  if (!has_valid)
+    return confidence;
+
+  BBox2i left_box = box;
+  left_box.expand(half_win);
+  BBox2i right_box(box.min() + disp_range.min(), box.max() + disp_range.max());
+  right_box.expand(half_win + 1);
+  ImageView<float> left  = crop(edge_extend(select_channel(left_image,  0),
+                                            ZeroEdgeExtension()), left_box);
+  ImageView<float> right = crop(edge_extend(select_channel(right_image, 0),
+                                            ZeroEdgeExtension()), right_box);
+
+  for (int row = 0; row < integer_disp.rows(); row++) {
+    for (int col = 0; col < integer_disp.cols(); col++) {
+      if (!is_valid(integer_disp(col, row)))
+        continue;
+      Vector2i d(round(integer_disp(col, row).child()[0]),
+                 round(integer_disp(col, row).child()[1]));
+      Vector2i lpix = box.min() + Vector2i(col, row);
+      Vector2i l = lpix - left_box.min(), r = lpix + d - right_box.min();
+      double peak = window_ncc(left, l, right, r, half_kernel);
+      if (peak <= 0)
+        continue;
+      double left_x  = window_ncc(left, l, right, r - Vector2i(1, 0), half_kernel);
+      double right_x = window_ncc(left, l, right, r + Vector2i(1, 0), half_kernel);
+      double up_y    = window_ncc(left, l, right, r - Vector2i(0, 1), half_kernel);
+      double down_y  = window_ncc(left, l, right, r + Vector2i(0, 1), half_kernel);
+      if (peak < std::max(left_x, right_x) || peak < std::max(up_y, down_y) ||
+          2*peak - left_x - right_x <= 0 || 2*peak - up_y - down_y <= 0)
+        continue;
+      confidence(col, row) = peak;
+    }
+  }
+
+  return confidence;
+}
+
+// Refine the disparity in a tile. With --subpixel-confidence-threshold
+// and subpixel modes 2 and 3, the parabola fit is done first, and only
+// the pixels where it cannot be trusted are passed to the much slower
+// affine or Bayes EM kernels, which skip the pixels with invalid seeds.
+template <class Image1T, class Image2T>
+ImageView<PixelMask<Vector2f> >
+refine_tile(Image1T const& left_image,
+            Image2T const& right_image,
+            ImageViewRef< PixelMask<Vector2f> > const& integer_disp,
+            BBox2i const& bbox, ASPGlobalOptions const& opt){
+
+  int    mode      = stereo_settings().subpixel_mode;
+  double threshold = stereo_settings().subpixel_confidence_threshold;
+  if (threshold <= 0 || (mode != 2 && mode != 3))
+    return crop(refine_disparity(left_image, right_image, integer_disp, opt, false), bbox);
+
+  PrefilterModeType prefilter_mode = 
+    static_cast<vw::stereo::PrefilterModeType>(stereo_settings().pre_filter_mode);
+  ImageView<PixelMask<Vector2f> > refined_disp
+    = crop(parabola_subpixel(integer_disp, left_image, right_image,
+                             prefilter_mode, stereo_settings().slogW,
+                             stereo_settings().subpixel_kernel), bbox);
+
+  // The seeds the slow kernels read for this tile, keeping only those
+  // where the parabola fit is not trusted.
+  Vector2i kernel = stereo_settings().subpixel_kernel;
+  BBox2i box = bbox;
+  box.expand(std::max(kernel[0], kernel[1]));
+  box.crop(bounding_box(integer_disp));
+  ImageView<PixelMask<Vector2f> > seed = crop(integer_disp, box);
+  ImageView<float> confidence = parabola_confidence(left_image, right_image, seed, box);
+  int num_low = 0;
+  for (int row = 0; row < seed.rows(); row++) {
+    for (int col = 0; col < seed.cols(); col++) {
+      if (!is_valid(seed(col, row)))
+        continue;
+      if (confidence(col, row) >= threshold)
+        seed(col, row).invalidate();
+      else if (bbox.contains(box.min() + Vector2i(col, row)))
+        num_low++;
+    }
+  }
+  VW_OUT(DebugMessage, "stereo") << "Tile " << bbox << ": refining " << num_low
+                                 << " low-confidence pixels with subpixel mode "
+                                 << mode << ".\n";
+  if (num_low == 0)
+    return refined_disp;
+
+  ImageViewRef<PixelMask<Vector2f> > low_conf_disp
+    = crop(edge_extend(seed, ZeroEdgeExtension()), -box.min().x(), -box.min().y(),
+           integer_disp.cols(), integer_disp.rows());
+  ImageView<PixelMask<Vector2f> > slow_disp;
+  if (mode == 2)
+    slow_disp = crop(bayes_em_subpixel(low_conf_disp, left_image, right_image,
+                                       prefilter_mode, stereo_settings().slogW,
+                                       stereo_settings().subpixel_kernel,
+                                       stereo_settings().subpixel_max_levels), bbox);
+  else
+    slow_disp = crop(affine_subpixel(low_conf_disp, left_image, right_image,
+                                     prefilter_mode, stereo_settings().slogW,
+                                     stereo_settings().subpixel_kernel,
+                                     stereo_settings().subpixel_max_levels), bbox);
+
+  Vector2i offset = bbox.min() - box.min();
+  for (int row = 0; row < refined_disp.rows(); row++) {
+    for (int col = 0; col < refined_disp.cols(); col++) {
+      Vector2i pix = offset + Vector2i(col, row);
+      if (is_valid(seed(pix.x(), pix.y())))
+        refined_disp(col, row) = slow_disp(col, row);
+    }
+  }
+
+  return refined_disp;
+}
+
 // Perform refinement in each tile. If using local homography,
 // apply the local homography transform for the given tile
 // to the right image before doing refinement in that tile.
@@ -180,6 +330,7 @@ class PerTileRfne: public ImageViewBase<PerTileRfne<Image1T, Image2T, SeedDispT>
   ImageView<Matrix3x3> m_local_hom;
   ASPGlobalOptions const&       m_opt;
   Vector2              m_upscale_factor;
+  bool                 m_crop_inputs;
 
 public:
   PerTileRfne( ImageViewBase<Image1T>   const& left_image,
@@ -188,11 +339,11 @@ public:
                ImageViewBase<SeedDispT> const& integer_disp,
                ImageViewBase<SeedDispT> const& sub_disp,
                ImageView    <Matrix3x3> const& local_hom,
-               ASPGlobalOptions const& opt):
+               ASPGlobalOptions const& opt, bool crop_inputs):
     m_left_image(left_image.impl()), m_right_image(right_image.impl()),
     m_right_mask(right_mask),
     m_integer_disp( integer_disp.impl() ), m_sub_disp( sub_disp.impl() ),
-    m_local_hom(local_hom), m_opt(opt){
+    m_local_hom(local_hom), m_opt(opt), m_crop_inputs(crop_inputs){
 
     m_upscale_factor = Vector2(double(m_left_image.impl().cols()) / m_sub_disp.cols(),
                                double(m_left_image.impl().rows()) / m_sub_disp.rows());
@@ -217,8 +368,18 @@ public:
   typedef CropView<ImageView<pixel_type> > prerasterize_type;
   inline prerasterize_type prerasterize(BBox2i const& bbox) const {
 
+    // When the inputs are read ahead, read just what the tile needs,
+    // all at once, so it comes from the pixels read ahead.
+    BBox2i left_box = bbox;
+    left_box.expand(subpixel_refinement_halo());
+    ImageViewRef<PixelMask<Vector2f> > integer_disp = m_integer_disp;
+    ImageViewRef<typename Image1T::pixel_type> left_image = m_left_image;
+    if (m_crop_inputs) {
+      integer_disp = crop_to_footprint(m_integer_disp, left_box);
+      left_image   = crop_to_footprint(m_left_image,   left_box);
+    }
+
     ImageView<pixel_type> tile_disparity;
-    bool verbose = false;
     if (stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography){
 
       int ts = ASPGlobalOptions::corr_tile_size();
@@ -237,8 +398,8 @@ public:
       ImageViewRef<right_pix_type> right_trans_img = apply_mask(right_trans_masked_img);
 
 
-      tile_disparity = crop(refine_disparity(m_left_image, right_trans_img,
-                                             m_integer_disp, m_opt, verbose), bbox);
+      tile_disparity = refine_tile(left_image, right_trans_img,
+                                   integer_disp, bbox, m_opt);
 
       // Must undo the local homography transform
       bool do_round = false; // don't round floating point disparities
@@ -246,8 +407,20 @@ public:
                                              tile_disparity);
 
     }else{
-      tile_disparity = crop(refine_disparity(m_left_image, m_right_image,
-                                             m_integer_disp, m_opt, verbose), bbox);
+      // The right image is read where the disparities of the tile point
+      ImageViewRef<typename Image2T::pixel_type> right_image = m_right_image;
+      if (m_crop_inputs) {
+        BBox2i right_box = left_box;
+        BBox2i disp_range
+          = stereo::get_disparity_range(crop(integer_disp, left_box));
+        if (!disp_range.empty()) {
+          right_box.min() += disp_range.min();
+          right_box.max() += disp_range.max() + Vector2i(1, 1);
+        }
+        right_image = crop_to_footprint(m_right_image, right_box);
+      }
+      tile_disparity = refine_tile(left_image, right_image,
+                                   integer_disp, bbox, m_opt);
     }
     
     prerasterize_type disparity = prerasterize_type(tile_disparity,
@@ -270,10 +443,36 @@ per_tile_rfne( ImageViewBase<Image1T  > const& left,
                ImageViewBase<SeedDispT> const& integer_disp,
                ImageViewBase<SeedDispT> const& sub_disp,
                ImageView<Matrix3x3    > const& local_hom,
-               ASPGlobalOptions const& opt) {
+               ASPGlobalOptions const& opt, bool crop_inputs) {
   typedef PerTileRfne<Image1T, Image2T, SeedDispT> return_type;
   return return_type( left.impl(), right.impl(), right_mask,
-                      integer_disp.impl(), sub_disp.impl(), local_hom, opt );
+                      integer_disp.impl(), sub_disp.impl(), local_hom, opt, crop_inputs );
+}
+
+// The range of the disparity, to find what part of the right image a
+// tile needs. Take it from D_sub, padded, as it is at low resolution,
+// or else from the search range.
+bool refinement_disp_range(ASPGlobalOptions const& opt, Vector2i const& image_size,
+                           BBox2i & range){
+  std::string d_sub_file = opt.out_prefix + "-D_sub.tif";
+  if (stereo_settings().seed_mode > 0 && fs::exists(d_sub_file)) {
+    ImageView<PixelMask<Vector2f> > sub_disp;
+    read_image(sub_disp, d_sub_file);
+    if (sub_disp.cols() == 0 || sub_disp.rows() == 0)
+      return false;
+    Vector2 scale(double(image_size[0])/sub_disp.cols(), double(image_size[1])/sub_disp.rows());
+    BBox2i sub_range = stereo::get_disparity_range(sub_disp);
+    if (sub_range.empty())
+      return false;
+    range.min() = floor(elem_prod(Vector2(sub_range.min()), scale) - scale);
+    range.max() = ceil (elem_prod(Vector2(sub_range.max()), scale) + scale);
+    return true;
+  }
+  if (stereo_settings().is_search_defined()) {
+    range = stereo_settings().search_range;
+    return true;
+  }
+  return false;
 }
 
 void stereo_refinement( ASPGlobalOptions const& opt ) {
@@ -289,10 +488,12 @@ void stereo_refinement( ASPGlobalOptions const& opt ) {
   string right_mask_file  = opt.out_prefix+"-rMask.tif";
 
   try {
-    left_image   = DiskImageView< PixelGray<float> >(left_image_file );
-    right_image  = DiskImageView< PixelGray<float> >(right_image_file);
-    left_mask    = DiskImageView<uint8>(left_mask_file );
-    right_mask   = DiskImageView<uint8>(right_mask_file);
+    // These are memory-mapped if written uncompressed, and expanded
+    // to float if stored as 16-bit integers.
+    left_image   = asp::open_normalized_image(left_image_file );
+    right_image  = asp::open_normalized_image(right_image_file);
+    left_mask    = asp::open_intermediate<uint8>(left_mask_file );
+    right_mask   = asp::open_intermediate<uint8>(right_mask_file);
 
     // Read the correct type of correlation file (float for SGM/MGM, otherwise integer)
     std::string disp_file = opt.out_prefix + "-D.tif";
@@ -300,9 +501,9 @@ void stereo_refinement( ASPGlobalOptions const& opt ) {
     ChannelTypeEnum disp_data_type = rsrc->channel_type();
     if (disp_data_type == VW_CHANNEL_INT32)
       integer_disp = pixel_cast<PixelMask<Vector2f> >(
-                      DiskImageView< PixelMask<Vector2i> >(disp_file));
+                      asp::open_intermediate< PixelMask<Vector2i> >(disp_file));
     else // File on disk is float
-      integer_disp = DiskImageView< PixelMask<Vector2f> >(disp_file);
+      integer_disp = asp::open_intermediate< PixelMask<Vector2f> >(disp_file);
     
     if ( stereo_settings().seed_mode > 0 &&
          stereo_settings().use_local_homography ){
@@ -317,6 +518,25 @@ void stereo_refinement( ASPGlobalOptions const& opt ) {
                             << e.what() << "\nExiting.\n\n" );
   }
 
+  // Read the inputs of the next tiles while the current ones are
+  // refined. The right image is transformed per tile with local
+  // homographies, so it is then read as needed. EM refinement works on
+  // the whole image at once, so there is nothing to read ahead.
+  boost::shared_ptr<asp::TilePrefetcher> prefetcher;
+  if (stereo_settings().prefetch_mb > 0 && stereo_settings().subpixel_mode != 5) {
+    BBox2i crop_win = stereo_settings().trans_crop_win;
+    prefetcher.reset(new asp::TilePrefetcher(asp::write_schedule(crop_win, opt.raster_tile_size),
+                                             boost::uint64_t(stereo_settings().prefetch_mb)
+                                             *1024*1024));
+    Vector2i halo(subpixel_refinement_halo(), subpixel_refinement_halo());
+    left_image   = asp::prefetch_input(left_image,   halo, BBox2i(0, 0, 0, 0), *prefetcher);
+    integer_disp = asp::prefetch_input(integer_disp, halo, BBox2i(0, 0, 0, 0), *prefetcher);
+    BBox2i disp_range;
+    if (!(stereo_settings().seed_mode > 0 && stereo_settings().use_local_homography) &&
+        refinement_disp_range(opt, Vector2i(left_image.cols(), left_image.rows()), disp_range))
+      right_image = asp::prefetch_input(right_image, halo, disp_range, *prefetcher);
+  }
+
   bool skip_img_norm = asp::skip_image_normalization(opt);
   if (skip_img_norm && stereo_settings().subpixel_mode == 2){
     // Images were not normalized in pre-processing. Must do so now
@@ -347,11 +567,17 @@ void stereo_refinement( ASPGlobalOptions const& opt ) {
   ImageView<PixelGray<float>    > left_dummy(1, 1), right_dummy(1, 1);
   ImageView<PixelMask<Vector2f> > dummy_disp(1, 1);
   refine_disparity(left_dummy, right_dummy, dummy_disp, opt, verbose);
+  if (stereo_settings().subpixel_confidence_threshold > 0 &&
+      (stereo_settings().subpixel_mode == 2 || stereo_settings().subpixel_mode == 3))
+    vw_out() << "\t--> Using it only where the parabola fit confidence is below "
+             << stereo_settings().subpixel_confidence_threshold << ".\n";
 
   ImageViewRef< PixelMask<Vector2f> > refined_disp
-    = crop(per_tile_rfne(left_image, right_image, right_mask,
-                    integer_disp, sub_disp, local_hom, opt), 
-           stereo_settings().trans_crop_win);
+    = per_tile_rfne(left_image, right_image, right_mask,
+                    integer_disp, sub_disp, local_hom, opt, prefetcher.get() != NULL);
+  if (prefetcher)
+    refined_disp = asp::prefetch_tiles(refined_disp, *prefetcher);
+  refined_disp = crop(refined_disp, stereo_settings().trans_crop_win);
   
   cartography::GeoReference left_georef;
   bool   has_left_georef = read_georeference(left_georef,  opt.out_prefix + "-L.tif");
@@ -359,10 +585,17 @@ void stereo_refinement( ASPGlobalOptions const& opt ) {
   double nodata          = -32768.0;
 
   string rd_file = opt.out_prefix + "-RD.tif";
+
+  // The refined disparity depends on these besides the options
+  const char* inputs[] = {"-L.tif", "-R.tif", "-lMask.tif", "-rMask.tif", "-D.tif",
+                          "-D_sub.tif", "-local_hom.txt", "-lStats.tif", "-rStats.tif"};
+  for (size_t it = 0; it < sizeof(inputs)/sizeof(inputs[0]); it++)
+    asp::add_journal_input(opt.out_prefix + inputs[it]);
   vw_out() << "Writing: " << rd_file << "\n";
-  vw::cartography::block_write_gdal_image(rd_file, refined_disp,
+  asp::block_write_gdal_image_resumable(rd_file, refined_disp,
                               has_left_georef, left_georef,
                               has_nodata, nodata, opt,
+                              stereo_settings().resumable_output,
                               TerminalProgressCallback("asp", "\t--> Refinement :") );
 }
 
@@ -29,6 +29,7 @@
 #include <asp/Tools/stereo.h>
 #include <asp/Tools/jitter_adjust.h>
 #include <asp/Tools/ccd_adjust.h>
+#include <asp/Core/TilePrefetcher.h>
 
 // We must have the implementations of all sessions for triangulation
 #include <asp/Sessions/StereoSessionFactory.h>
@@ -40,6 +41,7 @@
 #include <asp/Sessions/StereoSessionSpot.h>
 #include <asp/Sessions/StereoSessionASTER.h>
 #include <xercesc/util/PlatformUtils.hpp>
+#include <algorithm>
 #include <ctime>
 
 using namespace vw;
@@ -196,6 +198,46 @@ stereo_error_triangulate( vector<DisparityT> const& disparities,
   return result_type( disparities, transforms, model, is_map_projected );
 }
 
+/// Apply a transform of L.tif or R.tif to the pixels of the
+/// corresponding subsampled image, L_sub.tif or R_sub.tif. This lets
+/// the low-resolution disparity be triangulated as is.
+template <class TXT>
+class SubsampledTX {
+  TXT     m_tx;
+  Vector2 m_scale; // subsampled image size over full image size
+public:
+  SubsampledTX(TXT const& tx, Vector2 const& scale): m_tx(tx), m_scale(scale) {}
+
+  Vector2 reverse(Vector2 const& p) const {
+    return m_tx.reverse(elem_quot(p, m_scale));
+  }
+
+  /// The box spanned by the reverse of points sampled at the corners
+  /// and along the edges of the given box. This stays cheap for the
+  /// small boxes of the subsampled image.
+  BBox2i reverse_bbox(BBox2i const& bbox) const {
+    const int NUM_EDGE_SAMPLES = 16;
+    if (bbox.empty())
+      return BBox2i();
+    Vector2 last = Vector2(bbox.max() - Vector2i(1, 1)); // the last pixel in the box
+    BBox2 out;
+    for (int s = 0; s <= NUM_EDGE_SAMPLES; s++) {
+      double t = double(s)/NUM_EDGE_SAMPLES;
+      Vector2 pt = Vector2(bbox.min()) + t*(last - Vector2(bbox.min()));
+      Vector2 samples[4] = {Vector2(pt.x(), bbox.min().y()), Vector2(pt.x(), last.y()),
+                            Vector2(bbox.min().x(), pt.y()), Vector2(last.x(), pt.y())};
+      for (int k = 0; k < 4; k++) {
+        try {
+          out.grow(reverse(samples[k]));
+        } catch (...) {} // points which do not map back are left out
+      }
+    }
+    if (out.empty())
+      return BBox2i();
+    return grow_bbox_to_int(out);
+  }
+};
+
 // Take a given disparity and make it between the original unaligned images
 template <class DisparityT, class TXT>
 void unalign_disparity(vector<ASPGlobalOptions> const& opt_vec,
@@ -590,6 +632,30 @@ namespace asp{
                                                          PointAndErrorNorm() );
   }
 
+  // ImageView operator which invalidates the points outside a polygon
+  // in longitude-latitude.
+  class LonLatRoiFunc : public ReturnFixedType<Vector6> {
+    cartography::Datum m_datum;
+    std::vector<Vector2> m_poly;
+    double m_mean_lon;
+  public:
+    LonLatRoiFunc(cartography::Datum const& datum, std::vector<Vector2> const& poly):
+      m_datum(datum), m_poly(poly), m_mean_lon(0) {
+      for (size_t it = 0; it < m_poly.size(); it++)
+        m_mean_lon += m_poly[it].x()/m_poly.size();
+    }
+    Vector6 operator() (Vector6 const& pt) const {
+      Vector3 xyz = subvector(pt, 0, 3);
+      if (xyz == Vector3())
+        return pt;
+      Vector3 llh = m_datum.cartesian_to_geodetic(xyz);
+      llh[0] += 360.0*round((m_mean_lon - llh[0])/360.0); // the polygon may use [0, 360]
+      if (!asp::point_in_polygon(subvector(llh, 0, 2), m_poly))
+        return Vector6();
+      return pt;
+    }
+  };
+
   template <class ImageT>
   void save_point_cloud(Vector3 const& shift, ImageT const& point_cloud,
                         string const& point_cloud_file,
@@ -602,6 +668,10 @@ namespace asp{
     bool has_nodata = false;
     double nodata = -std::numeric_limits<float>::max(); // smallest float
 
+    vw::cartography::GdalWriteOptions write_opt = opt;
+    if (stereo_settings().band_separated_point_cloud)
+      write_opt.gdal_options["INTERLEAVE"] = "BAND";
+
     // TODO: Replace this with with a function call!
     if ( (opt.session->name() == "isis") || (opt.session->name() == "isismapisis")){
       // ISIS does not support multi-threading
@@ -610,14 +680,15 @@ namespace asp{
           stereo_settings().point_cloud_rounding_error,
           point_cloud,
           has_georef, georef, has_nodata, nodata,
-          opt, TerminalProgressCallback("asp", "\t--> Triangulating: "));
+          write_opt, TerminalProgressCallback("asp", "\t--> Triangulating: "));
     }else{
       asp::block_write_approx_gdal_image
         ( point_cloud_file, shift,
           stereo_settings().point_cloud_rounding_error,
           point_cloud,
           has_georef, georef, has_nodata, nodata,
-          opt, TerminalProgressCallback("asp", "\t--> Triangulating: "));
+          write_opt, TerminalProgressCallback("asp", "\t--> Triangulating: "),
+          std::map<std::string, std::string>(), stereo_settings().resumable_output);
     }
 
   }
@@ -724,6 +795,170 @@ namespace asp{
 
   }
 
+  // Grid a small point cloud into a DEM and a triangulation error
+  // map, in the projection of the given georeference. Each grid cell
+  // gets the mean height and error of the points in it. The grid
+  // spacing is the median distance between the points of adjacent
+  // pixels, so the DEM has about the resolution of the cloud.
+  void write_preview_dem(string const& output_prefix,
+                         ImageView<Vector6> const& point_cloud,
+                         cartography::GeoReference const& input_georef,
+                         ASPGlobalOptions const& opt){
+
+    cartography::GeoReference georef = input_georef;
+    cartography::Datum datum = georef.datum();
+
+    // Project the points, keeping the grid of the cloud
+    ImageView<PixelMask<Vector3> > proj_pts(point_cloud.cols(), point_cloud.rows());
+    BBox2 proj_box;
+    for (int col = 0; col < point_cloud.cols(); col++){
+      for (int row = 0; row < point_cloud.rows(); row++){
+        proj_pts(col, row).invalidate();
+        Vector3 xyz = subvector(point_cloud(col, row), 0, 3);
+        if (xyz == Vector3())
+          continue;
+        Vector3 llh = datum.cartesian_to_geodetic(xyz);
+        Vector2 proj = georef.lonlat_to_point(subvector(llh, 0, 2));
+        proj_pts(col, row) = Vector3(proj[0], proj[1], llh[2]);
+        proj_box.grow(proj);
+      }
+    }
+
+    vector<double> dists;
+    for (int col = 0; col + 1 < proj_pts.cols(); col++){
+      for (int row = 0; row < proj_pts.rows(); row++){
+        if (!is_valid(proj_pts(col, row)) || !is_valid(proj_pts(col+1, row)))
+          continue;
+        dists.push_back(norm_2(subvector(proj_pts(col, row).child()   -
+                                         proj_pts(col+1, row).child(), 0, 2)));
+      }
+    }
+    if (dists.empty())
+      vw_throw(ArgumentErr() << "Too few valid points to create a preview DEM.\n");
+    std::nth_element(dists.begin(), dists.begin() + dists.size()/2, dists.end());
+    double spacing = dists[dists.size()/2];
+    if (spacing <= 0)
+      vw_throw(ArgumentErr() << "Could not determine the preview DEM grid size.\n");
+
+    // The upper-left grid point is at the upper-left corner of the points
+    Matrix3x3 transform = georef.transform();
+    transform.set_identity();
+    transform(0, 0) =  spacing;
+    transform(1, 1) = -spacing;
+    georef.set_transform(transform);
+    Vector2 ul = georef.point_to_pixel(Vector2(proj_box.min().x(), proj_box.max().y()));
+    georef = cartography::crop(georef, ul.x(), ul.y());
+
+    int cols = (int)round(proj_box.width()/spacing)  + 1;
+    int rows = (int)round(proj_box.height()/spacing) + 1;
+    ImageView<double> height_sum(cols, rows), err_sum(cols, rows);
+    ImageView<int>    count(cols, rows);
+    fill(height_sum, 0.0); fill(err_sum, 0.0); fill(count, 0);
+    for (int col = 0; col < proj_pts.cols(); col++){
+      for (int row = 0; row < proj_pts.rows(); row++){
+        if (!is_valid(proj_pts(col, row)))
+          continue;
+        Vector3 pt  = proj_pts(col, row).child();
+        Vector2 pix = georef.point_to_pixel(subvector(pt, 0, 2));
+        int c = (int)round(pix[0]), r = (int)round(pix[1]);
+        if (c < 0 || r < 0 || c >= cols || r >= rows)
+          continue;
+        height_sum(c, r) += pt[2];
+        err_sum(c, r)    += norm_2(subvector(point_cloud(col, row), 3, 3));
+        count(c, r)++;
+      }
+    }
+
+    float nodata = -std::numeric_limits<float>::max(); // as in point2dem
+    ImageView<float> dem(cols, rows), err(cols, rows);
+    for (int col = 0; col < cols; col++){
+      for (int row = 0; row < rows; row++){
+        if (count(col, row) == 0) {
+          dem(col, row) = nodata;
+          err(col, row) = nodata;
+          continue;
+        }
+        dem(col, row) = height_sum(col, row)/count(col, row);
+        err(col, row) = err_sum(col, row)/count(col, row);
+      }
+    }
+
+    vw_out() << "\t--> Preview DEM spacing: " << spacing << "\n";
+    string dem_file = output_prefix + "-DEM_preview.tif";
+    string err_file = output_prefix + "-IntersectionErr_preview.tif";
+    vw_out() << "Writing: " << dem_file << "\n";
+    cartography::block_write_gdal_image(dem_file, dem, true, georef, true, nodata, opt,
+                                        TerminalProgressCallback("asp", "\t--> DEM: "));
+    vw_out() << "Writing: " << err_file << "\n";
+    cartography::block_write_gdal_image(err_file, err, true, georef, true, nodata, opt,
+                                        TerminalProgressCallback("asp", "\t--> Error: "));
+  }
+
+}
+
+/// Triangulate the low-resolution disparity D_sub with the cameras and
+/// transforms of the full-resolution run, and grid the result into a
+/// coarse DEM and triangulation error map. D_sub is small, so the cloud
+/// is kept in memory.
+template <class SessionT>
+void preview_triangulation(string const& output_prefix,
+                           vector<ASPGlobalOptions> const& opt_vec,
+                           vector<const camera::CameraModel *> const& camera_ptrs,
+                           vector<typename SessionT::tx_type> const& transforms,
+                           stereo::UniverseRadiusFunc const& universe_radius_func){
+
+  typedef typename SessionT::tx_type           TXT;
+  typedef typename SessionT::stereo_model_type StereoModelT;
+
+  // D_sub is from L_sub to R_sub, so the transforms of L and R are
+  // applied after undoing the subsampling of each.
+  vector< ImageViewRef<PixelMask<Vector2f> > > sub_disps;
+  vector< SubsampledTX<TXT> > sub_transforms;
+  Vector2 left_scale;
+  for (int p = 0; p < (int)opt_vec.size(); p++){
+    string prefix     = opt_vec[p].out_prefix;
+    string d_sub_file = prefix + "-D_sub.tif";
+    if (!fs::exists(d_sub_file))
+      vw_throw(ArgumentErr() << "Cannot create a preview DEM, as " << d_sub_file
+               << " does not exist.\n");
+    sub_disps.push_back(DiskImageView<PixelMask<Vector2f> >(d_sub_file));
+
+    if (p == 0){
+      left_scale = elem_quot(Vector2(file_image_size(prefix + "-L_sub.tif")),
+                             Vector2(file_image_size(prefix + "-L.tif")));
+      sub_transforms.push_back(SubsampledTX<TXT>(transforms[0], left_scale));
+    }
+    Vector2 right_scale = elem_quot(Vector2(file_image_size(prefix + "-R_sub.tif")),
+                                    Vector2(file_image_size(prefix + "-R.tif")));
+    sub_transforms.push_back(SubsampledTX<TXT>(transforms[p+1], right_scale));
+  }
+
+  double angle_tol = vw::stereo::StereoModel::robust_1_minus_cos(stereo_settings().min_triangulation_angle*M_PI/180);
+  StereoModelT stereo_model(camera_ptrs, stereo_settings().use_least_squares, angle_tol);
+
+  ImageViewRef<Vector6> point_cloud = per_pixel_filter
+    (stereo_error_triangulate(sub_disps, sub_transforms, stereo_model,
+                              SessionT::isMapProjected()),
+     universe_radius_func);
+  if (!stereo_settings().lon_lat_roi.empty())
+    point_cloud = per_pixel_filter(point_cloud,
+                                   LonLatRoiFunc(opt_vec[0].session->get_datum(camera_ptrs[0], false),
+                                                 stereo_settings().lon_lat_roi));
+
+  // Triangulate only in the subsampled region to process
+  BBox2i cbox = stereo_settings().trans_crop_win;
+  BBox2i sub_box(floor(elem_prod(Vector2(cbox.min()), left_scale)),
+                 ceil (elem_prod(Vector2(cbox.max()), left_scale)));
+  sub_box.crop(bounding_box(point_cloud));
+
+  int num_threads = opt_vec[0].num_threads;
+  if (opt_vec[0].session->name() == "isis" || opt_vec[0].session->name() == "isismapisis")
+    num_threads = 1;
+  vw_out() << "\t--> Triangulating the low-resolution disparity.\n";
+  ImageView<Vector6> sub_cloud = block_rasterize(crop(point_cloud, sub_box),
+                                                 opt_vec[0].raster_tile_size, num_threads);
+
+  write_preview_dem(output_prefix, sub_cloud, opt_vec[0].session->get_georef(), opt_vec[0]);
 }
 
 /// Main triangulation function
@@ -790,9 +1025,21 @@ void stereo_triangulation( string          const& output_prefix,
                              << "Will not be able to filter triangulated points by radius.\n";
     } // End try/catch
 
+    // The preview needs only D_sub, which exists long before F.tif
+    if (stereo_settings().preview_dem){
+      std::vector<const vw::camera::CameraModel *> camera_ptrs;
+      for (int c = 0; c < (int)cameras.size(); c++)
+        camera_ptrs.push_back(cameras[c].get());
+      preview_triangulation<SessionT>(output_prefix, opt_vec, camera_ptrs, transforms,
+                                      universe_radius_func);
+      vw_out() << "Created the preview DEM. Will stop here." << endl;
+      return;
+    }
+
     vector<PVImageT> disparity_maps;
     for (int p = 0; p < (int)opt_vec.size(); p++){
       disparity_maps.push_back(opt_vec[p].session->pre_pointcloud_hook(opt_vec[p].out_prefix+"-F.tif"));
+      asp::add_journal_input(opt_vec[p].out_prefix+"-F.tif"); // the cloud depends on it
     }
 
     std::string unalign_disp = asp::unwarped_disp_file(output_prefix,
@@ -891,6 +1138,21 @@ void stereo_triangulation( string          const& output_prefix,
     StereoModelT stereo_model( camera_ptrs, stereo_settings().use_least_squares,
                                angle_tol);
 
+    // Read the disparities for the next tiles of the point cloud while
+    // the current ones are triangulated. Each point needs only the
+    // disparity at its pixel.
+    BBox2i cbox = stereo_settings().trans_crop_win;
+    boost::shared_ptr<asp::TilePrefetcher> prefetcher;
+    if (stereo_settings().prefetch_mb > 0) {
+      prefetcher.reset(new asp::TilePrefetcher(asp::write_schedule(cbox,
+                                                                   opt_vec[0].raster_tile_size),
+                                               boost::uint64_t(stereo_settings().prefetch_mb)
+                                               *1024*1024));
+      for (size_t p = 0; p < disparity_maps.size(); p++)
+        disparity_maps[p] = asp::prefetch_input(disparity_maps[p], Vector2i(0, 0),
+                                                BBox2i(0, 0, 0, 0), *prefetcher);
+    }
+
     // Apply radius function and stereo model in one go
     vw_out() << "\t--> Generating a 3D point cloud." << endl;
     ImageViewRef<Vector6> point_cloud = per_pixel_filter
@@ -898,6 +1160,12 @@ void stereo_triangulation( string          const& output_prefix,
        (disparity_maps, transforms, stereo_model, is_map_projected),
        universe_radius_func);
 
+    // Keep only the points in the region to process, if one was given
+    if (!stereo_settings().lon_lat_roi.empty())
+      point_cloud = per_pixel_filter(point_cloud,
+                                     LonLatRoiFunc(opt_vec[0].session->get_datum(camera_ptrs[0], false),
+                                                   stereo_settings().lon_lat_roi));
+
     // If we crop the left and right images, at each run we must
     // recompute the cloud center, as the cropping windows may have changed.
     bool crop_left  = (stereo_settings().left_image_crop_win  != BBox2i(0, 0, 0, 0));
@@ -919,9 +1187,13 @@ void stereo_triangulation( string          const& output_prefix,
       return;
     }
 
+    // Only the tiles written to the point cloud are read ahead, not
+    // those used above to find its center.
+    if (prefetcher)
+      point_cloud = asp::prefetch_tiles(point_cloud, *prefetcher);
+
     // We are supposed to do the triangulation in trans_crop_win only
     // so force rasterization in that box only using crop().
-    BBox2i cbox = stereo_settings().trans_crop_win;
     string point_cloud_file = output_prefix + "-PC.tif";
     if (stereo_settings().compute_error_vector){
 
@@ -971,15 +1243,17 @@ int main( int argc, char* argv[] ) {
                        output_prefix);
     }
 
-    // Keep only those stereo pairs for which filtered disparity exists
+    // Keep only those stereo pairs for which filtered disparity
+    // exists, or the low-resolution one if that is all we need.
+    string disp_suffix = stereo_settings().preview_dem ? "-D_sub.tif" : "-F.tif";
     vector<ASPGlobalOptions> opt_vec_new;
     for (int p = 0; p < (int)opt_vec.size(); p++){
-      if (fs::exists(opt_vec[p].out_prefix+"-F.tif"))
+      if (fs::exists(opt_vec[p].out_prefix + disp_suffix))
         opt_vec_new.push_back(opt_vec[p]);
     }
     opt_vec = opt_vec_new;
     if (opt_vec.empty())
-      vw_throw( ArgumentErr() << "No valid F.tif files found.\n" );
+      vw_throw( ArgumentErr() << "No valid " << disp_suffix.substr(1) << " files found.\n" );
 
     // Triangulation uses small tiles.
     //---------------------------------------------------------
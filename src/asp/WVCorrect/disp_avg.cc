@@ -21,15 +21,129 @@
 #pragma warning(disable:4996)
 #endif
 
+#include <vw/Core/Settings.h>
+#include <vw/Core/Stopwatch.h>
+#include <vw/Core/ThreadPool.h>
+#include <vw/FileIO/DiskImageResource.h>
 #include <vw/FileIO/DiskImageView.h>
+#include <vw/Image/ImageView.h>
+#include <vw/Math/BBox.h>
 #include <vw/Stereo/DisparityMap.h>
 
+#include <boost/shared_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
 using namespace vw;
 using namespace std;
 
+// The sums of the valid disparities in each column, their squares,
+// and their number.
+struct ColumnSums {
+  vector<double> sx, sy, sxx, syy;
+  vector<int>    count;
+  void resize(int cols) {
+    sx.assign(cols, 0.0);  sy.assign(cols, 0.0);
+    sxx.assign(cols, 0.0); syy.assign(cols, 0.0);
+    count.assign(cols, 0);
+  }
+};
+
+// Where the disparities in each column of the image are kept, if
+// outliers are removed. A disparity is kept if it is within the radius
+// of the center in both x and y.
+struct ColumnBounds {
+  vector<double> cx, cy, rx, ry;
+};
+
+// Accumulate the per-column sums over a tile of the disparity. The
+// tile is read at once, so each disk block is decoded once.
+class ColumnSumsTask: public vw::Task, private boost::noncopyable {
+  DiskImageView< PixelMask<Vector2f> > const& m_disp;
+  BBox2i               m_bbox;
+  ColumnBounds const * m_bounds;
+  ColumnSums         & m_sums;
+public:
+  ColumnSumsTask(DiskImageView< PixelMask<Vector2f> > const& disp,
+                 BBox2i const& bbox, ColumnBounds const* bounds, ColumnSums & sums):
+    m_disp(disp), m_bbox(bbox), m_bounds(bounds), m_sums(sums){}
+
+  virtual void operator()() {
+    ImageView< PixelMask<Vector2f> > tile = crop(m_disp, m_bbox);
+    m_sums.resize(tile.cols());
+    for (int row = 0; row < tile.rows(); row++) {
+      for (int col = 0; col < tile.cols(); col++) {
+        PixelMask<Vector2f> const& p = tile(col, row);
+        if (!is_valid(p)) continue;
+        double x = p.child()[0], y = p.child()[1];
+        if (m_bounds != NULL) {
+          int c = m_bbox.min().x() + col;
+          if (fabs(x - m_bounds->cx[c]) > m_bounds->rx[c] ||
+              fabs(y - m_bounds->cy[c]) > m_bounds->ry[c])
+            continue;
+        }
+        m_sums.sx[col]  += x;
+        m_sums.sy[col]  += y;
+        m_sums.sxx[col] += x*x;
+        m_sums.syy[col] += y*y;
+        m_sums.count[col]++;
+      }
+    }
+  }
+};
+
+// Find the per-column sums over the given rows of tiles. A band of
+// rows of tiles is processed in parallel, then merged into the totals
+// in a fixed order, so that the memory used is bounded by the image
+// width and the result is reproducible.
+void column_sums(DiskImageView< PixelMask<Vector2f> > const& disp,
+                 vector< vector<BBox2i> > const& tile_rows,
+                 ColumnBounds const* bounds, ColumnSums & totals) {
+
+  int num_threads = vw_settings().default_num_threads();
+  totals.resize(disp.cols());
+  size_t band_start = 0;
+  while (band_start < tile_rows.size()) {
+
+    // Enough tiles to keep the threads busy
+    size_t band_end = band_start, num_tiles = 0;
+    while (band_end < tile_rows.size() && num_tiles < size_t(2*num_threads)) {
+      num_tiles += tile_rows[band_end].size();
+      band_end++;
+    }
+
+    vector<BBox2i> tiles;
+    for (size_t r = band_start; r < band_end; r++)
+      tiles.insert(tiles.end(), tile_rows[r].begin(), tile_rows[r].end());
+    vector<ColumnSums> sums(tiles.size());
+    FifoWorkQueue queue(num_threads);
+    for (size_t t = 0; t < tiles.size(); t++) {
+      boost::shared_ptr<ColumnSumsTask> task(new ColumnSumsTask(disp, tiles[t], bounds, sums[t]));
+      queue.add_task(task);
+    }
+    queue.join_all();
+
+    for (size_t t = 0; t < tiles.size(); t++) {
+      for (int c = 0; c < tiles[t].width(); c++) {
+        int col = tiles[t].min().x() + c;
+        totals.sx[col]    += sums[t].sx[c];
+        totals.sy[col]    += sums[t].sy[c];
+        totals.sxx[col]   += sums[t].sxx[c];
+        totals.syy[col]   += sums[t].syy[c];
+        totals.count[col] += sums[t].count[c];
+      }
+    }
+    band_start = band_end;
+  }
+}
+
 // Average the rows in a given disparity image. Save them to disk as
 // two text files (x and y values), with as many entries as there
-// were columns in the disparity.
+// were columns in the disparity. If an outlier factor is given,
+// average again in each column only the disparities within that many
+// standard deviations of the first average.
 
 int main( int argc, char *argv[] ){
 
@@ -37,7 +151,7 @@ int main( int argc, char *argv[] ){
 
   // TODO: No need for outdx.txt and outdy.txt, just save with with same prefix.
   if (argc <= 3) {
-    vw_out() << "Usage: disp_avg disp.tif outdx.txt outdy.txt [row_start] [num_rows] [col_start] [num_cols]\n";
+    vw_out() << "Usage: disp_avg disp.tif outdx.txt outdy.txt [row_start] [num_rows] [col_start] [num_cols] [outlier_factor]\n";
     return 1;
   }
 
@@ -59,35 +173,78 @@ int main( int argc, char *argv[] ){
   if (argc > 5) row_stop  = row_start + atoi(argv[5]);
   if (argc > 6) col_start = atoi(argv[6]);
   if (argc > 7) col_stop  = col_start + atoi(argv[7]);
+  double outlier_factor = 0; // no outlier removal
+  if (argc > 8) outlier_factor = atof(argv[8]);
 
-  // TODO: Add a progress bar.
-  vector<double> Dx(cols, 0), Dy(cols, 0); // Always full sized, even if crop is used.
-  for (int col = col_start; col < col_stop; col++){
-    if (col%100 == 0){
-      std::cout << "column " << col << std::endl;
-    }
-    vector<double> px, py;
-    for (int row = row_start; row < row_stop; row++){
-      PixelMask<Vector2f> p = D(col, row);
-      if (! is_valid(p)) continue;
-      px.push_back(p.child()[0]);
-      py.push_back(p.child()[1]);
+  // Visit the disparity in tiles aligned with its disk blocks, as
+  // reading it column by column would decode each block many times.
+  // The tiles are processed in parallel, a band of them at a time.
+  Vector2i block_size;
+  {
+    boost::shared_ptr<DiskImageResource> rsrc(DiskImageResource::open(in_file));
+    block_size = rsrc->block_read_size();
+  }
+  // Use whole blocks, about 1024 x 1024 pixels in total. Strips as
+  // wide as the image get fewer rows.
+  int min_tile_size = 1024;
+  block_size[0] = std::max(block_size[0], 1);
+  block_size[1] = std::max(block_size[1], 1);
+  Vector2i tile_size;
+  tile_size[0] = block_size[0]*std::max(1, min_tile_size/block_size[0]);
+  tile_size[1] = block_size[1]*std::max(1, min_tile_size*min_tile_size
+                                        /(tile_size[0]*block_size[1]));
+
+  BBox2i roi(col_start, row_start, col_stop - col_start, row_stop - row_start);
+  roi.crop(bounding_box(D));
+  std::vector< std::vector<BBox2i> > tile_rows;
+  size_t num_tiles = 0;
+  if (!roi.empty()) {
+    for (int row = roi.min().y() - roi.min().y() % tile_size[1]; row < roi.max().y();
+         row += tile_size[1]) {
+      std::vector<BBox2i> tile_row;
+      for (int col = roi.min().x() - roi.min().x() % tile_size[0]; col < roi.max().x();
+           col += tile_size[0]) {
+        BBox2i tile(col, row, tile_size[0], tile_size[1]);
+        tile.crop(roi);
+        if (!tile.empty())
+          tile_row.push_back(tile);
+      }
+      num_tiles += tile_row.size();
+      tile_rows.push_back(tile_row);
     }
-    std::sort(px.begin(), px.end());
-    std::sort(py.begin(), py.end());
-    int len = px.size();
-    int num_valid = 0;
-    Dx[col] = 0;
-    Dy[col] = 0;
-    for (int k = 0; k < len; k++){
-      num_valid++;
-      Dx[col] += px[k];
-      Dy[col] += py[k];
+  }
+
+  Stopwatch sw;
+  sw.start();
+  ColumnSums totals;
+  column_sums(D, tile_rows, NULL, totals);
+
+  // Keep in each column only the disparities near the average and
+  // pass over the disparity again.
+  if (outlier_factor > 0) {
+    ColumnBounds bounds;
+    bounds.cx.resize(cols); bounds.cy.resize(cols);
+    bounds.rx.resize(cols); bounds.ry.resize(cols);
+    for (int col = 0; col < cols; col++) {
+      int n = std::max(totals.count[col], 1);
+      bounds.cx[col] = totals.sx[col]/n;
+      bounds.cy[col] = totals.sy[col]/n;
+      double vx = std::max(totals.sxx[col]/n - bounds.cx[col]*bounds.cx[col], 0.0);
+      double vy = std::max(totals.syy[col]/n - bounds.cy[col]*bounds.cy[col], 0.0);
+      bounds.rx[col] = outlier_factor*sqrt(vx);
+      bounds.ry[col] = outlier_factor*sqrt(vy);
     }
+    column_sums(D, tile_rows, &bounds, totals);
+  }
+  sw.stop();
+  std::cout << "Processed " << num_tiles << " tiles in " << sw.elapsed_seconds()
+            << " seconds." << std::endl;
 
-    if (num_valid > 0){
-      Dx[col] /= num_valid;
-      Dy[col] /= num_valid;
+  vector<double> Dx(cols, 0), Dy(cols, 0); // Always full sized, even if crop is used.
+  for (int col = 0; col < cols; col++) {
+    if (totals.count[col] > 0){
+      Dx[col] = totals.sx[col]/totals.count[col];
+      Dy[col] = totals.sy[col]/totals.count[col];
     }
   }
 